@@ -13,117 +13,262 @@
 
 #include "stereo3d.h"
 
+// closer than this an animated value snaps to its destination
+#define ANIMATION_EPSILON 0.0001f
+
+static bool
+easeTowards (float *curr, float dst, float divisor)
+{
+    if (fabsf (dst - *curr) < ANIMATION_EPSILON)
+    {
+        *curr = dst;
+        return false;
+    }
+
+    *curr += (dst - *curr) / divisor;
+    return true;
+}
+
 void updateWindowsPosition(AnimationManager *animationMgr, CompScreen* s, float depth, float lightingStrength)
 {
-    int floatingWindowsCount = 0;
+    Stereo3DWindow *focusWindow = NULL;
+    CompWindow     *active;
+    unsigned int   events;
+    int            touched;
 
-    animationMgr->backgroundDepth = depth;
+    STEREO3D_SCREEN (s);
 
-    updateMousePosition(animationMgr);
-    Stereo3DWindow *lastDrawnWindow = NULL;
-    Stereo3DWindow *bkgWindow = NULL;
+    active = s->display->activeWindow ? findWindowAtScreen (s, s->display->activeWindow) : NULL;
+    if (active)
+        focusWindow = GET_STEREO3D_WINDOW (active, sos);
+
+    if (focusWindow != animationMgr->focusWindow)
+    {
+        animationMgr->focusWindow = focusWindow;
+        animationMgr->layoutEvents |= LAYOUT_EVENT (LayoutEventFocus);
+    }
 
+    animationMgr->strategy = stereo3dGetLayoutStrategy (s->display);
+
+    events = animationMgr->layoutEvents;
+    touched = layoutWindows (animationMgr,
+                             sos->backgroundWindows, sos->nBackgroundWindows,
+                             sos->dockWindows, sos->nDockWindows,
+                             sos->floatingWindows, sos->nFloatingWindows,
+                             sos->pointerWindow, depth, lightingStrength);
+
+    HOOK_COUNT_N (&sos->hookCounters, HookLayoutWindow, animationMgr->animatedWindows);
+
+    if (events && animationMgr->cursorWindow == NULL)
+        compLogMessage ("stereo3d", CompLogLevelWarn, "no window found to hook up mouse drawing");
+
+    if (events && stereo3dGetLayoutStats (s->display))
+        countLayoutPass (&sos->layoutStats, events, touched,
+                         getLayoutStrategyName (animationMgr->strategy));
+}
 
-    for (CompWindow *w = s->windows; w; w = w->next)
+/* Moves every window and the cursor to its destination at once */
+void finishAnimations(AnimationManager *animationMgr, CompScreen *s)
+{
+    CompWindow *w;
+
+    for (w = s->windows; w; w = w->next)
     {
         STEREO3D_WINDOW (w);
-        sow->floatingType = getFloatingType(w);
-
-        if(sow->floatingType == FTWINDOW)
-            floatingWindowsCount ++;
+        sow->currAttrs = sow->dstAttrs;
     }
-    if(floatingWindowsCount == 0 ) floatingWindowsCount++;
 
-    //compLogMessage ("stereo3d", CompLogLevelWarn, "WndCount: %d", windowsCount);
+    animationMgr->mouseCurr = animationMgr->mouseDst;
+    animationMgr->foregroundCurrZ = animationMgr->foregroundDstZ;
+    animationMgr->cursorCurrZ = animationMgr->cursorDstZ;
+    animationMgr->layoutSettled = false;
+}
+
+/* Gives a window its destination depth, lighting being how far the
+ * depth lighting applies to it. Returns whether the depth changed,
+ * refresh updates the lighting of windows staying in place. */
+static bool
+placeWindow (Stereo3DWindow *sow, float wndDepth, float lighting,
+             float lightingStrength, bool refresh)
+{
+    bool moved = !sow->layoutAssigned || sow->layoutDepth != wndDepth;
+
+    if (!moved && !refresh)
+        return false;
+
+    sow -> opacity = 1.0f;
+    sow -> brightness = 1.0f - lighting * 0.8 * lightingStrength;
+    sow -> saturation = 1.0f - lighting * 0.5 * lightingStrength;
+
+    if(sow -> brightness>1.0f) sow -> brightness = 1.0f;
+    if(sow -> saturation>1.0f) sow -> saturation = 1.0f;
 
-    float step = (depth + animationMgr->foregroundCurrZ) / (float)floatingWindowsCount;
+    sow ->dstAttrs.translation.z = -wndDepth;
+    sow ->dstAttrs.rotation.y = 0.0f;
 
-    int i = 0;
-    for (CompWindow *w = s->windows; w; w = w->next)
+    sow->layoutAssigned = true;
+    sow->layoutDepth = wndDepth;
+    sow->layoutMoving = true;
+
+    return moved;
+}
+
+/* Eases the windows not at their destination yet, counting them into
+ * animated, returns whether any is still moving */
+static bool
+animateWindows (Stereo3DWindow **windows, int nWindows, int *animated)
+{
+    bool animating = false;
+
+    for (int i = 0; i < nWindows; i++)
     {
-        STEREO3D_WINDOW (w);
-        
-        sow -> drawMouse = false;
-        sow -> opacity = 1.0f;
-        sow -> brightness = 1.0f;
-        sow -> saturation = 1.0f;
+        Stereo3DWindow *sow = windows[i];
 
-        switch(sow -> floatingType)
-        {
-        case FTBACKGROUND:
-            sow ->dstAttrs.translation.z = -depth ;
-            sow ->dstAttrs.rotation.y = 0.0f;
+        if (!sow->layoutMoving)
+            continue;
 
-            
-            sow -> brightness = 1.0f - 0.8 * lightingStrength;
-            sow -> saturation = 1.0f - 0.5 * lightingStrength;
-            
+        /** update animation current positions **/
+        sow->layoutMoving = updateWindow(sow);
+        animating |= sow->layoutMoving;
+        (*animated)++;
+    }
 
-            bkgWindow = sow;
-            break;
+    return animating;
+}
+
+/* Places the classified windows, bottom-most first in each array. Kept
+ * free of CompScreen so recorded frames can be replayed through it. The
+ * cursor is drawn with pointerWindow, the topmost window when NULL.
+ * Windows are only placed again on layoutEvents or when the depth,
+ * lighting, foreground or strategy changed, and only the windows whose
+ * depth changed are moved; returns how many those were. Touches no
+ * more than its arguments, the layout worker runs it on its own copies
+ * of the windows. */
+int layoutWindows(AnimationManager *animationMgr,
+                  Stereo3DWindow **background, int nBackground,
+                  Stereo3DWindow **dock, int nDock,
+                  Stereo3DWindow **floating, int nFloating,
+                  Stereo3DWindow *pointerWindow,
+                  float depth, float lightingStrength)
+{
+    animationMgr->backgroundDepth = depth;
+    animationMgr->animatedWindows = 0;
+
+    updateMousePosition(animationMgr);
+
+    bool relight = animationMgr->layoutDepth != depth ||
+                   animationMgr->layoutLightingStrength != lightingStrength;
+    bool replace = relight || animationMgr->layoutEvents ||
+                   animationMgr->layoutForegroundZ != animationMgr->foregroundCurrZ ||
+                   animationMgr->layoutStrategy != animationMgr->strategy;
+
+    if (animationMgr->layoutSettled && !replace &&
+        animationMgr->layoutPointerWindow == pointerWindow)
+        return 0;
 
-        case FTDOCK:
-            sow ->dstAttrs.translation.z = 0.0f;
-            sow ->dstAttrs.rotation.y = 0.0f;
-//            lastDrawnWindow = sow;
-            break;
+    animationMgr->layoutPasses++;
 
-        case FTWINDOW:
+    int touched = 0;
+    Stereo3DWindow *lastDrawnWindow = NULL;
+    Stereo3DWindow *bkgWindow = NULL;
+
+    //compLogMessage ("stereo3d", CompLogLevelWarn, "WndCount: %d", windowsCount);
+
+    if (replace)
+    {
+        for (int i = 0; i < nBackground; i++)
+            touched += placeWindow (background[i], depth, 1.0f, lightingStrength, relight);
+
+        for (int i = 0; i < nDock; i++)
+            touched += placeWindow (dock[i], 0.0f, 0.0f, lightingStrength, relight);
+
+        assignFloatingDepths (animationMgr, floating, nFloating, depth);
+
+        for (int i = 0; i < nFloating; i++)
         {
-            float wndDepth = depth - (float)(i+1) * step;
-            if (wndDepth > depth ) wndDepth = depth;
-            lastDrawnWindow = sow;
-            
-            
-            sow -> brightness = 1.0f - (wndDepth/depth)* 0.8 * lightingStrength;
-            sow -> saturation = 1.0f - (wndDepth/depth)* 0.5 * lightingStrength;
-
-            if(sow -> brightness>1.0f) sow -> brightness = 1.0f;
-            if(sow -> saturation>1.0f) sow -> saturation = 1.0f;
-            
-
-            sow ->dstAttrs.translation.z = -wndDepth;
-            sow ->dstAttrs.rotation.y = 0.0f;
-
-            i ++;
-        }
-        break;
-        default:
-            break;
-        }
+            float wndDepth = floating[i]->layoutTarget;
 
-        /** update animation current positions **/
-        updateWindow(sow);
+            touched += placeWindow (floating[i], wndDepth,
+                                    depth > 0.0f ? wndDepth / depth : 0.0f,
+                                    lightingStrength, relight);
+        }
     }
-    
 
-    if(lastDrawnWindow != NULL)
-        lastDrawnWindow->drawMouse = true;
+    bool animating = animateWindows (background, nBackground, &animationMgr->animatedWindows);
+    animating |= animateWindows (dock, nDock, &animationMgr->animatedWindows);
+    animating |= animateWindows (floating, nFloating, &animationMgr->animatedWindows);
+
+    if (nBackground > 0)
+        bkgWindow = background[nBackground - 1];
+    if (nFloating > 0)
+        lastDrawnWindow = floating[nFloating - 1];
+
+    if (animationMgr->cursorWindow != NULL)
+        animationMgr->cursorWindow->drawMouse = false;
+
+    animationMgr->cursorDstZ = animationMgr->foregroundCurrZ;
+
+    // drawn right after the window under it, at that window's depth
+    if(pointerWindow != NULL && pointerWindow->floatingType != FTNONE)
+    {
+        animationMgr->cursorWindow = pointerWindow;
+        animationMgr->cursorDstZ = pointerWindow->dstAttrs.translation.z;
+    }
+    else if(lastDrawnWindow != NULL)
+        animationMgr->cursorWindow = lastDrawnWindow;
     else if(bkgWindow != NULL)
-        bkgWindow->drawMouse = true;
+        animationMgr->cursorWindow = bkgWindow;
     else
-        compLogMessage ("stereo3d", CompLogLevelWarn, "no window found to hook up mouse drawing");        
+        animationMgr->cursorWindow = NULL;
+
+    if (animationMgr->cursorWindow != NULL)
+        animationMgr->cursorWindow->drawMouse = true;
+
+    animationMgr->layoutSettled = !animating;
+    animationMgr->layoutDepth = depth;
+    animationMgr->layoutLightingStrength = lightingStrength;
+    animationMgr->layoutForegroundZ = animationMgr->foregroundCurrZ;
+    animationMgr->layoutPointerWindow = pointerWindow;
+    animationMgr->layoutStrategy = animationMgr->strategy;
+    animationMgr->layoutEvents = 0;
 
+    return touched;
 }
 
-void updateWindow(Stereo3DWindow * sow)
+/* returns whether the window has not reached its destination yet */
+bool updateWindow(Stereo3DWindow * sow)
 {
-    sow ->currAttrs.rotation.x += ( sow->dstAttrs.rotation.x - sow->currAttrs.rotation.x ) / 2.0f;
-    sow ->currAttrs.rotation.y += ( sow->dstAttrs.rotation.y - sow->currAttrs.rotation.y ) / 2.0f;
-    sow ->currAttrs.rotation.z += ( sow->dstAttrs.rotation.z - sow->currAttrs.rotation.z ) / 2.0f;
+    bool moving = false;
 
-    sow ->currAttrs.translation.x += ( sow->dstAttrs.translation.x - sow->currAttrs.translation.x ) / 2.0f;
-    sow ->currAttrs.translation.y += ( sow->dstAttrs.translation.y - sow->currAttrs.translation.y ) / 2.0f;
-    sow ->currAttrs.translation.z += ( sow->dstAttrs.translation.z - sow->currAttrs.translation.z ) / 2.0f;
+    moving |= easeTowards (&sow->currAttrs.rotation.x, sow->dstAttrs.rotation.x, 2.0f);
+    moving |= easeTowards (&sow->currAttrs.rotation.y, sow->dstAttrs.rotation.y, 2.0f);
+    moving |= easeTowards (&sow->currAttrs.rotation.z, sow->dstAttrs.rotation.z, 2.0f);
 
-    sow ->currAttrs.scale += ( sow->dstAttrs.scale - sow->currAttrs.scale ) / 2.0f;
+    moving |= easeTowards (&sow->currAttrs.translation.x, sow->dstAttrs.translation.x, 2.0f);
+    moving |= easeTowards (&sow->currAttrs.translation.y, sow->dstAttrs.translation.y, 2.0f);
+    moving |= easeTowards (&sow->currAttrs.translation.z, sow->dstAttrs.translation.z, 2.0f);
+
+    moving |= easeTowards (&sow->currAttrs.scale, sow->dstAttrs.scale, 2.0f);
+
+    return moving;
+}
+
+/* The cursor eases on whole pixels, halving the last one towards a
+ * position right of or below it would not move it at all */
+static int
+easeMouse (int curr, int dst)
+{
+    int next = curr + (dst - curr) / 2.0f;
+
+    return next == curr ? dst : next;
 }
 
 void updateMousePosition(AnimationManager *animationMgr)
 {
-    animationMgr->mouseCurr.x += (animationMgr->mouseDst.x - animationMgr->mouseCurr.x)/2.0f;
-    animationMgr->mouseCurr.y += (animationMgr->mouseDst.y - animationMgr->mouseCurr.y)/2.0f;
-    animationMgr->foregroundCurrZ = animationMgr->foregroundCurrZ + (animationMgr->foregroundDstZ - animationMgr->foregroundCurrZ)/1.5f;
+    animationMgr->mouseCurr.x = easeMouse (animationMgr->mouseCurr.x, animationMgr->mouseDst.x);
+    animationMgr->mouseCurr.y = easeMouse (animationMgr->mouseCurr.y, animationMgr->mouseDst.y);
+    easeTowards (&animationMgr->foregroundCurrZ, animationMgr->foregroundDstZ, 1.5f);
+    easeTowards (&animationMgr->cursorCurrZ, animationMgr->cursorDstZ, 2.0f);
 }
 
 Bool
@@ -161,6 +306,11 @@ float getCurrentForegroundZ(AnimationManager *animationMgr)
     return animationMgr->foregroundCurrZ;
 }
 
+float getCurrentCursorZ(AnimationManager *animationMgr)
+{
+    return animationMgr->cursorCurrZ;
+}
+
 float getCurrentMouseX(AnimationManager *animationMgr)
 {
     return animationMgr->mouseCurr.x;
@@ -0,0 +1,507 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* CPU versions of the output modes, combining a left and a right RGBA
+ * eye image. They are the reference the GL filters are checked against
+ * (see snapshot.cpp), so the anaglyph uses the matrix of the fragment
+ * program and the eyes go to the same colour channels as the colour
+ * masks of AnaglyphFilter. Rows are split into bands composited by
+ * one thread each; the SIMD kernels give the same bytes as the scalar
+ * ones. On x86 the AVX2 kernels are built whatever the compiler flags
+ * and taken where the CPU has AVX2, SSE2 otherwise; ARM builds with
+ * NEON use that. */
+
+#include "stereo3d.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+// STEREO3D_NO_SIMD builds the scalar kernels only and STEREO3D_NO_AVX2
+// leaves out AVX2, as the tests do to compare them with each other
+#if defined (__SSE2__) && !defined (STEREO3D_NO_SIMD)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (USE_SSE2) && defined (__GNUC__) && !defined (STEREO3D_NO_AVX2)
+#define USE_AVX2
+#include <immintrin.h>
+#define AVX2_KERNEL __attribute__ ((target ("avx2")))
+#endif
+
+#if (defined (__ARM_NEON) || defined (__ARM_NEON__)) && !defined (STEREO3D_NO_SIMD)
+#define USE_NEON
+#include <arm_neon.h>
+#endif
+
+#define MAX_COMPOSITE_THREADS 8
+// fewer rows than this are not worth a thread
+#define MIN_BAND_ROWS         64
+
+/* anaglifProgramData in fixed point, 1.0 = 256. Red comes from the right
+ * eye, green and blue from the left one. */
+#define RED_R   26
+#define RED_G   161
+#define RED_B   69
+#define GREEN_R 26
+#define GREEN_G 230
+#define BLUE_R  26
+#define BLUE_B  230
+
+static inline unsigned int
+weigh (unsigned int r, unsigned int g, unsigned int b,
+       unsigned int wr, unsigned int wg, unsigned int wb)
+{
+    return (r * wr + g * wg + b * wb + 128) >> 8;
+}
+
+#ifdef USE_AVX2
+/* Eight pixels at a time, returning how many were done; the SSE2 and
+ * scalar loops do the rest */
+static AVX2_KERNEL int
+anaglyphRowAvx2 (const unsigned char *left,
+		 const unsigned char *right,
+		 unsigned char       *out,
+		 int                 width)
+{
+    const __m256i byteMask = _mm256_set1_epi32 (0xff);
+    const __m256i alpha = _mm256_set1_epi32 (0xff000000);
+    const __m256i round = _mm256_set1_epi32 (128);
+    int           x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+	__m256i l = _mm256_loadu_si256 ((const __m256i *) (left + x * 4));
+	__m256i r = _mm256_loadu_si256 ((const __m256i *) (right + x * 4));
+	__m256i lr, lg, lb, rr, rg, rb, red, green, blue;
+
+	lr = _mm256_and_si256 (l, byteMask);
+	lg = _mm256_and_si256 (_mm256_srli_epi32 (l, 8), byteMask);
+	lb = _mm256_and_si256 (_mm256_srli_epi32 (l, 16), byteMask);
+	rr = _mm256_and_si256 (r, byteMask);
+	rg = _mm256_and_si256 (_mm256_srli_epi32 (r, 8), byteMask);
+	rb = _mm256_and_si256 (_mm256_srli_epi32 (r, 16), byteMask);
+
+	red = _mm256_add_epi32 (
+	    _mm256_add_epi32 (_mm256_mullo_epi16 (rr, _mm256_set1_epi32 (RED_R)),
+			      _mm256_mullo_epi16 (rg, _mm256_set1_epi32 (RED_G))),
+	    _mm256_add_epi32 (_mm256_mullo_epi16 (rb, _mm256_set1_epi32 (RED_B)), round));
+	green = _mm256_add_epi32 (
+	    _mm256_add_epi32 (_mm256_mullo_epi16 (lr, _mm256_set1_epi32 (GREEN_R)),
+			      _mm256_mullo_epi16 (lg, _mm256_set1_epi32 (GREEN_G))),
+	    round);
+	blue = _mm256_add_epi32 (
+	    _mm256_add_epi32 (_mm256_mullo_epi16 (lr, _mm256_set1_epi32 (BLUE_R)),
+			      _mm256_mullo_epi16 (lb, _mm256_set1_epi32 (BLUE_B))),
+	    round);
+
+	red = _mm256_srli_epi32 (red, 8);
+	green = _mm256_slli_epi32 (_mm256_srli_epi32 (green, 8), 8);
+	blue = _mm256_slli_epi32 (_mm256_srli_epi32 (blue, 8), 16);
+
+	_mm256_storeu_si256 ((__m256i *) (out + x * 4),
+			     _mm256_or_si256 (_mm256_or_si256 (red, green),
+					      _mm256_or_si256 (blue, alpha)));
+    }
+
+    return x;
+}
+
+static AVX2_KERNEL int
+columnInterlacedRowAvx2 (const unsigned char *left,
+			 const unsigned char *right,
+			 unsigned char       *out,
+			 int                 width)
+{
+    const __m256i evenMask = _mm256_set_epi32 (0, -1, 0, -1, 0, -1, 0, -1);
+    int           x;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+	__m256i l = _mm256_loadu_si256 ((const __m256i *) (left + x * 4));
+	__m256i r = _mm256_loadu_si256 ((const __m256i *) (right + x * 4));
+
+	_mm256_storeu_si256 ((__m256i *) (out + x * 4),
+			     _mm256_blendv_epi8 (r, l, evenMask));
+    }
+
+    return x;
+}
+
+static AVX2_KERNEL int
+halveRowAvx2 (const unsigned char *eye,
+	      int                 eyeWidth,
+	      unsigned char       *out,
+	      int                 width)
+{
+    int x;
+
+    for (x = 0; x + 8 <= width && 2 * x + 16 <= eyeWidth; x += 8)
+    {
+	__m256 a = _mm256_castsi256_ps (_mm256_loadu_si256 ((const __m256i *) (eye + x * 8)));
+	__m256 b = _mm256_castsi256_ps (_mm256_loadu_si256 ((const __m256i *) (eye + x * 8 + 32)));
+	__m256i even = _mm256_castps_si256 (_mm256_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0)));
+	__m256i odd = _mm256_castps_si256 (_mm256_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1)));
+
+	// the shuffles work within 128 bit lanes, leaving the pixel pairs
+	// of a and b interleaved
+	_mm256_storeu_si256 ((__m256i *) (out + x * 4),
+			     _mm256_permute4x64_epi64 (_mm256_avg_epu8 (even, odd),
+						       _MM_SHUFFLE (3, 1, 2, 0)));
+    }
+
+    return x;
+}
+#endif
+
+static void
+anaglyphRow (const unsigned char *left,
+	     const unsigned char *right,
+	     unsigned char       *out,
+	     int                 width,
+	     bool                avx2)
+{
+    int x = 0;
+
+#ifdef USE_AVX2
+    if (avx2)
+	x = anaglyphRowAvx2 (left, right, out, width);
+#endif
+
+#ifdef USE_NEON
+    const uint8x8_t alpha = vdup_n_u8 (0xff);
+
+    // eight pixels at a time, split into their channels
+    for (; x + 8 <= width; x += 8)
+    {
+	uint8x8x4_t l = vld4_u8 (left + x * 4);
+	uint8x8x4_t r = vld4_u8 (right + x * 4);
+	uint8x8x4_t o;
+	uint16x8_t  red, green, blue;
+
+	// the weights of each channel add up to 256, the sums stay
+	// below 1 << 16
+	red = vmull_u8 (r.val[0], vdup_n_u8 (RED_R));
+	red = vmlal_u8 (red, r.val[1], vdup_n_u8 (RED_G));
+	red = vmlal_u8 (red, r.val[2], vdup_n_u8 (RED_B));
+	green = vmull_u8 (l.val[0], vdup_n_u8 (GREEN_R));
+	green = vmlal_u8 (green, l.val[1], vdup_n_u8 (GREEN_G));
+	blue = vmull_u8 (l.val[0], vdup_n_u8 (BLUE_R));
+	blue = vmlal_u8 (blue, l.val[2], vdup_n_u8 (BLUE_B));
+
+	// adds 128 before the shift, as weigh does
+	o.val[0] = vrshrn_n_u16 (red, 8);
+	o.val[1] = vrshrn_n_u16 (green, 8);
+	o.val[2] = vrshrn_n_u16 (blue, 8);
+	o.val[3] = alpha;
+
+	vst4_u8 (out + x * 4, o);
+    }
+#endif
+
+#ifdef USE_SSE2
+    const __m128i byteMask = _mm_set1_epi32 (0xff);
+    const __m128i alpha = _mm_set1_epi32 (0xff000000);
+    const __m128i round = _mm_set1_epi32 (128);
+
+    // four pixels at a time, one channel per 32 bit lane
+    for (; x + 4 <= width; x += 4)
+    {
+	__m128i l = _mm_loadu_si128 ((const __m128i *) (left + x * 4));
+	__m128i r = _mm_loadu_si128 ((const __m128i *) (right + x * 4));
+	__m128i lr, lg, lb, rr, rg, rb, red, green, blue;
+
+	lr = _mm_and_si128 (l, byteMask);
+	lg = _mm_and_si128 (_mm_srli_epi32 (l, 8), byteMask);
+	lb = _mm_and_si128 (_mm_srli_epi32 (l, 16), byteMask);
+	rr = _mm_and_si128 (r, byteMask);
+	rg = _mm_and_si128 (_mm_srli_epi32 (r, 8), byteMask);
+	rb = _mm_and_si128 (_mm_srli_epi32 (r, 16), byteMask);
+
+	// products stay below 1 << 16, the high halves multiply zeros
+	red = _mm_add_epi32 (_mm_add_epi32 (_mm_mullo_epi16 (rr, _mm_set1_epi32 (RED_R)),
+					    _mm_mullo_epi16 (rg, _mm_set1_epi32 (RED_G))),
+			     _mm_add_epi32 (_mm_mullo_epi16 (rb, _mm_set1_epi32 (RED_B)), round));
+	green = _mm_add_epi32 (_mm_add_epi32 (_mm_mullo_epi16 (lr, _mm_set1_epi32 (GREEN_R)),
+					      _mm_mullo_epi16 (lg, _mm_set1_epi32 (GREEN_G))),
+			       round);
+	blue = _mm_add_epi32 (_mm_add_epi32 (_mm_mullo_epi16 (lr, _mm_set1_epi32 (BLUE_R)),
+					     _mm_mullo_epi16 (lb, _mm_set1_epi32 (BLUE_B))),
+			      round);
+
+	red = _mm_srli_epi32 (red, 8);
+	green = _mm_slli_epi32 (_mm_srli_epi32 (green, 8), 8);
+	blue = _mm_slli_epi32 (_mm_srli_epi32 (blue, 8), 16);
+
+	_mm_storeu_si128 ((__m128i *) (out + x * 4),
+			  _mm_or_si128 (_mm_or_si128 (red, green), _mm_or_si128 (blue, alpha)));
+    }
+#endif
+
+    for (; x < width; x++)
+    {
+	const unsigned char *l = left + x * 4;
+	const unsigned char *r = right + x * 4;
+	unsigned char       *o = out + x * 4;
+
+	o[0] = weigh (r[0], r[1], r[2], RED_R, RED_G, RED_B);
+	o[1] = weigh (l[0], l[1], l[2], GREEN_R, GREEN_G, 0);
+	o[2] = weigh (l[0], l[1], l[2], BLUE_R, 0, BLUE_B);
+	o[3] = 0xff;
+    }
+}
+
+/* even columns from the left eye */
+static void
+columnInterlacedRow (const unsigned char *left,
+		     const unsigned char *right,
+		     unsigned char       *out,
+		     int                 width,
+		     bool                avx2)
+{
+    int x = 0;
+
+#ifdef USE_AVX2
+    if (avx2)
+	x = columnInterlacedRowAvx2 (left, right, out, width);
+#endif
+
+#ifdef USE_NEON
+    static const uint32_t even[4] = { 0xffffffff, 0, 0xffffffff, 0 };
+    const uint32x4_t      evenMask = vld1q_u32 (even);
+
+    for (; x + 4 <= width; x += 4)
+    {
+	uint32x4_t l = vld1q_u32 ((const uint32_t *) (left + x * 4));
+	uint32x4_t r = vld1q_u32 ((const uint32_t *) (right + x * 4));
+
+	vst1q_u32 ((uint32_t *) (out + x * 4), vbslq_u32 (evenMask, l, r));
+    }
+#endif
+
+#ifdef USE_SSE2
+    const __m128i evenMask = _mm_set_epi32 (0, -1, 0, -1);
+
+    for (; x + 4 <= width; x += 4)
+    {
+	__m128i l = _mm_loadu_si128 ((const __m128i *) (left + x * 4));
+	__m128i r = _mm_loadu_si128 ((const __m128i *) (right + x * 4));
+
+	_mm_storeu_si128 ((__m128i *) (out + x * 4),
+			  _mm_or_si128 (_mm_and_si128 (evenMask, l),
+					_mm_andnot_si128 (evenMask, r)));
+    }
+#endif
+
+    for (; x < width; x++)
+	memcpy (out + x * 4, ((x & 1) ? right : left) + x * 4, 4);
+}
+
+/* Halves an eye horizontally into width pixels, averaging pixel pairs
+ * and clamping the last pair of odd widths */
+static void
+halveRow (const unsigned char *eye,
+	  int                 eyeWidth,
+	  unsigned char       *out,
+	  int                 width,
+	  bool                avx2)
+{
+    int x = 0;
+
+#ifdef USE_AVX2
+    if (avx2)
+	x = halveRowAvx2 (eye, eyeWidth, out, width);
+#endif
+
+#ifdef USE_NEON
+    for (; x + 4 <= width && 2 * x + 8 <= eyeWidth; x += 4)
+    {
+	// the even and the odd pixels of eight
+	uint32x4x2_t pairs = vld2q_u32 ((const uint32_t *) (eye + x * 8));
+
+	vst1q_u8 (out + x * 4, vrhaddq_u8 (vreinterpretq_u8_u32 (pairs.val[0]),
+					   vreinterpretq_u8_u32 (pairs.val[1])));
+    }
+#endif
+
+#ifdef USE_SSE2
+    for (; x + 4 <= width && 2 * x + 8 <= eyeWidth; x += 4)
+    {
+	__m128 a = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) (eye + x * 8)));
+	__m128 b = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) (eye + x * 8 + 16)));
+	__m128i even = _mm_castps_si128 (_mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0)));
+	__m128i odd = _mm_castps_si128 (_mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1)));
+
+	_mm_storeu_si128 ((__m128i *) (out + x * 4), _mm_avg_epu8 (even, odd));
+    }
+#endif
+
+    for (; x < width; x++)
+    {
+	const unsigned char *p = eye + 2 * x * 4;
+	const unsigned char *q = 2 * x + 1 < eyeWidth ? p + 4 : p;
+	int                 c;
+
+	// rounds up like _mm_avg_epu8
+	for (c = 0; c < 4; c++)
+	    out[x * 4 + c] = (p[c] + q[c] + 1) >> 1;
+    }
+}
+
+typedef struct _CompositeBand
+{
+    const CpuImage   *left;
+    const CpuImage   *right;
+    CpuImage         *out;
+    CpuCompositeMode mode;
+    bool             avx2;
+    int              y1;
+    int              y2;
+} CompositeBand;
+
+static void *
+compositeBand (void *closure)
+{
+    CompositeBand *band = (CompositeBand *) closure;
+    int           width = band->out->width;
+    int           y;
+
+    for (y = band->y1; y < band->y2; y++)
+    {
+	const unsigned char *l = band->left->pixels + y * band->left->stride;
+	const unsigned char *r = band->right->pixels + y * band->right->stride;
+	unsigned char       *o = band->out->pixels + y * band->out->stride;
+
+	switch (band->mode)
+	{
+	case CpuAnaglyph:
+	    anaglyphRow (l, r, o, width, band->avx2);
+	    break;
+
+	case CpuRowInterlaced:
+	    // even rows from the left eye, counted from the top
+	    memcpy (o, (y & 1) ? r : l, width * 4);
+	    break;
+
+	case CpuColumnInterlaced:
+	    columnInterlacedRow (l, r, o, width, band->avx2);
+	    break;
+
+	case CpuSideBySide:
+	    halveRow (l, band->left->width, o, width / 2, band->avx2);
+	    halveRow (r, band->right->width, o + (width / 2) * 4, width - width / 2,
+		      band->avx2);
+	    break;
+	}
+    }
+
+    return NULL;
+}
+
+static bool
+haveAvx2 (void)
+{
+#ifdef USE_AVX2
+    return __builtin_cpu_supports ("avx2");
+#else
+    return false;
+#endif
+}
+
+/* Name of the kernels cpuComposite runs on this CPU */
+const char *
+getCpuCompositeKernels (void)
+{
+#if defined (USE_NEON)
+    return "neon";
+#elif defined (USE_SSE2)
+    return haveAvx2 () ? "avx2" : "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+/* Composites left and right, which have the size of out, in one of the
+ * output modes. Returns false when the images do not match in size. */
+bool
+cpuComposite (const CpuImage   *left,
+	      const CpuImage   *right,
+	      CpuImage         *out,
+	      CpuCompositeMode mode)
+{
+    CompositeBand bands[MAX_COMPOSITE_THREADS];
+    pthread_t     threads[MAX_COMPOSITE_THREADS];
+    bool          started[MAX_COMPOSITE_THREADS];
+    long          nCpus = sysconf (_SC_NPROCESSORS_ONLN);
+    int           nBands, i;
+
+    if (left->width != out->width || left->height != out->height ||
+	right->width != out->width || right->height != out->height)
+	return false;
+
+    nBands = out->height / MIN_BAND_ROWS;
+    if (nBands > nCpus)
+	nBands = nCpus;
+    if (nBands > MAX_COMPOSITE_THREADS)
+	nBands = MAX_COMPOSITE_THREADS;
+    if (nBands < 1)
+	nBands = 1;
+
+    for (i = 0; i < nBands; i++)
+    {
+	bands[i].left = left;
+	bands[i].right = right;
+	bands[i].out = out;
+	bands[i].mode = mode;
+	bands[i].avx2 = haveAvx2 ();
+	bands[i].y1 = out->height * i / nBands;
+	bands[i].y2 = out->height * (i + 1) / nBands;
+    }
+
+    // the calling thread takes the first band
+    for (i = 1; i < nBands; i++)
+	started[i] = !pthread_create (&threads[i], NULL, compositeBand, &bands[i]);
+
+    compositeBand (&bands[0]);
+
+    for (i = 1; i < nBands; i++)
+    {
+	if (started[i])
+	    pthread_join (threads[i], NULL);
+	else
+	    compositeBand (&bands[i]);
+    }
+
+    return true;
+}
+
+/* Allocates a width x height image, rows top-down */
+bool
+allocCpuImage (CpuImage *image, int width, int height)
+{
+    image->data = (unsigned char *) malloc (width * height * 4);
+    image->pixels = image->data;
+    image->width = width;
+    image->height = height;
+    image->stride = width * 4;
+
+    return image->data != NULL;
+}
+
+void
+freeCpuImage (CpuImage *image)
+{
+    free (image->data);
+    image->data = NULL;
+    image->pixels = NULL;
+}
@@ -0,0 +1,303 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Export of the composed stereo frames to a POSIX shared memory ring.
+ * Each frame is read into one of a ring of pixel buffer objects that is
+ * only mapped when it comes round again EXPORT_PBOS frames later, long
+ * after the transfer is done, so the readback never waits for the GPU.
+ * The mapped pixels are copied once, straight into the next slot of the
+ * shared ring, where a consumer reads them in place (see
+ * ExportRingHeader). The compositor never waits for the consumer; slots
+ * it has not read yet are overwritten. */
+
+#include "stereo3d.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef GL_PIXEL_PACK_BUFFER_ARB
+#define GL_PIXEL_PACK_BUFFER_ARB 0x88EB
+#endif
+#ifndef GL_STREAM_READ_ARB
+#define GL_STREAM_READ_ARB 0x88E1
+#endif
+#ifndef GL_READ_ONLY_ARB
+#define GL_READ_ONLY_ARB 0x88B8
+#endif
+
+#define EXPORT_PAGE_SIZE 4096
+
+static size_t
+roundToPage (size_t size)
+{
+    return (size + EXPORT_PAGE_SIZE - 1) & ~(size_t) (EXPORT_PAGE_SIZE - 1);
+}
+
+static bool
+loadBufferFunctions (CompScreen *s, FrameExporter *fe)
+{
+    const char *extensions = (const char *) glGetString (GL_EXTENSIONS);
+
+    if (!extensions || !strstr (extensions, "GL_ARB_pixel_buffer_object"))
+	return false;
+
+    fe->genBuffers = (GLGenBuffersProc)
+	(*s->getProcAddress) ((GLubyte *) "glGenBuffersARB");
+    fe->deleteBuffers = (GLDeleteBuffersProc)
+	(*s->getProcAddress) ((GLubyte *) "glDeleteBuffersARB");
+    fe->bindBuffer = (GLBindBufferProc)
+	(*s->getProcAddress) ((GLubyte *) "glBindBufferARB");
+    fe->bufferData = (GLBufferDataProc)
+	(*s->getProcAddress) ((GLubyte *) "glBufferDataARB");
+    fe->mapBuffer = (GLMapBufferProc)
+	(*s->getProcAddress) ((GLubyte *) "glMapBufferARB");
+    fe->unmapBuffer = (GLUnmapBufferProc)
+	(*s->getProcAddress) ((GLubyte *) "glUnmapBufferARB");
+
+    return fe->genBuffers && fe->deleteBuffers && fe->bindBuffer &&
+	   fe->bufferData && fe->mapBuffer && fe->unmapBuffer;
+}
+
+static void
+closeRing (FrameExporter *fe)
+{
+    if (fe->ring)
+	munmap (fe->ring, fe->mapSize);
+    if (fe->fd >= 0)
+	close (fe->fd);
+    if (fe->name)
+	shm_unlink (fe->name);
+
+    free (fe->name);
+    fe->name = NULL;
+    fe->ring = NULL;
+    fe->fd = -1;
+}
+
+/* Creates the ring and the buffer objects for width x height frames */
+static bool
+openRing (CompScreen *s, FrameExporter *fe, const char *name, int width, int height)
+{
+    int    nSlots = stereo3dGetExportSlots (s->display);
+    size_t frameSize = (size_t) width * height * 4;
+    size_t slotSize = roundToPage (sizeof (ExportFrameHeader) + frameSize);
+    int    i;
+
+    fe->fd = shm_open (name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fe->fd < 0)
+	return false;
+
+    fe->name = strdup (name);
+    fe->mapSize = EXPORT_PAGE_SIZE + nSlots * slotSize;
+
+    if (ftruncate (fe->fd, fe->mapSize) < 0)
+	return false;
+
+    fe->ring = (ExportRingHeader *) mmap (NULL, fe->mapSize, PROT_READ | PROT_WRITE,
+					  MAP_SHARED, fe->fd, 0);
+    if (fe->ring == MAP_FAILED)
+    {
+	fe->ring = NULL;
+	return false;
+    }
+
+    fe->ring->version = EXPORT_VERSION;
+    fe->ring->nSlots = nSlots;
+    fe->ring->slotOffset = EXPORT_PAGE_SIZE;
+    fe->ring->slotSize = slotSize;
+    fe->ring->frameOffset = sizeof (ExportFrameHeader);
+    fe->ring->width = width;
+    fe->ring->height = height;
+    fe->ring->stride = width * 4;
+    fe->ring->writeCount = 0;
+
+    // consumers check the magic last
+    __sync_synchronize ();
+    fe->ring->magic = EXPORT_MAGIC;
+
+    (*fe->genBuffers) (EXPORT_PBOS, fe->pbo);
+    for (i = 0; i < EXPORT_PBOS; i++)
+    {
+	(*fe->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, fe->pbo[i]);
+	(*fe->bufferData) (GL_PIXEL_PACK_BUFFER_ARB, frameSize, NULL, GL_STREAM_READ_ARB);
+    }
+    (*fe->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    fe->width = width;
+    fe->height = height;
+    fe->nRead = 0;
+    fe->nDropped = 0;
+
+    compLogMessage ("stereo3d", CompLogLevelInfo,
+		    "exporting %dx%d frames to shared memory %s, %d slots",
+		    width, height, name, nSlots);
+
+    return true;
+}
+
+static void publishFrame (FrameExporter *fe, int pbo);
+
+void
+stopExport (FrameExporter *fe)
+{
+    unsigned long n;
+
+    if (!fe->ring)
+	return;
+
+    // the readbacks still in flight are complete frames too
+    n = fe->nRead > EXPORT_PBOS ? fe->nRead - EXPORT_PBOS : 0;
+    for (; n < fe->nRead; n++)
+	publishFrame (fe, n % EXPORT_PBOS);
+    (*fe->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    // readers see the ring go away before it is unlinked
+    fe->ring->magic = 0;
+
+    (*fe->deleteBuffers) (EXPORT_PBOS, fe->pbo);
+
+    compLogMessage ("stereo3d", CompLogLevelInfo,
+		    "exported %llu frames, %lu dropped",
+		    (unsigned long long) fe->ring->writeCount, fe->nDropped);
+
+    closeRing (fe);
+}
+
+/* Follows the export_shm option, called at the start of every frame */
+void
+updateExport (CompScreen *s, FrameExporter *fe)
+{
+    const char *name = stereo3dGetExportShm (s->display);
+
+    if (!name || !*name)
+    {
+	stopExport (fe);
+	fe->failed = false;
+	return;
+    }
+
+    // renamed or resized, started again from the next exported output
+    if (fe->ring && (strcmp (name, fe->name) ||
+		     (int) fe->ring->nSlots != stereo3dGetExportSlots (s->display)))
+	stopExport (fe);
+}
+
+/* Copies a finished readback from its buffer object into the next slot */
+static void
+publishFrame (FrameExporter *fe, int pbo)
+{
+    ExportRingHeader  *ring = fe->ring;
+    ExportFrameHeader *frame;
+    unsigned long     slot = ring->writeCount % ring->nSlots;
+    void              *pixels;
+
+    frame = (ExportFrameHeader *) ((char *) ring + ring->slotOffset + slot * ring->slotSize);
+
+    (*fe->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, fe->pbo[pbo]);
+    pixels = (*fe->mapBuffer) (GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+
+    if (pixels)
+    {
+	// odd while the slot is being written
+	frame->sequence++;
+	__sync_synchronize ();
+
+	memcpy ((char *) frame + ring->frameOffset, pixels, (size_t) ring->stride * ring->height);
+	frame->frameNumber = fe->pboFrame[pbo];
+	frame->timestampUs = fe->pboTimestamp[pbo];
+
+	__sync_synchronize ();
+	frame->sequence++;
+
+	(*fe->unmapBuffer) (GL_PIXEL_PACK_BUFFER_ARB);
+
+	__sync_synchronize ();
+	ring->writeCount++;
+    }
+    else
+	fe->nDropped++;
+}
+
+/* Whether output is the one configured by export_output, the whole
+ * screen when core paints it as a single output */
+static bool
+isExportedOutput (CompScreen *s, CompOutput *output)
+{
+    int id = stereo3dGetExportOutput (s->display);
+
+    if (output == &s->fullscreenOutput)
+	return true;
+
+    if (id >= s->nOutputDev)
+	id = s->nOutputDev - 1;
+
+    return output == &s->outputDev[id];
+}
+
+/* Starts the readback of the painted output and publishes the one read
+ * EXPORT_PBOS frames ago. Only the configured output is exported, so
+ * the ring keeps its size on multi-head. */
+void
+exportOutput (CompScreen *s, FrameExporter *fe, CompOutput *output, unsigned int frame)
+{
+    const char     *name = stereo3dGetExportShm (s->display);
+    struct timeval now;
+    int            pbo;
+
+    STEREO3D_SCREEN (s);
+
+    if (!name || !*name || fe->failed || fe->exportedFrame == frame ||
+	!isExportedOutput (s, output))
+	return;
+
+    fe->exportedFrame = frame;
+
+    if (fe->ring && (fe->width != output->width || fe->height != output->height))
+	stopExport (fe);
+
+    if (!fe->ring)
+    {
+	if (!loadBufferFunctions (s, fe) ||
+	    !openRing (s, fe, name, output->width, output->height))
+	{
+	    compLogMessage ("stereo3d", CompLogLevelWarn,
+			    "unable to export frames to shared memory %s", name);
+	    closeRing (fe);
+	    fe->failed = true;
+	    return;
+	}
+    }
+
+    GL_SITE (&sos->glCalls, GLSiteOther);
+
+    pbo = fe->nRead % EXPORT_PBOS;
+
+    // the oldest buffer in flight is reused below, publish it first
+    if (fe->nRead >= EXPORT_PBOS)
+	publishFrame (fe, pbo);
+
+    gettimeofday (&now, 0);
+    fe->pboFrame[pbo] = frame;
+    fe->pboTimestamp[pbo] = (long long) now.tv_sec * 1000000 + now.tv_usec;
+
+    (*fe->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, fe->pbo[pbo]);
+    countedPixelStorei (&sos->glCalls, GL_PACK_ALIGNMENT, 4);
+    countedReadPixels (&sos->glCalls, output->region.extents.x1,
+		       s->height - output->region.extents.y2,
+		       output->width, output->height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    (*fe->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    fe->nRead++;
+}
@@ -14,197 +14,298 @@
 
 #include "stereo3d.h"
 
+void
+LightingFunctions::init(const char *colorProgram)
+{
+    this->colorProgram = colorProgram;
+
+    for(int i=0; i<COMP_FETCH_TARGET_NUM; i++)
+        for(int j=0; j<LIGHTING_MAX_PARAMS; j++)
+            this->fragmentFunctions[i][j] = 0;
+}
+
+void
+LightingFunctions::deinit(CompScreen *s)
+{
+    for(int i=0; i<COMP_FETCH_TARGET_NUM; i++)
+    {
+        for(int j=0; j<LIGHTING_MAX_PARAMS; j++)
+        {
+            if(this->fragmentFunctions[i][j] != 0)
+            {
+                destroyFragmentFunction(s, this->fragmentFunctions[i][j]);
+                this->fragmentFunctions[i][j] = 0;
+            }
+        }
+    }
+}
+
+/* brightness and saturation are read from program.env[param].x and .y,
+ * so one function per texture target and parameter slot serves every
+ * window, whatever other plugins allocated before us */
+void
+LightingFunctions::addLighting(FragmentAttrib *fa, CompTexture *texture, CompScreen *s,
+                               float brightness, float saturation)
+{
+    int      target, param;
+    Bool     status = TRUE;
+    char     str[1024];
+
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    // lighting alone is a no-op, stay on core's plain texture path
+    if (!this->colorProgram && brightness >= 1.0f && saturation >= 1.0f)
+        return;
+
+    if (!s->fragmentProgram)
+    {
+        fa->brightness = (GLushort)(fa->brightness * brightness);
+        fa->saturation = (GLushort)(fa->saturation * saturation);
+        return;
+    }
+
+    if (texture->target == GL_TEXTURE_2D)
+        target = COMP_FETCH_TARGET_2D;
+    else
+        target = COMP_FETCH_TARGET_RECT;
+
+    param = allocFragmentParameters(fa, 1);
+
+    if (param < 0 || param >= LIGHTING_MAX_PARAMS)
+    {
+        fa->brightness = (GLushort)(fa->brightness * brightness);
+        fa->saturation = (GLushort)(fa->saturation * saturation);
+        return;
+    }
+
+    int *function = &this->fragmentFunctions[target][param];
+
+    if (!*function)
+    {
+        CompFunctionData *data;
+        data = createFunctionData ();
+
+        status &= addTempHeaderOpToFunctionData (data, "temp");
+        status &= addFetchOpToFunctionData (data, "output", NULL, target);
+        status &= addColorOpToFunctionData (data, "output", "output");
+
+        snprintf (str, sizeof (str),
+                  "DP3 temp.x, output, {0.30, 0.59, 0.11, 0.0};"
+                  "LRP output.xyz, program.env[%d].yyyy, output, temp.xxxx;"
+                  "MUL output.xyz, output, program.env[%d].xxxx;",
+                  param, param);
+        status &= addDataOpToFunctionData (data, str);
+
+        if (this->colorProgram)
+            status &= addDataOpToFunctionData (data, this->colorProgram);
+
+        if (status)
+            *function = createFragmentFunction (s, "stereoscopic_lighting", data);
+        else
+            compLogMessage ("stereoscopic", CompLogLevelWarn, "Error creating fragment program");
+
+        destroyFunctionData (data);
+    }
+
+    if (!*function)
+    {
+        fa->brightness = (GLushort)(fa->brightness * brightness);
+        fa->saturation = (GLushort)(fa->saturation * saturation);
+        return;
+    }
+
+    countedAddFragmentFunction (gc, fa, *function);
+    (*s->programEnvParameter4f) (GL_FRAGMENT_PROGRAM_ARB, param, brightness, saturation, 0.0f, 0.0f);
+    GL_COUNT (gc, GLCallFragment);
+}
+
+
+void MonoFilter::init()
+{
+    lighting.init(NULL);
+}
+
+void MonoFilter::deinit(CompScreen *s)
+{
+    lighting.deinit(s);
+}
+
+void MonoFilter::applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s,
+                             float brightness, float saturation)
+{
+    lighting.addLighting(fa, texture, s, brightness, saturation);
+}
+
+
 void InterlacedFilter::init()
 {
     column = false;
+    lighting.init(NULL);
 }
 
-void InterlacedFilter::applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s)
+void InterlacedFilter::deinit(CompScreen *s)
 {
-    if(eyenum==0)
-        glStencilFunc(GL_NOTEQUAL, 0, 1);
-    else
-        glStencilFunc(GL_EQUAL, 0, 1);
+    lighting.deinit(s);
 }
 
-void InterlacedFilter::prepareFilter(int width, int height)
+void InterlacedFilter::applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s,
+                                   float brightness, float saturation)
 {
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity ();
-    glOrtho (0, width, height, 0, 0, 1);
+    STEREO3D_SCREEN (s);
+
+    applyMask(&sos->glCalls, eyenum);
+    lighting.addLighting(fa, texture, s, brightness, saturation);
+}
 
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
+/* The cursor and the wireframe drawn after a window texture keep the
+ * stencil function of its eye */
+void InterlacedFilter::applyMask(GLCallCounters *gc, int eyenum)
+{
+    if(eyenum==FILTER_BOTH_EYES)
+        countedStencilFunc (gc, GL_ALWAYS, 0, 1);
+    else if(eyenum==0)
+        countedStencilFunc (gc, GL_NOTEQUAL, 0, 1);
+    else
+        countedStencilFunc (gc, GL_EQUAL, 0, 1);
+}
+
+void InterlacedFilter::prepareFilter(GLCallCounters *gc, int width, int height)
+{
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedPushMatrix (gc);
+    countedLoadIdentity (gc);
+    countedOrtho (gc, 0, width, height, 0, 0, 1);
+
+    countedMatrixMode (gc, GL_MODELVIEW);
+    countedPushMatrix (gc);
+    countedLoadIdentity (gc);
     
-    glEnable (GL_STENCIL_TEST);
-    glColorMask (GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    countedEnable (gc, GL_STENCIL_TEST);
+    countedColorMask (gc, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-    glStencilMask(GL_TRUE);
+    countedStencilMask (gc, GL_TRUE);
 
-    glClearStencil(0);
-    glClear(GL_STENCIL_BUFFER_BIT);
+    countedClearStencil (gc, 0);
+    countedClear (gc, GL_STENCIL_BUFFER_BIT);
 
-    glStencilOp(GL_INVERT, GL_KEEP, GL_KEEP);
-    glStencilFunc(GL_NEVER, 1, 1);
+    countedStencilOp (gc, GL_INVERT, GL_KEEP, GL_KEEP);
+    countedStencilFunc (gc, GL_NEVER, 1, 1);
 
-    glDisable( GL_LINE_SMOOTH );
-    glHint(GL_LINE_SMOOTH_HINT, GL_FASTEST);
-    glLineWidth (1.0f);
+    countedDisable (gc, GL_LINE_SMOOTH );
+    countedHint (gc, GL_LINE_SMOOTH_HINT, GL_FASTEST);
+    countedLineWidth (gc, 1.0f);
 
 
-    glBegin(GL_LINES);
+    // the lines mark eye 0 on the even rows from the top or the even
+    // columns; through the pixel centres, on the edges between pixels it
+    // is up to the driver which side they fall on
+    countedBegin (gc, GL_LINES);
     {
         if(!column)
         {
             int y;
-            for (y=0 ; y <= height; y += 2) {
-                glVertex2f(0.0f, float(y) ) ;
-                glVertex2f((float)width, float(y) );
+            for (y=0 ; y < height; y += 2) {
+                countedVertex2f (gc, 0.0f, y + 0.5f);
+                countedVertex2f (gc, (float)width, y + 0.5f);
             }
         }
         else
         {
             int x;
-            for (x=0 ; x <= width; x += 2) {
-                glVertex2f(float(x), 0.0f) ;
-                glVertex2f(float(x), (float)width);
+            for (x=0 ; x < width; x += 2) {
+                countedVertex2f (gc, x + 0.5f, 0.0f);
+                countedVertex2f (gc, x + 0.5f, (float)height);
             }
         }
     }
-    glEnd();
+    countedEnd (gc);
 
-    glStencilMask(GL_FALSE);
-    glColorMask (GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    countedStencilMask (gc, GL_FALSE);
+    countedColorMask (gc, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
     //glDisable (GL_STENCIL_TEST);
 
-    glStencilFunc(GL_NOTEQUAL, 0, 1);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    countedStencilFunc (gc, GL_NOTEQUAL, 0, 1);
+    countedStencilOp (gc, GL_KEEP, GL_KEEP, GL_KEEP);
 
     
-    glPopMatrix();
+    countedPopMatrix (gc);
 //
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedPopMatrix (gc);
+    countedMatrixMode (gc, GL_MODELVIEW);
 }
 
-void InterlacedFilter::cleanup()
+void InterlacedFilter::cleanup(GLCallCounters *gc)
 {
-    glClearStencil(0);
-    glClear(GL_STENCIL_BUFFER_BIT);
-    glDisable(GL_STENCIL_TEST);
+    countedClearStencil (gc, 0);
+    countedClear (gc, GL_STENCIL_BUFFER_BIT);
+    countedDisable (gc, GL_STENCIL_TEST);
 }
 
 
 void
 AnaglyphFilter::init()
 {
-    for(int i=0; i<3; i++)
-    {
-        this->fragmentFunctions[i] = 0;
-    }
+    static const char *anaglifProgramData =
+            "MOV temp, output;"
+            "DP3 temp.r, output, {0.1, 0.63, 0.27, 0.0};" //optimized anaglyph
+            "DP3 temp.g, output, {0.1, 0.9 , 0.0 , 0.0};"
+            "DP3 temp.b, output, {0.1, 0.0 , 0.9 , 0.0};"
+            "MOV output, temp;";
+
+    lighting.init(anaglifProgramData);
 }
 
 
 void
 AnaglyphFilter::deinit(CompScreen *s)
 {
-    for(int i=0; i<3; i++)
-    {
-        if(this->fragmentFunctions[i] != 0)
-        {
-            destroyFragmentFunction(s, this->fragmentFunctions[i]);
-            this->fragmentFunctions[i] = 0;
-        }
-    }
+    lighting.deinit(s);
 }
 
 void
-AnaglyphFilter::applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s)
+AnaglyphFilter::applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s,
+                            float brightness, float saturation)
 {
-    if(eyenum==0)
-    {
-    //    compLogMessage ("stereoscopic", CompLogLevelError, "setLeftEyeFilter");
-        int fragmentId;
+    STEREO3D_SCREEN (s);
 
-        glColorMask (GL_FALSE,GL_TRUE,GL_TRUE,GL_TRUE);
-        if(GLenum err = glGetError () != GL_NO_ERROR)
-            compLogMessage ("stereoscopic", CompLogLevelWarn, "glColorMask problem! %d", err );
+    applyMask(&sos->glCalls, eyenum);
 
-        /* Anaglif Left */
-        fragmentId = getAnaglifFragmentFunction(texture, s);
+    /* Anaglif with depth lighting */
+    lighting.addLighting(fa, texture, s, brightness, saturation);
+}
 
-        addFragmentFunction(fa, fragmentId);
+void
+AnaglyphFilter::applyMask(GLCallCounters *gc, int eyenum)
+{
+    if(eyenum==FILTER_BOTH_EYES)
+    {
+        countedColorMask (gc, GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
     }
-    else
+    else if(eyenum==0)
     {
-
-//    compLogMessage ("stereoscopic", CompLogLevelError, "setRightEyeFilter");
-        int fragmentId;
-
-        glColorMask (GL_TRUE,GL_FALSE,GL_FALSE,GL_TRUE);
-        if(GLenum err = glGetError () != GL_NO_ERROR)
-            compLogMessage ("stereoscopic", CompLogLevelWarn, "glColorMask problem! %d", err  );
-
-        /* Anaglif Left */
-        fragmentId = getAnaglifFragmentFunction(texture, s);
-
-        addFragmentFunction(fa, fragmentId);
+    //    compLogMessage ("stereoscopic", CompLogLevelError, "setLeftEyeFilter");
+        countedColorMask (gc, GL_FALSE,GL_TRUE,GL_TRUE,GL_TRUE);
+        if(GLenum err = countedGetError (gc) != GL_NO_ERROR)
+            compLogMessage ("stereoscopic", CompLogLevelWarn, "glColorMask problem! %d", err );
     }
-
-}
-
-int
-AnaglyphFilter::getAnaglifFragmentFunction (CompTexture *texture, CompScreen *s)
-{
-    int      target;
-    Bool     status = TRUE;
-
-    if (texture->target == GL_TEXTURE_2D)
-        target = COMP_FETCH_TARGET_2D;
     else
-        target = COMP_FETCH_TARGET_RECT;
-
-    if (!this->fragmentFunctions[target])
     {
-        static const char *anaglifProgramData =
-		"MOV temp, output;"
-		"DP3 temp.r, output, {0.1, 0.63, 0.27, 0.0};" //optimized anaglyph
-		"DP3 temp.g, output, {0.1, 0.9 , 0.0 , 0.0};"
-		"DP3 temp.b, output, {0.1, 0.0 , 0.9 , 0.0};"
-		"MOV output, temp;";
-        CompFunctionData *data;
-        data = createFunctionData ();
-
-	status &= addTempHeaderOpToFunctionData (data, "temp");
-	status &= addFetchOpToFunctionData (data, "output", NULL, target);
-	status &= addColorOpToFunctionData (data, "output", "output");
-
-	status &= addDataOpToFunctionData (data, anaglifProgramData);
-
-        if (!status)
-        {
-            compLogMessage ("stereoscopic", CompLogLevelWarn, "Error creating fragment program");
-            return 0;
-        }
-
-        this->fragmentFunctions[target] = createFragmentFunction (s, "stereoscopic_anaglif", data);
-        printf("####### Creating fragment function... ##### \n");
-        destroyFunctionData (data);
+//    compLogMessage ("stereoscopic", CompLogLevelError, "setRightEyeFilter");
+        countedColorMask (gc, GL_TRUE,GL_FALSE,GL_FALSE,GL_TRUE);
+        if(GLenum err = countedGetError (gc) != GL_NO_ERROR)
+            compLogMessage ("stereoscopic", CompLogLevelWarn, "glColorMask problem! %d", err  );
     }
-
-    return this->fragmentFunctions[target];
 }
 
-void AnaglyphFilter::prepareFilter(int width, int height)
+void AnaglyphFilter::prepareFilter(GLCallCounters *gc, int width, int height)
 {
     
 }
 
-void AnaglyphFilter::cleanup()
+void AnaglyphFilter::cleanup(GLCallCounters *gc)
 {
-    glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
+    countedColorMask (gc, GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
 }
 
@@ -0,0 +1,179 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+#include "stereo3d.h"
+
+// frames between two logged summaries
+#define GL_STATS_INTERVAL 300
+
+static const char *siteNames[] = {
+    "other",
+    "filter",
+    "filter setup",
+    "projection",
+    "cursor",
+    "wireframe"
+};
+
+static const char *typeNames[] = {
+    "matrix",
+    "color mask",
+    "stencil",
+    "fragment",
+    "vertex",
+    "texture bind",
+    "glGetError",
+    "state",
+    "uniform",
+    "framebuffer"
+};
+
+/* Calls allowed per unit of each site. The vertices of the filter setup
+ * depend on the screen size and are checked separately, its programs,
+ * uniforms, texture and framebuffer binds are those of the layered and
+ * lenticular compose passes. A layered window or cursor drawn for each
+ * eye on its own binds the eye's layer after each projection and both
+ * layers again after the last draw. */
+static const unsigned int budgets[GLSiteCount][GLCallTypeCount] = {
+    //                 matrix mask stencil frag vertex bind error state uniform fb
+    /* other */      {   0,    0,    0,    0,    0,    0,    0,    0,    0,     0 },
+    /* filter */     {   0,    1,    1,    2,    1,    0,    1,    4,    2,     1 },
+    /* setup */      {  11,    3,    8,    2,    0,    2,    0,    9,    3,     2 },
+    /* projection */ {   7,    0,    0,    0,    0,    0,    0,    1,    0,     1 },
+    /* cursor */     {   4,    0,    0,    0,    4,    2,    0,   11,    0,     1 },
+    /* wireframe */  {   3,    0,    0,    0,    8,    0,    0,   17,    0,     0 }
+};
+
+static unsigned int
+getBudget (const GLCallCounters *gc, int site, int type, int width, int height)
+{
+    // two vertices for each even scanline or column, see InterlacedFilter
+    if (site == GLSiteFilterSetup && type == GLCallVertex)
+	return gc->units[site] * ((width > height ? width : height) + 1);
+
+    return budgets[site][type] * gc->units[site];
+}
+
+/* Number of sites and call types over budget in the frame counted in
+ * gc, on a width x height screen. Those are flagged in exceeded when it
+ * is given. Also used by the test harness, which fails on any. */
+int
+countGLCallOverruns (const GLCallCounters *gc,
+		     int                  width,
+		     int                  height,
+		     bool                 exceeded[GLSiteCount][GLCallTypeCount])
+{
+    int overruns = 0;
+
+    for (int site = GLSiteFilter; site < GLSiteCount; site++)
+    {
+	for (int type = 0; type < GLCallTypeCount; type++)
+	{
+	    bool over = gc->calls[site][type] > getBudget (gc, site, type, width, height);
+
+	    if (exceeded)
+		exceeded[site][type] = over;
+	    if (over)
+		overruns++;
+	}
+    }
+
+    return overruns;
+}
+
+/* All counted calls of the frame */
+unsigned int
+getGLCallTotal (const GLCallCounters *gc)
+{
+    unsigned int total = 0;
+
+    if (!gc->enabled)
+	return 0;
+
+    for (int site = 0; site < GLSiteCount; site++)
+	for (int type = 0; type < GLCallTypeCount; type++)
+	    total += gc->calls[site][type];
+
+    return total;
+}
+
+static void
+logFrameCounts (GLCallCounters *gc)
+{
+    for (int site = GLSiteFilter; site < GLSiteCount; site++)
+    {
+	unsigned int *calls = gc->calls[site];
+
+	compLogMessage ("stereo3d", CompLogLevelInfo,
+			"GL calls, %s x%u: matrix %u, color mask %u, stencil %u, "
+			"fragment %u, vertex %u, texture bind %u, glGetError %u, state %u, "
+			"uniform %u, framebuffer %u",
+			siteNames[site], gc->units[site],
+			calls[GLCallMatrix], calls[GLCallColorMask], calls[GLCallStencil],
+			calls[GLCallFragment], calls[GLCallVertex], calls[GLCallTextureBind],
+			calls[GLCallGetError], calls[GLCallState], calls[GLCallUniform],
+			calls[GLCallFramebuffer]);
+    }
+}
+
+/* Called after every stereo frame of the screen. Reports each site and
+ * call type going over its budget once, logs the counts of every
+ * GL_STATS_INTERVAL-th frame and starts counting the next frame.
+ * Returns the number of budgets the frame went over. */
+int
+checkGLCallBudget (CompScreen     *s,
+		   GLCallCounters *gc)
+{
+    bool enabled = stereo3dGetGlCallStats (s->display);
+    int  overruns = 0;
+
+    if (enabled && gc->enabled)
+    {
+	bool exceeded[GLSiteCount][GLCallTypeCount];
+
+	overruns = countGLCallOverruns (gc, s->width, s->height, exceeded);
+
+	for (int site = GLSiteFilter; site < GLSiteCount && overruns; site++)
+	{
+	    for (int type = 0; type < GLCallTypeCount; type++)
+	    {
+		if (!exceeded[site][type] || gc->reported[site][type])
+		    continue;
+
+		compLogMessage ("stereo3d", CompLogLevelWarn,
+				"GL call budget exceeded, %s: %u %s calls for %u uses, budget %u",
+				siteNames[site], gc->calls[site][type], typeNames[type],
+				gc->units[site],
+				getBudget (gc, site, type, s->width, s->height));
+		gc->reported[site][type] = true;
+	    }
+	}
+
+	if (++gc->frames % GL_STATS_INTERVAL == 0)
+	    logFrameCounts (gc);
+    }
+    else if (enabled)
+    {
+	// budgets are reported again after counting was switched off
+	memset (gc->reported, 0, sizeof (gc->reported));
+	gc->frames = 0;
+    }
+
+    memset (gc->calls, 0, sizeof (gc->calls));
+    memset (gc->units, 0, sizeof (gc->units));
+
+    gc->enabled = enabled;
+    gc->site = GLSiteOther;
+
+    return overruns;
+}
@@ -0,0 +1,336 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* GLSL programs for the window textures of the stereo path. Instead of
+ * a fragment function built and bound through core for every texture,
+ * each draw binds one of these programs and updates its uniforms: the
+ * paint attributes and lighting once per draw, the eye projection only
+ * when the eye or the frame changed since the program last drew. The
+ * modelview still comes from core, which loads it for every window.
+ * Drivers without OpenGL 2.0 keep the fragment function path. */
+
+#include "stereo3d.h"
+
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_GEOMETRY_SHADER
+#define GL_GEOMETRY_SHADER 0x8DD9
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS 0x8B82
+#endif
+
+static const char *vertexSource =
+    "uniform mat4 eyeProjection;\n"
+    "void main ()\n"
+    "{\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = eyeProjection * (gl_ModelViewMatrix * gl_Vertex);\n"
+    "}\n";
+
+/* Same operations as the fragment functions of LightingFunctions, on
+ * premultiplied colour: paint is opacity, brightness and saturation */
+static const char *fragmentTemplate =
+    "%s"
+    "uniform %s windowTexture;\n"
+    "uniform vec3 paint;\n"
+    "void main ()\n"
+    "{\n"
+    "    vec4 color = %s (windowTexture, gl_TexCoord[0].st);\n"
+    "    float grey = dot (color.rgb, vec3 (0.30, 0.59, 0.11));\n"
+    "    color.rgb = mix (vec3 (grey), color.rgb, paint.z) * paint.y;\n"
+    "%s"
+    "    gl_FragColor = color * paint.x;\n"
+    "}\n";
+
+// by ShaderVariant, as in AnaglyphFilter::init
+static const char *variantSources[] = {
+    "",
+    "    color.rgb = vec3 (dot (color.rgb, vec3 (0.1, 0.63, 0.27)),\n"
+    "                      dot (color.rgb, vec3 (0.1, 0.9, 0.0)),\n"
+    "                      dot (color.rgb, vec3 (0.1, 0.0, 0.9)));\n"
+};
+
+static const char *variantNames[] = {
+    "lighting",
+    "anaglyph"
+};
+
+static bool
+loadShaderFunctions (CompScreen *s, ShaderBackend *sb)
+{
+    const char *version = (const char *) glGetString (GL_VERSION);
+
+    // the entry points below are core in 2.0, without the ARB suffixes
+    if (!version || atoi (version) < 2)
+	return false;
+
+#define LOAD(member, type, name) \
+    sb->member = (type) (*s->getProcAddress) ((GLubyte *) name)
+
+    LOAD (createShader, GLCreateShaderProc, "glCreateShader");
+    LOAD (shaderSource, GLShaderSourceProc, "glShaderSource");
+    LOAD (compileShader, GLCompileShaderProc, "glCompileShader");
+    LOAD (getShaderiv, GLGetShaderivProc, "glGetShaderiv");
+    LOAD (getShaderInfoLog, GLGetShaderInfoLogProc, "glGetShaderInfoLog");
+    LOAD (deleteShader, GLDeleteShaderProc, "glDeleteShader");
+    LOAD (createProgram, GLCreateProgramProc, "glCreateProgram");
+    LOAD (attachShader, GLAttachShaderProc, "glAttachShader");
+    LOAD (linkProgram, GLLinkProgramProc, "glLinkProgram");
+    LOAD (getProgramiv, GLGetProgramivProc, "glGetProgramiv");
+    LOAD (getProgramInfoLog, GLGetProgramInfoLogProc, "glGetProgramInfoLog");
+    LOAD (deleteProgram, GLDeleteProgramProc, "glDeleteProgram");
+    LOAD (useProgram, GLUseProgramProc, "glUseProgram");
+    LOAD (getUniformLocation, GLGetUniformLocationProc, "glGetUniformLocation");
+    LOAD (uniform1i, GLUniform1iProc, "glUniform1i");
+    LOAD (uniform3f, GLUniform3fProc, "glUniform3f");
+    LOAD (uniformMatrix4fv, GLUniformMatrix4fvProc, "glUniformMatrix4fv");
+
+#undef LOAD
+
+    return sb->createShader && sb->shaderSource && sb->compileShader &&
+	   sb->getShaderiv && sb->getShaderInfoLog && sb->deleteShader &&
+	   sb->createProgram && sb->attachShader && sb->linkProgram &&
+	   sb->getProgramiv && sb->getProgramInfoLog && sb->deleteProgram &&
+	   sb->useProgram && sb->getUniformLocation && sb->uniform1i &&
+	   sb->uniform3f && sb->uniformMatrix4fv;
+}
+
+/* Looks up the entry points once, false without GLSL */
+bool
+initShaderBackend (CompScreen *s, ShaderBackend *sb)
+{
+    if (!sb->loaded)
+    {
+	sb->loaded = true;
+	sb->supported = loadShaderFunctions (s, sb);
+
+	if (!sb->supported)
+	    compLogMessage ("stereo3d", CompLogLevelInfo,
+			    "GLSL is not available, drawing with fragment programs");
+    }
+
+    return sb->supported;
+}
+
+void
+finiShaderBackend (ShaderBackend *sb)
+{
+    if (!sb->supported)
+	return;
+
+    for (int variant = 0; variant < ShaderVariantCount; variant++)
+    {
+	for (int target = 0; target < 2; target++)
+	{
+	    ShaderProgram *sp = &sb->programs[variant][target];
+
+	    if (sp->program)
+		(*sb->deleteProgram) (sp->program);
+
+	    sp->program = 0;
+	    sp->failed = false;
+	}
+    }
+}
+
+static GLuint
+compileShader (ShaderBackend *sb, GLenum type, const char *source)
+{
+    GLuint shader = (*sb->createShader) (type);
+    GLint  status;
+
+    (*sb->shaderSource) (shader, 1, &source, NULL);
+    (*sb->compileShader) (shader);
+    (*sb->getShaderiv) (shader, GL_COMPILE_STATUS, &status);
+
+    if (!status)
+    {
+	char log[1024];
+
+	(*sb->getShaderInfoLog) (shader, sizeof (log), NULL, log);
+	compLogMessage ("stereo3d", CompLogLevelWarn, "unable to compile shader: %s", log);
+	(*sb->deleteShader) (shader);
+	return 0;
+    }
+
+    return shader;
+}
+
+/* Compiles and links a program from the given stages, geometry may be
+ * NULL. Returns 0 and logs why on failure. */
+GLuint
+linkShaderProgram (ShaderBackend *sb,
+		   const char    *vertexSource,
+		   const char    *geometrySource,
+		   const char    *fragmentSource)
+{
+    GLuint shaders[3];
+    GLuint program;
+    GLint  status;
+    int    i, nShaders = 0;
+    bool   compiled = true;
+
+    shaders[nShaders++] = compileShader (sb, GL_VERTEX_SHADER, vertexSource);
+    if (geometrySource)
+	shaders[nShaders++] = compileShader (sb, GL_GEOMETRY_SHADER, geometrySource);
+    shaders[nShaders++] = compileShader (sb, GL_FRAGMENT_SHADER, fragmentSource);
+
+    for (i = 0; i < nShaders; i++)
+	compiled = compiled && shaders[i];
+
+    if (!compiled)
+    {
+	for (i = 0; i < nShaders; i++)
+	    if (shaders[i])
+		(*sb->deleteShader) (shaders[i]);
+	return 0;
+    }
+
+    program = (*sb->createProgram) ();
+    for (i = 0; i < nShaders; i++)
+	(*sb->attachShader) (program, shaders[i]);
+    (*sb->linkProgram) (program);
+
+    // kept alive by the program
+    for (i = 0; i < nShaders; i++)
+	(*sb->deleteShader) (shaders[i]);
+
+    (*sb->getProgramiv) (program, GL_LINK_STATUS, &status);
+    if (!status)
+    {
+	char log[1024];
+
+	(*sb->getProgramInfoLog) (program, sizeof (log), NULL, log);
+	compLogMessage ("stereo3d", CompLogLevelWarn, "unable to link shader program: %s", log);
+	(*sb->deleteProgram) (program);
+	return 0;
+    }
+
+    return program;
+}
+
+static bool
+buildProgram (ShaderBackend *sb, ShaderProgram *sp, int variant, int target)
+{
+    char source[2048];
+
+    if (target == COMP_FETCH_TARGET_2D)
+	snprintf (source, sizeof (source), fragmentTemplate,
+		  "", "sampler2D", "texture2D", variantSources[variant]);
+    else
+	snprintf (source, sizeof (source), fragmentTemplate,
+		  "#extension GL_ARB_texture_rectangle : require\n",
+		  "sampler2DRect", "texture2DRect", variantSources[variant]);
+
+    sp->program = linkShaderProgram (sb, vertexSource, NULL, source);
+    if (!sp->program)
+	return false;
+
+    // the sampler stays on texture unit 0, its default
+    sp->eyeProjection = (*sb->getUniformLocation) (sp->program, "eyeProjection");
+    sp->paint = (*sb->getUniformLocation) (sp->program, "paint");
+    sp->eye = -1;
+
+    return true;
+}
+
+/* Called once per frame after setupProjections. The GL projection of an
+ * eye is its perspective followed by the translation applied in
+ * set*EyeProjectionMatrix, the same product is built here. */
+void
+setShaderProjections (ShaderBackend *sb,
+		      const float   *left,
+		      const float   *right,
+		      const float   *single,
+		      float         parallax,
+		      float         zCorrection)
+{
+    const float *projections[3] = { left, right, single };
+    const float shifts[3] = { -parallax, parallax, 0.0f };
+
+    for (int eye = EyeLeft; eye <= EyeSingle; eye++)
+    {
+	const float *p = projections[eye];
+	float       *m = sb->eyeProjection[eye];
+
+	memcpy (m, p, 12 * sizeof (float));
+	for (int i = 0; i < 4; i++)
+	    m[12 + i] = p[i] * shifts[eye] + p[8 + i] * zCorrection + p[12 + i];
+    }
+
+    sb->serial++;
+}
+
+/* Program of the variant for the texture's target, built the first time
+ * it is asked for. NULL when it failed to build or the target is one
+ * the programs do not sample. */
+ShaderProgram *
+getShaderProgram (ShaderBackend *sb, int variant, CompTexture *texture)
+{
+    ShaderProgram *sp;
+    int           target;
+
+    if (texture->target == GL_TEXTURE_2D)
+	target = COMP_FETCH_TARGET_2D;
+    else if (texture->target == GL_TEXTURE_RECTANGLE_ARB)
+	target = COMP_FETCH_TARGET_RECT;
+    else
+	return NULL;
+
+    sp = &sb->programs[variant][target];
+
+    if (!sp->program && !sp->failed && !buildProgram (sb, sp, variant, target))
+    {
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"%s shader unavailable, drawing it with fragment programs",
+			variantNames[variant]);
+	sp->failed = true;
+    }
+
+    return sp->program ? sp : NULL;
+}
+
+/* Binds the program for one draw in eye, brightness and saturation
+ * already include the window's depth lighting */
+void
+useShaderProgram (ShaderBackend  *sb,
+		  GLCallCounters *gc,
+		  ShaderProgram  *sp,
+		  int            eye,
+		  float          opacity,
+		  float          brightness,
+		  float          saturation)
+{
+    (*sb->useProgram) (sp->program);
+    GL_COUNT (gc, GLCallFragment);
+
+    if (sp->eye != eye || sp->serial != sb->serial)
+    {
+	(*sb->uniformMatrix4fv) (sp->eyeProjection, 1, GL_FALSE, sb->eyeProjection[eye]);
+	GL_COUNT (gc, GLCallUniform);
+
+	sp->eye = eye;
+	sp->serial = sb->serial;
+    }
+
+    (*sb->uniform3f) (sp->paint, opacity, brightness, saturation);
+    GL_COUNT (gc, GLCallUniform);
+}
@@ -0,0 +1,156 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Per-frame invocation counts of the wrapped hooks, the filter methods,
+ * the layout and the GL calls of each screen, related to the number of
+ * windows in its layout. Frames are grouped by window count in powers of two; a
+ * counter whose calls per window at least double from one group to a
+ * group with at least twice the windows grows faster than the window
+ * count and is reported. */
+
+#include "stereo3d.h"
+
+// frames between two logged summaries
+#define HOOK_STATS_INTERVAL 300
+
+static const char *counterNames[] = {
+    "preparePaintScreen",
+    "paintOutput",
+    "paintTransformedOutput",
+    "donePaintScreen",
+    "paintWindow",
+    "drawWindow",
+    "drawWindowTexture",
+    "prepareFilter",
+    "applyFilter",
+    "cleanupFilter",
+    "layout window",
+    "window index rebuild",
+    "window grid lookup",
+    "GL calls"
+};
+
+static int
+windowBucket (int nWindows)
+{
+    int bucket = 0;
+
+    while (nWindows > 1 && bucket < HOOK_STATS_BUCKETS - 1)
+    {
+	nWindows >>= 1;
+	bucket++;
+    }
+
+    return bucket;
+}
+
+static void
+checkScaling (HookCounters *hc, int counter)
+{
+    int a, b;
+
+    for (b = 2; b < HOOK_STATS_BUCKETS; b++)
+    {
+	float perWindowB;
+
+	if (!hc->windows[b][counter])
+	    continue;
+
+	perWindowB = (float) hc->calls[b][counter] /
+		     hc->windows[b][counter];
+
+	// a is at least half as many windows as b
+	for (a = 0; a + 2 <= b; a++)
+	{
+	    float perWindowA;
+
+	    if (!hc->windows[a][counter])
+		continue;
+
+	    perWindowA = (float) hc->calls[a][counter] /
+			 hc->windows[a][counter];
+
+	    if (perWindowA > 0.0f && perWindowB >= 2.0f * perWindowA)
+	    {
+		compLogMessage ("stereo3d", CompLogLevelWarn,
+				"%s grows faster than the window count: %.1f calls per "
+				"window at %d-%d windows, %.1f at %d-%d windows",
+				counterNames[counter],
+				perWindowA, 1 << a, (2 << a) - 1,
+				perWindowB, 1 << b, (2 << b) - 1);
+		hc->reported[counter] = true;
+		return;
+	    }
+	}
+    }
+}
+
+static void
+logFrameCounts (HookCounters *hc, int nWindows)
+{
+    char line[1024];
+    int  used = 0;
+
+    for (int counter = 0; counter < HookCounterCount; counter++)
+	used += snprintf (line + used, sizeof (line) - used, "%s%s %u",
+			  counter ? ", " : "", counterNames[counter],
+			  hc->frame[counter]);
+
+    compLogMessage ("stereo3d", CompLogLevelInfo,
+		    "hook calls per frame at %d windows: %s", nWindows, line);
+}
+
+/* Called after every stereo frame with the number of windows in the
+ * layout, before checkGLCallBudget resets the GL counts. Frames that
+ * did not run through preparePaintScreen exactly once, like the first
+ * one after counting or stereo was switched on, are not evaluated. */
+void
+checkHookCounts (CompScreen *s, int nWindows)
+{
+    STEREO3D_SCREEN (s);
+
+    HookCounters *hc = &sos->hookCounters;
+    bool         enabled = stereo3dGetHookStats (s->display);
+
+    if (enabled && hc->enabled &&
+	hc->frame[HookPreparePaintScreen] == 1 && nWindows > 0)
+    {
+	int bucket = windowBucket (nWindows);
+
+	hc->frame[HookGLCalls] += getGLCallTotal (&sos->glCalls);
+
+	for (int counter = 0; counter < HookCounterCount; counter++)
+	{
+	    if (!hc->frame[counter])
+		continue;
+
+	    hc->calls[bucket][counter] += hc->frame[counter];
+	    hc->windows[bucket][counter] += nWindows;
+
+	    if (!hc->reported[counter])
+		checkScaling (hc, counter);
+	}
+
+	if (++hc->frames % HOOK_STATS_INTERVAL == 0)
+	    logFrameCounts (hc, nWindows);
+    }
+    else if (!enabled && hc->enabled)
+    {
+	// counted afresh when switched on again
+	memset (hc, 0, sizeof (*hc));
+    }
+
+    memset (hc->frame, 0, sizeof (hc->frame));
+
+    hc->enabled = enabled;
+}
@@ -0,0 +1,276 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Pointer to screen latency of the 3D cursor. A measurement starts when
+ * the plugin learns a new pointer position and no other one is running.
+ * The cursor has reached it once it is drawn at that position, or past
+ * it along the motion, so moving on before the easing catches up still
+ * counts. The measurement ends at donePaintScreen of that frame, after
+ * the buffer swap, and goes into the distribution of the pointer source
+ * and cursor smoothing in use.
+ *
+ * With XInput2 the measurement starts at the server time of the first
+ * raw motion towards the position, so the time until the position is
+ * queried counts. The server clock is related to ours by the smallest
+ * difference seen between the two when raw events arrive. mousepoll and
+ * the late-latched cursor only see positions; their measurements start
+ * when the position arrives, without the polling delay before it. */
+
+#include "stereo3d.h"
+
+// measurements between two logged distributions
+#define LATENCY_REPORT_INTERVAL 200
+// drawn this close to the target counts as reached
+#define LATENCY_TOLERANCE       0.5f
+// not reached after this long, the pointer has turned back
+#define LATENCY_TIMEOUT_US      1000000
+
+static const char *sourceNames[] = {
+    "mousepoll",
+    "XInput2"
+};
+
+static const char *eyeNames[] = {
+    "left",
+    "right",
+    "single",
+    "both"
+};
+
+static const char *smoothingNames[] = {
+    "eased",
+    "snapped",
+    "late latched"
+};
+
+static long
+elapsedUs (const struct timeval *from, const struct timeval *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000 + (to->tv_usec - from->tv_usec);
+}
+
+static int64_t
+nowUs (void)
+{
+    struct timeval now;
+
+    gettimeofday (&now, 0);
+
+    return (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/* Called with the server time of every raw event. Delivery only adds to
+ * the difference of the clocks, a much larger one means the server time
+ * wrapped or the server was restarted */
+void
+latencyServerEvent (LatencyProbe *lp, Time serverTime)
+{
+    int64_t offsetUs;
+
+    if (!lp->enabled || serverTime == CurrentTime)
+	return;
+
+    offsetUs = nowUs () - (int64_t) serverTime * 1000;
+
+    if (!lp->serverClockKnown || offsetUs < lp->serverClockOffsetUs ||
+	offsetUs > lp->serverClockOffsetUs + LATENCY_TIMEOUT_US)
+    {
+	lp->serverClockOffsetUs = offsetUs;
+	lp->serverClockKnown = true;
+    }
+}
+
+/* Called with every new pointer position, inputTime is the server time
+ * of the input that moved the pointer there or CurrentTime */
+void
+latencyPointerMoved (LatencyProbe *lp,
+		     float        x,
+		     float        y,
+		     unsigned int frame,
+		     Time         inputTime)
+{
+    int64_t now, us;
+
+    if (!lp->enabled || lp->pending)
+	return;
+
+    if (fabsf (x - lp->drawnX) < LATENCY_TOLERANCE &&
+	fabsf (y - lp->drawnY) < LATENCY_TOLERANCE)
+	return;
+
+    lp->pending = true;
+    lp->startX = lp->drawnX;
+    lp->startY = lp->drawnY;
+    lp->targetX = x;
+    lp->targetY = y;
+    lp->inputFrame = frame;
+    lp->reachedEyes = 0;
+
+    now = nowUs ();
+    us = now;
+
+    if (inputTime != CurrentTime && lp->serverClockKnown)
+    {
+	us = (int64_t) inputTime * 1000 + lp->serverClockOffsetUs;
+	if (us > now)
+	    us = now;
+    }
+
+    lp->inputTime.tv_sec = us / 1000000;
+    lp->inputTime.tv_usec = us % 1000000;
+}
+
+/* Called with the position the cursor is drawn at for eye */
+void
+latencyCursorDrawn (LatencyProbe *lp, int eye, float x, float y)
+{
+    float dx, dy, length, along;
+
+    lp->drawnX = x;
+    lp->drawnY = y;
+
+    if (!lp->pending)
+	return;
+
+    dx = lp->targetX - lp->startX;
+    dy = lp->targetY - lp->startY;
+    length = sqrtf (dx * dx + dy * dy);
+
+    // distance covered towards the target since the measurement started
+    along = ((x - lp->startX) * dx + (y - lp->startY) * dy) / length;
+
+    if (along < length - LATENCY_TOLERANCE)
+	return;
+
+    if (eye < 0 || eye > EyeBoth || (lp->reachedEyes & (1 << eye)))
+	return;
+
+    gettimeofday (&lp->reachedTime[eye], 0);
+    lp->reachedEyes |= 1 << eye;
+}
+
+static void
+logDistribution (LatencyDistribution *ld, int source, int smoothing)
+{
+    unsigned int percentiles[] = { 50, 90, 99 };
+    float        values[3];
+    unsigned int seen = 0;
+    int          p = 0, bucket;
+
+    for (bucket = 0; bucket <= LATENCY_BUCKETS && p < 3; bucket++)
+    {
+	seen += ld->buckets[bucket];
+
+	while (p < 3 && seen * 100 >= percentiles[p] * ld->count)
+	    values[p++] = bucket;
+    }
+
+    compLogMessage ("stereo3d", CompLogLevelInfo,
+		    "cursor latency, %s %s, %u samples: median %.0f ms, p90 %.0f ms, "
+		    "p99 %.0f ms, max %.1f ms, %.2f frames on average, %u not reached",
+		    sourceNames[source], smoothingNames[smoothing], ld->count,
+		    values[0], values[1], values[2], ld->maxUs / 1000.0f,
+		    (float) ld->frames / ld->count, ld->lost);
+
+    for (int eye = EyeLeft; eye <= EyeBoth; eye++)
+    {
+	if (ld->eyeCount[eye])
+	    compLogMessage ("stereo3d", CompLogLevelInfo,
+			    "cursor latency, %s %s: %s eye drawn %.1f ms after the input on average",
+			    sourceNames[source], smoothingNames[smoothing], eyeNames[eye],
+			    ld->eyeUs[eye] / (1000.0f * ld->eyeCount[eye]));
+    }
+}
+
+/* Logs every distribution with samples and starts them again */
+void
+reportLatency (LatencyProbe *lp)
+{
+    for (int source = 0; source < LATENCY_SOURCES; source++)
+    {
+	for (int smoothing = 0; smoothing < LATENCY_SMOOTHINGS; smoothing++)
+	{
+	    LatencyDistribution *ld = &lp->distributions[source][smoothing];
+
+	    if (ld->count || ld->lost)
+		logDistribution (ld, source, smoothing);
+	}
+    }
+
+    memset (lp->distributions, 0, sizeof (lp->distributions));
+    lp->nSamples = 0;
+}
+
+/* Called after every stereo frame with the pointer source and cursor
+ * smoothing that were in use */
+void
+latencyFrameDone (CompScreen   *s,
+		  LatencyProbe *lp,
+		  unsigned int frame,
+		  int          source,
+		  int          smoothing)
+{
+    LatencyDistribution *ld;
+    struct timeval      now;
+    long                us;
+    bool                enabled = stereo3dGetLatencyStats (s->display);
+
+    if (!enabled)
+    {
+	if (lp->enabled)
+	    reportLatency (lp);
+	lp->enabled = false;
+	lp->pending = false;
+	return;
+    }
+
+    lp->enabled = true;
+
+    if (!lp->pending)
+	return;
+
+    gettimeofday (&now, 0);
+    us = elapsedUs (&lp->inputTime, &now);
+
+    ld = &lp->distributions[source][smoothing];
+
+    if (!lp->reachedEyes)
+    {
+	if (us > LATENCY_TIMEOUT_US)
+	{
+	    ld->lost++;
+	    lp->pending = false;
+	}
+	return;
+    }
+
+    ld->count++;
+    ld->buckets[us / 1000 < LATENCY_BUCKETS ? us / 1000 : LATENCY_BUCKETS]++;
+    ld->frames += frame - lp->inputFrame + 1;
+    if (us > ld->maxUs)
+	ld->maxUs = us;
+
+    for (int eye = EyeLeft; eye <= EyeBoth; eye++)
+    {
+	if (lp->reachedEyes & (1 << eye))
+	{
+	    ld->eyeUs[eye] += elapsedUs (&lp->inputTime, &lp->reachedTime[eye]);
+	    ld->eyeCount[eye]++;
+	}
+    }
+
+    lp->pending = false;
+
+    if (++lp->nSamples >= LATENCY_REPORT_INTERVAL)
+	reportLatency (lp);
+}
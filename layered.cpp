@@ -0,0 +1,478 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Single pass stereo. The output is painted into a framebuffer with both
+ * layers of a texture array attached; a geometry shader emits every
+ * window triangle once per layer with that eye's projection, so each
+ * window texture is submitted once for both eyes. The output filter is
+ * then applied once per pixel while composing the layers into the back
+ * buffer, instead of per window through colour or stencil masks.
+ * Textures the layered program cannot draw, the cursor and the
+ * background wireframe are drawn into each layer on their own. Needs
+ * OpenGL 3.2 for geometry shaders and layered framebuffers. */
+
+#include "stereo3d.h"
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+#ifndef GL_FRAMEBUFFER_COMPLETE
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+
+static const char *windowVertexSource =
+    "#version 150 compatibility\n"
+    "out vec2 vertexTexCoord;\n"
+    "void main ()\n"
+    "{\n"
+    "    vertexTexCoord = gl_MultiTexCoord0.st;\n"
+    "    gl_Position = gl_ModelViewMatrix * gl_Vertex;\n"
+    "}\n";
+
+static const char *windowGeometrySource =
+    "#version 150 compatibility\n"
+    "layout (triangles) in;\n"
+    "layout (triangle_strip, max_vertices = 6) out;\n"
+    "uniform mat4 eyeProjection[2];\n"
+    "in vec2 vertexTexCoord[];\n"
+    "out vec2 texCoord;\n"
+    "void main ()\n"
+    "{\n"
+    "    for (int layer = 0; layer < 2; layer++)\n"
+    "    {\n"
+    "        for (int i = 0; i < 3; i++)\n"
+    "        {\n"
+    "            gl_Layer = layer;\n"
+    "            gl_Position = eyeProjection[layer] * gl_in[i].gl_Position;\n"
+    "            texCoord = vertexTexCoord[i];\n"
+    "            EmitVertex ();\n"
+    "        }\n"
+    "        EndPrimitive ();\n"
+    "    }\n"
+    "}\n";
+
+// lighting as in glsl.cpp, the anaglyph matrix is applied when composing
+static const char *windowFragmentTemplate =
+    "#version 150 compatibility\n"
+    "uniform %s windowTexture;\n"
+    "uniform vec3 paint;\n"
+    "in vec2 texCoord;\n"
+    "void main ()\n"
+    "{\n"
+    "    vec4 color = texture (windowTexture, texCoord);\n"
+    "    float grey = dot (color.rgb, vec3 (0.30, 0.59, 0.11));\n"
+    "    color.rgb = mix (vec3 (grey), color.rgb, paint.z) * paint.y;\n"
+    "    gl_FragColor = color * paint.x;\n"
+    "}\n";
+
+static const char *composeVertexSource =
+    "#version 150 compatibility\n"
+    "void main ()\n"
+    "{\n"
+    "    gl_Position = gl_Vertex;\n"
+    "}\n";
+
+/* The layers cover the screen and were painted with the viewport the
+ * compose pass runs in, so every pixel reads its own texel. eye0 is
+ * the eye the filters call 0, the left one unless inverted. */
+static const char *composeFragmentTemplate =
+    "#version 150 compatibility\n"
+    "uniform sampler2DArray eyes;\n"
+    "uniform int eye0Layer;\n"
+    "uniform vec3 interlace;\n"
+    "void main ()\n"
+    "{\n"
+    "    ivec2 pixel = ivec2 (gl_FragCoord.xy);\n"
+    "    vec3 eye0 = texelFetch (eyes, ivec3 (pixel, eye0Layer), 0).rgb;\n"
+    "    vec3 eye1 = texelFetch (eyes, ivec3 (pixel, 1 - eye0Layer), 0).rgb;\n"
+    "%s"
+    "}\n";
+
+// by ComposeVariant, the channels AnaglyphFilter masks each eye to
+static const char *composeSources[] = {
+    "    gl_FragColor = vec4 (dot (eye1, vec3 (0.1, 0.63, 0.27)),\n"
+    "                         dot (eye0, vec3 (0.1, 0.9, 0.0)),\n"
+    "                         dot (eye0, vec3 (0.1, 0.0, 0.9)), 1.0);\n",
+    // interlace.xy picks rows or columns, z the parity of eye 0's lines
+    "    float line = floor (dot (gl_FragCoord.xy, interlace.xy));\n"
+    "    gl_FragColor = vec4 (mod (line, 2.0) == interlace.z ? eye0 : eye1, 1.0);\n"
+};
+
+static bool
+loadFramebufferFunctions (CompScreen *s, LayeredStereo *ls)
+{
+    const char *version = (const char *) glGetString (GL_VERSION);
+    int        major, minor;
+
+    if (!version || sscanf (version, "%d.%d", &major, &minor) != 2)
+	return false;
+
+    // geometry shaders and glFramebufferTexture
+    if (!s->fbo || major < 3 || (major == 3 && minor < 2))
+	return false;
+
+    ls->genFramebuffers = s->genFramebuffers;
+    ls->deleteFramebuffers = s->deleteFramebuffers;
+    ls->bindFramebuffer = s->bindFramebuffer;
+    ls->checkFramebufferStatus = s->checkFramebufferStatus;
+
+#define LOAD(member, type, name) \
+    ls->member = (type) (*s->getProcAddress) ((GLubyte *) name)
+
+    LOAD (framebufferTexture, GLFramebufferTextureProc, "glFramebufferTexture");
+    LOAD (framebufferTextureLayer, GLFramebufferTextureLayerProc, "glFramebufferTextureLayer");
+
+#undef LOAD
+
+    return ls->framebufferTexture && ls->framebufferTextureLayer;
+}
+
+/* Looks up the entry points once, false without OpenGL 3.2 or after
+ * the layers could not be set up */
+bool
+initLayeredStereo (CompScreen *s, LayeredStereo *ls)
+{
+    if (!ls->loaded)
+    {
+	ls->loaded = true;
+	ls->supported = loadFramebufferFunctions (s, ls);
+
+	if (!ls->supported)
+	    compLogMessage ("stereo3d", CompLogLevelInfo,
+			    "OpenGL 3.2 is not available, drawing each eye on its own");
+    }
+
+    return ls->supported && !ls->failed;
+}
+
+static void
+freeLayers (LayeredStereo *ls)
+{
+    if (ls->texture)
+    {
+	(*ls->deleteFramebuffers) (3, ls->framebuffers);
+	glDeleteTextures (1, &ls->texture);
+    }
+
+    ls->texture = 0;
+    ls->width = 0;
+    ls->height = 0;
+}
+
+void
+finiLayeredStereo (LayeredStereo *ls, ShaderBackend *sb)
+{
+    if (!ls->supported)
+	return;
+
+    freeLayers (ls);
+
+    for (int target = 0; target < 2; target++)
+    {
+	if (ls->programs[target].program)
+	    (*sb->deleteProgram) (ls->programs[target].program);
+	ls->programs[target].program = 0;
+	ls->programs[target].failed = false;
+    }
+
+    for (int variant = 0; variant < ComposeVariantCount; variant++)
+    {
+	if (ls->composePrograms[variant])
+	    (*sb->deleteProgram) (ls->composePrograms[variant]);
+	ls->composePrograms[variant] = 0;
+	ls->composeFailed[variant] = false;
+    }
+
+    free (ls->indices);
+    ls->indices = NULL;
+    ls->nIndices = 0;
+}
+
+static bool
+allocLayers (LayeredStereo *ls, int width, int height)
+{
+    bool complete = true;
+    int  i;
+
+    freeLayers (ls);
+
+    glGenTextures (1, &ls->texture);
+    glBindTexture (GL_TEXTURE_2D_ARRAY, ls->texture);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D (GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, 2, 0,
+		  GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture (GL_TEXTURE_2D_ARRAY, 0);
+
+    (*ls->genFramebuffers) (3, ls->framebuffers);
+
+    for (i = 0; i < 3; i++)
+    {
+	(*ls->bindFramebuffer) (GL_FRAMEBUFFER, ls->framebuffers[i]);
+
+	if (i == 0)
+	    (*ls->framebufferTexture) (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ls->texture, 0);
+	else
+	    (*ls->framebufferTextureLayer) (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+					    ls->texture, 0, i - 1);
+
+	complete = complete &&
+		   (*ls->checkFramebufferStatus) (GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    (*ls->bindFramebuffer) (GL_FRAMEBUFFER, 0);
+
+    ls->width = width;
+    ls->height = height;
+
+    return complete;
+}
+
+/* Redirects the painting of an output into both layers, which core
+ * clears together. False when the layers are unusable, the output is
+ * then painted eye by eye. */
+bool
+beginLayeredOutput (CompScreen     *s,
+		    LayeredStereo  *ls,
+		    GLCallCounters *gc)
+{
+    if ((ls->width != s->width || ls->height != s->height) &&
+	!allocLayers (ls, s->width, s->height))
+    {
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"unable to render into layered framebuffer, drawing each eye on its own");
+	freeLayers (ls);
+	ls->failed = true;
+	return false;
+    }
+
+    GL_SITE (gc, GLSiteFilterSetup);
+    countedBindFramebuffer (gc, ls->bindFramebuffer, GL_FRAMEBUFFER, ls->framebuffers[0]);
+
+    return true;
+}
+
+/* Points the following fixed-function draws at one eye's layer, -1 goes
+ * back to both */
+void
+bindEyeLayer (LayeredStereo  *ls,
+	      GLCallCounters *gc,
+	      int            eye)
+{
+    countedBindFramebuffer (gc, ls->bindFramebuffer, GL_FRAMEBUFFER,
+			    ls->framebuffers[eye == EyeLeft ? 1 : eye == EyeRight ? 2 : 0]);
+}
+
+static GLuint
+getComposeProgram (LayeredStereo *ls, ShaderBackend *sb, int variant)
+{
+    char source[2048];
+
+    if (ls->composePrograms[variant] || ls->composeFailed[variant])
+	return ls->composePrograms[variant];
+
+    snprintf (source, sizeof (source), composeFragmentTemplate, composeSources[variant]);
+
+    ls->composePrograms[variant] = linkShaderProgram (sb, composeVertexSource, NULL, source);
+    if (!ls->composePrograms[variant])
+    {
+	ls->composeFailed[variant] = true;
+	return 0;
+    }
+
+    ls->composeEye0Layer[variant] =
+	(*sb->getUniformLocation) (ls->composePrograms[variant], "eye0Layer");
+    ls->composeInterlace[variant] =
+	(*sb->getUniformLocation) (ls->composePrograms[variant], "interlace");
+
+    return ls->composePrograms[variant];
+}
+
+/* Composes the layers into the back buffer with the filter of stereoType */
+void
+endLayeredOutput (CompScreen    *s,
+		  LayeredStereo *ls,
+		  ShaderBackend *sb,
+		  int           stereoType,
+		  bool          invert)
+{
+    int    variant = stereoType == 1 ? ComposeAnaglyph : ComposeInterlaced;
+    GLuint program;
+
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    GL_SITE (gc, GLSiteFilterSetup);
+    countedBindFramebuffer (gc, ls->bindFramebuffer, GL_FRAMEBUFFER, 0);
+
+    program = getComposeProgram (ls, sb, variant);
+    if (!program)
+    {
+	// nothing else can read the layers
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"unable to compose layered output, drawing each eye on its own");
+	ls->failed = true;
+	return;
+    }
+
+    GL_SITE_UNIT (gc, GLSiteFilterSetup);
+
+    (*sb->useProgram) (program);
+    GL_COUNT (gc, GLCallFragment);
+
+    (*sb->uniform1i) (ls->composeEye0Layer[variant], invert ? 1 : 0);
+    GL_COUNT (gc, GLCallUniform);
+
+    if (variant == ComposeInterlaced)
+    {
+	// eye 0 on the even rows from the top, or the even columns
+	if (stereoType == 2)
+	    (*sb->uniform3f) (ls->composeInterlace[variant], 0.0f, 1.0f, (s->height - 1) & 1);
+	else
+	    (*sb->uniform3f) (ls->composeInterlace[variant], 1.0f, 0.0f, 0.0f);
+	GL_COUNT (gc, GLCallUniform);
+    }
+
+    countedDisable (gc, GL_BLEND);
+    countedBindTexture (gc, GL_TEXTURE_2D_ARRAY, ls->texture);
+
+    countedBegin (gc, GL_QUADS);
+    countedVertex2f (gc, -1.0f, -1.0f);
+    countedVertex2f (gc, 1.0f, -1.0f);
+    countedVertex2f (gc, 1.0f, 1.0f);
+    countedVertex2f (gc, -1.0f, 1.0f);
+    countedEnd (gc);
+
+    countedBindTexture (gc, GL_TEXTURE_2D_ARRAY, 0);
+
+    (*sb->useProgram) (0);
+    GL_COUNT (gc, GLCallFragment);
+}
+
+/* Program drawing a texture of the target into both layers, NULL when
+ * it failed to build or the target is not sampled by it */
+ShaderProgram *
+getLayeredProgram (LayeredStereo *ls, ShaderBackend *sb, CompTexture *texture)
+{
+    ShaderProgram *sp;
+    char          source[2048];
+    int           target;
+
+    if (texture->target == GL_TEXTURE_2D)
+	target = COMP_FETCH_TARGET_2D;
+    else if (texture->target == GL_TEXTURE_RECTANGLE_ARB)
+	target = COMP_FETCH_TARGET_RECT;
+    else
+	return NULL;
+
+    sp = &ls->programs[target];
+
+    if (sp->program || sp->failed)
+	return sp->program ? sp : NULL;
+
+    snprintf (source, sizeof (source), windowFragmentTemplate,
+	      target == COMP_FETCH_TARGET_2D ? "sampler2D" : "sampler2DRect");
+
+    sp->program = linkShaderProgram (sb, windowVertexSource, windowGeometrySource, source);
+    if (!sp->program)
+    {
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"layered shader unavailable, drawing those windows eye by eye");
+	sp->failed = true;
+	return NULL;
+    }
+
+    sp->eyeProjection = (*sb->getUniformLocation) (sp->program, "eyeProjection");
+    sp->paint = (*sb->getUniformLocation) (sp->program, "paint");
+    sp->eye = EyeBoth;
+
+    return sp;
+}
+
+/* Index list drawing every quad of core's window geometry as two
+ * triangles, the only input a geometry shader takes */
+static bool
+ensureQuadIndices (LayeredStereo *ls, int nQuads)
+{
+    GLuint *indices;
+    int    q;
+
+    if (nQuads * 6 <= ls->nIndices)
+	return true;
+
+    indices = (GLuint *) realloc (ls->indices, nQuads * 6 * sizeof (GLuint));
+    if (!indices)
+	return false;
+
+    for (q = ls->nIndices / 6; q < nQuads; q++)
+    {
+	indices[q * 6 + 0] = q * 4 + 0;
+	indices[q * 6 + 1] = q * 4 + 1;
+	indices[q * 6 + 2] = q * 4 + 2;
+	indices[q * 6 + 3] = q * 4 + 0;
+	indices[q * 6 + 4] = q * 4 + 2;
+	indices[q * 6 + 5] = q * 4 + 3;
+    }
+
+    ls->indices = indices;
+    ls->nIndices = nQuads * 6;
+
+    return true;
+}
+
+/* Draws the window geometry added for the bound texture into both
+ * layers. The caller checked that it is core's single texture layout:
+ * two texture coordinates, then the position. */
+void
+drawLayeredGeometry (LayeredStereo  *ls,
+		     ShaderBackend  *sb,
+		     GLCallCounters *gc,
+		     ShaderProgram  *sp,
+		     CompWindow     *w,
+		     float          opacity,
+		     float          brightness,
+		     float          saturation)
+{
+    int nQuads = w->vCount / 4;
+    int stride = w->vertexStride * sizeof (GLfloat);
+
+    if (!nQuads || !ensureQuadIndices (ls, nQuads))
+	return;
+
+    (*sb->useProgram) (sp->program);
+    GL_COUNT (gc, GLCallFragment);
+
+    if (sp->serial != sb->serial)
+    {
+	// left and right are adjacent in eyeProjection
+	(*sb->uniformMatrix4fv) (sp->eyeProjection, 2, GL_FALSE, sb->eyeProjection[EyeLeft]);
+	GL_COUNT (gc, GLCallUniform);
+	sp->serial = sb->serial;
+    }
+
+    (*sb->uniform3f) (sp->paint, opacity, brightness, saturation);
+    GL_COUNT (gc, GLCallUniform);
+
+    countedVertexPointer (gc, 3, GL_FLOAT, stride, w->vertices + w->vertexStride - 3);
+    countedTexCoordPointer (gc, 2, GL_FLOAT, stride, w->vertices);
+    countedDrawElements (gc, GL_TRIANGLES, nQuads * 6, GL_UNSIGNED_INT, ls->indices);
+
+    (*sb->useProgram) (0);
+    GL_COUNT (gc, GLCallFragment);
+}
@@ -0,0 +1,261 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Depth strategies of the floating windows. A strategy only picks a
+ * depth per window, into layoutTarget; layoutWindows compares it with
+ * the depth the window was placed at and moves just the windows whose
+ * depth changed. Depths are distances into the screen, from the
+ * background depth to the foreground (-foregroundCurrZ). */
+
+#include "stereo3d.h"
+
+// bands of LayoutDepthBands, the topmost window is in the front one
+#define LAYOUT_BANDS 4
+
+// layout passes caused by window events between two logged summaries
+#define LAYOUT_STATS_INTERVAL 100
+
+typedef void (*LayoutStrategyProc) (AnimationManager *animationMgr,
+				    Stereo3DWindow   **floating,
+				    int              nFloating,
+				    float            depth,
+				    float            front);
+
+static void
+layoutStackLinear (AnimationManager *animationMgr,
+		   Stereo3DWindow   **floating,
+		   int              nFloating,
+		   float            depth,
+		   float            front)
+{
+    float step = (depth - front) / (float) (nFloating > 0 ? nFloating : 1);
+
+    for (int i = 0; i < nFloating; i++)
+    {
+	float wndDepth = depth - (float) (i + 1) * step;
+
+	floating[i]->layoutTarget = wndDepth > depth ? depth : wndDepth;
+    }
+}
+
+/* Raising a window moves nothing, a focus change only the two windows */
+static void
+layoutFocusForward (AnimationManager *animationMgr,
+		    Stereo3DWindow   **floating,
+		    int              nFloating,
+		    float            depth,
+		    float            front)
+{
+    float plane = (depth + front) / 2.0f;
+
+    for (int i = 0; i < nFloating; i++)
+	floating[i]->layoutTarget = floating[i] == animationMgr->focusWindow ? front : plane;
+}
+
+/* Stack-linear over applications ordered by their topmost window, so
+ * raising a window of the application on top moves nothing. The slots
+ * are those of the last index rebuild, see assignLayoutGroups. */
+static void
+layoutAppGroups (AnimationManager *animationMgr,
+		 Stereo3DWindow   **floating,
+		 int              nFloating,
+		 float            depth,
+		 float            front)
+{
+    int   i, nGroups = 0;
+    float step;
+
+    for (i = 0; i < nFloating; i++)
+	if (floating[i]->layoutSlot >= nGroups)
+	    nGroups = floating[i]->layoutSlot + 1;
+
+    step = (depth - front) / (float) (nGroups > 0 ? nGroups : 1);
+
+    for (i = 0; i < nFloating; i++)
+	floating[i]->layoutTarget = front + (float) floating[i]->layoutSlot * step;
+}
+
+/* Band depths do not depend on the window count, mapping or raising a
+ * window moves at most LAYOUT_BANDS windows */
+static void
+layoutDepthBands (AnimationManager *animationMgr,
+		  Stereo3DWindow   **floating,
+		  int              nFloating,
+		  float            depth,
+		  float            front)
+{
+    float step = (depth - front) / (float) LAYOUT_BANDS;
+
+    for (int i = 0; i < nFloating; i++)
+    {
+	int fromTop = nFloating - 1 - i;
+	int band = fromTop < LAYOUT_BANDS - 1 ? fromTop : LAYOUT_BANDS - 1;
+
+	floating[i]->layoutTarget = front + (float) band * step;
+    }
+}
+
+static const struct
+{
+    const char         *name;
+    LayoutStrategyProc proc;
+} strategies[LayoutStrategyCount] = {
+    { "stack-linear", layoutStackLinear },
+    { "focus-forward", layoutFocusForward },
+    { "app-groups", layoutAppGroups },
+    { "depth-bands", layoutDepthBands }
+};
+
+static const char *eventNames[LayoutEventCount] = {
+    "restack",
+    "map",
+    "focus"
+};
+
+/* Sets layoutTarget of the floating windows, bottom-most first */
+void
+assignFloatingDepths (AnimationManager *animationMgr,
+		      Stereo3DWindow   **floating,
+		      int              nFloating,
+		      float            depth)
+{
+    int strategy = animationMgr->strategy;
+
+    if (strategy < 0 || strategy >= LayoutStrategyCount)
+	strategy = LayoutStackLinear;
+
+    (*strategies[strategy].proc) (animationMgr, floating, nFloating, depth,
+				  -animationMgr->foregroundCurrZ);
+}
+
+static unsigned int
+hashGroup (Window group, int size)
+{
+    // Fibonacci hashing, client leaders are often close together
+    return ((unsigned int) group * 2654435761u) & (size - 1);
+}
+
+/* Gives each floating window, bottom-most first, the slot of its group
+ * counted from the top: a window joins the group of the first window
+ * above it of the same application. Only depends on the stacking order,
+ * so it is done when the window index is rebuilt. */
+void
+assignLayoutGroups (LayoutGroupTable *table,
+		    Stereo3DWindow   **floating,
+		    int              nFloating)
+{
+    int size = table->size ? table->size : 16, nGroups = 0;
+
+    // at most half full
+    while (size < 2 * nFloating)
+	size *= 2;
+
+    if (size != table->size)
+    {
+	Window *groups = (Window *) realloc (table->groups, size * sizeof (Window));
+	int    *slots;
+
+	if (groups)
+	    table->groups = groups;
+
+	slots = (int *) realloc (table->slots, size * sizeof (int));
+	if (slots)
+	    table->slots = slots;
+
+	if (!groups || !slots)
+	{
+	    compLogMessage ("stereo3d", CompLogLevelError,
+			    "unable to allocate application groups, one per window");
+
+	    for (int i = 0; i < nFloating; i++)
+		floating[i]->layoutSlot = nFloating - 1 - i;
+	    return;
+	}
+
+	table->size = size;
+    }
+
+    // None is never a group, windows without a leader are their own
+    memset (table->groups, 0, size * sizeof (Window));
+
+    for (int i = nFloating - 1; i >= 0; i--)
+    {
+	Stereo3DWindow *sow = floating[i];
+	unsigned int   h = hashGroup (sow->layoutGroup, size);
+
+	while (table->groups[h] && table->groups[h] != sow->layoutGroup)
+	    h = (h + 1) & (size - 1);
+
+	if (!table->groups[h])
+	{
+	    table->groups[h] = sow->layoutGroup;
+	    table->slots[h] = nGroups++;
+	}
+
+	sow->layoutSlot = table->slots[h];
+    }
+}
+
+void
+freeLayoutGroups (LayoutGroupTable *table)
+{
+    free (table->groups);
+    free (table->slots);
+    memset (table, 0, sizeof (LayoutGroupTable));
+}
+
+const char *
+getLayoutStrategyName (int strategy)
+{
+    if (strategy < 0 || strategy >= LayoutStrategyCount)
+	strategy = LayoutStackLinear;
+
+    return strategies[strategy].name;
+}
+
+/* Counts a layout pass for each event it handled with the windows it
+ * moved, a pass handling several events is counted for each of them */
+void
+countLayoutPass (LayoutStats  *stats,
+		 unsigned int events,
+		 int          touched,
+		 const char   *strategy)
+{
+    for (int event = 0; event < LayoutEventCount; event++)
+    {
+	if (!(events & LAYOUT_EVENT (event)))
+	    continue;
+
+	stats->events[event]++;
+	stats->touched[event] += touched;
+	if (touched > stats->maxTouched[event])
+	    stats->maxTouched[event] = touched;
+    }
+
+    if (++stats->passes < LAYOUT_STATS_INTERVAL)
+	return;
+
+    for (int event = 0; event < LayoutEventCount; event++)
+    {
+	if (!stats->events[event])
+	    continue;
+
+	compLogMessage ("stereo3d", CompLogLevelInfo,
+			"%s layout: %u %s events moved %.1f windows on average, %d at most",
+			strategy, stats->events[event], eventNames[event],
+			(float) stats->touched[event] / stats->events[event],
+			stats->maxTouched[event]);
+    }
+
+    memset (stats, 0, sizeof (LayoutStats));
+}
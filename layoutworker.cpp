@@ -0,0 +1,675 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The window layout on a worker thread. preparePaint takes the buffer
+ * published last as the front one of the frame and posts the frame's
+ * inputs; the worker lays out the windows with them while the frame is
+ * drawn and publishes the result into the other buffer, which the next
+ * frame takes. The layout is one frame behind the synchronous one.
+ *
+ * The worker only takes inputs posted with the buffer published last as
+ * their front, so it never writes the buffer the compositor took after
+ * that: reading a buffer needs no lock. The inputs are handed over under
+ * a mutex, held only to swap them. */
+
+#include "stereo3d.h"
+
+static bool
+growArray (void **array, int *size, int needed, size_t elementSize)
+{
+    void *grown;
+    int  newSize;
+
+    if (needed <= *size)
+	return true;
+
+    newSize = *size ? *size : 64;
+    while (newSize < needed)
+	newSize *= 2;
+
+    grown = realloc (*array, newSize * elementSize);
+    if (!grown)
+	return false;
+
+    *array = grown;
+    *size = newSize;
+
+    return true;
+}
+
+/* The per-type arrays hold every window at most */
+static bool
+growWindowArrays (LayoutWorker *lw, int needed)
+{
+    Stereo3DWindow **grown;
+
+    if (needed <= lw->arraysSize)
+	return true;
+
+    needed *= 2;
+
+    grown = (Stereo3DWindow **) realloc (lw->background, needed * sizeof (Stereo3DWindow *));
+    if (!grown)
+	return false;
+    lw->background = grown;
+
+    grown = (Stereo3DWindow **) realloc (lw->dock, needed * sizeof (Stereo3DWindow *));
+    if (!grown)
+	return false;
+    lw->dock = grown;
+
+    grown = (Stereo3DWindow **) realloc (lw->floating, needed * sizeof (Stereo3DWindow *));
+    if (!grown)
+	return false;
+    lw->floating = grown;
+
+    lw->arraysSize = needed;
+
+    return true;
+}
+
+/* The part of a window's state the layout reads and writes */
+static void
+copyLayoutState (Stereo3DWindow       *dst,
+		 const Stereo3DWindow *src)
+{
+    dst->currAttrs = src->currAttrs;
+    dst->dstAttrs = src->dstAttrs;
+    dst->drawMouse = src->drawMouse;
+    dst->opacity = src->opacity;
+    dst->saturation = src->saturation;
+    dst->brightness = src->brightness;
+    dst->floatingType = src->floatingType;
+    dst->layoutAssigned = src->layoutAssigned;
+    dst->layoutMoving = src->layoutMoving;
+    dst->layoutDepth = src->layoutDepth;
+    dst->layoutTarget = src->layoutTarget;
+    dst->layoutGroup = src->layoutGroup;
+    dst->layoutSlot = src->layoutSlot;
+    dst->workerSerial = src->workerSerial;
+}
+
+/* The state stereo3dInitWindow gives a new window */
+static void
+resetShadow (Stereo3DWindow *shadow, unsigned int serial)
+{
+    memset (shadow, 0, sizeof (Stereo3DWindow));
+
+    shadow->floatingType = FTNONE;
+    shadow->currAttrs.scale = 1.0f;
+    shadow->dstAttrs.scale = 1.0f;
+    shadow->workerSlot = -1;
+    shadow->workerSerial = serial;
+}
+
+static Stereo3DWindow *
+getShadow (LayoutWorker *lw, int slot)
+{
+    return slot >= 0 && slot < lw->nShadows ? lw->shadows[slot] : NULL;
+}
+
+/* Worker side of updateWindowIndex: the window types and groups of the
+ * posted stack, windows new to their slot start from scratch */
+static bool
+updateShadows (LayoutWorker *lw, const LayoutInput *in)
+{
+    int nShadows = lw->nShadows;
+    int size = lw->nShadows;
+
+    for (int i = 0; i < in->nWindows; i++)
+	if (in->windows[i].slot >= nShadows)
+	    nShadows = in->windows[i].slot + 1;
+
+    if (!growArray ((void **) &lw->shadows, &size, nShadows, sizeof (Stereo3DWindow *)))
+	return false;
+
+    for (int i = lw->nShadows; i < size; i++)
+	lw->shadows[i] = NULL;
+    lw->nShadows = nShadows;
+
+    if (!growWindowArrays (lw, in->nWindows))
+	return false;
+
+    lw->nBackground = 0;
+    lw->nDock = 0;
+    lw->nFloating = 0;
+
+    for (int slot = 0; slot < lw->nShadows; slot++)
+	if (lw->shadows[slot])
+	    lw->shadows[slot]->drawMouse = false;
+
+    for (int i = 0; i < in->nWindows; i++)
+    {
+	const LayoutInputWindow *iw = &in->windows[i];
+	Stereo3DWindow          *shadow = lw->shadows[iw->slot];
+
+	if (!shadow)
+	{
+	    shadow = (Stereo3DWindow *) malloc (sizeof (Stereo3DWindow));
+	    if (!shadow)
+		return false;
+
+	    resetShadow (shadow, iw->serial);
+	    lw->shadows[iw->slot] = shadow;
+	}
+	else if (shadow->workerSerial != iw->serial)
+	{
+	    resetShadow (shadow, iw->serial);
+	}
+
+	if (iw->floatingType != shadow->floatingType)
+	    shadow->layoutAssigned = false;
+
+	shadow->floatingType = iw->floatingType;
+	shadow->layoutGroup = iw->group;
+
+	switch (shadow->floatingType) {
+	case FTBACKGROUND:
+	    lw->background[lw->nBackground++] = shadow;
+	    break;
+	case FTDOCK:
+	    lw->dock[lw->nDock++] = shadow;
+	    break;
+	case FTWINDOW:
+	    lw->floating[lw->nFloating++] = shadow;
+	    break;
+	default:
+	    shadow->opacity = 1.0f;
+	    shadow->brightness = 1.0f;
+	    shadow->saturation = 1.0f;
+	    break;
+	}
+    }
+
+    assignLayoutGroups (&lw->groups, lw->floating, lw->nFloating);
+
+    // the cursor was unhooked above
+    lw->animationMgr.cursorWindow = NULL;
+    lw->animationMgr.layoutSettled = false;
+
+    return true;
+}
+
+static void
+publishLayout (LayoutWorker *lw, unsigned int events, int touched)
+{
+    AnimationManager *animationMgr = &lw->animationMgr;
+    int              back = 1 - __sync_fetch_and_add (&lw->published, 0);
+    LayoutBuffer     *buffer = &lw->buffers[back];
+
+    if (!growArray ((void **) &buffer->windows, &buffer->size, lw->nShadows,
+		    sizeof (LayoutResult)))
+	return;
+
+    for (int slot = 0; slot < lw->nShadows; slot++)
+    {
+	Stereo3DWindow *shadow = lw->shadows[slot];
+	LayoutResult   *result = &buffer->windows[slot];
+
+	if (!shadow)
+	{
+	    result->serial = 0;
+	    continue;
+	}
+
+	result->serial = shadow->workerSerial;
+	result->attrs = shadow->currAttrs;
+	result->opacity = shadow->opacity;
+	result->brightness = shadow->brightness;
+	result->saturation = shadow->saturation;
+	result->drawMouse = shadow->drawMouse;
+    }
+
+    buffer->nWindows = lw->nShadows;
+    buffer->foregroundZ = animationMgr->foregroundCurrZ;
+    buffer->cursorZ = animationMgr->cursorCurrZ;
+    buffer->sequence = ++lw->sequence;
+    buffer->events = events;
+    buffer->touched = touched;
+    buffer->animated = animationMgr->animatedWindows;
+    buffer->strategy = animationMgr->strategy;
+
+    // a full barrier, the buffer is complete before it is seen
+    __sync_bool_compare_and_swap (&lw->published, 1 - back, back);
+}
+
+/* One layout pass with the inputs in lw->work */
+static void
+layOutFrame (LayoutWorker *lw)
+{
+    AnimationManager *animationMgr = &lw->animationMgr;
+    LayoutInput      *in = &lw->work;
+    Stereo3DWindow   *focusWindow;
+    unsigned int     events, passes;
+    float            foregroundZ, cursorZ;
+    int              touched;
+
+    if (in->windowsChanged && !updateShadows (lw, in))
+    {
+	// left out until the next rebuild of the index
+	lw->nBackground = 0;
+	lw->nDock = 0;
+	lw->nFloating = 0;
+    }
+
+    focusWindow = getShadow (lw, in->focusSlot);
+    if (focusWindow != animationMgr->focusWindow)
+    {
+	animationMgr->focusWindow = focusWindow;
+	animationMgr->layoutEvents |= LAYOUT_EVENT (LayoutEventFocus);
+    }
+
+    animationMgr->layoutEvents |= in->events;
+    animationMgr->strategy = in->strategy;
+    animationMgr->foregroundDstZ = in->foregroundDstZ;
+
+    if (in->finish)
+    {
+	for (int slot = 0; slot < lw->nShadows; slot++)
+	    if (lw->shadows[slot])
+		lw->shadows[slot]->currAttrs = lw->shadows[slot]->dstAttrs;
+
+	animationMgr->foregroundCurrZ = animationMgr->foregroundDstZ;
+	animationMgr->cursorCurrZ = animationMgr->cursorDstZ;
+	animationMgr->layoutSettled = false;
+    }
+
+    events = animationMgr->layoutEvents;
+    passes = animationMgr->layoutPasses;
+    foregroundZ = animationMgr->foregroundCurrZ;
+    cursorZ = animationMgr->cursorCurrZ;
+
+    touched = layoutWindows (animationMgr,
+			     lw->background, lw->nBackground,
+			     lw->dock, lw->nDock,
+			     lw->floating, lw->nFloating,
+			     getShadow (lw, in->pointerSlot),
+			     in->depth, in->lightingStrength);
+
+    // a settled layout has nothing new to publish
+    if (passes != animationMgr->layoutPasses || in->windowsChanged || in->finish ||
+	foregroundZ != animationMgr->foregroundCurrZ || cursorZ != animationMgr->cursorCurrZ)
+	publishLayout (lw, events, touched);
+}
+
+static void
+swapLayoutInputs (LayoutInput *a,
+		  LayoutInput *b)
+{
+    LayoutInput tmp = *a;
+
+    *a = *b;
+    *b = tmp;
+}
+
+static void *
+runLayoutWorker (void *data)
+{
+    LayoutWorker *lw = (LayoutWorker *) data;
+
+    for (;;)
+    {
+	pthread_mutex_lock (&lw->mutex);
+
+	while (!lw->quit && !(lw->posted &&
+				  lw->input.front == __sync_fetch_and_add (&lw->published, 0)))
+	    pthread_cond_wait (&lw->cond, &lw->mutex);
+
+	if (lw->quit)
+	{
+	    pthread_mutex_unlock (&lw->mutex);
+	    break;
+	}
+
+	swapLayoutInputs (&lw->work, &lw->input);
+	lw->posted = false;
+
+	pthread_mutex_unlock (&lw->mutex);
+
+	layOutFrame (lw);
+    }
+
+    return NULL;
+}
+
+/* Empties the window list of the next post, see updateWindowIndex */
+void
+clearLayoutWindows (LayoutWorker *lw)
+{
+    lw->next.nWindows = 0;
+    lw->next.windowsChanged = true;
+}
+
+/* Appends sow to the window list of the next post. A window that does
+ * not fit is left out of the layout until the next index rebuild. */
+void
+addLayoutWindow (LayoutWorker   *lw,
+		 Stereo3DWindow *sow)
+{
+    LayoutInputWindow *iw;
+
+    if (sow->workerSlot < 0 ||
+	!growArray ((void **) &lw->next.windows, &lw->next.size, lw->next.nWindows + 1,
+		    sizeof (LayoutInputWindow)))
+	return;
+
+    iw = &lw->next.windows[lw->next.nWindows++];
+    iw->slot = sow->workerSlot;
+    iw->serial = sow->workerSerial;
+    iw->floatingType = sow->floatingType;
+    iw->group = sow->layoutGroup;
+}
+
+void
+allocLayoutSlot (LayoutWorker   *lw,
+		 Stereo3DWindow *sow)
+{
+    if (lw->nFreeSlots)
+	sow->workerSlot = lw->freeSlots[--lw->nFreeSlots];
+    else
+	sow->workerSlot = lw->nSlots++;
+
+    // 0 marks an empty result
+    if (!++lw->serial)
+	++lw->serial;
+    sow->workerSerial = lw->serial;
+}
+
+void
+releaseLayoutSlot (LayoutWorker   *lw,
+		   Stereo3DWindow *sow)
+{
+    // a slot that cannot be kept for reuse is not used again
+    if (sow->workerSlot >= 0 &&
+	growArray ((void **) &lw->freeSlots, &lw->freeSlotsSize, lw->nFreeSlots + 1,
+		   sizeof (int)))
+	lw->freeSlots[lw->nFreeSlots++] = sow->workerSlot;
+
+    sow->workerSlot = -1;
+}
+
+static void
+freeLayoutInput (LayoutInput *in)
+{
+    free (in->windows);
+    memset (in, 0, sizeof (LayoutInput));
+}
+
+/* Frees what the worker had, keeping the slots of the windows */
+static void
+freeLayoutWorker (LayoutWorker *lw)
+{
+    for (int slot = 0; slot < lw->nShadows; slot++)
+	free (lw->shadows[slot]);
+
+    free (lw->shadows);
+    free (lw->background);
+    free (lw->dock);
+    free (lw->floating);
+    freeLayoutGroups (&lw->groups);
+    free (lw->buffers[0].windows);
+    free (lw->buffers[1].windows);
+
+    freeLayoutInput (&lw->next);
+    freeLayoutInput (&lw->input);
+    freeLayoutInput (&lw->work);
+
+    lw->shadows = NULL;
+    lw->nShadows = 0;
+    lw->background = lw->dock = lw->floating = NULL;
+    lw->arraysSize = 0;
+    lw->nBackground = lw->nDock = lw->nFloating = 0;
+    memset (lw->buffers, 0, sizeof (lw->buffers));
+}
+
+/* Starts the worker from the current layout of the windows, unless it
+ * runs already or failed to start before. Returns whether it runs. */
+bool
+startLayoutWorker (CompScreen   *s,
+		   LayoutWorker *lw)
+{
+    CompWindow *w;
+    int        size = 0;
+
+    STEREO3D_SCREEN (s);
+
+    if (lw->running)
+	return true;
+    if (lw->failed)
+	return false;
+
+    if (!growArray ((void **) &lw->shadows, &size, lw->nSlots, sizeof (Stereo3DWindow *)))
+	goto fail;
+
+    memset (lw->shadows, 0, size * sizeof (Stereo3DWindow *));
+    lw->nShadows = lw->nSlots;
+
+    clearLayoutWindows (lw);
+
+    for (w = s->windows; w; w = w->next)
+    {
+	STEREO3D_WINDOW (w);
+
+	if (sow->workerSlot < 0)
+	    continue;
+
+	lw->shadows[sow->workerSlot] = (Stereo3DWindow *) malloc (sizeof (Stereo3DWindow));
+	if (!lw->shadows[sow->workerSlot])
+	    goto fail;
+
+	resetShadow (lw->shadows[sow->workerSlot], sow->workerSerial);
+	copyLayoutState (lw->shadows[sow->workerSlot], sow);
+	addLayoutWindow (lw, sow);
+    }
+
+    // the worker's window pointers are to its own copies
+    lw->animationMgr = sos->animationMgr;
+    lw->animationMgr.focusWindow = NULL;
+    lw->animationMgr.cursorWindow = NULL;
+    lw->animationMgr.layoutPointerWindow = NULL;
+    lw->animationMgr.layoutEvents = 0;
+    lw->animationMgr.layoutSettled = false;
+    sos->animationMgr.cursorWindow = NULL;
+
+    for (int i = 0; i < 2; i++)
+    {
+	lw->buffers[i].foregroundZ = sos->animationMgr.foregroundCurrZ;
+	lw->buffers[i].cursorZ = sos->animationMgr.cursorCurrZ;
+    }
+
+    lw->front = 0;
+    lw->published = 0;
+    lw->acquiredSequence = 0;
+    lw->sequence = 0;
+    lw->posted = false;
+    lw->quit = false;
+
+    pthread_mutex_init (&lw->mutex, NULL);
+    pthread_cond_init (&lw->cond, NULL);
+
+    if (pthread_create (&lw->thread, NULL, runLayoutWorker, lw))
+    {
+	pthread_mutex_destroy (&lw->mutex);
+	pthread_cond_destroy (&lw->cond);
+	goto fail;
+    }
+
+    lw->running = true;
+
+    return true;
+
+fail:
+    compLogMessage ("stereo3d", CompLogLevelError,
+		    "unable to start the layout worker, laying out on the compositor thread");
+    freeLayoutWorker (lw);
+    lw->failed = true;
+
+    return false;
+}
+
+/* Stops the worker. With restore the windows take over its layout
+ * state, so the synchronous layout carries on from where it was. */
+void
+stopLayoutWorker (CompScreen   *s,
+		  LayoutWorker *lw,
+		  bool         restore)
+{
+    CompWindow *w;
+
+    STEREO3D_SCREEN (s);
+
+    if (!lw->running)
+	return;
+
+    pthread_mutex_lock (&lw->mutex);
+    lw->quit = true;
+    pthread_cond_signal (&lw->cond);
+    pthread_mutex_unlock (&lw->mutex);
+
+    pthread_join (lw->thread, NULL);
+    pthread_mutex_destroy (&lw->mutex);
+    pthread_cond_destroy (&lw->cond);
+
+    lw->running = false;
+
+    if (restore)
+    {
+	for (w = s->windows; w; w = w->next)
+	{
+	    STEREO3D_WINDOW (w);
+
+	    Stereo3DWindow *shadow = getShadow (lw, sow->workerSlot);
+
+	    if (shadow && shadow->workerSerial == sow->workerSerial)
+		copyLayoutState (sow, shadow);
+	}
+
+	sos->animationMgr.foregroundCurrZ = lw->animationMgr.foregroundCurrZ;
+	sos->animationMgr.cursorCurrZ = lw->animationMgr.cursorCurrZ;
+	sos->animationMgr.cursorWindow = NULL;
+	sos->animationMgr.layoutSettled = false;
+	sos->windowIndexDirty = true;
+    }
+
+    freeLayoutWorker (lw);
+}
+
+/* Takes the buffer published last for the frame and posts the frame's
+ * inputs to the worker */
+void
+postLayoutFrame (CompScreen   *s,
+		 LayoutWorker *lw,
+		 float        depth,
+		 float        lightingStrength)
+{
+    AnimationManager *animationMgr;
+    LayoutBuffer     *buffer;
+    CompWindow       *active;
+    LayoutInput      *next = &lw->next;
+
+    STEREO3D_SCREEN (s);
+
+    animationMgr = &sos->animationMgr;
+
+    lw->front = __sync_fetch_and_add (&lw->published, 0);
+    buffer = &lw->buffers[lw->front];
+
+    // the foreground actions keep within it
+    animationMgr->backgroundDepth = depth;
+
+    // the pointer is eased here, the depths come from the worker
+    updateMousePosition (animationMgr);
+    animationMgr->foregroundCurrZ = buffer->foregroundZ;
+    animationMgr->cursorCurrZ = buffer->cursorZ;
+
+    if (buffer->sequence != lw->acquiredSequence)
+    {
+	lw->acquiredSequence = buffer->sequence;
+
+	HOOK_COUNT_N (&sos->hookCounters, HookLayoutWindow, buffer->animated);
+
+	if (buffer->events && stereo3dGetLayoutStats (s->display))
+	    countLayoutPass (&sos->layoutStats, buffer->events, buffer->touched,
+			     getLayoutStrategyName (buffer->strategy));
+    }
+
+    active = s->display->activeWindow ? findWindowAtScreen (s, s->display->activeWindow) : NULL;
+
+    next->front = lw->front;
+    next->depth = depth;
+    next->lightingStrength = lightingStrength;
+    next->foregroundDstZ = animationMgr->foregroundDstZ;
+    next->strategy = stereo3dGetLayoutStrategy (s->display);
+    next->events |= animationMgr->layoutEvents;
+    next->focusSlot = active ? GET_STEREO3D_WINDOW (active, sos)->workerSlot : -1;
+    next->pointerSlot = sos->pointerWindow ? sos->pointerWindow->workerSlot : -1;
+
+    animationMgr->layoutEvents = 0;
+
+    pthread_mutex_lock (&lw->mutex);
+
+    // an input the worker has not taken yet is replaced, keeping its
+    // events and its window list unless there is a newer one
+    if (lw->posted)
+    {
+	next->events |= lw->input.events;
+	next->finish |= lw->input.finish;
+
+	if (!next->windowsChanged && lw->input.windowsChanged)
+	{
+	    LayoutInputWindow *windows = next->windows;
+	    int               size = next->size;
+
+	    next->windows = lw->input.windows;
+	    next->nWindows = lw->input.nWindows;
+	    next->size = lw->input.size;
+	    next->windowsChanged = true;
+
+	    lw->input.windows = windows;
+	    lw->input.size = size;
+	}
+    }
+
+    swapLayoutInputs (&lw->input, next);
+    lw->posted = true;
+
+    pthread_cond_signal (&lw->cond);
+    pthread_mutex_unlock (&lw->mutex);
+
+    next->events = 0;
+    next->finish = false;
+    next->windowsChanged = false;
+}
+
+/* Gives sow the layout of the frame's buffer, from paintWindow. A
+ * window the buffer has no result for yet keeps its state. */
+void
+applyLayoutResult (LayoutWorker   *lw,
+		   Stereo3DWindow *sow)
+{
+    const LayoutBuffer *buffer = &lw->buffers[lw->front];
+    const LayoutResult *result;
+
+    if (sow->workerSlot < 0 || sow->workerSlot >= buffer->nWindows)
+	return;
+
+    result = &buffer->windows[sow->workerSlot];
+    if (result->serial != sow->workerSerial)
+	return;
+
+    sow->currAttrs = result->attrs;
+    sow->opacity = result->opacity;
+    sow->brightness = result->brightness;
+    sow->saturation = result->saturation;
+    sow->drawMouse = result->drawMouse;
+}
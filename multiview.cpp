@@ -0,0 +1,446 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Lenticular output. Autostereoscopic panels show a different view
+ * through each lens position, selected per subpixel. The output is
+ * painted once per view, with the cameras spread evenly between the
+ * left and the right eye of the two eye modes, into one layer each of
+ * a texture array at a fraction of the screen size. The layers are then
+ * interleaved into the back buffer: every subpixel shows the view its
+ * position under the slanted lenses maps to. Needs OpenGL 3.0 for
+ * texture arrays. */
+
+#include "stereo3d.h"
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#endif
+#ifndef GL_COLOR_ATTACHMENT0
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#endif
+#ifndef GL_FRAMEBUFFER_COMPLETE
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+// passes between two logged view timings
+#define MULTIVIEW_STATS_INTERVAL 300
+
+static const char *interleaveVertexSource =
+    "#version 130\n"
+    "void main ()\n"
+    "{\n"
+    "    gl_Position = gl_Vertex;\n"
+    "}\n";
+
+/* lens is the pitch in subpixels, the horizontal subpixels the lenses
+ * shift by per row and the subpixel offset of the first lens; screen
+ * the size in pixels and the view count. Rows count from the top. */
+static const char *interleaveFragmentSource =
+    "#version 130\n"
+    "uniform sampler2DArray views;\n"
+    "uniform vec3 lens;\n"
+    "uniform vec3 screen;\n"
+    "uniform int invert;\n"
+    "float subpixelView (float column, float row)\n"
+    "{\n"
+    "    float phase = fract ((column + lens.z - row * lens.y) / lens.x);\n"
+    "    float view = min (floor (phase * screen.z), screen.z - 1.0);\n"
+    "    return invert != 0 ? screen.z - 1.0 - view : view;\n"
+    "}\n"
+    "void main ()\n"
+    "{\n"
+    "    vec2 coord = gl_FragCoord.xy / screen.xy;\n"
+    "    float column = 3.0 * floor (gl_FragCoord.x);\n"
+    "    float row = screen.y - 1.0 - floor (gl_FragCoord.y);\n"
+    "    gl_FragColor = vec4 (texture (views, vec3 (coord, subpixelView (column, row))).r,\n"
+    "                         texture (views, vec3 (coord, subpixelView (column + 1.0, row))).g,\n"
+    "                         texture (views, vec3 (coord, subpixelView (column + 2.0, row))).b,\n"
+    "                         1.0);\n"
+    "}\n";
+
+static bool
+loadMultiViewFunctions (CompScreen *s, MultiView *mv)
+{
+    const char *version = (const char *) glGetString (GL_VERSION);
+    int        major, minor;
+
+    if (!version || sscanf (version, "%d.%d", &major, &minor) != 2)
+	return false;
+
+    // texture arrays, glFramebufferTextureLayer and GLSL 1.30
+    if (!s->fbo || major < 3)
+	return false;
+
+    mv->genFramebuffers = s->genFramebuffers;
+    mv->deleteFramebuffers = s->deleteFramebuffers;
+    mv->bindFramebuffer = s->bindFramebuffer;
+    mv->checkFramebufferStatus = s->checkFramebufferStatus;
+
+#define LOAD(member, type, name) \
+    mv->member = (type) (*s->getProcAddress) ((GLubyte *) name)
+
+    LOAD (framebufferTextureLayer, GLFramebufferTextureLayerProc, "glFramebufferTextureLayer");
+
+    // timer queries are 3.3's, the views are timed on the CPU only before
+    if (major > 3 || minor >= 3)
+    {
+	LOAD (genQueries, GLGenQueriesProc, "glGenQueries");
+	LOAD (deleteQueries, GLDeleteQueriesProc, "glDeleteQueries");
+	LOAD (beginQuery, GLBeginQueryProc, "glBeginQuery");
+	LOAD (endQuery, GLEndQueryProc, "glEndQuery");
+	LOAD (getQueryObjectuiv, GLGetQueryObjectuivProc, "glGetQueryObjectuiv");
+    }
+
+#undef LOAD
+
+    mv->timerQueries = mv->genQueries && mv->deleteQueries && mv->beginQuery &&
+		       mv->endQuery && mv->getQueryObjectuiv;
+
+    return mv->framebufferTextureLayer != NULL;
+}
+
+/* Looks up the entry points once and spreads nViews cameras between the
+ * eyes. False without OpenGL 3.0 or after the views could not be set up. */
+bool
+initMultiView (CompScreen *s, MultiView *mv, int nViews)
+{
+    if (!mv->loaded)
+    {
+	mv->loaded = true;
+	mv->supported = loadMultiViewFunctions (s, mv);
+
+	if (!mv->supported)
+	    compLogMessage ("stereo3d", CompLogLevelInfo,
+			    "OpenGL 3.0 is not available, lenticular output is drawn in 2.5D");
+	else if (mv->timerQueries)
+	    (*mv->genQueries) (2 * MULTIVIEW_MAX_VIEWS, mv->queries[0]);
+    }
+
+    if (nViews < 2)
+	nViews = 2;
+    if (nViews > MULTIVIEW_MAX_VIEWS)
+	nViews = MULTIVIEW_MAX_VIEWS;
+
+    mv->nViews = nViews;
+    for (int view = 0; view < nViews; view++)
+	mv->offsets[view] = 2.0f * view / (nViews - 1) - 1.0f;
+
+    return mv->supported && !mv->failed;
+}
+
+static void
+freeViews (MultiView *mv)
+{
+    if (mv->texture)
+    {
+	(*mv->deleteFramebuffers) (mv->layers, mv->framebuffers);
+	glDeleteTextures (1, &mv->texture);
+    }
+
+    mv->texture = 0;
+    mv->width = 0;
+    mv->height = 0;
+    mv->layers = 0;
+}
+
+void
+finiMultiView (MultiView *mv, ShaderBackend *sb)
+{
+    if (!mv->supported)
+	return;
+
+    freeViews (mv);
+
+    if (mv->program)
+	(*sb->deleteProgram) (mv->program);
+    mv->program = 0;
+    mv->programFailed = false;
+
+    if (mv->timerQueries)
+	(*mv->deleteQueries) (2 * MULTIVIEW_MAX_VIEWS, mv->queries[0]);
+}
+
+static bool
+allocViews (MultiView *mv, int width, int height, int layers)
+{
+    bool complete = true;
+
+    freeViews (mv);
+
+    glGenTextures (1, &mv->texture);
+    glBindTexture (GL_TEXTURE_2D_ARRAY, mv->texture);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage3D (GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0,
+		  GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture (GL_TEXTURE_2D_ARRAY, 0);
+
+    (*mv->genFramebuffers) (layers, mv->framebuffers);
+
+    for (int i = 0; i < layers; i++)
+    {
+	(*mv->bindFramebuffer) (GL_FRAMEBUFFER, mv->framebuffers[i]);
+	(*mv->framebufferTextureLayer) (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+					mv->texture, 0, i);
+
+	complete = complete &&
+		   (*mv->checkFramebufferStatus) (GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    (*mv->bindFramebuffer) (GL_FRAMEBUFFER, 0);
+
+    mv->width = width;
+    mv->height = height;
+    mv->layers = layers;
+
+    return complete;
+}
+
+/* Adds the GPU times of the views timed with this pass's set of queries
+ * when it last came round, dropped when the GPU has not finished them */
+static void
+readViewQueries (MultiView *mv, int set)
+{
+    GLuint available, ns;
+
+    if (!mv->queryViews[set])
+	return;
+
+    (*mv->getQueryObjectuiv) (mv->queries[set][mv->queryViews[set] - 1],
+			      GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if (available)
+    {
+	for (int view = 0; view < mv->queryViews[set]; view++)
+	{
+	    (*mv->getQueryObjectuiv) (mv->queries[set][view], GL_QUERY_RESULT, &ns);
+	    mv->gpuMs[view] += ns / 1000000.0;
+	}
+	mv->gpuSamples++;
+    }
+
+    mv->queryViews[set] = 0;
+}
+
+/* Sizes the view layers for scale of the screen. False when they are
+ * unusable, the output is then painted in 2.5D. */
+bool
+beginMultiView (CompScreen *s, MultiView *mv, float scale)
+{
+    int width = (int) (s->width * scale);
+    int height = (int) (s->height * scale);
+
+    if (width < 1)
+	width = 1;
+    if (height < 1)
+	height = 1;
+
+    if ((mv->width != width || mv->height != height || mv->layers != mv->nViews) &&
+	!allocViews (mv, width, height, mv->nViews))
+    {
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"unable to render the lenticular views, drawing in 2.5D");
+	freeViews (mv);
+	mv->failed = true;
+	return false;
+    }
+
+    if (mv->timing && mv->timerQueries)
+	readViewQueries (mv, mv->pass & 1);
+
+    return true;
+}
+
+/* Redirects the painting of the output into the view's layer, at the
+ * output's place in it */
+void
+beginView (CompScreen *s, MultiView *mv, CompOutput *output, int view)
+{
+    float sx = (float) mv->width / s->width;
+    float sy = (float) mv->height / s->height;
+
+    STEREO3D_SCREEN (s);
+
+    (*mv->bindFramebuffer) (GL_FRAMEBUFFER, mv->framebuffers[view]);
+
+    // part of switching to the view, like its projection
+    GL_SITE (&sos->glCalls, GLSiteProjection);
+    countedViewport (&sos->glCalls, (int) (output->region.extents.x1 * sx),
+		     (int) ((s->height - output->region.extents.y2) * sy),
+		     (int) (output->width * sx), (int) (output->height * sy));
+
+    if (!mv->timing)
+	return;
+
+    if (mv->timerQueries)
+	(*mv->beginQuery) (GL_TIME_ELAPSED, mv->queries[mv->pass & 1][view]);
+
+    gettimeofday (&mv->viewStart, 0);
+}
+
+void
+endView (MultiView *mv, int view)
+{
+    struct timeval now;
+
+    if (!mv->timing)
+	return;
+
+    if (mv->timerQueries)
+	(*mv->endQuery) (GL_TIME_ELAPSED);
+
+    gettimeofday (&now, 0);
+    mv->cpuMs[view] += (now.tv_sec - mv->viewStart.tv_sec) * 1000.0 +
+		       (now.tv_usec - mv->viewStart.tv_usec) / 1000.0;
+}
+
+static GLuint
+getInterleaveProgram (MultiView *mv, ShaderBackend *sb)
+{
+    if (mv->program || mv->programFailed)
+	return mv->program;
+
+    mv->program = linkShaderProgram (sb, interleaveVertexSource, NULL,
+				     interleaveFragmentSource);
+    if (!mv->program)
+    {
+	mv->programFailed = true;
+	return 0;
+    }
+
+    mv->lens = (*sb->getUniformLocation) (mv->program, "lens");
+    mv->screen = (*sb->getUniformLocation) (mv->program, "screen");
+    mv->invert = (*sb->getUniformLocation) (mv->program, "invert");
+
+    return mv->program;
+}
+
+/* Interleaves the views into the output in the back buffer. pitch is the
+ * lens width in subpixels and slant the subpixels the lenses shift by
+ * per row, invert reverses the order of the views. */
+void
+endMultiView (CompScreen    *s,
+	      MultiView     *mv,
+	      ShaderBackend *sb,
+	      CompOutput    *output,
+	      float         pitch,
+	      float         slant,
+	      float         offset,
+	      bool          invert)
+{
+    GLuint program;
+
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    (*mv->bindFramebuffer) (GL_FRAMEBUFFER, 0);
+
+    GL_SITE (gc, GLSiteFilterSetup);
+    countedViewport (gc, output->region.extents.x1, s->height - output->region.extents.y2,
+		     output->width, output->height);
+
+    if (mv->timing)
+    {
+	mv->queryViews[mv->pass & 1] = mv->timerQueries ? mv->nViews : 0;
+	mv->statsPasses++;
+    }
+    mv->pass++;
+
+    program = getInterleaveProgram (mv, sb);
+    if (!program)
+    {
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"unable to interleave the lenticular views, drawing in 2.5D");
+	mv->failed = true;
+	return;
+    }
+
+    GL_SITE_UNIT (gc, GLSiteFilterSetup);
+
+    (*sb->useProgram) (program);
+    GL_COUNT (gc, GLCallFragment);
+
+    (*sb->uniform3f) (mv->lens, pitch, slant, offset);
+    GL_COUNT (gc, GLCallUniform);
+    (*sb->uniform3f) (mv->screen, s->width, s->height, mv->nViews);
+    GL_COUNT (gc, GLCallUniform);
+    (*sb->uniform1i) (mv->invert, invert ? 1 : 0);
+    GL_COUNT (gc, GLCallUniform);
+
+    countedDisable (gc, GL_BLEND);
+    countedBindTexture (gc, GL_TEXTURE_2D_ARRAY, mv->texture);
+
+    countedBegin (gc, GL_QUADS);
+    countedVertex2f (gc, -1.0f, -1.0f);
+    countedVertex2f (gc, 1.0f, -1.0f);
+    countedVertex2f (gc, 1.0f, 1.0f);
+    countedVertex2f (gc, -1.0f, 1.0f);
+    countedEnd (gc);
+
+    countedBindTexture (gc, GL_TEXTURE_2D_ARRAY, 0);
+
+    (*sb->useProgram) (0);
+    GL_COUNT (gc, GLCallFragment);
+}
+
+/* Logs the average time of each view every MULTIVIEW_STATS_INTERVAL
+ * passes, and warns when the views together take longer than budgetMs */
+void
+reportViewTimes (MultiView *mv, float budgetMs)
+{
+    double cpuMs = 0.0, gpuMs = 0.0;
+
+    if (mv->statsPasses < MULTIVIEW_STATS_INTERVAL)
+	return;
+
+    for (int view = 0; view < mv->nViews; view++)
+    {
+	double viewCpuMs = mv->cpuMs[view] / mv->statsPasses;
+	double viewGpuMs = mv->gpuSamples ? mv->gpuMs[view] / mv->gpuSamples : 0.0;
+
+	compLogMessage ("stereo3d", CompLogLevelInfo,
+			"lenticular view %d of %d at %dx%d: %.2f ms CPU, %.2f ms GPU",
+			view, mv->nViews, mv->width, mv->height, viewCpuMs, viewGpuMs);
+
+	cpuMs += viewCpuMs;
+	gpuMs += viewGpuMs;
+    }
+
+    if (cpuMs > budgetMs || gpuMs > budgetMs)
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"the %d lenticular views take %.2f ms CPU and %.2f ms GPU, "
+			"over the %.2f ms budget of the target frame rate",
+			mv->nViews, cpuMs, gpuMs, budgetMs);
+
+    mv->statsPasses = 0;
+    mv->gpuSamples = 0;
+    memset (mv->cpuMs, 0, sizeof (mv->cpuMs));
+    memset (mv->gpuMs, 0, sizeof (mv->gpuMs));
+}
@@ -0,0 +1,243 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+#include "stereo3d.h"
+
+// frames a level is kept before the governor may step down again
+#define QUALITY_SETTLE_FRAMES 30
+// frames within budget before the governor tries a better level
+#define QUALITY_UP_HOLDOFF 120
+#define QUALITY_UP_HOLDOFF_MAX 3600
+
+static const char *qualityLevelNames[] = {
+    "full",
+    "no smooth edges",
+    "no lighting",
+    "no cursor smoothing",
+    "reduced resolution"
+};
+
+static void
+setQualityLevel (CompScreen *s, QualityGovernor *qg, int level)
+{
+    unsigned long value = level;
+
+    STEREO3D_DISPLAY (s->display);
+
+    // stepping down right after stepping up, wait longer next time
+    if (level > qg->level && qg->steppedUp &&
+        qg->framesSinceChange < 2 * QUALITY_SETTLE_FRAMES)
+    {
+        qg->upHoldoff *= 2;
+        if (qg->upHoldoff > QUALITY_UP_HOLDOFF_MAX)
+            qg->upHoldoff = QUALITY_UP_HOLDOFF_MAX;
+    }
+
+    qg->steppedUp = level < qg->level;
+    qg->level = level;
+    qg->framesSinceChange = 0;
+    qg->nSamples = 0;
+    qg->frameTimeSum = 0.0f;
+
+    compLogMessage ("stereo3d", CompLogLevelInfo, "quality level %d (%s)",
+                    level, qualityLevelNames[level]);
+
+    // published on the root window for monitoring, e.g. with xprop
+    XChangeProperty (s->display->display, s->root, sod->qualityAtom,
+                     XA_CARDINAL, 32, PropModeReplace,
+                     (unsigned char *) &value, 1);
+}
+
+void
+initQualityGovernor (CompScreen *s, QualityGovernor *qg)
+{
+    qg->level = QualityFull;
+    qg->maxLevel = QualityReducedResolution;
+    qg->nSamples = 0;
+    qg->frameTimeSum = 0.0f;
+    qg->framesSinceChange = 0;
+    qg->upHoldoff = QUALITY_UP_HOLDOFF;
+    qg->steppedUp = false;
+
+    qg->reducedTexture = 0;
+    qg->reducedWidth = 0;
+    qg->reducedHeight = 0;
+    qg->reducedTextureWidth = 0;
+    qg->reducedTextureHeight = 0;
+    qg->reducedActive = false;
+}
+
+void
+finiQualityGovernor (CompScreen *s, QualityGovernor *qg)
+{
+    STEREO3D_DISPLAY (s->display);
+
+    if (qg->reducedTexture)
+        glDeleteTextures (1, &qg->reducedTexture);
+    qg->reducedTexture = 0;
+
+    XDeleteProperty (s->display->display, s->root, sod->qualityAtom);
+}
+
+/* Called once per stereo frame with the time since the previous one.
+ * Averages the recent frame times and steps the quality one level down
+ * when they are over budget, or one level up after a hold-off period
+ * within budget. */
+void
+updateQualityGovernor (CompScreen *s, QualityGovernor *qg, int ms, int maxLevel)
+{
+    float budget, average;
+
+    qg->maxLevel = maxLevel;
+
+    if (!stereo3dGetAdaptiveQuality (s->display))
+    {
+        if (qg->level != QualityFull)
+            setQualityLevel (s, qg, QualityFull);
+        return;
+    }
+
+    if (qg->level > maxLevel)
+    {
+        setQualityLevel (s, qg, maxLevel);
+        return;
+    }
+
+    qg->framesSinceChange++;
+    qg->frameTimeSum += ms;
+    qg->nSamples++;
+
+    if (qg->nSamples < QUALITY_SETTLE_FRAMES)
+        return;
+
+    budget = 1000.0f / stereo3dGetTargetFps (s->display);
+    average = qg->frameTimeSum / qg->nSamples;
+
+    qg->nSamples = 0;
+    qg->frameTimeSum = 0.0f;
+
+    if (average > budget * 1.2f)
+    {
+        if (qg->level < maxLevel)
+            setQualityLevel (s, qg, qg->level + 1);
+    }
+    else if (average <= budget * 1.05f)
+    {
+        if (qg->level > QualityFull && qg->framesSinceChange >= qg->upHoldoff)
+            setQualityLevel (s, qg, qg->level - 1);
+    }
+}
+
+/* Redirects the output into a half size viewport, the result is scaled
+ * up to the full output by endReducedResolution. */
+bool
+beginReducedResolution (CompScreen *s, QualityGovernor *qg, CompOutput *output)
+{
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    if (qg->level < QualityReducedResolution)
+        return false;
+
+    GL_SITE (gc, GLSiteOther);
+
+    qg->reducedWidth = output->width / 2;
+    qg->reducedHeight = output->height / 2;
+
+    if (!qg->reducedTexture)
+    {
+        glGenTextures (1, &qg->reducedTexture);
+        countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, qg->reducedTexture);
+        glTexParameteri (GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri (GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri (GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri (GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, 0);
+        qg->reducedTextureWidth = 0;
+        qg->reducedTextureHeight = 0;
+    }
+
+    if (qg->reducedTextureWidth != qg->reducedWidth ||
+        qg->reducedTextureHeight != qg->reducedHeight)
+    {
+        countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, qg->reducedTexture);
+        glTexImage2D (GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGB,
+                      qg->reducedWidth, qg->reducedHeight, 0,
+                      GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, 0);
+        qg->reducedTextureWidth = qg->reducedWidth;
+        qg->reducedTextureHeight = qg->reducedHeight;
+    }
+
+    countedViewport (gc, output->region.extents.x1,
+                     s->height - output->region.extents.y2,
+                     qg->reducedWidth, qg->reducedHeight);
+
+    qg->reducedActive = true;
+
+    return true;
+}
+
+void
+endReducedResolution (CompScreen *s, QualityGovernor *qg, CompOutput *output)
+{
+    int x = output->region.extents.x1;
+    int y = s->height - output->region.extents.y2;
+
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    if (!qg->reducedActive)
+        return;
+
+    qg->reducedActive = false;
+
+    GL_SITE (gc, GLSiteOther);
+
+    countedEnable (gc, GL_TEXTURE_RECTANGLE_ARB);
+    countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, qg->reducedTexture);
+    countedCopyTexSubImage2D (gc, GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, x, y,
+                              qg->reducedWidth, qg->reducedHeight);
+
+    countedViewport (gc, x, y, output->width, output->height);
+
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedPushMatrix (gc);
+    countedLoadIdentity (gc);
+    countedOrtho (gc, 0, 1, 0, 1, -1, 1);
+    countedMatrixMode (gc, GL_MODELVIEW);
+    countedPushMatrix (gc);
+    countedLoadIdentity (gc);
+
+    countedDisable (gc, GL_BLEND);
+    countedColor4f (gc, 1.0f, 1.0f, 1.0f, 1.0f);
+
+    countedBegin (gc, GL_QUADS);
+    countedTexCoord2f (gc, 0, 0);
+    countedVertex2f (gc, 0, 0);
+    countedTexCoord2f (gc, qg->reducedWidth, 0);
+    countedVertex2f (gc, 1, 0);
+    countedTexCoord2f (gc, qg->reducedWidth, qg->reducedHeight);
+    countedVertex2f (gc, 1, 1);
+    countedTexCoord2f (gc, 0, qg->reducedHeight);
+    countedVertex2f (gc, 0, 1);
+    countedEnd (gc);
+
+    countedPopMatrix (gc);
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedPopMatrix (gc);
+    countedMatrixMode (gc, GL_MODELVIEW);
+
+    countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, 0);
+    countedDisable (gc, GL_TEXTURE_RECTANGLE_ARB);
+}
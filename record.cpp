@@ -0,0 +1,190 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Recording of the per-frame inputs of the layout and the projection
+ * setup, in the format given in stereo3d.h. tests/replay.cpp replays
+ * them at full speed. */
+
+#include "stereo3d.h"
+
+static bool
+startRecording (CompScreen *s)
+{
+    RecordHeader header;
+    const char   *path = stereo3dGetRecordFile (s->display);
+    char         name[1024];
+
+    STEREO3D_SCREEN (s);
+
+    // one file per screen
+    if (s->screenNum > 0)
+	snprintf (name, sizeof (name), "%s.%d", path, s->screenNum);
+    else
+	snprintf (name, sizeof (name), "%s", path);
+
+    sos->recordFile = fopen (name, "wb");
+    if (!sos->recordFile)
+    {
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"unable to open %s for recording", name);
+	sos->recordFailed = true;
+	return false;
+    }
+
+    setvbuf (sos->recordFile, NULL, _IOFBF, 1 << 16);
+
+    header.magic = RECORD_MAGIC;
+    header.version = RECORD_VERSION;
+    header.screenWidth = s->width;
+    header.screenHeight = s->height;
+    fwrite (&header, sizeof (header), 1, sos->recordFile);
+
+    // the first frame carries the full window list
+    sos->recordedIndexGeneration = sos->windowIndexGeneration - 1;
+    sos->recordedWindows = 0;
+    sos->recordedFrames = 0;
+
+    compLogMessage ("stereo3d", CompLogLevelInfo, "recording to %s", name);
+
+    return true;
+}
+
+void
+stopRecording (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+
+    if (!sos->recordFile)
+	return;
+
+    fclose (sos->recordFile);
+    sos->recordFile = NULL;
+
+    compLogMessage ("stereo3d", CompLogLevelInfo, "recorded %lu frames",
+		    sos->recordedFrames);
+}
+
+static void
+recordWindows (FILE *file, Stereo3DWindow **windows, int nWindows)
+{
+    RecordWindow rw;
+
+    memset (&rw, 0, sizeof (rw));
+
+    for (int i = 0; i < nWindows; i++)
+    {
+	CompWindow *w = windows[i]->window;
+
+	rw.id = w->id;
+	rw.group = windows[i]->layoutGroup;
+	rw.x = w->attrib.x;
+	rw.y = w->attrib.y;
+	rw.width = w->width;
+	rw.height = w->height;
+	rw.floatingType = windows[i]->floatingType;
+
+	fwrite (&rw, sizeof (rw), 1, file);
+    }
+}
+
+static void
+numberRecordWindows (Stereo3DWindow **windows, int nWindows, int *slot)
+{
+    for (int i = 0; i < nWindows; i++)
+	windows[i]->recordSlot = (*slot)++;
+}
+
+/* Slot of sow in the window list recorded last, -1 for none */
+static int
+getRecordSlot (CompScreen *s, Stereo3DWindow *sow)
+{
+    STEREO3D_SCREEN (s);
+
+    if (!sow || sow->floatingType == FTNONE || sow->recordSlot >= sos->recordedWindows)
+	return -1;
+
+    return sow->recordSlot;
+}
+
+/* Called once per stereo frame, right before the layout. The foreground
+ * actions are captured through the foreground destination they set. */
+void
+recordFrame (CompScreen *s, int ms, float depth, float lightingStrength)
+{
+    const char  *path = stereo3dGetRecordFile (s->display);
+    RecordFrame frame;
+    CompWindow  *active;
+    int         nWindows;
+
+    STEREO3D_SCREEN (s);
+
+    if (!path || !*path)
+    {
+	stopRecording (s);
+	sos->recordFailed = false;
+	return;
+    }
+
+    if (!sos->recordFile && (sos->recordFailed || !startRecording (s)))
+	return;
+
+    nWindows = sos->nBackgroundWindows + sos->nDockWindows + sos->nFloatingWindows;
+
+    memset (&frame, 0, sizeof (frame));
+    frame.ms = ms;
+    frame.pointerX = sos->animationMgr.mouseDst.x;
+    frame.pointerY = sos->animationMgr.mouseDst.y;
+    frame.foregroundDstZ = sos->animationMgr.foregroundDstZ;
+    frame.depth = depth;
+    frame.lightingStrength = lightingStrength;
+    frame.fov = stereo3dGetFov (s->display);
+    frame.strength = stereo3dGetStrength (s->display);
+    frame.outputMode = sos->stereoType;
+
+    if (sos->recordedIndexGeneration != sos->windowIndexGeneration)
+    {
+	frame.flags |= RECORD_FRAME_WINDOWS;
+	frame.nWindows = nWindows < 0xffff ? nWindows : 0xffff;
+    }
+
+    // the slots are those of the windows written right after the frame
+    if (frame.flags & RECORD_FRAME_WINDOWS)
+    {
+	int slot = 0;
+
+	numberRecordWindows (sos->backgroundWindows, sos->nBackgroundWindows, &slot);
+	numberRecordWindows (sos->dockWindows, sos->nDockWindows, &slot);
+	numberRecordWindows (sos->floatingWindows, sos->nFloatingWindows, &slot);
+
+	sos->recordedWindows = frame.nWindows;
+    }
+
+    active = s->display->activeWindow ? findWindowAtScreen (s, s->display->activeWindow) : NULL;
+    frame.focusSlot = getRecordSlot (s, active ? GET_STEREO3D_WINDOW (active, sos) : NULL);
+    frame.pointerSlot = getRecordSlot (s, sos->pointerWindow);
+
+    fwrite (&frame, sizeof (frame), 1, sos->recordFile);
+
+    if (frame.flags & RECORD_FRAME_WINDOWS)
+    {
+	// stacking order within each type is kept, that is all the layout needs
+	recordWindows (sos->recordFile, sos->backgroundWindows, sos->nBackgroundWindows);
+	recordWindows (sos->recordFile, sos->dockWindows, sos->nDockWindows);
+	recordWindows (sos->recordFile, sos->floatingWindows,
+		       sos->nFloatingWindows - (nWindows - frame.nWindows));
+
+	sos->recordedIndexGeneration = sos->windowIndexGeneration;
+    }
+
+    sos->recordedFrames++;
+}
@@ -0,0 +1,198 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Output snapshots. Each eye of one output is painted on its own without
+ * the output filter, then the real frame is painted and read back. The
+ * eyes are composited by the CPU compositor in the current mode and the
+ * result is compared against what the GL filters produced. The eye
+ * images, both composites and a side-by-side image are written as PPM
+ * next to the snapshot_file prefix. */
+
+#include "stereo3d.h"
+
+// channel difference still counted as a match, covers rounding and blending order
+#define SNAPSHOT_TOLERANCE 8
+
+/* Reads the output from the back buffer into a new image, top row first */
+bool
+readOutputImage (CompScreen *s, CompOutput *output, CpuImage *image)
+{
+    int width = output->width;
+    int height = output->height;
+
+    if (!allocCpuImage (image, width, height))
+	return false;
+
+    glPixelStorei (GL_PACK_ALIGNMENT, 4);
+    glReadPixels (output->region.extents.x1, s->height - output->region.extents.y2,
+		  width, height, GL_RGBA, GL_UNSIGNED_BYTE, image->data);
+
+    // GL rows are bottom-up
+    image->pixels = image->data + (height - 1) * width * 4;
+    image->stride = -width * 4;
+
+    return true;
+}
+
+static void
+writePPM (const char *prefix, const char *name, const CpuImage *image)
+{
+    char path[1024];
+    FILE *file;
+    int  x, y;
+
+    snprintf (path, sizeof (path), "%s-%s.ppm", prefix, name);
+
+    file = fopen (path, "wb");
+    if (!file)
+    {
+	compLogMessage ("stereo3d", CompLogLevelWarn, "unable to write %s", path);
+	return;
+    }
+
+    fprintf (file, "P6\n%d %d\n255\n", image->width, image->height);
+
+    for (y = 0; y < image->height; y++)
+    {
+	const unsigned char *row = image->pixels + y * image->stride;
+
+	for (x = 0; x < image->width; x++)
+	    fwrite (row + x * 4, 1, 3, file);
+    }
+
+    fclose (file);
+}
+
+static double
+compositeMs (const CpuImage *left, const CpuImage *right, CpuImage *out, CpuCompositeMode mode)
+{
+    struct timeval before, after;
+
+    gettimeofday (&before, 0);
+    cpuComposite (left, right, out, mode);
+    gettimeofday (&after, 0);
+
+    return (after.tv_sec - before.tv_sec) * 1000.0 +
+	   (after.tv_usec - before.tv_usec) / 1000.0;
+}
+
+static void
+compareImages (const CpuImage *cpu, const CpuImage *gpu)
+{
+    unsigned long mismatches = 0;
+    unsigned long total = 0;
+    int           maxDiff = 0;
+    int           x, y, c;
+
+    for (y = 0; y < cpu->height; y++)
+    {
+	const unsigned char *a = cpu->pixels + y * cpu->stride;
+	const unsigned char *b = gpu->pixels + y * gpu->stride;
+
+	for (x = 0; x < cpu->width; x++)
+	{
+	    bool match = true;
+
+	    for (c = 0; c < 3; c++)
+	    {
+		int diff = abs (a[x * 4 + c] - b[x * 4 + c]);
+
+		total += diff;
+		if (diff > maxDiff)
+		    maxDiff = diff;
+		if (diff > SNAPSHOT_TOLERANCE)
+		    match = false;
+	    }
+
+	    if (!match)
+		mismatches++;
+	}
+    }
+
+    compLogMessage ("stereo3d", CompLogLevelInfo,
+		    "snapshot: %lu of %d pixels differ, mean channel difference %.2f, max %d",
+		    mismatches, cpu->width * cpu->height,
+		    (double) total / (3.0 * cpu->width * cpu->height), maxDiff);
+}
+
+/* Composites the captured eyes, compares them with the GL output and
+ * writes the images. stereoType is the output mode the frame was painted
+ * in, the snapshot images are freed. */
+void
+finishSnapshot (CompScreen *s, OutputSnapshot *snap, int stereoType)
+{
+    static const char *modeNames[] = {
+	"anaglyph", "rows", "columns", "side-by-side"
+    };
+    const char        *prefix = stereo3dGetSnapshotFile (s->display);
+    const CpuImage    *left = &snap->left;
+    const CpuImage    *right = &snap->right;
+    CpuImage          out;
+    int               mode;
+
+    // the eye passes follow the invert option, the colour channels do not
+    if (stereo3dGetInvert (s->display))
+    {
+	left = &snap->right;
+	right = &snap->left;
+    }
+
+    if (!allocCpuImage (&out, left->width, left->height))
+    {
+	freeSnapshot (snap);
+	return;
+    }
+
+    writePPM (prefix, "left", left);
+    writePPM (prefix, "right", right);
+    writePPM (prefix, "gpu", &snap->gpu);
+
+    // every mode is timed at this output's size
+    for (mode = CpuAnaglyph; mode <= CpuSideBySide; mode++)
+    {
+	double ms = compositeMs (left, right, &out, (CpuCompositeMode) mode);
+
+	compLogMessage ("stereo3d", CompLogLevelInfo,
+			"snapshot: %s composite of %dx%d took %.2f ms, %.0f Mpixel/s, "
+			"%s kernels",
+			modeNames[mode], out.width, out.height, ms,
+			ms > 0.0 ? out.width * out.height / (ms * 1000.0) : 0.0,
+			getCpuCompositeKernels ());
+
+	// output modes 1 to 3 have a CPU counterpart, lenticular has none
+	if (stereoType <= 3 && mode == stereoType - 1)
+	{
+	    writePPM (prefix, "cpu", &out);
+
+	    if (snap->reduced)
+		compLogMessage ("stereo3d", CompLogLevelInfo,
+				"snapshot: frame was painted at reduced resolution, not compared");
+	    else
+		compareImages (&out, &snap->gpu);
+	}
+
+	if (mode == CpuSideBySide)
+	    writePPM (prefix, "side-by-side", &out);
+    }
+
+    freeCpuImage (&out);
+    freeSnapshot (snap);
+}
+
+void
+freeSnapshot (OutputSnapshot *snap)
+{
+    freeCpuImage (&snap->left);
+    freeCpuImage (&snap->right);
+    freeCpuImage (&snap->gpu);
+}
@@ -17,10 +17,38 @@
 
 int displayPrivateIndex = 0;
 
+static struct timeval pluginLoadTime;
+
 static void
 enableMouseDrawing(CompScreen *s);
 static void
 disableMouseDrawing(CompScreen *s);
+static void
+pollCursorImage(CompScreen *s);
+static void
+requestLatchedPointer(CompScreen *s);
+static void
+updatePointerPosition(CompScreen *s);
+static void
+setPassthrough(CompScreen *s, bool passthrough);
+static void
+selectFilter (CompScreen *s, int mode, bool shaders);
+static float
+getWorldZCorrection (float fov);
+static bool
+captureEyes (CompScreen              *s,
+	     const ScreenPaintAttrib *sa,
+	     const CompTransform     *transform,
+	     Region                  region,
+	     CompOutput              *output,
+	     unsigned int            mask);
+static void
+paintMultiView (CompScreen              *s,
+		const ScreenPaintAttrib *sa,
+		const CompTransform     *transform,
+		Region                  region,
+		CompOutput              *output,
+		unsigned int            mask);
 
 static void
 frustum (GLfloat *m,
@@ -67,19 +95,65 @@ perspective (GLfloat *m,
     frustum (m, xmin + xShift, xmax + xShift, ymin, ymax, zNear, zFar);
 }
 
+/* fov in degrees, maxDisparityInPx is the strength of the stereo effect */
+void
+setupProjections (Stereo3DScreen *sos,
+                  int            stereoType,
+                  float          fov,
+                  float          maxDisparityInPx,
+                  float          screenWidthPx)
+{
+    // distance of near plane
+    float nearval = 0.1f;
+    // distance of far plane
+    float farval = 100.0f;
+    // aspect ratio
+    float aspect = 1.0f;
+
+    float tanfov = 0.5f / tan(fov * M_PI / 360.0);
+
+    // stereo attributes                                0.1    0.577..
+    sos->convergence = (maxDisparityInPx / screenWidthPx) * (nearval/tanfov);
+    sos->parallax = (maxDisparityInPx / screenWidthPx);
+
+    if(stereoType != 0)
+    {
+        //left eye projection matrix
+        perspective (sos->projectionL, fov, aspect, nearval, farval, -sos->convergence);
+
+        //right eye projection matrix
+        perspective (sos->projectionR, fov, aspect, nearval, farval, sos->convergence);
+    }
+
+    // lenticular views, spread between the left and the right eye
+    for (int view = 0; stereoType == 4 && view < sos->multiView.nViews; view++)
+        perspective (sos->multiView.projections[view], fov, aspect, nearval, farval,
+                     sos->multiView.offsets[view] * sos->convergence);
+
+    //zero convergence for 2.5d effect and for windows at zero disparity
+    perspective (sos->projectionM, fov, aspect, nearval, farval, 0.0f);
+}
+
 static void
-stereo3dPreparePaintScreen (CompScreen *s,
-			    int        ms)
+prepareStereoFrame (CompScreen *s,
+		    int        ms)
 {
     STEREO3D_SCREEN (s);
 
-    UNWRAP (sos, s, preparePaintScreen);
-    (*s->preparePaintScreen) (s, ms);
-    WRAP (sos, s, preparePaintScreen, stereo3dPreparePaintScreen);
+    sos->stereoActive = false;
 
     if(!sos->enabled)
         return;
 
+    sos->frameCount++;
+
+    if (sos->windowIndexDirty || sos->viewportX != s->x || sos->viewportY != s->y)
+        updateWindowIndex (s);
+
+    setPassthrough (s, sos->passthroughWindow != NULL);
+    if (sos->passthrough)
+        return;
+
     if(stereo3dGetDrawmouse (s->display))
     {
         if(!sos->mouseDrawingEnabled)
@@ -97,71 +171,101 @@ stereo3dPreparePaintScreen (CompScreen *s,
         } 
     }
 
+    pollCursorImage(s);
+
+    if (sos->mouseDrawingEnabled && sos->pointerSource == PSXINPUT2 && sos->pointerMoved)
+        updatePointerPosition(s);
+
     sos->stereoType = stereo3dGetOutputMode(s->display);
-    switch(sos->stereoType)
-    {
-        case 0:
-            //2.5D, do nothing...
-            sos->currFilter = sos->anaglyphFilter;
-            break;
 
-        case 1:
-            sos->currFilter = sos->anaglyphFilter;
-            break;
+    // the views are interleaved by a GLSL pass, 2.5D without it
+    if (sos->stereoType == 4 &&
+        !(initShaderBackend (s, &sos->shaders) &&
+          initMultiView (s, &sos->multiView, stereo3dGetViews (s->display))))
+        sos->stereoType = 0;
 
-        case 2:
-            sos->interlacedFilter->column = false;
-            sos->currFilter = sos->interlacedFilter;
-            break;
+    bool shaders = stereo3dGetGlsl (s->display) && initShaderBackend (s, &sos->shaders);
+    if (sos->stereoType != sos->filterMode || shaders != sos->filterShaders)
+        selectFilter (s, sos->stereoType, shaders);
 
-        case 3:
-            sos->interlacedFilter->column = true;
-            sos->currFilter = sos->interlacedFilter;
-            break;
-    }
+    bool invert = stereo3dGetInvert (s->display);
+    sos->eyeFilter[EyeLeft] = invert ? 1 : 0;
+    sos->eyeFilter[EyeRight] = invert ? 0 : 1;
+    sos->eyeFilter[EyeSingle] = FILTER_BOTH_EYES;
+    sos->eyeFilter[EyeBoth] = sos->eyeFilter[Cleanup] = -1;
 
-    // distance of near plane
-    float nearval = 0.1f;
-    // distance of far plane
-    float farval = 100.0f;
-    // aspect ratio
-    float aspect = 1.0f;
+    setupProjections (sos, sos->stereoType, stereo3dGetFov(s->display),
+                      stereo3dGetStrength(s->display), s->width);
 
-    float fov = stereo3dGetFov(s->display);
+    if (shaders)
+        setShaderProjections (&sos->shaders, sos->projectionL, sos->projectionR,
+                              sos->projectionM, sos->parallax,
+                              getWorldZCorrection (stereo3dGetFov (s->display)));
 
-    // strength of stereo efect, maximum disparity in px
-    float maxDisparityInPx = stereo3dGetStrength(s->display);
+    sos->layeredStereo = shaders && sos->stereoType >= 1 && sos->stereoType <= 3 &&
+                         stereo3dGetLayeredStereo (s->display) &&
+                         initLayeredStereo (s, &sos->layered);
 
-    // screen width
-    float screenWidthPx = s->width;
 
+    // interlaced and lenticular output already reduce each eye's resolution
+    updateQualityGovernor (s, &sos->quality, ms,
+                           sos->stereoType >= 2 ? QualityNoCursorSmoothing : QualityReducedResolution);
 
-    float tanfov = 0.5f / tan(fov * M_PI / 360.0);
+    float depth = stereo3dGetDepth(s->display);
+    sos->lightingStrength = stereo3dGetLightingStrength(s->display);
+    sos->edgesStrength = stereo3dGetEdgesStrength(s->display);
 
-    // stereo attributes                                0.1    0.577..
-    sos->convergence = (maxDisparityInPx / screenWidthPx) * (nearval/tanfov);
-    sos->parallax = (maxDisparityInPx / screenWidthPx);
+    if (sos->quality.level >= QualityNoLighting)
+        sos->lightingStrength = 0.0f;
 
-    if(sos->stereoType != 0)
-    {
-        //left eye projection matrix
-        perspective (sos->projectionL, fov, aspect, nearval, farval, -sos->convergence);
+    recordFrame (s, ms, depth, sos->lightingStrength);
 
-        //right eye projection matrix
-        perspective (sos->projectionR, fov, aspect, nearval, farval, sos->convergence);
+    if (stereo3dGetLayoutThread (s->display) && startLayoutWorker (s, &sos->layoutWorker))
+    {
+        postLayoutFrame (s, &sos->layoutWorker, depth, sos->lightingStrength);
     }
     else
     {
-        //zero convergence for 2.5d effect
-        perspective (sos->projectionM, fov, aspect, nearval, farval, 0.0f);        
+        stopLayoutWorker (s, &sos->layoutWorker, true);
+        updateWindowsPosition (&sos->animationMgr, s, depth, sos->lightingStrength);
     }
 
+    if (sos->quality.level >= QualityNoCursorSmoothing)
+        sos->animationMgr.mouseCurr = sos->animationMgr.mouseDst;
 
-    float depth = stereo3dGetDepth(s->display);
-    sos->lightingStrength = stereo3dGetLightingStrength(s->display);
-    sos->edgesStrength = stereo3dGetEdgesStrength(s->display);
+    sos->stereoActive = true;
+}
+
+static void
+stereo3dPreparePaintScreen (CompScreen *s,
+			    int        ms)
+{
+    STEREO3D_SCREEN (s);
+
+    HOOK_COUNT (&sos->hookCounters, HookPreparePaintScreen);
+
+    // disabled, the hooks only forward until toggled on again
+    if (!sos->enabled)
+    {
+        sos->stereoActive = false;
+
+        UNWRAP (sos, s, preparePaintScreen);
+        (*s->preparePaintScreen) (s, ms);
+        WRAP (sos, s, preparePaintScreen, stereo3dPreparePaintScreen);
+        return;
+    }
+
+    updateTracing (s, &sos->trace);
+    updateExport (s, &sos->exporter);
+    TRACE_BEGIN (&sos->trace, "preparePaintScreen", 0, -1);
+
+    UNWRAP (sos, s, preparePaintScreen);
+    (*s->preparePaintScreen) (s, ms);
+    WRAP (sos, s, preparePaintScreen, stereo3dPreparePaintScreen);
 
-    updateWindowsPosition (&sos->animationMgr, s, depth, sos->lightingStrength);
+    prepareStereoFrame (s, ms);
+
+    TRACE_END (&sos->trace, "preparePaintScreen");
 }
 
 static Bool
@@ -173,24 +277,31 @@ stereo3dPaintOutput (CompScreen              *s,
 		     unsigned int            mask)
 {
     Bool status;
-    CompTransform *mTransform;
 
     STEREO3D_SCREEN (s);
 
-    mTransform = (CompTransform*)memcpy (malloc (sizeof (CompTransform)), origTransform, sizeof (CompTransform));
+    HOOK_COUNT (&sos->hookCounters, HookPaintOutput);
 
-    if(sos->enabled)
+    if(!sos->stereoActive)
     {
-        mask |= PAINT_SCREEN_WITH_TRANSFORMED_WINDOWS_MASK;
+        UNWRAP (sos, s, paintOutput);
+        status = (*s->paintOutput) (s, sa, origTransform, region, output, mask);
+        WRAP (sos, s, paintOutput, stereo3dPaintOutput);
 
-        mask |= PAINT_SCREEN_TRANSFORMED_MASK | PAINT_SCREEN_CLEAR_MASK;
+        return status;
     }
 
+    mask |= PAINT_SCREEN_WITH_TRANSFORMED_WINDOWS_MASK;
+
+    mask |= PAINT_SCREEN_TRANSFORMED_MASK | PAINT_SCREEN_CLEAR_MASK;
+
+    TRACE_BEGIN (&sos->trace, "paintOutput", 0, -1);
+
     UNWRAP (sos, s, paintOutput);
-    status = (*s->paintOutput) (s, sa, mTransform, region, output, mask);
+    status = (*s->paintOutput) (s, sa, origTransform, region, output, mask);
     WRAP (sos, s, paintOutput, stereo3dPaintOutput);
 
-    free (mTransform);
+    TRACE_END (&sos->trace, "paintOutput");
 
     return status;
 }
@@ -203,29 +314,89 @@ stereo3dPaintTransformedOutput (CompScreen              *s,
 			        CompOutput              *output,
 			        unsigned int            mask)
 {
-    CompTransform *mTransform;
-
     STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
 
-    mTransform = (CompTransform*)memcpy (malloc (sizeof (CompTransform)), origTransform, sizeof (CompTransform));
+    HOOK_COUNT (&sos->hookCounters, HookPaintTransformedOutput);
 
-    if(sos->enabled)
+    if(sos->stereoActive)
     {
         mask |= PAINT_SCREEN_CLEAR_MASK;
         mask |= PAINT_SCREEN_WITH_TRANSFORMED_WINDOWS_MASK;
 
-        sos->currFilter->prepareFilter(s->width, s->height);
+        bool snapshot = false;
 
-        UNWRAP (sos, s, paintTransformedOutput);
-        (*s->paintTransformedOutput) (s, sa, mTransform, region, output, mask);
-        WRAP (sos, s, paintTransformedOutput, stereo3dPaintTransformedOutput);
+        TRACE_BEGIN (&sos->trace, "paintTransformedOutput", 0, -1);
+
+        if (sos->mouseDrawingEnabled && stereo3dGetLateLatchCursor (s->display))
+            requestLatchedPointer (s);
+
+        if (sos->snapshotPending)
+        {
+            sos->snapshotPending = false;
+            snapshot = captureEyes (s, sa, origTransform, region, output, mask);
+        }
+
+        if (sos->stereoType == 4 &&
+            !beginMultiView (s, &sos->multiView, stereo3dGetViewScale (s->display)))
+            sos->stereoType = 0;
+
+        if (sos->stereoType == 4)
+        {
+            paintMultiView (s, sa, origTransform, region, output, mask);
+        }
+        else
+        {
+            // the layers are composed through the filter, no masks needed
+            sos->layeredActive = sos->layeredStereo && beginLayeredOutput (s, &sos->layered, gc);
+
+            if (!sos->layeredActive)
+            {
+                TRACE_BEGIN (&sos->trace, "prepareFilter", 0, -1);
+                GL_SITE_UNIT (gc, GLSiteFilterSetup);
+                (*sos->prepareOutputFilter) (s);
+                TRACE_END (&sos->trace, "prepareFilter");
+            }
+            sos->snapshot.reduced = beginReducedResolution(s, &sos->quality, output);
+
+            UNWRAP (sos, s, paintTransformedOutput);
+            (*s->paintTransformedOutput) (s, sa, origTransform, region, output, mask);
+            WRAP (sos, s, paintTransformedOutput, stereo3dPaintTransformedOutput);
+
+            if (sos->layeredActive)
+            {
+                TRACE_BEGIN (&sos->trace, "composeLayers", 0, -1);
+                endLayeredOutput (s, &sos->layered, &sos->shaders, sos->stereoType,
+                                  stereo3dGetInvert (s->display));
+                TRACE_END (&sos->trace, "composeLayers");
+                sos->layeredActive = false;
+            }
+            else
+            {
+                TRACE_BEGIN (&sos->trace, "cleanupFilter", 0, -1);
+                GL_SITE (gc, GLSiteFilterSetup);
+                (*sos->cleanupOutputFilter) (s);
+                TRACE_END (&sos->trace, "cleanupFilter");
+            }
+            endReducedResolution(s, &sos->quality, output);
+        }
+
+        exportOutput (s, &sos->exporter, output, sos->frameCount);
+
+        if (snapshot)
+        {
+            if (readOutputImage (s, output, &sos->snapshot.gpu))
+                finishSnapshot (s, &sos->snapshot, sos->stereoType);
+            else
+                freeSnapshot (&sos->snapshot);
+        }
 
-        sos->currFilter->cleanup();
+        TRACE_END (&sos->trace, "paintTransformedOutput");
     }
     else
     {
         UNWRAP (sos, s, paintTransformedOutput);
-        (*s->paintTransformedOutput) (s, sa, mTransform, region, output, mask);
+        (*s->paintTransformedOutput) (s, sa, origTransform, region, output, mask);
         WRAP (sos, s, paintTransformedOutput, stereo3dPaintTransformedOutput);
     }
 }
@@ -235,10 +406,32 @@ stereo3dDonePaintScreen (CompScreen *s)
 {
     STEREO3D_SCREEN (s);
 
-    if(sos->enabled)
+    HOOK_COUNT (&sos->hookCounters, HookDonePaintScreen);
+
+    if(sos->stereoActive)
     {
         //FIXME: probably I don't need do damage all screen
         damageScreen (s);
+
+        checkHookCounts (s, sos->nBackgroundWindows + sos->nDockWindows +
+                            sos->nFloatingWindows);
+        checkGLCallBudget (s, &sos->glCalls);
+
+        latencyFrameDone (s, &sos->latency, sos->frameCount, sos->pointerSource,
+                          stereo3dGetLateLatchCursor (s->display) ? 2 :
+                          sos->quality.level >= QualityNoCursorSmoothing ? 1 : 0);
+
+        if (!sos->firstStereoFrameDone)
+        {
+            struct timeval now;
+
+            gettimeofday (&now, 0);
+            compLogMessage ("stereo3d", CompLogLevelInfo,
+                            "first stereo frame %.1f ms after plugin load",
+                            (now.tv_sec - pluginLoadTime.tv_sec) * 1000.0 +
+                            (now.tv_usec - pluginLoadTime.tv_usec) / 1000.0);
+            sos->firstStereoFrameDone = true;
+        }
     }
 
     UNWRAP (sos, s, donePaintScreen);
@@ -264,109 +457,201 @@ freeCursor (Stereo3DScreen *sos, CursorTexture * cursor)
     cursor->texture = 0;
 }
 
+/* Sends the pointer query of the late-latched cursor when the frame's
+ * output starts painting, drawCursor collects the reply once the
+ * windows below the cursor have been submitted */
+static void
+requestLatchedPointer (CompScreen *s)
+{
+    xcb_connection_t *c = XGetXCBConnection (s->display->display);
+
+    STEREO3D_SCREEN (s);
+
+    if (sos->latchedFrame == sos->frameCount)
+	return;
+
+    if (sos->pointerRequestPending)
+    {
+	if (sos->pointerRequestFrame == sos->frameCount)
+	    return;
+
+	// no window drew the cursor in that frame
+	xcb_discard_reply (c, sos->pointerCookie.sequence);
+    }
+
+    sos->pointerCookie = xcb_query_pointer (c, s->root);
+    sos->pointerRequestPending = true;
+    sos->pointerRequestFrame = sos->frameCount;
+    xcb_flush (c);
+}
+
+/* The position the query of requestLatchedPointer returned. A reply
+ * that is not back yet is dropped, the cursor is not worth waiting on
+ * the server in the middle of the frame. */
+static bool
+pollLatchedPointer (CompScreen *s, int *x, int *y)
+{
+    xcb_connection_t    *c = XGetXCBConnection (s->display->display);
+    void                *reply = NULL;
+    xcb_generic_error_t *error = NULL;
+    bool                latched = false;
+
+    STEREO3D_SCREEN (s);
+
+    if (!sos->pointerRequestPending)
+	return false;
+
+    sos->pointerRequestPending = false;
+
+    if (!xcb_poll_for_reply (c, sos->pointerCookie.sequence, &reply, &error))
+    {
+	xcb_discard_reply (c, sos->pointerCookie.sequence);
+	return false;
+    }
+
+    xcb_query_pointer_reply_t *qp = (xcb_query_pointer_reply_t *) reply;
+
+    if (qp && qp->same_screen)
+    {
+	*x = qp->root_x;
+	*y = qp->root_y;
+	latched = true;
+    }
+
+    free (reply);
+    free (error);
+
+    return latched;
+}
+
 static void
 drawCursor (CompScreen *s)
 {
     STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
 
     if (sos->cursorTex.isSet && sos->mouseDrawingEnabled)
     {
 	CompTransform      sTransform;// = transform;
 	int           x, y;
+	float         mouseX, mouseY;
+
+	TRACE_BEGIN (&sos->trace, "drawCursor", 0, sos->renderingState);
+	GL_SITE_UNIT (gc, GLSiteCursor);
+
+	if (stereo3dGetLateLatchCursor (s->display))
+	{
+	    // first eye of the frame samples, the second one reuses it
+	    if (sos->latchedFrame != sos->frameCount)
+	    {
+		if (pollLatchedPointer (s, &x, &y))
+		{
+		    latencyPointerMoved (&sos->latency, x, y, sos->frameCount, CurrentTime);
+
+		    sos->latchedMouseX = x;
+		    sos->latchedMouseY = y;
+
+		    // no easing towards a stale target once latching stops
+		    setDestMouseX (&sos->animationMgr, x);
+		    setDestMouseY (&sos->animationMgr, y);
+		    sos->animationMgr.mouseCurr = sos->animationMgr.mouseDst;
+		}
+		else
+		{
+		    sos->latchedMouseX = getCurrentMouseX (&sos->animationMgr);
+		    sos->latchedMouseY = getCurrentMouseY (&sos->animationMgr);
+		}
+		sos->latchedFrame = sos->frameCount;
+	    }
+
+	    mouseX = sos->latchedMouseX;
+	    mouseY = sos->latchedMouseY;
+	}
+	else
+	{
+	    mouseX = getCurrentMouseX (&sos->animationMgr);
+	    mouseY = getCurrentMouseY (&sos->animationMgr);
+	}
 
+	latencyCursorDrawn (&sos->latency, sos->renderingState, mouseX, mouseY);
 
-        matrixTranslate (&sTransform, 0.0f, 0.0f, getCurrentForegroundZ (&sos->animationMgr));
+	matrixGetIdentity (&sTransform);
+        matrixTranslate (&sTransform, 0.0f, 0.0f, getCurrentCursorZ (&sos->animationMgr));
 
 	transformToScreenSpace (s, &s->outputDev[s->currentOutputDev], -DEFAULT_Z_CAMERA, &sTransform);
 
-        glPushMatrix ();
-        glLoadMatrixf (sTransform.m);
-        glTranslatef ( getCurrentMouseX (&sos->animationMgr),
-                       getCurrentMouseY (&sos->animationMgr),
-                       0.0f);
+        countedPushMatrix (gc);
+        countedLoadMatrixf (gc, sTransform.m);
+        countedTranslatef (gc, mouseX, mouseY, 0.0f);
 
         
 	x = -sos->cursorTex.hotX;
 	y = -sos->cursorTex.hotY;
 
-	glEnable (GL_BLEND);
-	glBindTexture (GL_TEXTURE_RECTANGLE_ARB, sos->cursorTex.texture);
-	glEnable (GL_TEXTURE_RECTANGLE_ARB);
-
-
-	glBegin (GL_QUADS);
-	glTexCoord2d (0, 0);
-	glVertex2f (x, y);
-	glTexCoord2d (0, sos->cursorTex.height);
-	glVertex2f (x, y + sos->cursorTex.height);
-	glTexCoord2d (sos->cursorTex.width, sos->cursorTex.height);
-	glVertex2f (x + sos->cursorTex.width, y + sos->cursorTex.height);
-	glTexCoord2d (sos->cursorTex.width, 0);
-	glVertex2f (x + sos->cursorTex.width, y);
-	glEnd ();
-
-	glDisable (GL_BLEND);
-	glBindTexture (GL_TEXTURE_RECTANGLE_ARB, 0);
-	glDisable (GL_TEXTURE_RECTANGLE_ARB);
-	glPopMatrix ();
+	countedEnable (gc, GL_BLEND);
+	countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, sos->cursorTex.texture);
+	countedEnable (gc, GL_TEXTURE_RECTANGLE_ARB);
+
+
+	countedBegin (gc, GL_QUADS);
+	countedTexCoord2d (gc, 0, 0);
+	countedVertex2f (gc, x, y);
+	countedTexCoord2d (gc, 0, sos->cursorTex.height);
+	countedVertex2f (gc, x, y + sos->cursorTex.height);
+	countedTexCoord2d (gc, sos->cursorTex.width, sos->cursorTex.height);
+	countedVertex2f (gc, x + sos->cursorTex.width, y + sos->cursorTex.height);
+	countedTexCoord2d (gc, sos->cursorTex.width, 0);
+	countedVertex2f (gc, x + sos->cursorTex.width, y);
+	countedEnd (gc);
+
+	countedDisable (gc, GL_BLEND);
+	countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, 0);
+	countedDisable (gc, GL_TEXTURE_RECTANGLE_ARB);
+	countedPopMatrix (gc);
+
+	TRACE_END (&sos->trace, "drawCursor");
     }
 }
 
 /* Create (if necessary) a texture to store the cursor,
- * fetch the cursor with XFixes. Store it.  */
+ * store the image fetched with XFixes in it.  */
 static void
-updateCursor (CompScreen *s)
+updateCursor (CompScreen *s, xcb_xfixes_get_cursor_image_reply_t *ci)
 {
 //    compLogMessage ("stereo3d", CompLogLevelWarn, "updateCursor!");
-    unsigned char *pixels;
-    int           i;
-    Display       *dpy = s->display->display;
+    const void    *pixels;
+    uint32_t      fallback = 0x00ffffff;
 
     STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    GL_SITE (gc, GLSiteOther);
 
     if (!sos->cursorTex.isSet)
     {
 	sos->cursorTex.isSet = true;
 	sos->cursorTex.screen = s;
-	glEnable (GL_TEXTURE_RECTANGLE_ARB);
+	countedEnable (gc, GL_TEXTURE_RECTANGLE_ARB);
 	glGenTextures (1, &sos->cursorTex.texture);
-	glBindTexture (GL_TEXTURE_RECTANGLE_ARB, sos->cursorTex.texture);
+	countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, sos->cursorTex.texture);
 
 	glTexParameteri (GL_TEXTURE_RECTANGLE_ARB,
 			 GL_TEXTURE_WRAP_S, GL_CLAMP);
 	glTexParameteri (GL_TEXTURE_RECTANGLE_ARB,
 			 GL_TEXTURE_WRAP_T, GL_CLAMP);
     } else {
-	glEnable (GL_TEXTURE_RECTANGLE_ARB);
+	countedEnable (gc, GL_TEXTURE_RECTANGLE_ARB);
     }
 
-    XFixesCursorImage *ci = XFixesGetCursorImage (dpy);
-
     if (ci)
     {
 	sos->cursorTex.width = ci->width;
 	sos->cursorTex.height = ci->height;
 	sos->cursorTex.hotX = ci->xhot;
 	sos->cursorTex.hotY = ci->yhot;
-	pixels = (unsigned char *) malloc (ci->width * ci->height * 4);
-
-	if (!pixels)
-	{
-	    XFree (ci);
-            
-	    return;
-	}
-
-	for (i = 0; i < ci->width * ci->height; i++)
-	{
-	    unsigned long pix = ci->pixels[i];
-	    pixels[i * 4] = pix & 0xff;
-	    pixels[(i * 4) + 1] = (pix >> 8) & 0xff;
-	    pixels[(i * 4) + 2] = (pix >> 16) & 0xff;
-	    pixels[(i * 4) + 3] = (pix >> 24) & 0xff;
-	}
 
-	XFree (ci);
+	// ARGB words, uploaded as they are
+	pixels = xcb_xfixes_get_cursor_image_cursor_image (ci);
     }
     else
     {
@@ -377,30 +662,73 @@ updateCursor (CompScreen *s)
 	sos->cursorTex.height = 1;
 	sos->cursorTex.hotX = 0;
 	sos->cursorTex.hotY = 0;
-	pixels = (unsigned char *) malloc (sos->cursorTex.width * sos->cursorTex.height * 4);
-
-	if (!pixels)
-	    return;
-
-	for (i = 0; i < sos->cursorTex.width * sos->cursorTex.height; i++)
-	{
-	    unsigned long pix = 0x00ffffff;
-	    pixels[i * 4] = pix & 0xff;
-	    pixels[(i * 4) + 1] = (pix >> 8) & 0xff;
-	    pixels[(i * 4) + 2] = (pix >> 16) & 0xff;
-	    pixels[(i * 4) + 3] = (pix >> 24) & 0xff;
-	}
+	pixels = &fallback;
 
 	compLogMessage ("stereo3d", CompLogLevelWarn, "unable to get system cursor image!");
     }
 
-    glBindTexture (GL_TEXTURE_RECTANGLE_ARB, sos->cursorTex.texture);
+    countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, sos->cursorTex.texture);
     glTexImage2D (GL_TEXTURE_RECTANGLE_ARB, 0, GL_RGBA, sos->cursorTex.width,
-		  sos->cursorTex.height, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
-    glBindTexture (GL_TEXTURE_RECTANGLE_ARB, 0);
-    glDisable (GL_TEXTURE_RECTANGLE_ARB);
+		  sos->cursorTex.height, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, pixels);
+    countedBindTexture (gc, GL_TEXTURE_RECTANGLE_ARB, 0);
+    countedDisable (gc, GL_TEXTURE_RECTANGLE_ARB);
+}
+
+/* Sends the XFixes cursor image request without waiting for the reply,
+ * pollCursorImage picks it up on a later frame */
+static void
+requestCursorImage (CompScreen *s)
+{
+    xcb_connection_t *c = XGetXCBConnection (s->display->display);
+
+    STEREO3D_SCREEN (s);
 
-    free (pixels);
+    if (sos->cursorRequestPending)
+	return;
+
+    sos->cursorCookie = xcb_xfixes_get_cursor_image (c);
+    sos->cursorRequestPending = true;
+    xcb_flush (c);
+}
+
+static void
+pollCursorImage (CompScreen *s)
+{
+    xcb_connection_t    *c = XGetXCBConnection (s->display->display);
+    void                *reply = NULL;
+    xcb_generic_error_t *error = NULL;
+
+    STEREO3D_SCREEN (s);
+
+    if (!sos->cursorRequestPending)
+	return;
+
+    if (!xcb_poll_for_reply (c, sos->cursorCookie.sequence, &reply, &error))
+	return;
+
+    sos->cursorRequestPending = false;
+
+    xcb_xfixes_get_cursor_image_reply_t *ci = (xcb_xfixes_get_cursor_image_reply_t *) reply;
+
+    updateCursor (s, ci);
+
+    if (ci)
+    {
+	// the reply carries the pointer position too, no need to query it
+	setDestMouseX (&sos->animationMgr, (float) ci->x);
+	setDestMouseY (&sos->animationMgr, (float) ci->y);
+	sos->animationMgr.mouseCurr = sos->animationMgr.mouseDst;
+    }
+
+    //hides original cursor once ours can be drawn
+    if (!sos->cursorHidden && !sos->passthrough)
+    {
+	XFixesHideCursor (s->display->display, s->root);
+	sos->cursorHidden = true;
+    }
+
+    free (reply);
+    free (error);
 }
 
 
@@ -416,45 +744,54 @@ stereo3dPaintWindow (CompWindow              *w,
 		     Region                  region,
 		     unsigned int            mask)
 {
-    CompTransform *mTransform;
-    WindowPaintAttrib *mAttrib;
+    CompTransform mTransform;
+    WindowPaintAttrib mAttrib;
+    Bool status;
 
     STEREO3D_SCREEN(w->screen);
     STEREO3D_WINDOW(w);
 
-    mTransform = (CompTransform*)memcpy (malloc (sizeof (CompTransform)), transform, sizeof (CompTransform));
-    mAttrib = (WindowPaintAttrib*)memcpy (malloc (sizeof (WindowPaintAttrib)), attrib, sizeof (WindowPaintAttrib));
+    HOOK_COUNT (&sos->hookCounters, HookPaintWindow);
 
-    if(sos->enabled)
+    if(!sos->stereoActive)
     {
-        mask |= PAINT_WINDOW_TRANSFORMED_MASK;
-        mask |= PAINT_WINDOW_ON_TRANSFORMED_SCREEN_MASK;
-
-        // transform the window to its position
-        matrixTranslate (mTransform, w->width/2.0f, w->height/2.0f, 0.0f);
-        matrixScale (mTransform, sow->currAttrs.scale, sow->currAttrs.scale, 1.0f);
-        matrixRotate (mTransform, sow->currAttrs.rotation.y, 0.0f, 0.1f, 0.0f);
-        matrixRotate (mTransform, sow->currAttrs.rotation.x, 0.1f, 0.0f, 0.0f);
-        matrixTranslate (mTransform, -w->width/2.0f, -w->height/2.0f, 0.0f);
-        matrixTranslate (mTransform, sow->currAttrs.translation.x, sow->currAttrs.translation.y, sow->currAttrs.translation.z);
-
-        mAttrib->opacity *= sow->opacity;
-        mAttrib->brightness *= sow->brightness;
-        mAttrib->saturation *= sow->saturation;
+        UNWRAP (sos, w->screen, paintWindow);
+        status = (*w->screen->paintWindow) (w, attrib, transform, region, mask);
+        WRAP (sos, w->screen, paintWindow, stereo3dPaintWindow);
+
+        return status;
     }
 
+    // the rest of the paint path reads the worker's layout from sow
+    if (sos->layoutWorker.running)
+        applyLayoutResult (&sos->layoutWorker, sow);
+
+    mTransform = *transform;
+    mAttrib = *attrib;
+
+    mask |= PAINT_WINDOW_TRANSFORMED_MASK;
+    mask |= PAINT_WINDOW_ON_TRANSFORMED_SCREEN_MASK;
+
+    // transform the window to its position
+    matrixTranslate (&mTransform, w->width/2.0f, w->height/2.0f, 0.0f);
+    matrixScale (&mTransform, sow->currAttrs.scale, sow->currAttrs.scale, 1.0f);
+    matrixRotate (&mTransform, sow->currAttrs.rotation.y, 0.0f, 0.1f, 0.0f);
+    matrixRotate (&mTransform, sow->currAttrs.rotation.x, 0.1f, 0.0f, 0.0f);
+    matrixTranslate (&mTransform, -w->width/2.0f, -w->height/2.0f, 0.0f);
+    matrixTranslate (&mTransform, sow->currAttrs.translation.x, sow->currAttrs.translation.y, sow->currAttrs.translation.z);
+
+    // brightness and saturation are applied by the filter's fragment function
+    mAttrib.opacity *= sow->opacity;
+
     UNWRAP (sos, w->screen, paintWindow);
-    Bool status = (*w->screen->paintWindow) (w, mAttrib, mTransform, region, mask);
+    status = (*w->screen->paintWindow) (w, &mAttrib, &mTransform, region, mask);
     WRAP (sos, w->screen, paintWindow, stereo3dPaintWindow);
 
-    free (mAttrib);
-    free (mTransform);
-
     return status;
 }
 
 static void
-initProjectionMatrixChange();
+initProjectionMatrixChange(GLCallCounters *gc);
 
 static void
 setLeftEyeProjectionMatrix (CompScreen *s);
@@ -465,9 +802,63 @@ setRightEyeProjectionMatrix (CompScreen *s);
 static void
 setNoConvergenceProjectionMatrix (CompScreen *s);
 
+static void
+setViewProjectionMatrix (CompScreen *s, int view);
+
 static void
 cleanupProjectionMatrixOperations (CompScreen *s);
 
+static Bool
+stereo3dDrawWindow (CompWindow           *w,
+		    const CompTransform  *transform,
+		    const FragmentAttrib *fragment,
+		    Region               region,
+		    unsigned int         mask);
+
+/* One core drawWindow call for the current renderingState */
+static Bool
+drawWindowPass (CompWindow           *w,
+		const CompTransform  *transform,
+		const FragmentAttrib *fragment,
+		Region               region,
+		unsigned int         mask)
+{
+    Bool status;
+
+    STEREO3D_SCREEN(w->screen);
+
+    TRACE_BEGIN (&sos->trace, "drawWindow", w->id, sos->renderingState);
+
+    UNWRAP (sos, w->screen, drawWindow);
+    status = (*w->screen->drawWindow) (w, transform, fragment, region, mask);
+    WRAP (sos, w->screen, drawWindow, stereo3dDrawWindow);
+
+    TRACE_END (&sos->trace, "drawWindow");
+
+    return status;
+}
+
+/* Parallel to the screen and not being scaled, see updateWindowsPosition */
+static bool
+isPlanarWindow (Stereo3DWindow *sow)
+{
+    return sow->currAttrs.rotation.x == 0.0f &&
+           sow->currAttrs.rotation.y == 0.0f &&
+           sow->currAttrs.rotation.z == 0.0f &&
+           sow->currAttrs.scale == 1.0f &&
+           sow->dstAttrs.scale == 1.0f;
+}
+
+/* Horizontal distance in px between the left and right eye images of a
+ * screen parallel plane at depth z, with the projections of preparePaint */
+static float
+getDisparityPx (CompScreen *s, float z)
+{
+    float tanfov = 0.5f / tan (stereo3dGetFov (s->display) * M_PI / 360.0);
+
+    return 2.0f * stereo3dGetStrength (s->display) * z / (tanfov - z);
+}
+
 static Bool
 stereo3dDrawWindow (CompWindow           *w,
 		    const CompTransform  *transform,
@@ -480,31 +871,86 @@ stereo3dDrawWindow (CompWindow           *w,
     STEREO3D_SCREEN(w->screen);
     STEREO3D_WINDOW(w);
 
+    HOOK_COUNT (&sos->hookCounters, HookDrawWindow);
+
     status = TRUE;
 
-    if (sos->enabled)
+    if (sos->stereoActive)
     {
         mask |= PAINT_WINDOW_TRANSFORMED_MASK;
 
-        initProjectionMatrixChange();
+        initProjectionMatrixChange(&sos->glCalls);
 
-        if (sos->stereoType != 0)
+        if (sos->renderView >= 0)
         {
-            // ********* left eye *********
-            setLeftEyeProjectionMatrix (w->screen);
-            UNWRAP (sos, w->screen, drawWindow);
-            status &= (*w->screen->drawWindow) (w, transform, fragment, region, mask);
-            WRAP (sos, w->screen, drawWindow, stereo3dDrawWindow);
+            // one lenticular view, drawn without the output filter
+            setViewProjectionMatrix (w->screen, sos->renderView);
+            status &= drawWindowPass (w, transform, fragment, region, mask);
             if(sow->drawMouse)
             {
                 drawCursor(w->screen);
             }
-
+        }
+        else if (sos->captureEye == EyeLeft || sos->captureEye == EyeRight)
+        {
+            // one eye of a snapshot, drawn without the output filter
+            if (sos->captureEye == EyeLeft)
+                setLeftEyeProjectionMatrix (w->screen);
+            else
+                setRightEyeProjectionMatrix (w->screen);
+
+            sos->renderingState = EyeSingle;
+            status &= drawWindowPass (w, transform, fragment, region, mask);
+            if(sow->drawMouse)
+            {
+                drawCursor(w->screen);
+            }
+        }
+        else if (sos->layeredActive)
+        {
+            // drawWindowTexture fills both layers at once
+            sos->renderingState = EyeBoth;
+            status &= drawWindowPass (w, transform, fragment, region, mask);
+            if(sow->drawMouse)
+            {
+                setLeftEyeProjectionMatrix (w->screen);
+                bindEyeLayer (&sos->layered, &sos->glCalls, EyeLeft);
+                drawCursor(w->screen);
+
+                setRightEyeProjectionMatrix (w->screen);
+                bindEyeLayer (&sos->layered, &sos->glCalls, EyeRight);
+                drawCursor(w->screen);
+
+                bindEyeLayer (&sos->layered, &sos->glCalls, -1);
+            }
+        }
+        else if (sos->stereoType != 0 && !sow->drawMouse && isPlanarWindow (sow) &&
+            fabsf (getDisparityPx (w->screen, sow->currAttrs.translation.z)) < 0.5f)
+        {
+            // both eyes would see the same pixels, draw them once
+            setNoConvergenceProjectionMatrix (w->screen);
+            status &= drawWindowPass (w, transform, fragment, region, mask);
+        }
+        else if (sos->stereoType != 0 && !sow->drawMouse && isPlanarWindow (sow))
+        {
+            // the eyes only differ by a horizontal shift, so the geometry
+            // is built once and drawWindowTexture draws it for both
+            sos->renderingState = EyeBoth;
+            status &= drawWindowPass (w, transform, fragment, region, mask);
+        }
+        else if (sos->stereoType != 0)
+        {
+            // ********* left eye *********
+            setLeftEyeProjectionMatrix (w->screen);
+            status &= drawWindowPass (w, transform, fragment, region, mask);
+            if(sow->drawMouse)
+            {
+                drawCursor(w->screen);
+            }
+
             // ********* right eye *********
             setRightEyeProjectionMatrix (w->screen);
-            UNWRAP (sos, w->screen, drawWindow);
-            status &= (*w->screen->drawWindow) (w, transform, fragment, region, mask);
-            WRAP (sos, w->screen, drawWindow, stereo3dDrawWindow);
+            status &= drawWindowPass (w, transform, fragment, region, mask);
             if(sow->drawMouse)
             {
                 drawCursor(w->screen);
@@ -513,9 +959,7 @@ stereo3dDrawWindow (CompWindow           *w,
         else // 2.5D
         {
             setNoConvergenceProjectionMatrix(w->screen);
-            UNWRAP (sos, w->screen, drawWindow);
-            status &= (*w->screen->drawWindow) (w, transform, fragment, region, mask);
-            WRAP (sos, w->screen, drawWindow, stereo3dDrawWindow);
+            status &= drawWindowPass (w, transform, fragment, region, mask);
             if(sow->drawMouse)
             {
                 drawCursor(w->screen);
@@ -540,6 +984,7 @@ drawBackgroundWireframe(CompWindow *w, float lightingStrength, float edgesStreng
 {
     STEREO3D_SCREEN (w->screen);
     STEREO3D_WINDOW (w);
+    GLCallCounters *gc = &sos->glCalls;
 
     float z1 = 0.0f;
     float z2 = -sow->currAttrs.translation.z;
@@ -548,11 +993,14 @@ drawBackgroundWireframe(CompWindow *w, float lightingStrength, float edgesStreng
     float alpha1 = (alpha2 * 0.8 * (1.0 - sos->lightingStrength) ) * edgesStrength;
 
     CompTransform sTransform;
+    matrixGetIdentity (&sTransform);
     matrixTranslate (&sTransform, 0.0f, 0.0f, -z2);
+
+    GL_SITE_UNIT (gc, GLSiteWireframe);
     transformToScreenSpace (w->screen, &w->screen->outputDev[w->screen->currentOutputDev], -DEFAULT_Z_CAMERA, &sTransform);
 
-    glPushMatrix();
-    glLoadMatrixf (sTransform.m);
+    countedPushMatrix (gc);
+    countedLoadMatrixf (gc, sTransform.m);
 
     float x1 = 0.0f;//-0.5;
     float y1 = 0.0f;//-0.5;
@@ -560,310 +1008,1348 @@ drawBackgroundWireframe(CompWindow *w, float lightingStrength, float edgesStreng
     float x2 = w->screen->width;//0.5f;
     float y2 = w->screen->height;//0.5;
 
-    glEnable( GL_LINE_SMOOTH );
-    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    bool smooth = sos->quality.level < QualityNoSmoothEdges;
+
+    if (smooth)
+    {
+        countedEnable (gc, GL_LINE_SMOOTH );
+        countedHint (gc, GL_LINE_SMOOTH_HINT, GL_NICEST);
+    }
+    countedEnable (gc, GL_BLEND);
+    countedBlendFunc (gc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glLineWidth (2.0f);
+    countedLineWidth (gc, 2.0f);
 
-    glBegin( GL_LINES );
+    countedBegin (gc, GL_LINES );
     {
-        glColor4f( 1.0f, 1.0f, 1.0f, alpha1 );
-        glVertex3f( x1, y1, z1  );
-        glColor4f( 1.0f, 1.0f, 1.0f, alpha2 );
-        glVertex3f( x1, y1, z2 );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, alpha1 );
+        countedVertex3f (gc, x1, y1, z1  );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, alpha2 );
+        countedVertex3f (gc, x1, y1, z2 );
 
-        glColor4f( 1.0f, 1.0f, 1.0f, alpha1 );
-        glVertex3f( x1, y2, z1 );
-        glColor4f( 1.0f, 1.0f, 1.0f, alpha2 );
-        glVertex3f( x1, y2, z2 );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, alpha1 );
+        countedVertex3f (gc, x1, y2, z1 );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, alpha2 );
+        countedVertex3f (gc, x1, y2, z2 );
 
-        glColor4f( 1.0f, 1.0f, 1.0f, alpha1 );
-        glVertex3f( x2, y1, z1 );
-        glColor4f( 1.0f, 1.0f, 1.0f, alpha2 );
-        glVertex3f( x2, y1, z2 );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, alpha1 );
+        countedVertex3f (gc, x2, y1, z1 );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, alpha2 );
+        countedVertex3f (gc, x2, y1, z2 );
 
-        glColor4f( 1.0f, 1.0f, 1.0f, alpha1 );
-        glVertex3f( x2, y2, z1 );
-        glColor4f( 1.0f, 1.0f, 1.0f, alpha2 );
-        glVertex3f( x2, y2, z2 );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, alpha1 );
+        countedVertex3f (gc, x2, y2, z1 );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, alpha2 );
+        countedVertex3f (gc, x2, y2, z2 );
 
 
-        glColor4f( 1.0f, 1.0f, 1.0f, 1.0f );
+        countedColor4f (gc, 1.0f, 1.0f, 1.0f, 1.0f );
     }
-    glEnd();
-    glDisable( GL_LINE_SMOOTH );
+    countedEnd (gc);
+    if (smooth)
+        countedDisable (gc, GL_LINE_SMOOTH );
 
 
-    glPopMatrix();
+    countedPopMatrix (gc);
 }
 
 static void
 stereo3dDrawWindowTexture (CompWindow           *w,
 			   CompTexture          *texture,
 			   const FragmentAttrib *attrib,
-			   unsigned int         mask)
+			   unsigned int         mask);
+
+template <class Filter, Filter Stereo3DScreen::*filter>
+static void
+drawWindowTextureForEye (CompWindow           *w,
+			 CompTexture          *texture,
+			 const FragmentAttrib *attrib,
+			 unsigned int         mask,
+			 int                  eye)
 {
-    FragmentAttrib *fa;
+    FragmentAttrib fa = *attrib;
 
     STEREO3D_SCREEN(w->screen);
     STEREO3D_WINDOW(w);
+    GLCallCounters *gc = &sos->glCalls;
+
+    TRACE_BEGIN (&sos->trace, "drawWindowTexture", w->id, eye);
+
+    GL_SITE_UNIT (gc, GLSiteFilter);
+    HOOK_COUNT (&sos->hookCounters, HookApplyFilter);
+
+    if (sos->eyeFilter[eye] >= 0)
+        (sos->*filter).applyFilter(sos->eyeFilter[eye], &fa, texture, w->screen,
+                                    sow->brightness, sow->saturation);
+
+    if(sow->floatingType == FTBACKGROUND)
+    {
+        drawBackgroundWireframe(w, sos->lightingStrength, sos->edgesStrength);
+    }
+
+    UNWRAP (sos, w->screen, drawWindowTexture);
+    (*w->screen->drawWindowTexture) (w, texture, &fa, mask);
+    WRAP (sos, w->screen, drawWindowTexture, stereo3dDrawWindowTexture);
+
+    TRACE_END (&sos->trace, "drawWindowTexture");
+}
+
+/* Texture filter of a window drawn with mask, as core's drawWindowTexture
+ * picks it */
+static CompTextureFilter
+getTextureFilter (CompScreen *s, unsigned int mask)
+{
+    if (mask & (PAINT_WINDOW_TRANSFORMED_MASK | PAINT_WINDOW_ON_TRANSFORMED_SCREEN_MASK))
+        return (CompTextureFilter) s->filter[SCREEN_TRANS_FILTER];
+
+    return (CompTextureFilter) s->filter[NOTHING_TRANS_FILTER];
+}
+
+/* drawWindowTextureForEye with the filter's GLSL program in place of
+ * core's texture drawing, the masks of the filter are applied the same
+ * way. Falls back to drawWindowTextureForEye for textures the programs
+ * cannot draw alone. */
+template <class Filter, Filter Stereo3DScreen::*filter>
+static void
+drawWindowTextureShaded (CompWindow           *w,
+			 CompTexture          *texture,
+			 const FragmentAttrib *attrib,
+			 unsigned int         mask,
+			 int                  eye)
+{
+    CompScreen    *s = w->screen;
+    ShaderProgram *sp;
+
+    STEREO3D_SCREEN(s);
+    STEREO3D_WINDOW(w);
+    GLCallCounters *gc = &sos->glCalls;
+
+    // fragment functions of other plugins and plugins wrapped below us
+    // only work through core's drawing
+    if (attrib->nFunction || sos->drawWindowTexture != drawWindowTexture ||
+        eye < EyeLeft || eye > EyeSingle ||
+        !(sp = getShaderProgram (&sos->shaders, Filter::shaderVariant, texture)))
+    {
+        drawWindowTextureForEye<Filter, filter> (w, texture, attrib, mask, eye);
+        return;
+    }
+
+    TRACE_BEGIN (&sos->trace, "drawWindowTexture", w->id, eye);
+
+    GL_SITE_UNIT (gc, GLSiteFilter);
+    HOOK_COUNT (&sos->hookCounters, HookApplyFilter);
+
+    (sos->*filter).applyMask (gc, sos->eyeFilter[eye]);
+
+    if(sow->floatingType == FTBACKGROUND)
+    {
+        drawBackgroundWireframe(w, sos->lightingStrength, sos->edgesStrength);
+        GL_SITE (gc, GLSiteFilter);
+    }
+
+    enableTexture (s, texture, getTextureFilter (s, mask));
+
+    useShaderProgram (&sos->shaders, gc, sp, eye,
+                      attrib->opacity / (float) OPAQUE,
+                      attrib->brightness / (float) BRIGHT * sow->brightness,
+                      attrib->saturation / (float) COLOR * sow->saturation);
+
+    if (mask & PAINT_WINDOW_BLEND_MASK)
+        countedEnable (gc, GL_BLEND);
+
+    (*w->drawWindowGeometry) (w);
+
+    if (mask & PAINT_WINDOW_BLEND_MASK)
+        countedDisable (gc, GL_BLEND);
+
+    (*sos->shaders.useProgram) (0);
+    GL_COUNT (gc, GLCallFragment);
+
+    disableTexture (s, texture);
+
+    TRACE_END (&sos->trace, "drawWindowTexture");
+}
+
+/* One texture into both layers. Textures the layered program cannot
+ * draw, and background windows with their wireframe, are drawn into
+ * each layer on its own with the lighting only; the output filter
+ * is applied when composing. */
+static void
+drawWindowTextureLayered (CompWindow           *w,
+			  CompTexture          *texture,
+			  const FragmentAttrib *attrib,
+			  unsigned int         mask)
+{
+    CompScreen    *s = w->screen;
+    ShaderProgram *sp;
+
+    STEREO3D_SCREEN(s);
+    STEREO3D_WINDOW(w);
+    GLCallCounters *gc = &sos->glCalls;
+
+    if (!attrib->nFunction && sos->drawWindowTexture == drawWindowTexture &&
+        w->drawWindowGeometry == drawWindowGeometry &&
+        w->texUnits == 1 && w->texCoordSize == 2 &&
+        sow->floatingType != FTBACKGROUND &&
+        (sp = getLayeredProgram (&sos->layered, &sos->shaders, texture)))
+    {
+        TRACE_BEGIN (&sos->trace, "drawWindowTexture", w->id, EyeBoth);
+        GL_SITE_UNIT (gc, GLSiteFilter);
+        HOOK_COUNT (&sos->hookCounters, HookApplyFilter);
+
+        enableTexture (s, texture, getTextureFilter (s, mask));
+
+        if (mask & PAINT_WINDOW_BLEND_MASK)
+            countedEnable (gc, GL_BLEND);
+
+        drawLayeredGeometry (&sos->layered, &sos->shaders, gc, sp, w,
+                             attrib->opacity / (float) OPAQUE,
+                             attrib->brightness / (float) BRIGHT * sow->brightness,
+                             attrib->saturation / (float) COLOR * sow->saturation);
+
+        if (mask & PAINT_WINDOW_BLEND_MASK)
+            countedDisable (gc, GL_BLEND);
+
+        disableTexture (s, texture);
+
+        TRACE_END (&sos->trace, "drawWindowTexture");
+        return;
+    }
+
+    setLeftEyeProjectionMatrix (s);
+    bindEyeLayer (&sos->layered, gc, EyeLeft);
+    drawWindowTextureForEye<MonoFilter, &Stereo3DScreen::monoFilter> (w, texture, attrib, mask, EyeLeft);
+
+    setRightEyeProjectionMatrix (s);
+    bindEyeLayer (&sos->layered, gc, EyeRight);
+    drawWindowTextureForEye<MonoFilter, &Stereo3DScreen::monoFilter> (w, texture, attrib, mask, EyeRight);
+
+    // the background's wireframe went last
+    GL_SITE (gc, GLSiteFilter);
+    bindEyeLayer (&sos->layered, gc, -1);
+}
+
+template <class Filter, Filter Stereo3DScreen::*filter>
+static void
+prepareOutputFilter (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    HOOK_COUNT (&sos->hookCounters, HookPrepareFilter);
+    (sos->*filter).prepareFilter (gc, s->width, s->height);
+}
+
+template <class Filter, Filter Stereo3DScreen::*filter>
+static void
+cleanupOutputFilter (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    HOOK_COUNT (&sos->hookCounters, HookCleanupFilter);
+    (sos->*filter).cleanup (gc);
+}
+
+/* Paints the output once per eye with the lighting of the 2.5D mode and
+ * no colour or stencil masks, reading each eye into the snapshot. The
+ * real frame painted afterwards clears them again. */
+static bool
+captureEyes (CompScreen              *s,
+	     const ScreenPaintAttrib *sa,
+	     const CompTransform     *transform,
+	     Region                  region,
+	     CompOutput              *output,
+	     unsigned int            mask)
+{
+    DrawWindowTextureForEyeProc drawForEye;
+    bool                        status;
+
+    STEREO3D_SCREEN (s);
+
+    memset (&sos->snapshot, 0, sizeof (sos->snapshot));
+
+    drawForEye = sos->drawWindowTextureForEye;
+    sos->drawWindowTextureForEye = drawWindowTextureForEye<MonoFilter, &Stereo3DScreen::monoFilter>;
+
+    sos->captureEye = EyeLeft;
+    UNWRAP (sos, s, paintTransformedOutput);
+    (*s->paintTransformedOutput) (s, sa, transform, region, output, mask);
+    WRAP (sos, s, paintTransformedOutput, stereo3dPaintTransformedOutput);
+    status = readOutputImage (s, output, &sos->snapshot.left);
+
+    sos->captureEye = EyeRight;
+    UNWRAP (sos, s, paintTransformedOutput);
+    (*s->paintTransformedOutput) (s, sa, transform, region, output, mask);
+    WRAP (sos, s, paintTransformedOutput, stereo3dPaintTransformedOutput);
+    status = status && readOutputImage (s, output, &sos->snapshot.right);
+
+    sos->captureEye = -1;
+    sos->drawWindowTextureForEye = drawForEye;
+
+    if (!status)
+    {
+        compLogMessage ("stereo3d", CompLogLevelWarn, "unable to allocate snapshot images");
+        freeSnapshot (&sos->snapshot);
+    }
+
+    return status;
+}
+
+/* Paints the output once per lenticular view into its layer, then
+ * interleaves the layers into the back buffer */
+static void
+paintMultiView (CompScreen              *s,
+		const ScreenPaintAttrib *sa,
+		const CompTransform     *transform,
+		Region                  region,
+		CompOutput              *output,
+		unsigned int            mask)
+{
+    MultiView *mv;
+
+    STEREO3D_SCREEN (s);
+
+    mv = &sos->multiView;
+    mv->timing = stereo3dGetViewStats (s->display);
+
+    for (int view = 0; view < mv->nViews; view++)
+    {
+        TRACE_BEGIN (&sos->trace, "view", 0, -1);
+        beginView (s, mv, output, view);
+        sos->renderView = view;
+
+        UNWRAP (sos, s, paintTransformedOutput);
+        (*s->paintTransformedOutput) (s, sa, transform, region, output, mask);
+        WRAP (sos, s, paintTransformedOutput, stereo3dPaintTransformedOutput);
+
+        endView (mv, view);
+        TRACE_END (&sos->trace, "view");
+    }
+
+    sos->renderView = -1;
+
+    TRACE_BEGIN (&sos->trace, "interleaveViews", 0, -1);
+    endMultiView (s, mv, &sos->shaders, output,
+                  stereo3dGetLensPitch (s->display),
+                  stereo3dGetLensSlant (s->display),
+                  stereo3dGetLensOffset (s->display),
+                  stereo3dGetInvert (s->display));
+    TRACE_END (&sos->trace, "interleaveViews");
+
+    if (mv->timing)
+        reportViewTimes (mv, 1000.0f / stereo3dGetTargetFps (s->display));
+}
+
+/* Points the draw paths at the ones instantiated for the filter of the
+ * output mode, only called when the mode or the backend changes */
+static void
+selectFilter (CompScreen *s, int mode, bool shaders)
+{
+    STEREO3D_SCREEN (s);
+
+    switch (mode)
+    {
+        case 0:
+            //2.5D, lighting only
+            sos->prepareOutputFilter = prepareOutputFilter<MonoFilter, &Stereo3DScreen::monoFilter>;
+            sos->cleanupOutputFilter = cleanupOutputFilter<MonoFilter, &Stereo3DScreen::monoFilter>;
+            sos->drawWindowTextureForEye = shaders ?
+                drawWindowTextureShaded<MonoFilter, &Stereo3DScreen::monoFilter> :
+                drawWindowTextureForEye<MonoFilter, &Stereo3DScreen::monoFilter>;
+            break;
+
+        case 4:
+            // lenticular views, each set as the GL projection which the
+            // GLSL programs of the two eye modes do not read
+            sos->prepareOutputFilter = prepareOutputFilter<MonoFilter, &Stereo3DScreen::monoFilter>;
+            sos->cleanupOutputFilter = cleanupOutputFilter<MonoFilter, &Stereo3DScreen::monoFilter>;
+            sos->drawWindowTextureForEye = drawWindowTextureForEye<MonoFilter, &Stereo3DScreen::monoFilter>;
+            break;
+
+        case 1:
+            sos->prepareOutputFilter = prepareOutputFilter<AnaglyphFilter, &Stereo3DScreen::anaglyphFilter>;
+            sos->cleanupOutputFilter = cleanupOutputFilter<AnaglyphFilter, &Stereo3DScreen::anaglyphFilter>;
+            sos->drawWindowTextureForEye = shaders ?
+                drawWindowTextureShaded<AnaglyphFilter, &Stereo3DScreen::anaglyphFilter> :
+                drawWindowTextureForEye<AnaglyphFilter, &Stereo3DScreen::anaglyphFilter>;
+            break;
+
+        case 2:
+        case 3:
+            sos->interlacedFilter.column = (mode == 3);
+            sos->prepareOutputFilter = prepareOutputFilter<InterlacedFilter, &Stereo3DScreen::interlacedFilter>;
+            sos->cleanupOutputFilter = cleanupOutputFilter<InterlacedFilter, &Stereo3DScreen::interlacedFilter>;
+            sos->drawWindowTextureForEye = shaders ?
+                drawWindowTextureShaded<InterlacedFilter, &Stereo3DScreen::interlacedFilter> :
+                drawWindowTextureForEye<InterlacedFilter, &Stereo3DScreen::interlacedFilter>;
+            break;
+    }
+
+    sos->filterMode = mode;
+    sos->filterShaders = shaders;
+}
+
+/* Size of the window on screen relative to its texture, the screen
+ * plane is tanfov away from the eyes as in getDisparityPx */
+static float
+getProjectedScale (CompScreen *s, Stereo3DWindow *sow)
+{
+    float tanfov = 0.5f / tan (stereo3dGetFov (s->display) * M_PI / 360.0);
+
+    return sow->currAttrs.scale * tanfov / (tanfov - sow->currAttrs.translation.z);
+}
+
+/* Recessed windows are sampled through the mipmap chain of their texture.
+ * Core only regenerates the chain when the window was damaged since the
+ * last time, so both eyes and undamaged frames reuse it. Rectangle
+ * textures have no mipmaps and keep plain linear filtering. */
+static bool
+useMipmapLod (CompWindow *w, CompTexture *texture)
+{
+    CompScreen *s = w->screen;
+
+    STEREO3D_WINDOW (w);
+
+    if (!stereo3dGetLodMipmap (s->display))
+        return false;
+
+    if (!texture->mipmap || !s->fbo || !s->textureNonPowerOfTwo)
+        return false;
+
+    return getProjectedScale (s, sow) < stereo3dGetLodThreshold (s->display);
+}
+
+static void
+stereo3dDrawWindowTexture (CompWindow           *w,
+			   CompTexture          *texture,
+			   const FragmentAttrib *attrib,
+			   unsigned int         mask)
+{
+    STEREO3D_SCREEN(w->screen);
+
+    HOOK_COUNT (&sos->hookCounters, HookDrawWindowTexture);
+
+    if(sos->stereoActive)
+    {
+        CompScreen  *s = w->screen;
+        bool        lod = useMipmapLod (w, texture);
+        GLenum      textureFilter = s->display->textureFilter;
+        int         screenFilter = s->filter[SCREEN_TRANS_FILTER];
+        int         nothingFilter = s->filter[NOTHING_TRANS_FILTER];
+
+        if (lod)
+        {
+            // core picks the mipmap filter for "good" textures with this
+            s->display->textureFilter = GL_LINEAR_MIPMAP_LINEAR;
+            s->filter[SCREEN_TRANS_FILTER] = COMP_TEXTURE_FILTER_GOOD;
+            s->filter[NOTHING_TRANS_FILTER] = COMP_TEXTURE_FILTER_GOOD;
+        }
+
+        if (sos->renderingState == EyeBoth && sos->layeredActive)
+        {
+            drawWindowTextureLayered (w, texture, attrib, mask);
+            sos->renderingState = EyeBoth;
+        }
+        else if (sos->renderingState == EyeBoth)
+        {
+            setLeftEyeProjectionMatrix (w->screen);
+            (*sos->drawWindowTextureForEye) (w, texture, attrib, mask, EyeLeft);
+
+            setRightEyeProjectionMatrix (w->screen);
+            (*sos->drawWindowTextureForEye) (w, texture, attrib, mask, EyeRight);
+
+            // decorations and other textures of this window follow
+            sos->renderingState = EyeBoth;
+        }
+        else
+        {
+            (*sos->drawWindowTextureForEye) (w, texture, attrib, mask, sos->renderingState);
+        }
+
+        if (lod)
+        {
+            s->display->textureFilter = textureFilter;
+            s->filter[SCREEN_TRANS_FILTER] = screenFilter;
+            s->filter[NOTHING_TRANS_FILTER] = nothingFilter;
+        }
+    }
+    else
+    {
+        UNWRAP (sos, w->screen, drawWindowTexture);
+        (*w->screen->drawWindowTexture) (w, texture, attrib, mask);
+        WRAP (sos, w->screen, drawWindowTexture, stereo3dDrawWindowTexture);
+    }
+}
+
+
+static void
+initProjectionMatrixChange(GLCallCounters *gc)
+{
+//    compLogMessage ("stereoscopic", CompLogLevelError, "initProjectionMatrixChange"  );
+    GL_SITE_UNIT (gc, GLSiteProjection);
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedPushMatrix (gc);
+    countedLoadIdentity (gc);
+    countedMatrixMode (gc, GL_MODELVIEW);
+}
+
+static float
+getWorldZCorrection(float fov)
+{
+    float tanfov = 0.5f / tan(fov * M_PI / 360.0);
+
+    float result = DEFAULT_Z_CAMERA - (tanfov);
+
+    return result;
+}
+
+static void
+setLeftEyeProjectionMatrix (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    sos->renderingState = EyeLeft;
+    GL_SITE_UNIT (gc, GLSiteProjection);
+
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedLoadIdentity (gc);
+
+    countedMultMatrixf (gc, sos->projectionL);
+
+    countedTranslatef (gc, -(sos->parallax), 0.0f, getWorldZCorrection( stereo3dGetFov(s->display) ) );
+
+    countedMatrixMode (gc, GL_MODELVIEW);
+}
+
+
+static void
+setRightEyeProjectionMatrix (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    sos->renderingState = EyeRight;
+    GL_SITE_UNIT (gc, GLSiteProjection);
+
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedLoadIdentity (gc);
+
+    countedMultMatrixf (gc, sos->projectionR);
+
+    countedTranslatef (gc, sos->parallax, 0.0f, getWorldZCorrection( stereo3dGetFov(s->display) ) );
+
+    countedMatrixMode (gc, GL_MODELVIEW);
+}
+
+
+/* Projection of a lenticular view, between the two eye projections
+ * by the view's camera offset */
+static void
+setViewProjectionMatrix (CompScreen *s, int view)
+{
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    sos->renderingState = EyeSingle;
+    GL_SITE_UNIT (gc, GLSiteProjection);
+
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedLoadIdentity (gc);
+
+    countedMultMatrixf (gc, sos->multiView.projections[view]);
+
+    countedTranslatef (gc, sos->multiView.offsets[view] * sos->parallax, 0.0f,
+                       getWorldZCorrection (stereo3dGetFov (s->display)));
+
+    countedMatrixMode (gc, GL_MODELVIEW);
+}
+
+static void
+setNoConvergenceProjectionMatrix (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    sos->renderingState = EyeSingle;
+    GL_SITE_UNIT (gc, GLSiteProjection);
+
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedLoadIdentity (gc);
+
+    countedMultMatrixf (gc, sos->projectionM);
+
+    countedTranslatef (gc, 0.0f, 0.0f, getWorldZCorrection( stereo3dGetFov(s->display) ) );
+
+    countedMatrixMode (gc, GL_MODELVIEW);
+}
+
+static void
+cleanupProjectionMatrixOperations (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
+
+    sos->renderingState = Cleanup;
+    GL_SITE (gc, GLSiteProjection);
+    countedMatrixMode (gc, GL_PROJECTION);
+    countedPopMatrix (gc);
+    countedMatrixMode (gc, GL_MODELVIEW);
+}
+
+/********************************************************************
+*******************       Handle Inputs       ***********************
+*********************************************************************/
+static Bool
+moveForegroundIn(CompDisplay     *display,
+		 CompAction      *action,
+		 CompActionState state,
+		 CompOption      *option,
+		 int             nOption)
+{
+    CompScreen *s;
+    Window     xid;
+
+    xid = getIntOptionNamed (option, nOption, "root", 0);
+    s = findScreenAtDisplay (display, xid);
+
+    if (s) {
+        STEREO3D_SCREEN (s);
+        return moveForegroundIn (&sos->animationMgr);
+    }
+
+    return TRUE;
+}
+
+static Bool
+moveForegroundOut(CompDisplay     *display,
+		  CompAction      *action,
+		  CompActionState state,
+		  CompOption      *option,
+		  int             nOption)
+{
+    CompScreen *s;
+    Window     xid;
+
+    xid = getIntOptionNamed (option, nOption, "root", 0);
+    s = findScreenAtDisplay (display, xid);
+
+    if (s) {
+        STEREO3D_SCREEN (s);
+        return moveForegroundOut (&sos->animationMgr);
+    }
+
+    return TRUE;
+}
+
+
+static Bool
+resetForegroundDepth(CompDisplay     *display,
+		     CompAction      *action,
+		     CompActionState state,
+		     CompOption      *option,
+		     int             nOption)
+{
+    CompScreen *s;
+    Window     xid;
+
+    xid = getIntOptionNamed (option, nOption, "root", 0);
+    s = findScreenAtDisplay (display, xid);
+
+    if (s) {
+        STEREO3D_SCREEN (s);
+        return resetForegroundDepth (&sos->animationMgr);
+    }
+
+    return TRUE;
+}
+
+
+static Bool
+toggleOn (CompDisplay     *d,
+	  CompAction      *action,
+	  CompActionState state,
+	  CompOption      *option,
+	  int             nOption)
+{
+    CompScreen *s;
+    Window xid;
+
+    xid = getIntOptionNamed (option, nOption, "root", 0);
+    s = findScreenAtDisplay (d, xid);
+
+    if (s)
+    {
+	STEREO3D_SCREEN (s);
+	sos->enabled = !sos->enabled;
+
+	// no half finished easing is resumed when toggled on again
+	finishAnimations (&sos->animationMgr, s);
+	sos->layoutWorker.next.finish = true;
+	sos->windowIndexDirty = true;
+
+	// the disabled hooks no longer follow the trace and export
+	// options, both are closed until stereo is back on
+	if (!sos->enabled)
+	{
+	    stopTracing (&sos->trace);
+	    stopExport (&sos->exporter);
+	}
+
+	// nothing else may damage the screen until the next frame
+	damageScreen (s);
+
+	if(!sos->mouseDrawingEnabled)
+	    return true;
+
+	if(sos->enabled)
+	{
+	    if(sos->mouseDrawingEnabled)
+		enableMouseDrawing(s);
+	}
+	else
+	{
+	    if(sos->mouseDrawingEnabled)
+		disableMouseDrawing(s);
+	}
+    }
+    
+    return true;
+}
+
+/* The window under the pointer is looked up in the window grid on every
+ * pointer update, the layout draws the cursor at its depth. inputTime is
+ * the server time of the input that moved the pointer, if known */
+static void
+setPointerPosition (CompScreen *s, int x, int y, Time inputTime)
+{
+    STEREO3D_SCREEN(s);
+
+    setDestMouseX (&sos->animationMgr, x);
+    setDestMouseY (&sos->animationMgr, y);
+
+    sos->pointerWindow = findGridWindow (&sos->windowGrid, &sos->hookCounters, x, y);
+
+    latencyPointerMoved (&sos->latency, x, y, sos->frameCount, inputTime);
+}
+
+static void
+updateMouseInterval (CompScreen *s, int x, int y)
+{
+    STEREO3D_SCREEN(s);
+
+    sos->pointerWakeups[PSMOUSEPOLL]++;
+
+    setPointerPosition (s, x, y, CurrentTime);
+}
+
+/* XInput2 raw motion only says that the pointer moved, the position
+ * itself is queried once per frame in which that happened */
+static bool
+queryPointer (CompScreen *s, int *x, int *y)
+{
+    Window       root, child;
+    int          winX, winY;
+    unsigned int mask;
+
+    return XQueryPointer (s->display->display, s->root, &root, &child,
+			  x, y, &winX, &winY, &mask);
+}
+
+static void
+updatePointerPosition (CompScreen *s)
+{
+    int x, y;
+
+    STEREO3D_SCREEN(s);
+
+    sos->pointerMoved = false;
+
+    if (queryPointer (s, &x, &y))
+	setPointerPosition (s, x, y, sos->pointerMovedTime);
+}
+
+static bool
+checkXInput2 (CompDisplay *d)
+{
+    int event, error, major = 2, minor = 0;
+
+    STEREO3D_DISPLAY (d);
+
+    if (!sod->xi2Checked)
+    {
+	sod->xi2Checked = true;
+	sod->xi2Available =
+	    XQueryExtension (d->display, "XInputExtension", &sod->xiOpcode, &event, &error) &&
+	    XIQueryVersion (d->display, &major, &minor) == Success;
+
+	if (!sod->xi2Available)
+	    compLogMessage ("stereo3d", CompLogLevelWarn,
+			    "XInput2 not available, falling back to mousepoll");
+    }
+
+    return sod->xi2Available;
+}
+
+static void
+selectRawMotion (CompScreen *s, bool enable)
+{
+    unsigned char mask[XIMaskLen (XI_RawMotion)];
+    XIEventMask   eventMask;
+
+    memset (mask, 0, sizeof (mask));
+    if (enable)
+	XISetMask (mask, XI_RawMotion);
+
+    // raw events are only ever delivered to the root window
+    eventMask.deviceid = XIAllMasterDevices;
+    eventMask.mask_len = sizeof (mask);
+    eventMask.mask = mask;
+
+    XISelectEvents (s->display->display, s->root, &eventMask, 1);
+}
+
+static void
+acquirePointerSource (CompScreen *s)
+{
+    STEREO3D_DISPLAY(s->display);
+    STEREO3D_SCREEN(s);
+
+    if (stereo3dGetPointerSource (s->display) == PSXINPUT2 &&
+	checkXInput2 (s->display))
+    {
+	sos->pointerSource = PSXINPUT2;
+	selectRawMotion (s, true);
+    }
+    else
+    {
+	sos->pointerSource = PSMOUSEPOLL;
+	sos->pollHandle = sod->mpFunc->addPositionPolling (s, updateMouseInterval);
+    }
+
+    sos->pointerMoved = false;
+    sos->pointerWakeups[PSMOUSEPOLL] = 0;
+    sos->pointerWakeups[PSXINPUT2] = 0;
+    gettimeofday (&sos->pointerSourceStart, 0);
+}
+
+static void
+releasePointerSource (CompScreen *s)
+{
+    struct timeval now;
+
+    STEREO3D_DISPLAY(s->display);
+    STEREO3D_SCREEN(s);
+
+    gettimeofday (&now, 0);
+    compLogMessage ("stereo3d", CompLogLevelDebug,
+		    "%s pointer source: %lu wakeups in %.1f s",
+		    sos->pointerSource == PSXINPUT2 ? "XInput2" : "mousepoll",
+		    sos->pointerWakeups[sos->pointerSource],
+		    (now.tv_sec - sos->pointerSourceStart.tv_sec) +
+		    (now.tv_usec - sos->pointerSourceStart.tv_usec) / 1000000.0);
+
+    if (sos->pointerSource == PSXINPUT2)
+	selectRawMotion (s, false);
+    else
+	sod->mpFunc->removePositionPolling (s, sos->pollHandle);
+}
+
+static void
+stereo3dPointerSourceChanged (CompDisplay           *d,
+			      CompOption            *opt,
+			      Stereo3dDisplayOptions num)
+{
+    CompScreen *s;
+
+    for (s = d->screens; s; s = s->next)
+    {
+	STEREO3D_SCREEN (s);
+
+	if (sos->mouseDrawingEnabled && sos->enabled)
+	{
+	    releasePointerSource (s);
+	    acquirePointerSource (s);
+	}
+    }
+}
+
+
+static void
+stereo3dRecordFileChanged (CompDisplay           *d,
+			   CompOption            *opt,
+			   Stereo3dDisplayOptions num)
+{
+    CompScreen *s;
+
+    // the next frame starts recording to the new file
+    for (s = d->screens; s; s = s->next)
+    {
+	STEREO3D_SCREEN (s);
+
+	stopRecording (s);
+	sos->recordFailed = false;
+    }
+}
+
+static Bool
+snapshot (CompDisplay     *d,
+	  CompAction      *action,
+	  CompActionState state,
+	  CompOption      *option,
+	  int             nOption)
+{
+    CompScreen *s;
+    Window     xid;
+
+    xid = getIntOptionNamed (option, nOption, "root", 0);
+    s = findScreenAtDisplay (d, xid);
+
+    if (s)
+    {
+	STEREO3D_SCREEN (s);
+
+	sos->snapshotPending = true;
+	damageScreen (s);
+    }
+
+    return TRUE;
+}
+
+FloatingTypeEnum
+getFloatingType (CompWindow *window)
+{
+    if (window->attrib.override_redirect)
+	return FTNONE;
+
+    if (window->attrib.map_state != IsViewable || window->shaded)
+        return FTNONE;
+
+    if (matchEval (stereo3dGetDesktopMatch (window->screen->display), window))
+	return FTBACKGROUND;
+
+    if (matchEval (stereo3dGetDockMatch (window->screen->display), window))
+	return FTDOCK;
+
+    if (matchEval (stereo3dGetWindowMatch (window->screen->display), window))
+	return FTWINDOW;
+
+    return FTNONE;
+}
+
+static bool
+isOnCurrentViewport (CompWindow *w)
+{
+    CompScreen *s = w->screen;
+
+    return w->attrib.x + w->width > 0 && w->attrib.x < s->width &&
+           w->attrib.y + w->height > 0 && w->attrib.y < s->height;
+}
+
+static bool
+growWindowIndex (Stereo3DScreen *sos, int size)
+{
+    Stereo3DWindow **windows;
+
+    if (size <= sos->windowIndexSize)
+        return true;
+
+    windows = (Stereo3DWindow**)realloc (sos->backgroundWindows, size * sizeof (Stereo3DWindow *));
+    if (!windows)
+        return false;
+    sos->backgroundWindows = windows;
+
+    windows = (Stereo3DWindow**)realloc (sos->dockWindows, size * sizeof (Stereo3DWindow *));
+    if (!windows)
+        return false;
+    sos->dockWindows = windows;
+
+    windows = (Stereo3DWindow**)realloc (sos->floatingWindows, size * sizeof (Stereo3DWindow *));
+    if (!windows)
+        return false;
+    sos->floatingWindows = windows;
+
+    sos->windowIndexSize = size;
+
+    return true;
+}
 
-    fa = (FragmentAttrib*)memcpy (malloc (sizeof (FragmentAttrib)), attrib, sizeof (FragmentAttrib));
+/* Returns the topmost window if it is a fullscreen client that renders
+ * stereo frames itself, those are shown as they are. */
+static CompWindow *
+findPassthroughWindow (CompScreen *s)
+{
+    CompWindow *w;
 
-    if(sos->enabled)
+    for (w = s->reverseWindows; w; w = w->prev)
     {
-        // switches the eyes
-        bool invert = stereo3dGetInvert(w->screen->display);
+        if (w->attrib.override_redirect || w->attrib.map_state != IsViewable)
+            continue;
+        if (!isOnCurrentViewport (w))
+            continue;
 
-        switch (sos->renderingState)
-        {
-            case EyeLeft:
-                    sos->currFilter->applyFilter(invert?1:0, fa, texture, w->screen);
-                break;
+        if (!(w->state & CompWindowStateFullscreenMask))
+            return NULL;
 
-            case EyeRight:
-                    sos->currFilter->applyFilter(invert?0:1, fa, texture, w->screen);
-                break;
+        STEREO3D_WINDOW (w);
 
-            default:
-                break;
-        }
+        if (sow->passthroughHint ||
+            matchEval (stereo3dGetPassthroughMatch (s->display), w))
+            return w;
 
-        if(sow->floatingType == FTBACKGROUND)
-        {
-            drawBackgroundWireframe(w, sos->lightingStrength, sos->edgesStrength);
-        }
+        return NULL;
     }
 
-    UNWRAP (sos, w->screen, drawWindowTexture);
-    (*w->screen->drawWindowTexture) (w, texture, fa, mask);
-    WRAP (sos, w->screen, drawWindowTexture, stereo3dDrawWindowTexture);
-
-    free (fa);
+    return NULL;
 }
 
-
-static void
-initProjectionMatrixChange()
+/* Classifies the windows of the current viewport and sorts them into the
+ * per-type arrays used by updateWindowsPosition. Windows that drop out of
+ * the index get their lighting reset once here instead of every frame,
+ * the others keep theirs until the layout moves them. */
+void
+updateWindowIndex (CompScreen *s)
 {
-//    compLogMessage ("stereoscopic", CompLogLevelError, "initProjectionMatrixChange"  );
-    glMatrixMode (GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity ();
-    glMatrixMode (GL_MODELVIEW);
-}
+    CompWindow *w;
+    int        nWindows = 0;
 
-static float
-getWorldZCorrection(float fov)
-{
-    float tanfov = 0.5f / tan(fov * M_PI / 360.0);
+    STEREO3D_SCREEN (s);
 
-    float result = DEFAULT_Z_CAMERA - (tanfov);
+    HOOK_COUNT (&sos->hookCounters, HookIndexRebuild);
 
-    return result;
-}
+    for (w = s->windows; w; w = w->next)
+        nWindows++;
 
-static void
-setLeftEyeProjectionMatrix (CompScreen *s)
-{
-    STEREO3D_SCREEN (s);
+    sos->nBackgroundWindows = 0;
+    sos->nDockWindows = 0;
+    sos->nFloatingWindows = 0;
 
-    sos->renderingState = EyeLeft;
+    if (sos->layoutWorker.running)
+        clearLayoutWindows (&sos->layoutWorker);
 
-    glMatrixMode (GL_PROJECTION);
-    glLoadIdentity ();
+    for (w = s->windows; w; w = w->next)
+    {
+        STEREO3D_WINDOW (w);
+        sow->inGrid = false;
+    }
 
-    glMultMatrixf (sos->projectionL);
+    if (!resetWindowGrid (&sos->windowGrid, s->width, s->height))
+        compLogMessage ("stereo3d", CompLogLevelError, "unable to allocate window grid");
 
-    glTranslatef( -(sos->parallax), 0.0f, getWorldZCorrection( stereo3dGetFov(s->display) ) );
+    if (!growWindowIndex (sos, nWindows))
+    {
+        compLogMessage ("stereo3d", CompLogLevelError, "unable to allocate window index");
+        return;
+    }
 
-    glMatrixMode (GL_MODELVIEW);
-}
+    // windows are in stacking order, bottom-most first
+    nWindows = 0;
+    for (w = s->windows; w; w = w->next)
+    {
+        STEREO3D_WINDOW (w);
 
+        FloatingTypeEnum floatingType = getFloatingType (w);
 
-static void
-setRightEyeProjectionMatrix (CompScreen *s)
-{
-    STEREO3D_SCREEN (s);
+        sow->onViewport = isOnCurrentViewport (w);
+        if (floatingType != FTBACKGROUND && !sow->onViewport)
+            floatingType = FTNONE;
 
-    sos->renderingState = EyeRight;
+        // placed again even where its new type puts it at the same depth
+        if (floatingType != sow->floatingType)
+            sow->layoutAssigned = false;
 
-    glMatrixMode (GL_PROJECTION);
-    glLoadIdentity ();
+        sow->stackPosition = nWindows++;
+        sow->stackBelow = w->prev ? w->prev->id : None;
+        sow->floatingType = floatingType;
+        sow->layoutGroup = w->clientLeader ? w->clientLeader : w->id;
+        sow->drawMouse = false;
 
-    glMultMatrixf (sos->projectionR);
+        if (sow->floatingType == FTNONE)
+        {
+            sow->opacity = 1.0f;
+            sow->brightness = 1.0f;
+            sow->saturation = 1.0f;
+        }
 
-    glTranslatef(sos->parallax, 0.0f, getWorldZCorrection( stereo3dGetFov(s->display) ) );
+        if (sos->layoutWorker.running)
+            addLayoutWindow (&sos->layoutWorker, sow);
 
-    glMatrixMode (GL_MODELVIEW);
-}
+        switch (sow->floatingType)
+        {
+        case FTBACKGROUND:
+            sos->backgroundWindows[sos->nBackgroundWindows++] = sow;
+            break;
 
+        case FTDOCK:
+            sos->dockWindows[sos->nDockWindows++] = sow;
+            break;
 
-static void
-setNoConvergenceProjectionMatrix (CompScreen *s)
-{
-    STEREO3D_SCREEN (s);
+        case FTWINDOW:
+            sos->floatingWindows[sos->nFloatingWindows++] = sow;
+            break;
 
-    sos->renderingState = EyeSingle;
+        default:
+            break;
+        }
+    }
+
+    assignLayoutGroups (&sos->layoutGroups, sos->floatingWindows, sos->nFloatingWindows);
+
+    // top to bottom, so the grid cells are filled by appending
+    for (w = s->reverseWindows; w; w = w->prev)
+    {
+        STEREO3D_WINDOW (w);
 
-    glMatrixMode (GL_PROJECTION);
-    glLoadIdentity ();
+        if (sow->floatingType != FTNONE)
+            insertGridWindow (&sos->windowGrid, sow);
+    }
+
+    sos->pointerWindow = findGridWindow (&sos->windowGrid, &sos->hookCounters,
+                                         sos->animationMgr.mouseDst.x,
+                                         sos->animationMgr.mouseDst.y);
 
-    glMultMatrixf (sos->projectionM);
+    sos->passthroughWindow = findPassthroughWindow (s);
 
-    glTranslatef( 0.0f, 0.0f, getWorldZCorrection( stereo3dGetFov(s->display) ) );
+    sos->viewportX = s->x;
+    sos->viewportY = s->y;
+    sos->windowIndexDirty = false;
+    sos->windowIndexGeneration++;
 
-    glMatrixMode (GL_MODELVIEW);
+    // the cursor was unhooked above; a rebuild without a window event
+    // (options, window state, viewport) counts as a restack
+    sos->animationMgr.cursorWindow = NULL;
+    if (!sos->animationMgr.layoutEvents)
+        sos->animationMgr.layoutEvents = LAYOUT_EVENT (LayoutEventRestack);
+    sos->animationMgr.layoutSettled = false;
 }
 
 static void
-cleanupProjectionMatrixOperations (CompScreen *s)
+invalidateScreenWindowIndex (CompScreen *s, int event)
 {
     STEREO3D_SCREEN (s);
 
-    sos->renderingState = Cleanup;
-    glMatrixMode (GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode (GL_MODELVIEW);
+    sos->windowIndexDirty = true;
+    sos->animationMgr.layoutEvents |= LAYOUT_EVENT (event);
 }
 
-/********************************************************************
-*******************       Handle Inputs       ***********************
-*********************************************************************/
-static Bool
-moveForegroundIn(CompDisplay     *display,
-		 CompAction      *action,
-		 CompActionState state,
-		 CompOption      *option,
-		 int             nOption)
+static void
+invalidateWindowIndex (CompDisplay *d, int event)
 {
     CompScreen *s;
-    Window     xid;
-
-    xid = getIntOptionNamed (option, nOption, "root", 0);
-    s = findScreenAtDisplay (display, xid);
-
-    if (s) {
-        STEREO3D_SCREEN (s);
-        return moveForegroundIn (&sos->animationMgr);
-    }
 
-    return TRUE;
+    for (s = d->screens; s; s = s->next)
+        invalidateScreenWindowIndex (s, event);
 }
 
-static Bool
-moveForegroundOut(CompDisplay     *display,
-		  CompAction      *action,
-		  CompActionState state,
-		  CompOption      *option,
-		  int             nOption)
+/* Only a window going up or down the stack or across the viewport edge
+ * changes the index, moving and resizing it within the viewport is left
+ * to the window grid (see updateGridWindow) and is no layout event.
+ * Core has already restacked the window for the event at this point. */
+static void
+handleConfigureNotify (CompDisplay     *d,
+		       XConfigureEvent *ce)
 {
-    CompScreen *s;
-    Window     xid;
+    CompWindow *w = findWindowAtDisplay (d, ce->window);
 
-    xid = getIntOptionNamed (option, nOption, "root", 0);
-    s = findScreenAtDisplay (display, xid);
+    if (!w)
+    {
+	CompScreen *s = findScreenAtDisplay (d, ce->window);
 
-    if (s) {
-        STEREO3D_SCREEN (s);
-        return moveForegroundOut (&sos->animationMgr);
+	// a resized root changes the viewport of every window
+	if (s)
+	    invalidateScreenWindowIndex (s, LayoutEventRestack);
+	return;
     }
 
-    return TRUE;
-}
+    STEREO3D_WINDOW (w);
 
+    Window below = w->prev ? w->prev->id : None;
 
-static Bool
-resetForegroundDepth(CompDisplay     *display,
-		     CompAction      *action,
-		     CompActionState state,
-		     CompOption      *option,
-		     int             nOption)
+    if (below != sow->stackBelow)
+	invalidateScreenWindowIndex (w->screen, LayoutEventRestack);
+
+    // to the layout a window leaving or entering the viewport is mapped
+    if (isOnCurrentViewport (w) != sow->onViewport)
+	invalidateScreenWindowIndex (w->screen, LayoutEventMap);
+}
+
+/* The server time of a raw event. Core does not fetch the data of
+ * generic events; when no other plugin did either it is fetched and
+ * freed here, CurrentTime if that fails */
+static Time
+rawEventTime (Display             *dpy,
+	      XGenericEventCookie *cookie)
 {
-    CompScreen *s;
-    Window     xid;
+    Time time = CurrentTime;
 
-    xid = getIntOptionNamed (option, nOption, "root", 0);
-    s = findScreenAtDisplay (display, xid);
+    if (cookie->data)
+	return ((XIRawEvent *) cookie->data)->time;
 
-    if (s) {
-        STEREO3D_SCREEN (s);
-        return resetForegroundDepth (&sos->animationMgr);
+    if (XGetEventData (dpy, cookie))
+    {
+	time = ((XIRawEvent *) cookie->data)->time;
+	XFreeEventData (dpy, cookie);
     }
 
-    return TRUE;
+    return time;
 }
 
-
-static Bool
-toggleOn (CompDisplay     *d,
-	  CompAction      *action,
-	  CompActionState state,
-	  CompOption      *option,
-	  int             nOption)
+static void
+stereo3dHandleEvent (CompDisplay *d,
+		     XEvent      *event)
 {
     CompScreen *s;
-    Window xid;
 
-    xid = getIntOptionNamed (option, nOption, "root", 0);
-    s = findScreenAtDisplay (d, xid);
+    STEREO3D_DISPLAY (d);
 
-    if (s)
-    {
-	STEREO3D_SCREEN (s);
-	sos->enabled = !sos->enabled;
+    UNWRAP (sod, d, handleEvent);
+    (*d->handleEvent) (d, event);
+    WRAP (sod, d, handleEvent, stereo3dHandleEvent);
+
+    switch (event->type) {
+    case MapNotify:
+    case UnmapNotify:
+    case DestroyNotify:
+    case ReparentNotify:
+	// map state and stacking order are updated by core at this point,
+	// the event window of these is the root they were selected on
+	s = findScreenAtDisplay (d, event->xany.window);
+	if (s)
+	    invalidateScreenWindowIndex (s, LayoutEventMap);
+	else
+	    invalidateWindowIndex (d, LayoutEventMap);
+	break;
+    case ConfigureNotify:
+	handleConfigureNotify (d, &event->xconfigure);
+	break;
+    case PropertyNotify:
+	if (event->xproperty.atom == sod->passthroughAtom)
+	{
+	    CompWindow *w = findWindowAtDisplay (d, event->xproperty.window);
 
-	if(!sos->mouseDrawingEnabled)
-	    return true;
+	    if (w)
+	    {
+		STEREO3D_SCREEN (w->screen);
+		STEREO3D_WINDOW (w);
 
-	if(sos->enabled)
-	{
-	    if(sos->mouseDrawingEnabled)
-		enableMouseDrawing(s);
+		sow->passthroughHint = getWindowProp (d, w->id, sod->passthroughAtom, 0);
+		sos->windowIndexDirty = true;
+	    }
 	}
-	else
+	break;
+    case GenericEvent:
+	if (sod->xi2Available &&
+	    event->xcookie.extension == sod->xiOpcode &&
+	    event->xcookie.evtype == XI_RawMotion)
 	{
-	    if(sos->mouseDrawingEnabled)
-		disableMouseDrawing(s);
+	    Time time = rawEventTime (d->display, &event->xcookie);
+
+	    for (s = d->screens; s; s = s->next)
+	    {
+		STEREO3D_SCREEN (s);
+
+		if (sos->mouseDrawingEnabled && sos->pointerSource == PSXINPUT2)
+		{
+		    latencyServerEvent (&sos->latency, time);
+
+		    if (!sos->pointerMoved)
+			sos->pointerMovedTime = time;
+
+		    sos->pointerMoved = true;
+		    sos->pointerWakeups[PSXINPUT2]++;
+		}
+	    }
 	}
+	break;
+    default:
+	break;
     }
-    
-    return true;
 }
 
 static void
-updateMouseInterval (CompScreen *s, int x, int y)
+stereo3dMatchPropertyChanged (CompDisplay *d,
+			      CompWindow  *w)
 {
-    STEREO3D_SCREEN(s);
+    STEREO3D_DISPLAY (d);
+    STEREO3D_SCREEN (w->screen);
 
-    setDestMouseX (&sos->animationMgr, x);
-    setDestMouseY (&sos->animationMgr, y);
+    sos->windowIndexDirty = true;
+
+    UNWRAP (sod, d, matchPropertyChanged);
+    (*d->matchPropertyChanged) (d, w);
+    WRAP (sod, d, matchPropertyChanged, stereo3dMatchPropertyChanged);
 }
 
+static void
+stereo3dWindowStateChangeNotify (CompWindow   *w,
+				 unsigned int lastState)
+{
+    STEREO3D_SCREEN (w->screen);
+
+    sos->windowIndexDirty = true;
 
-FloatingTypeEnum
-getFloatingType (CompWindow *window)
+    UNWRAP (sos, w->screen, windowStateChangeNotify);
+    (*w->screen->windowStateChangeNotify) (w, lastState);
+    WRAP (sos, w->screen, windowStateChangeNotify, stereo3dWindowStateChangeNotify);
+}
+
+/* Keeps the window grid in step with window geometry, the stack and the
+ * classification only change through a rebuild of the window index */
+static void
+updateGridWindow (CompWindow *w)
 {
-    if (window->attrib.override_redirect)
-	return FTNONE;
+    STEREO3D_SCREEN (w->screen);
+    STEREO3D_WINDOW (w);
 
-    if (window->attrib.map_state != IsViewable || window->shaded)
-        return FTNONE;
+    if (!sow->inGrid)
+        return;
 
-    //TODO: move fetching options out of the drawing loop
+    removeGridWindow (&sos->windowGrid, sow);
+    insertGridWindow (&sos->windowGrid, sow);
 
-    if (matchEval (stereo3dGetDesktopMatch (window->screen->display), window))
-	return FTBACKGROUND;
+    sos->pointerWindow = findGridWindow (&sos->windowGrid, &sos->hookCounters,
+                                         sos->animationMgr.mouseDst.x,
+                                         sos->animationMgr.mouseDst.y);
+}
 
-    if (matchEval (stereo3dGetDockMatch (window->screen->display), window))
-	return FTDOCK;
+static void
+stereo3dWindowMoveNotify (CompWindow *w,
+			  int        dx,
+			  int        dy,
+			  Bool       immediate)
+{
+    STEREO3D_SCREEN (w->screen);
 
-    if (matchEval (stereo3dGetWindowMatch (window->screen->display), window))
-	return FTWINDOW;
+    updateGridWindow (w);
 
-    return FTNONE;
+    UNWRAP (sos, w->screen, windowMoveNotify);
+    (*w->screen->windowMoveNotify) (w, dx, dy, immediate);
+    WRAP (sos, w->screen, windowMoveNotify, stereo3dWindowMoveNotify);
+}
+
+static void
+stereo3dWindowResizeNotify (CompWindow *w,
+			    int        dx,
+			    int        dy,
+			    int        dwidth,
+			    int        dheight)
+{
+    STEREO3D_SCREEN (w->screen);
+
+    updateGridWindow (w);
+
+    UNWRAP (sos, w->screen, windowResizeNotify);
+    (*w->screen->windowResizeNotify) (w, dx, dy, dwidth, dheight);
+    WRAP (sos, w->screen, windowResizeNotify, stereo3dWindowResizeNotify);
+}
+
+static void
+stereo3dMatchOptionChanged (CompDisplay           *d,
+			    CompOption            *opt,
+			    Stereo3dDisplayOptions num)
+{
+    invalidateWindowIndex (d, LayoutEventRestack);
 }
 
 /********************************************************************
@@ -906,31 +2392,53 @@ stereo3dInitScreen (CompPlugin *p,
 
     stereo3dSetToggleInitiate (s->display, toggleOn);
 
-
-    sos->anaglyphFilter = new AnaglyphFilter;
-    sos->interlacedFilter = new InterlacedFilter;
-
-    sos->anaglyphFilter->init();
-    sos->interlacedFilter->init();
-
-
-    sos->currFilter = sos->anaglyphFilter;
-
-
-    /* draw cursor to texture */
-    sos->mouseDrawingEnabled = stereo3dGetDrawmouse(s->display);
+    stereo3dSetWindowMatchNotify (s->display, stereo3dMatchOptionChanged);
+    stereo3dSetDesktopMatchNotify (s->display, stereo3dMatchOptionChanged);
+    stereo3dSetDockMatchNotify (s->display, stereo3dMatchOptionChanged);
+    stereo3dSetPassthroughMatchNotify (s->display, stereo3dMatchOptionChanged);
+
+    stereo3dSetPointerSourceNotify (s->display, stereo3dPointerSourceChanged);
+    stereo3dSetRecordFileNotify (s->display, stereo3dRecordFileChanged);
+
+    stereo3dSetSnapshotInitiate (s->display, snapshot);
+
+    sos->windowIndexDirty = true;
+    sos->animationMgr.layoutSettled = false;
+    sos->passthroughWindow = NULL;
+    sos->passthrough = false;
+    sos->stereoActive = false;
+    sos->snapshotPending = false;
+    sos->captureEye = -1;
+    sos->renderView = -1;
+    sos->exporter.fd = -1;
+
+    /* the filters only get their fragment functions on first use,
+     * selectFilter picks one for the output mode each frame. The cursor
+     * texture and mouse polling wait for drawmouse, see
+     * prepareStereoFrame */
+    sos->monoFilter.init();
+    sos->anaglyphFilter.init();
+    sos->interlacedFilter.init();
+    sos->filterMode = -1;
+    for (int eye = EyeLeft; eye <= Cleanup; eye++)
+        sos->eyeFilter[eye] = -1;
+
+    sos->mouseDrawingEnabled = false;
 
     WRAP (sos, s, preparePaintScreen, stereo3dPreparePaintScreen);
     WRAP (sos, s, paintOutput, stereo3dPaintOutput);
     WRAP (sos, s, paintTransformedOutput, stereo3dPaintTransformedOutput);
     WRAP (sos, s, donePaintScreen, stereo3dDonePaintScreen);
+    WRAP (sos, s, paintWindow, stereo3dPaintWindow);
     WRAP (sos, s, drawWindow, stereo3dDrawWindow);
     WRAP (sos, s, drawWindowTexture, stereo3dDrawWindowTexture);
+    WRAP (sos, s, windowStateChangeNotify, stereo3dWindowStateChangeNotify);
+    WRAP (sos, s, windowMoveNotify, stereo3dWindowMoveNotify);
+    WRAP (sos, s, windowResizeNotify, stereo3dWindowResizeNotify);
 
-    s->base.privates[sod->screenPrivateIndex].ptr = sos;
+    initQualityGovernor (s, &sos->quality);
 
-    if(sos->mouseDrawingEnabled)
-        enableMouseDrawing(s);
+    s->base.privates[sod->screenPrivateIndex].ptr = sos;
 
     return TRUE;
 }
@@ -938,57 +2446,126 @@ stereo3dInitScreen (CompPlugin *p,
 static void
 enableMouseDrawing(CompScreen *s)
 {
-    int x, y;
-
-    STEREO3D_DISPLAY(s->display);
-    STEREO3D_SCREEN(s);
 
-    updateCursor(s);
+    requestCursorImage(s);
 
-    //hides original cursor
-    XFixesHideCursor (s->display->display, s->root);
-    
-    sos->pollHandle = sod->mpFunc->addPositionPolling (s, updateMouseInterval);
-    //lastChange = time(NULL);
-    sod->mpFunc->getCurrentPosition (s, &x, &y);
-    setDestMouseX (&sos->animationMgr, (float) x);
-    setDestMouseY (&sos->animationMgr, (float) y);
+    acquirePointerSource(s);
 }
 
 static void
 disableMouseDrawing(CompScreen *s)
 {
-    STEREO3D_DISPLAY(s->display);
     STEREO3D_SCREEN(s);
 
-    sod->mpFunc->removePositionPolling (s, sos->pollHandle);
-    XFixesShowCursor (s->display->display, s->root);
+    if (sos->cursorRequestPending)
+    {
+	xcb_discard_reply (XGetXCBConnection (s->display->display),
+			   sos->cursorCookie.sequence);
+	sos->cursorRequestPending = false;
+    }
+
+    if (sos->pointerRequestPending)
+    {
+	xcb_discard_reply (XGetXCBConnection (s->display->display),
+			   sos->pointerCookie.sequence);
+	sos->pointerRequestPending = false;
+    }
+
+    releasePointerSource(s);
+
+    if (sos->cursorHidden)
+    {
+	XFixesShowCursor (s->display->display, s->root);
+	sos->cursorHidden = false;
+    }
+
     freeCursor (sos, &sos->cursorTex);
 }
 
+/* Switches between stereo output and passing a stereo-aware client
+ * through untouched. The client gets the real cursor back. */
+static void
+setPassthrough(CompScreen *s, bool passthrough)
+{
+    STEREO3D_SCREEN(s);
+
+    if (sos->passthrough == passthrough)
+	return;
+
+    sos->passthrough = passthrough;
+
+    if (passthrough)
+    {
+	compLogMessage ("stereo3d", CompLogLevelInfo, "passthrough for window 0x%lx",
+			sos->passthroughWindow->id);
+
+	if (sos->cursorHidden)
+	{
+	    XFixesShowCursor (s->display->display, s->root);
+	    sos->cursorHidden = false;
+	}
+    }
+    else
+    {
+	compLogMessage ("stereo3d", CompLogLevelInfo, "passthrough ended");
+
+	if (sos->mouseDrawingEnabled && sos->cursorTex.isSet && !sos->cursorHidden)
+	{
+	    XFixesHideCursor (s->display->display, s->root);
+	    sos->cursorHidden = true;
+	}
+    }
+
+    damageScreen (s);
+}
+
 static void
 stereo3dFiniScreen (CompPlugin *p,
 		    CompScreen *s)
 {
     STEREO3D_SCREEN (s);
+    GLCallCounters *gc = &sos->glCalls;
 
     freeWindowPrivateIndex (s, sos->windowPrivateIndex);
 
-    sos -> anaglyphFilter->deinit(s);
-    sos -> interlacedFilter->deinit(s);
+    sos->monoFilter.deinit(s);
+    sos->anaglyphFilter.deinit(s);
+    sos->interlacedFilter.deinit(s);
+    finiLayeredStereo (&sos->layered, &sos->shaders);
+    finiMultiView (&sos->multiView, &sos->shaders);
+    finiShaderBackend (&sos->shaders);
 
     if(sos->mouseDrawingEnabled)
         disableMouseDrawing(s);
 
-    glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
-    glDisable (GL_STENCIL_TEST);
+    finiQualityGovernor (s, &sos->quality);
+    stopLayoutWorker (s, &sos->layoutWorker, false);
+    free (sos->layoutWorker.freeSlots);
+    stopRecording (s);
+    stopTracing (&sos->trace);
+    stopExport (&sos->exporter);
+    if (sos->latency.enabled)
+	reportLatency (&sos->latency);
+
+    countedColorMask (gc, GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
+    countedDisable (gc, GL_STENCIL_TEST);
 
     UNWRAP (sos, s, preparePaintScreen);
     UNWRAP (sos, s, paintOutput);
     UNWRAP (sos, s, paintTransformedOutput);
     UNWRAP (sos, s, donePaintScreen);
+    UNWRAP (sos, s, paintWindow);
     UNWRAP (sos, s, drawWindow);
     UNWRAP (sos, s, drawWindowTexture);
+    UNWRAP (sos, s, windowStateChangeNotify);
+    UNWRAP (sos, s, windowMoveNotify);
+    UNWRAP (sos, s, windowResizeNotify);
+
+    free (sos->backgroundWindows);
+    free (sos->dockWindows);
+    free (sos->floatingWindows);
+    freeLayoutGroups (&sos->layoutGroups);
+    finiWindowGrid (&sos->windowGrid);
 
     free(sos);
 }
@@ -997,17 +2574,22 @@ static Bool
 stereo3dInitWindow (CompPlugin *p, CompWindow *w)
 {
     Stereo3DWindow *sow;
+    STEREO3D_DISPLAY(w->screen->display);
     STEREO3D_SCREEN(w->screen);
 
     sow = (Stereo3DWindow*)calloc (1, sizeof (Stereo3DWindow));
     if (!sow)
         return FALSE;
 
+    sow->window = w;
     sow->drawMouse = false;
     sow->floatingType = FTNONE;
 
     sow->floatingType = getFloatingType(w);
 
+    sow->passthroughHint = getWindowProp (w->screen->display, w->id,
+                                          sod->passthroughAtom, 0);
+
     sow->currAttrs.rotation.x=0.0f;
     sow->currAttrs.rotation.y=0.0f;
     sow->currAttrs.rotation.z=0.0f;
@@ -1028,16 +2610,29 @@ stereo3dInitWindow (CompPlugin *p, CompWindow *w)
 
     sow->dstAttrs.scale=1.0f;
 
+    allocLayoutSlot (&sos->layoutWorker, sow);
+
     w->base.privates[sos->windowPrivateIndex].ptr = sow;
 
+    sos->windowIndexDirty = true;
+
     return TRUE;
 }
 
 static void
 stereo3dFiniWindow (CompPlugin *p, CompWindow *w)
 {
+    STEREO3D_SCREEN(w->screen);
     STEREO3D_WINDOW(w);
 
+    sos->windowIndexDirty = true;
+
+    removeGridWindow (&sos->windowGrid, sow);
+    if (sos->pointerWindow == sow)
+        sos->pointerWindow = NULL;
+
+    releaseLayoutSlot (&sos->layoutWorker, sow);
+
     free(sow);
 }
 
@@ -1045,8 +2640,13 @@ static Bool
 stereo3dInitDisplay (CompPlugin  *p,
 		     CompDisplay *d)
 {
+    static const char *atomNames[] = {
+	"_COMPIZ_STEREO3D_PASSTHROUGH",
+	"_COMPIZ_STEREO3D_QUALITY"
+    };
     int index;
     Stereo3DDisplay *sod;
+    Atom atoms[ARRAY_SIZE (atomNames)];
 
     if (!checkPluginABI ("core", CORE_ABIVERSION))
         return FALSE;
@@ -1070,6 +2670,17 @@ stereo3dInitDisplay (CompPlugin  *p,
 
     sod->mpFunc = (MousePollFunc*) d->base.privates[index].ptr;
 
+    sod->xi2Checked = false;
+    sod->xi2Available = false;
+
+    // one round trip for all of the plugin's atoms
+    XInternAtoms (d->display, (char **) atomNames, ARRAY_SIZE (atomNames), 0, atoms);
+    sod->passthroughAtom = atoms[0];
+    sod->qualityAtom = atoms[1];
+
+    WRAP (sod, d, handleEvent, stereo3dHandleEvent);
+    WRAP (sod, d, matchPropertyChanged, stereo3dMatchPropertyChanged);
+
     d->base.privates[displayPrivateIndex].ptr = sod;
 
     return TRUE;
@@ -1081,6 +2692,9 @@ stereo3dFiniDisplay (CompPlugin  *p,
 {
     STEREO3D_DISPLAY (d);
 
+    UNWRAP (sod, d, handleEvent);
+    UNWRAP (sod, d, matchPropertyChanged);
+
     freeScreenPrivateIndex (d, sod->screenPrivateIndex);
     free (sod);
 }
@@ -1088,6 +2702,8 @@ stereo3dFiniDisplay (CompPlugin  *p,
 static Bool
 stereo3dInit (CompPlugin *p)
 {
+    gettimeofday (&pluginLoadTime, 0);
+
     displayPrivateIndex = allocateDisplayPrivateIndex ();
 
     if (displayPrivateIndex < 0)
@@ -30,6 +30,15 @@
 
 #include <X11/cursorfont.h>
 #include <X11/extensions/shape.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/extensions/XInput2.h>
+
+#include <xcb/xcbext.h>
+#include <xcb/xfixes.h>
+
+#include <sys/time.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include <GL/glu.h>
 #include <GL/gl.h>
@@ -43,6 +52,18 @@ typedef struct _Stereo3DDisplay
     int screenPrivateIndex;
 
     MousePollFunc *mpFunc;
+
+    // XInput2 is probed the first time it is asked for
+    bool xi2Checked;
+    bool xi2Available;
+    int  xiOpcode;
+
+    Atom passthroughAtom;
+    // the quality level published on the root windows
+    Atom qualityAtom;
+
+    HandleEventProc handleEvent;
+    MatchPropertyChangedProc matchPropertyChanged;
 } Stereo3DDisplay;
 
 enum FloatingTypeEnum { FTBACKGROUND, FTDOCK, FTWINDOW , FTNONE};
@@ -62,10 +83,93 @@ typedef struct _AnimationManager
     float               foregroundCurrZ;
     float               foregroundDstZ;
     float               backgroundDepth;
+    // depth of the window under the pointer, the cursor eases to it
+    float               cursorCurrZ;
+    float               cursorDstZ;
+
+    // layout inputs of the last frame, nothing is recomputed while
+    // they are unchanged and every window has reached its destination
+    bool                layoutSettled;
+    float               layoutDepth;
+    float               layoutLightingStrength;
+    float               layoutForegroundZ;
+    Stereo3DWindow      *layoutPointerWindow;
+    int                 layoutStrategy;
+
+    // LayoutStrategyType to place the floating windows with
+    int                 strategy;
+    // LayoutEvent bits since the last layout, the windows they moved
+    // are placed again
+    unsigned int        layoutEvents;
+    Stereo3DWindow      *focusWindow;
+    Stereo3DWindow      *cursorWindow;
+
+    // layoutWindows calls that did not return early, and the windows
+    // the last one eased
+    unsigned int        layoutPasses;
+    int                 animatedWindows;
     
 } AnimationManager;
 
+/* Depth policies for the floating windows, see layout.cpp */
+enum LayoutStrategyType
+{
+    // evenly spread by stacking order
+    LayoutStackLinear = 0,
+    // the focused window at the foreground, the others on one plane
+    LayoutFocusForward,
+    // windows of an application share the depth of its topmost one
+    LayoutAppGroups,
+    // the topmost few in fixed bands, the rest at the back
+    LayoutDepthBands,
+    LayoutStrategyCount
+};
+
+enum LayoutEvent
+{
+    LayoutEventRestack = 0,
+    LayoutEventMap,
+    LayoutEventFocus,
+    LayoutEventCount
+};
+
+#define LAYOUT_EVENT(event) (1 << (event))
+
+typedef struct _LayoutStats
+{
+    unsigned int passes;
+    unsigned int events[LayoutEventCount];
+    unsigned int touched[LayoutEventCount];
+    int          maxTouched[LayoutEventCount];
+} LayoutStats;
+
+/* Client leader to slot hash of assignLayoutGroups, kept between index
+ * rebuilds so it is only grown */
+typedef struct _LayoutGroupTable
+{
+    Window *groups;
+    int    *slots;
+    int    size;
+} LayoutGroupTable;
+
     void updateWindowsPosition(AnimationManager *animationMgr, CompScreen* s, float, float);
+    void finishAnimations(AnimationManager *animationMgr, CompScreen *s);
+    int layoutWindows(AnimationManager *animationMgr,
+                       Stereo3DWindow **background, int nBackground,
+                       Stereo3DWindow **dock, int nDock,
+                       Stereo3DWindow **floating, int nFloating,
+                       Stereo3DWindow *pointerWindow,
+                       float depth, float lightingStrength);
+    float getCurrentCursorZ(AnimationManager *animationMgr);
+
+    void assignFloatingDepths(AnimationManager *animationMgr, Stereo3DWindow **floating,
+                              int nFloating, float depth);
+    void assignLayoutGroups(LayoutGroupTable *table, Stereo3DWindow **floating,
+                            int nFloating);
+    void freeLayoutGroups(LayoutGroupTable *table);
+    const char *getLayoutStrategyName(int strategy);
+    void countLayoutPass(LayoutStats *stats, unsigned int events, int touched,
+                         const char *strategy);
     Bool moveForegroundIn(AnimationManager *animationMgr);
     Bool moveForegroundOut(AnimationManager *animationMgr);
     Bool resetForegroundDepth(AnimationManager *animationMgr);
@@ -77,49 +181,623 @@ typedef struct _AnimationManager
     void setDestMouseX(AnimationManager *animationMgr, float value);
     void setDestMouseY(AnimationManager *animationMgr, float value);
 //
-    void updateWindow(Stereo3DWindow * sow);
+    bool updateWindow(Stereo3DWindow * sow);
     void updateMousePosition(AnimationManager *animationMgr);
 
-typedef struct _StereoscopicFilterBase
+/* Window layout on a worker thread, see layoutworker.cpp. Each window
+ * has a slot for its lifetime; the worker keeps a copy of the layout
+ * state of every slot and runs layoutWindows over those with the inputs
+ * the compositor posted in preparePaint. What paintWindow needs of the
+ * result goes to one of two buffers, the compositor reads the other. */
+typedef struct _LayoutResult
+{
+    // window the slot belonged to, see Stereo3DWindow::workerSerial
+    unsigned int      serial;
+    WndAnimationAttrs attrs;
+    float             opacity;
+    float             brightness;
+    float             saturation;
+    bool              drawMouse;
+} LayoutResult;
+
+typedef struct _LayoutBuffer
+{
+    // by slot
+    LayoutResult *windows;
+    int          nWindows;
+    int          size;
+    float        foregroundZ;
+    float        cursorZ;
+    // the layout pass it holds, for the hook and layout stats
+    unsigned int sequence;
+    unsigned int events;
+    int          touched;
+    int          animated;
+    int          strategy;
+} LayoutBuffer;
+
+typedef struct _LayoutInputWindow
+{
+    int              slot;
+    unsigned int     serial;
+    FloatingTypeEnum floatingType;
+    Window           group;
+} LayoutInputWindow;
+
+typedef struct _LayoutInput
+{
+    // buffer the compositor reads while this is laid out
+    int          front;
+    float        depth;
+    float        lightingStrength;
+    float        foregroundDstZ;
+    int          strategy;
+    unsigned int events;
+    // -1 for none
+    int          focusSlot;
+    int          pointerSlot;
+    bool         finish;
+    // every window in stacking order, sent after an index rebuild
+    bool              windowsChanged;
+    LayoutInputWindow *windows;
+    int               nWindows;
+    int               size;
+} LayoutInput;
+
+typedef struct _LayoutWorker
+{
+    bool            running;
+    bool            failed;
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    bool            quit;
+
+    // built by the compositor during the frame, swapped into input when
+    // posted and from there into work when the worker takes it
+    LayoutInput     next;
+    LayoutInput     input;
+    bool            posted;
+
+    // the buffer the compositor reads this frame and the one published
+    // last, the worker only writes the other one
+    LayoutBuffer    buffers[2];
+    int             front;
+    volatile int    published;
+    unsigned int    acquiredSequence;
+
+    // slots of the windows, handed out by the compositor
+    int             nSlots;
+    int             *freeSlots;
+    int             nFreeSlots;
+    int             freeSlotsSize;
+    unsigned int    serial;
+
+    // the worker's own, never touched by the compositor while it runs
+    LayoutInput     work;
+    AnimationManager animationMgr;
+    Stereo3DWindow  **shadows;
+    int             nShadows;
+    Stereo3DWindow  **background;
+    Stereo3DWindow  **dock;
+    Stereo3DWindow  **floating;
+    int             arraysSize;
+    int             nBackground;
+    int             nDock;
+    int             nFloating;
+    LayoutGroupTable groups;
+    unsigned int    sequence;
+} LayoutWorker;
+
+    bool startLayoutWorker(CompScreen *s, LayoutWorker *lw);
+    void stopLayoutWorker(CompScreen *s, LayoutWorker *lw, bool restore);
+    void postLayoutFrame(CompScreen *s, LayoutWorker *lw, float depth, float lightingStrength);
+    void applyLayoutResult(LayoutWorker *lw, Stereo3DWindow *sow);
+    void allocLayoutSlot(LayoutWorker *lw, Stereo3DWindow *sow);
+    void releaseLayoutSlot(LayoutWorker *lw, Stereo3DWindow *sow);
+    void clearLayoutWindows(LayoutWorker *lw);
+    void addLayoutWindow(LayoutWorker *lw, Stereo3DWindow *sow);
+
+/********************************************************************
+*******************      GL call counters     ***********************
+*********************************************************************/
+
+/* The GL calls of the plugin's paint paths are counted per screen
+ * against the site that is current when they are made, see
+ * glcounters.cpp. A unit is one use of a site (one filter application,
+ * one cursor draw, ...), the budgets are given per unit. */
+enum GLCallSite
+{
+    GLSiteOther = 0,
+    GLSiteFilter,
+    GLSiteFilterSetup,
+    GLSiteProjection,
+    GLSiteCursor,
+    GLSiteWireframe,
+    GLSiteCount
+};
+
+enum GLCallType
+{
+    GLCallMatrix = 0,
+    GLCallColorMask,
+    GLCallStencil,
+    GLCallFragment,
+    GLCallVertex,
+    GLCallTextureBind,
+    GLCallGetError,
+    GLCallState,
+    GLCallUniform,
+    GLCallFramebuffer,
+    GLCallTypeCount
+};
+
+typedef struct _GLCallCounters
+{
+    bool         enabled;
+    int          site;
+    unsigned int calls[GLSiteCount][GLCallTypeCount];
+    unsigned int units[GLSiteCount];
+    bool         reported[GLSiteCount][GLCallTypeCount];
+    unsigned int frames;
+} GLCallCounters;
+
+    int checkGLCallBudget(CompScreen *s, GLCallCounters *gc);
+    int countGLCallOverruns(const GLCallCounters *gc, int width, int height,
+                            bool exceeded[GLSiteCount][GLCallTypeCount]);
+    unsigned int getGLCallTotal(const GLCallCounters *gc);
+
+#define GL_SITE(gc, s) ((gc)->site = (s))
+#define GL_SITE_UNIT(gc, s) ((gc)->site = (s), (gc)->units[s]++)
+#define GL_COUNT(gc, type) \
+    ((gc)->enabled ? (void) (gc)->calls[(gc)->site][type]++ : (void) 0)
+
+/* The counted GL calls of the paint paths, each one is counted where
+ * it is made */
+static inline void countedMatrixMode (GLCallCounters *gc, GLenum mode)
+{ GL_COUNT (gc, GLCallMatrix); glMatrixMode (mode); }
+static inline void countedPushMatrix (GLCallCounters *gc)
+{ GL_COUNT (gc, GLCallMatrix); glPushMatrix (); }
+static inline void countedPopMatrix (GLCallCounters *gc)
+{ GL_COUNT (gc, GLCallMatrix); glPopMatrix (); }
+static inline void countedLoadIdentity (GLCallCounters *gc)
+{ GL_COUNT (gc, GLCallMatrix); glLoadIdentity (); }
+static inline void countedLoadMatrixf (GLCallCounters *gc, const GLfloat *m)
+{ GL_COUNT (gc, GLCallMatrix); glLoadMatrixf (m); }
+static inline void countedMultMatrixf (GLCallCounters *gc, const GLfloat *m)
+{ GL_COUNT (gc, GLCallMatrix); glMultMatrixf (m); }
+static inline void countedTranslatef (GLCallCounters *gc, GLfloat x, GLfloat y, GLfloat z)
+{ GL_COUNT (gc, GLCallMatrix); glTranslatef (x, y, z); }
+static inline void countedOrtho (GLCallCounters *gc, GLdouble left, GLdouble right,
+                                 GLdouble bottom, GLdouble top, GLdouble zNear, GLdouble zFar)
+{ GL_COUNT (gc, GLCallMatrix); glOrtho (left, right, bottom, top, zNear, zFar); }
+
+static inline void countedColorMask (GLCallCounters *gc, GLboolean red, GLboolean green,
+                                     GLboolean blue, GLboolean alpha)
+{ GL_COUNT (gc, GLCallColorMask); glColorMask (red, green, blue, alpha); }
+
+static inline void countedStencilFunc (GLCallCounters *gc, GLenum func, GLint ref, GLuint mask)
+{ GL_COUNT (gc, GLCallStencil); glStencilFunc (func, ref, mask); }
+static inline void countedStencilOp (GLCallCounters *gc, GLenum fail, GLenum zfail, GLenum zpass)
+{ GL_COUNT (gc, GLCallStencil); glStencilOp (fail, zfail, zpass); }
+static inline void countedStencilMask (GLCallCounters *gc, GLuint mask)
+{ GL_COUNT (gc, GLCallStencil); glStencilMask (mask); }
+static inline void countedClearStencil (GLCallCounters *gc, GLint s)
+{ GL_COUNT (gc, GLCallStencil); glClearStencil (s); }
+
+static inline void countedAddFragmentFunction (GLCallCounters *gc, FragmentAttrib *attrib,
+                                               int function)
+{ GL_COUNT (gc, GLCallFragment); addFragmentFunction (attrib, function); }
+
+static inline void countedVertex2f (GLCallCounters *gc, GLfloat x, GLfloat y)
+{ GL_COUNT (gc, GLCallVertex); glVertex2f (x, y); }
+static inline void countedVertex3f (GLCallCounters *gc, GLfloat x, GLfloat y, GLfloat z)
+{ GL_COUNT (gc, GLCallVertex); glVertex3f (x, y, z); }
+
+static inline void countedBindTexture (GLCallCounters *gc, GLenum target, GLuint texture)
+{ GL_COUNT (gc, GLCallTextureBind); glBindTexture (target, texture); }
+
+static inline GLenum countedGetError (GLCallCounters *gc)
+{ GL_COUNT (gc, GLCallGetError); return glGetError (); }
+
+static inline void countedEnable (GLCallCounters *gc, GLenum cap)
+{ GL_COUNT (gc, GLCallState); glEnable (cap); }
+static inline void countedDisable (GLCallCounters *gc, GLenum cap)
+{ GL_COUNT (gc, GLCallState); glDisable (cap); }
+static inline void countedBegin (GLCallCounters *gc, GLenum mode)
+{ GL_COUNT (gc, GLCallState); glBegin (mode); }
+static inline void countedEnd (GLCallCounters *gc)
+{ GL_COUNT (gc, GLCallState); glEnd (); }
+static inline void countedColor4f (GLCallCounters *gc, GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{ GL_COUNT (gc, GLCallState); glColor4f (r, g, b, a); }
+static inline void countedTexCoord2d (GLCallCounters *gc, GLdouble s, GLdouble t)
+{ GL_COUNT (gc, GLCallState); glTexCoord2d (s, t); }
+static inline void countedTexCoord2f (GLCallCounters *gc, GLfloat s, GLfloat t)
+{ GL_COUNT (gc, GLCallState); glTexCoord2f (s, t); }
+static inline void countedLineWidth (GLCallCounters *gc, GLfloat width)
+{ GL_COUNT (gc, GLCallState); glLineWidth (width); }
+static inline void countedHint (GLCallCounters *gc, GLenum target, GLenum mode)
+{ GL_COUNT (gc, GLCallState); glHint (target, mode); }
+static inline void countedBlendFunc (GLCallCounters *gc, GLenum sfactor, GLenum dfactor)
+{ GL_COUNT (gc, GLCallState); glBlendFunc (sfactor, dfactor); }
+static inline void countedClear (GLCallCounters *gc, GLbitfield mask)
+{ GL_COUNT (gc, GLCallState); glClear (mask); }
+static inline void countedViewport (GLCallCounters *gc, GLint x, GLint y,
+                                    GLsizei width, GLsizei height)
+{ GL_COUNT (gc, GLCallState); glViewport (x, y, width, height); }
+static inline void countedPixelStorei (GLCallCounters *gc, GLenum pname, GLint param)
+{ GL_COUNT (gc, GLCallState); glPixelStorei (pname, param); }
+static inline void countedVertexPointer (GLCallCounters *gc, GLint size, GLenum type,
+                                         GLsizei stride, const GLvoid *pointer)
+{ GL_COUNT (gc, GLCallState); glVertexPointer (size, type, stride, pointer); }
+static inline void countedTexCoordPointer (GLCallCounters *gc, GLint size, GLenum type,
+                                           GLsizei stride, const GLvoid *pointer)
+{ GL_COUNT (gc, GLCallState); glTexCoordPointer (size, type, stride, pointer); }
+static inline void countedDrawElements (GLCallCounters *gc, GLenum mode, GLsizei count,
+                                        GLenum type, const GLvoid *indices)
+{ GL_COUNT (gc, GLCallVertex); glDrawElements (mode, count, type, indices); }
+
+static inline void countedBindFramebuffer (GLCallCounters *gc, GLBindFramebufferProc bind,
+                                           GLenum target, GLuint framebuffer)
+{ GL_COUNT (gc, GLCallFramebuffer); (*bind) (target, framebuffer); }
+static inline void countedCopyTexSubImage2D (GLCallCounters *gc, GLenum target, GLint level,
+                                             GLint xoffset, GLint yoffset, GLint x, GLint y,
+                                             GLsizei width, GLsizei height)
+{
+    GL_COUNT (gc, GLCallFramebuffer);
+    glCopyTexSubImage2D (target, level, xoffset, yoffset, x, y, width, height);
+}
+static inline void countedReadPixels (GLCallCounters *gc, GLint x, GLint y,
+                                      GLsizei width, GLsizei height, GLenum format,
+                                      GLenum type, GLvoid *pixels)
+{ GL_COUNT (gc, GLCallFramebuffer); glReadPixels (x, y, width, height, format, type, pixels); }
+
+/********************************************************************
+*******************     Hook call counters    ***********************
+*********************************************************************/
+
+/* Calls per frame of the paint hooks and the per-window work behind
+ * them, per screen, checked against the window count in hookstats.cpp */
+enum HookCounter
+{
+    HookPreparePaintScreen = 0,
+    HookPaintOutput,
+    HookPaintTransformedOutput,
+    HookDonePaintScreen,
+    HookPaintWindow,
+    HookDrawWindow,
+    HookDrawWindowTexture,
+    HookPrepareFilter,
+    HookApplyFilter,
+    HookCleanupFilter,
+    HookLayoutWindow,
+    HookIndexRebuild,
+    HookGridLookup,
+    HookGLCalls,
+    HookCounterCount
+};
+
+// window counts 1, 2-3, 4-7, ... 2048 and more
+#define HOOK_STATS_BUCKETS 12
+
+typedef struct _HookCounters
+{
+    bool          enabled;
+    unsigned int  frame[HookCounterCount];
+    // totals of the evaluated frames by window count bucket, the windows
+    // only of the frames a counter was called in: layout and index work
+    // happens on some frames only and is compared per frame it ran in
+    unsigned long calls[HOOK_STATS_BUCKETS][HookCounterCount];
+    unsigned long windows[HOOK_STATS_BUCKETS][HookCounterCount];
+    bool          reported[HookCounterCount];
+    unsigned int  frames;
+} HookCounters;
+
+    void checkHookCounts(CompScreen *s, int nWindows);
+
+#define HOOK_COUNT(hc, counter) \
+    ((hc)->enabled ? (void) (hc)->frame[counter]++ : (void) 0)
+#define HOOK_COUNT_N(hc, counter, n) \
+    ((hc)->enabled ? (void) ((hc)->frame[counter] += (n)) : (void) 0)
+
+// eyenum for a draw that is the same in both eyes
+#define FILTER_BOTH_EYES 2
+
+// parameter slots other plugins may have taken before the lighting
+#define LIGHTING_MAX_PARAMS 8
+
+/* Cache of fragment functions applying the depth lighting, optionally
+ * followed by a colour matrix, so every window texture binds one program */
+struct LightingFunctions
+{
+        void init(const char *colorProgram);
+        void deinit(CompScreen *s);
+        void addLighting(FragmentAttrib *fa, CompTexture *texture, CompScreen *s,
+                         float brightness, float saturation);
+
+        const char *colorProgram;
+        // the program hardcodes its parameter slot, one per target and slot
+        int fragmentFunctions[COMP_FETCH_TARGET_NUM][LIGHTING_MAX_PARAMS];
+};
+
+/* GLSL path for the window textures, see glsl.cpp. One program per
+ * filter variant and texture target, with the eye projection, the paint
+ * attributes and the lighting as uniforms. */
+enum ShaderVariant
+{
+    // depth lighting only
+    ShaderLighting = 0,
+    // lighting followed by the anaglyph colour matrix
+    ShaderAnaglyph,
+    ShaderVariantCount
+};
+
+typedef GLuint (*GLCreateShaderProc) (GLenum type);
+typedef void (*GLShaderSourceProc) (GLuint shader, GLsizei count, const char **string, const GLint *length);
+typedef void (*GLCompileShaderProc) (GLuint shader);
+typedef void (*GLGetShaderivProc) (GLuint shader, GLenum pname, GLint *params);
+typedef void (*GLGetShaderInfoLogProc) (GLuint shader, GLsizei size, GLsizei *length, char *log);
+typedef void (*GLDeleteShaderProc) (GLuint shader);
+typedef GLuint (*GLCreateProgramProc) (void);
+typedef void (*GLAttachShaderProc) (GLuint program, GLuint shader);
+typedef void (*GLLinkProgramProc) (GLuint program);
+typedef void (*GLGetProgramivProc) (GLuint program, GLenum pname, GLint *params);
+typedef void (*GLGetProgramInfoLogProc) (GLuint program, GLsizei size, GLsizei *length, char *log);
+typedef void (*GLDeleteProgramProc) (GLuint program);
+typedef void (*GLUseProgramProc) (GLuint program);
+typedef GLint (*GLGetUniformLocationProc) (GLuint program, const char *name);
+typedef void (*GLUniform1iProc) (GLint location, GLint v0);
+typedef void (*GLUniform3fProc) (GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+typedef void (*GLUniformMatrix4fvProc) (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+
+typedef struct _ShaderProgram
 {
-    void (*init)();
-    virtual void deinit(CompScreen *s) {};
-    virtual void prepareFilter(int width, int height) {};
-    virtual void applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s) {};
-    virtual void cleanup() {};
-} StereoscopicFilterBase;
+    GLuint program;
+    bool failed;
+    GLint eyeProjection;
+    GLint paint;
+    // eye and projection serial last uploaded, reuploaded when either changes
+    int eye;
+    unsigned int serial;
+} ShaderProgram;
+
+typedef struct _ShaderBackend
+{
+    bool loaded;
+    bool supported;
+
+    // by ShaderVariant and COMP_FETCH_TARGET_*
+    ShaderProgram programs[ShaderVariantCount][2];
+
+    // by DrawingType, EyeLeft to EyeSingle, with the parallax shift
+    float eyeProjection[3][16];
+    unsigned int serial;
+
+    GLCreateShaderProc createShader;
+    GLShaderSourceProc shaderSource;
+    GLCompileShaderProc compileShader;
+    GLGetShaderivProc getShaderiv;
+    GLGetShaderInfoLogProc getShaderInfoLog;
+    GLDeleteShaderProc deleteShader;
+    GLCreateProgramProc createProgram;
+    GLAttachShaderProc attachShader;
+    GLLinkProgramProc linkProgram;
+    GLGetProgramivProc getProgramiv;
+    GLGetProgramInfoLogProc getProgramInfoLog;
+    GLDeleteProgramProc deleteProgram;
+    GLUseProgramProc useProgram;
+    GLGetUniformLocationProc getUniformLocation;
+    GLUniform1iProc uniform1i;
+    GLUniform3fProc uniform3f;
+    GLUniformMatrix4fvProc uniformMatrix4fv;
+} ShaderBackend;
+
+    bool initShaderBackend(CompScreen *s, ShaderBackend *sb);
+    void finiShaderBackend(ShaderBackend *sb);
+    GLuint linkShaderProgram(ShaderBackend *sb, const char *vertexSource,
+                             const char *geometrySource, const char *fragmentSource);
+    void setShaderProjections(ShaderBackend *sb, const float *left, const float *right,
+                              const float *single, float parallax, float zCorrection);
+    ShaderProgram *getShaderProgram(ShaderBackend *sb, int variant, CompTexture *texture);
+    void useShaderProgram(ShaderBackend *sb, GLCallCounters *gc, ShaderProgram *sp, int eye,
+                          float opacity, float brightness, float saturation);
+
+/* Both eyes rendered in one submission into the layers of a texture
+ * array and composed into the output, see layered.cpp */
+typedef void (*GLFramebufferTextureProc) (GLenum target, GLenum attachment, GLuint texture, GLint level);
+typedef void (*GLFramebufferTextureLayerProc) (GLenum target, GLenum attachment, GLuint texture,
+                                               GLint level, GLint layer);
+
+enum ComposeVariant
+{
+    ComposeAnaglyph = 0,
+    ComposeInterlaced,
+    ComposeVariantCount
+};
 
-struct InterlacedFilter : public StereoscopicFilterBase
+typedef struct _LayeredStereo
+{
+    bool loaded;
+    bool supported;
+    bool failed;
+
+    // two layer array of the screen size, left eye in layer 0
+    GLuint texture;
+    int width;
+    int height;
+    // both layers, then the left and the right layer alone
+    GLuint framebuffers[3];
+
+    // window programs by COMP_FETCH_TARGET_*, compose programs by ComposeVariant
+    ShaderProgram programs[2];
+    GLuint composePrograms[ComposeVariantCount];
+    bool composeFailed[ComposeVariantCount];
+    GLint composeEye0Layer[ComposeVariantCount];
+    GLint composeInterlace[ComposeVariantCount];
+
+    // quads of the window geometry as triangles
+    GLuint *indices;
+    int nIndices;
+
+    // core's framebuffer object functions, the attachments are 3.2's
+    GLGenFramebuffersProc genFramebuffers;
+    GLDeleteFramebuffersProc deleteFramebuffers;
+    GLBindFramebufferProc bindFramebuffer;
+    GLFramebufferTextureProc framebufferTexture;
+    GLFramebufferTextureLayerProc framebufferTextureLayer;
+    GLCheckFramebufferStatusProc checkFramebufferStatus;
+} LayeredStereo;
+
+    bool initLayeredStereo(CompScreen *s, LayeredStereo *ls);
+    void finiLayeredStereo(LayeredStereo *ls, ShaderBackend *sb);
+    bool beginLayeredOutput(CompScreen *s, LayeredStereo *ls, GLCallCounters *gc);
+    void endLayeredOutput(CompScreen *s, LayeredStereo *ls, ShaderBackend *sb,
+                          int stereoType, bool invert);
+    void bindEyeLayer(LayeredStereo *ls, GLCallCounters *gc, int eye);
+    ShaderProgram *getLayeredProgram(LayeredStereo *ls, ShaderBackend *sb, CompTexture *texture);
+    void drawLayeredGeometry(LayeredStereo *ls, ShaderBackend *sb, GLCallCounters *gc,
+                             ShaderProgram *sp, CompWindow *w, float opacity, float brightness, float saturation);
+
+/* N camera views of the lenticular output mode, rendered at reduced
+ * resolution into the layers of a texture array and interleaved per
+ * subpixel, see multiview.cpp */
+#define MULTIVIEW_MAX_VIEWS 9
+
+typedef void (*GLGenQueriesProc) (GLsizei n, GLuint *ids);
+typedef void (*GLDeleteQueriesProc) (GLsizei n, const GLuint *ids);
+typedef void (*GLBeginQueryProc) (GLenum target, GLuint id);
+typedef void (*GLEndQueryProc) (GLenum target);
+typedef void (*GLGetQueryObjectuivProc) (GLuint id, GLenum pname, GLuint *params);
+
+typedef struct _MultiView
+{
+    bool loaded;
+    bool supported;
+    bool failed;
+
+    // camera offset of each view, -1 is the left eye's and 1 the right's
+    int nViews;
+    float offsets[MULTIVIEW_MAX_VIEWS];
+    float projections[MULTIVIEW_MAX_VIEWS][16];
+
+    // one layer per view, at scale of the screen size
+    GLuint texture;
+    int width;
+    int height;
+    int layers;
+    float scale;
+    GLuint framebuffers[MULTIVIEW_MAX_VIEWS];
+
+    GLuint program;
+    bool programFailed;
+    GLint lens;
+    GLint screen;
+    GLint invert;
+
+    // time of each view while timing, the GPU's is read back when its
+    // set of queries comes round again two passes later
+    bool timing;
+    bool timerQueries;
+    GLuint queries[2][MULTIVIEW_MAX_VIEWS];
+    int queryViews[2];
+    unsigned int pass;
+    struct timeval viewStart;
+    unsigned int statsPasses;
+    double cpuMs[MULTIVIEW_MAX_VIEWS];
+    double gpuMs[MULTIVIEW_MAX_VIEWS];
+    unsigned int gpuSamples;
+
+    GLGenFramebuffersProc genFramebuffers;
+    GLDeleteFramebuffersProc deleteFramebuffers;
+    GLBindFramebufferProc bindFramebuffer;
+    GLCheckFramebufferStatusProc checkFramebufferStatus;
+    GLFramebufferTextureLayerProc framebufferTextureLayer;
+    GLGenQueriesProc genQueries;
+    GLDeleteQueriesProc deleteQueries;
+    GLBeginQueryProc beginQuery;
+    GLEndQueryProc endQuery;
+    GLGetQueryObjectuivProc getQueryObjectuiv;
+} MultiView;
+
+    bool initMultiView(CompScreen *s, MultiView *mv, int nViews);
+    void finiMultiView(MultiView *mv, ShaderBackend *sb);
+    bool beginMultiView(CompScreen *s, MultiView *mv, float scale);
+    void beginView(CompScreen *s, MultiView *mv, CompOutput *output, int view);
+    void endView(MultiView *mv, int view);
+    void endMultiView(CompScreen *s, MultiView *mv, ShaderBackend *sb, CompOutput *output,
+                      float pitch, float slant, float offset, bool invert);
+    void reportViewTimes(MultiView *mv, float budgetMs);
+
+/* The filters share no base class, each draw path is instantiated for
+ * its filter type (see drawWindowTextureForEye) so the per-window calls
+ * are resolved at compile time. They hold no constructed members and
+ * live inside the calloc'ed screen private. */
+
+// 2.5D, a single eye with lighting only
+struct MonoFilter
 {
         void init();
-        void prepareFilter(int width, int height);
-        void applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s);
-        void cleanup();
+        void deinit(CompScreen *s);
+        void prepareFilter(GLCallCounters *gc, int width, int height) {}
+        void applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s,
+                         float brightness, float saturation);
+        void applyMask(GLCallCounters *gc, int eyenum) {}
+        void cleanup(GLCallCounters *gc) {}
+
+        static const int shaderVariant = ShaderLighting;
+
+        LightingFunctions lighting;
+};
+
+struct InterlacedFilter
+{
+        void init();
+        void deinit(CompScreen *s);
+        void prepareFilter(GLCallCounters *gc, int width, int height);
+        void applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s,
+                         float brightness, float saturation);
+        void applyMask(GLCallCounters *gc, int eyenum);
+        void cleanup(GLCallCounters *gc);
+
+        static const int shaderVariant = ShaderLighting;
 
         // column or row interlaced
         bool column;
+
+        LightingFunctions lighting;
 };
 
-class AnaglyphFilter : public StereoscopicFilterBase
+struct AnaglyphFilter
 {
-    public:
         void init();
         void deinit(CompScreen *s);
-        void prepareFilter(int width, int height);
-        void applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s);
-        void cleanup();
+        void prepareFilter(GLCallCounters *gc, int width, int height);
+        void applyFilter(int eyenum, FragmentAttrib *fa, CompTexture *texture, CompScreen *s,
+                         float brightness, float saturation);
+        void applyMask(GLCallCounters *gc, int eyenum);
+        void cleanup(GLCallCounters *gc);
 
-private:
-        int fragmentFunctions[3];
+        static const int shaderVariant = ShaderAnaglyph;
 
-        int getAnaglifFragmentFunction (CompTexture *texture, CompScreen *s);
+        // anaglyph matrix fused with the lighting
+        LightingFunctions lighting;
 };
 
+typedef void (*PrepareOutputFilterProc) (CompScreen *s);
+typedef void (*CleanupOutputFilterProc) (CompScreen *s);
+typedef void (*DrawWindowTextureForEyeProc) (CompWindow           *w,
+                                             CompTexture          *texture,
+                                             const FragmentAttrib *attrib,
+                                             unsigned int         mask,
+                                             int                  eye);
+
     enum DrawingType
     {
         EyeLeft = 0,
         EyeRight,
         EyeSingle,
+        // planar window, drawWindowTexture draws both eyes
+        EyeBoth,
         Cleanup
     };
 
@@ -134,6 +812,303 @@ private:
             int        hotY;
     } CursorTexture;
 
+enum PointerSourceEnum { PSMOUSEPOLL = 0, PSXINPUT2 };
+
+// each level includes the savings of the ones before it
+enum QualityLevel
+{
+    QualityFull = 0,
+    QualityNoSmoothEdges,
+    QualityNoLighting,
+    QualityNoCursorSmoothing,
+    QualityReducedResolution
+};
+
+typedef struct _QualityGovernor
+{
+    int   level;
+    int   maxLevel;
+
+    // frame times since the last decision
+    float frameTimeSum;
+    int   nSamples;
+
+    int   framesSinceChange;
+    int   upHoldoff;
+    bool  steppedUp;
+
+    // half resolution rendering, the texture storage is only
+    // reallocated when the reduced size changes
+    GLuint reducedTexture;
+    int    reducedWidth;
+    int    reducedHeight;
+    int    reducedTextureWidth;
+    int    reducedTextureHeight;
+    bool   reducedActive;
+} QualityGovernor;
+
+    void initQualityGovernor(CompScreen *s, QualityGovernor *qg);
+    void finiQualityGovernor(CompScreen *s, QualityGovernor *qg);
+    void updateQualityGovernor(CompScreen *s, QualityGovernor *qg, int ms, int maxLevel);
+    bool beginReducedResolution(CompScreen *s, QualityGovernor *qg, CompOutput *output);
+    void endReducedResolution(CompScreen *s, QualityGovernor *qg, CompOutput *output);
+
+/* CPU reference compositor, see cpucomposite.cpp */
+typedef struct _CpuImage
+{
+    unsigned char *data;
+    // first row, stride is negative for bottom-up images
+    unsigned char *pixels;
+    int width;
+    int height;
+    int stride;
+} CpuImage;
+
+enum CpuCompositeMode
+{
+    CpuAnaglyph,
+    CpuRowInterlaced,
+    CpuColumnInterlaced,
+    CpuSideBySide
+};
+
+    bool cpuComposite(const CpuImage *left, const CpuImage *right, CpuImage *out,
+                      CpuCompositeMode mode);
+    const char *getCpuCompositeKernels(void);
+    bool allocCpuImage(CpuImage *image, int width, int height);
+    void freeCpuImage(CpuImage *image);
+
+/* Eye images and GL output of one output, see snapshot.cpp */
+typedef struct _OutputSnapshot
+{
+    CpuImage left;
+    CpuImage right;
+    CpuImage gpu;
+    // painted by the quality governor at reduced resolution
+    bool reduced;
+} OutputSnapshot;
+
+    bool readOutputImage(CompScreen *s, CompOutput *output, CpuImage *image);
+    void finishSnapshot(CompScreen *s, OutputSnapshot *snap, int stereoType);
+    void freeSnapshot(OutputSnapshot *snap);
+
+/* Shared memory frame ring written by export.cpp. The ring starts with
+ * an ExportRingHeader, slot n starts slotOffset + n * slotSize bytes in,
+ * with an ExportFrameHeader followed by the RGBA pixels at frameOffset,
+ * bottom row first. Frame k goes to slot k % nSlots and writeCount is
+ * bumped once it is complete. A slot's sequence is odd while it is being
+ * written; readers compare it before and after using the pixels. */
+#define EXPORT_MAGIC   0x53334458
+#define EXPORT_VERSION 1
+#define EXPORT_PBOS    3
+
+typedef struct _ExportRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nSlots;
+    uint32_t slotOffset;
+    uint64_t slotSize;
+    uint32_t frameOffset;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    volatile uint64_t writeCount;
+} ExportRingHeader;
+
+typedef struct _ExportFrameHeader
+{
+    volatile uint64_t sequence;
+    // stereo frame count of the compositor, gaps are frames not exported
+    uint64_t frameNumber;
+    // gettimeofday when the readback was started
+    int64_t timestampUs;
+} ExportFrameHeader;
+
+typedef void (*GLGenBuffersProc) (GLsizei n, GLuint *buffers);
+typedef void (*GLDeleteBuffersProc) (GLsizei n, const GLuint *buffers);
+typedef void (*GLBindBufferProc) (GLenum target, GLuint buffer);
+typedef void (*GLBufferDataProc) (GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage);
+typedef GLvoid *(*GLMapBufferProc) (GLenum target, GLenum access);
+typedef GLboolean (*GLUnmapBufferProc) (GLenum target);
+
+typedef struct _FrameExporter
+{
+    bool failed;
+    char *name;
+    int fd;
+    size_t mapSize;
+    ExportRingHeader *ring;
+    int width;
+    int height;
+
+    GLuint pbo[EXPORT_PBOS];
+    uint64_t pboFrame[EXPORT_PBOS];
+    int64_t pboTimestamp[EXPORT_PBOS];
+    // readbacks started, the frame they were started in and map failures
+    unsigned long nRead;
+    unsigned int exportedFrame;
+    unsigned long nDropped;
+
+    GLGenBuffersProc genBuffers;
+    GLDeleteBuffersProc deleteBuffers;
+    GLBindBufferProc bindBuffer;
+    GLBufferDataProc bufferData;
+    GLMapBufferProc mapBuffer;
+    GLUnmapBufferProc unmapBuffer;
+} FrameExporter;
+
+    void updateExport(CompScreen *s, FrameExporter *fe);
+    void exportOutput(CompScreen *s, FrameExporter *fe, CompOutput *output, unsigned int frame);
+    void stopExport(FrameExporter *fe);
+
+/* Windows of the layout by screen area, see windowgrid.cpp */
+#define WINDOW_GRID_CELL_SIZE 128
+
+typedef struct _WindowGridCell
+{
+    // topmost first
+    Stereo3DWindow **windows;
+    int nWindows;
+    int size;
+} WindowGridCell;
+
+typedef struct _WindowGrid
+{
+    WindowGridCell *cells;
+    int cols;
+    int rows;
+} WindowGrid;
+
+    bool resetWindowGrid(WindowGrid *grid, int width, int height);
+    void finiWindowGrid(WindowGrid *grid);
+    void insertGridWindow(WindowGrid *grid, Stereo3DWindow *sow);
+    void removeGridWindow(WindowGrid *grid, Stereo3DWindow *sow);
+    Stereo3DWindow *findGridWindow(WindowGrid *grid, HookCounters *hc, int x, int y);
+
+/* Chrome trace JSON writer, see trace.cpp */
+typedef struct _TraceWriter
+{
+    FILE *file;
+    bool  failed;
+    char  *buffer;
+    int   used;
+    int   pid;
+    unsigned long nEvents;
+} TraceWriter;
+
+    void updateTracing(CompScreen *s, TraceWriter *tw);
+    void stopTracing(TraceWriter *tw);
+    void traceEvent(TraceWriter *tw, char phase, const char *name, Window id, int eye);
+
+// cheap enough to leave in the paint paths while tracing is off
+#define TRACE_BEGIN(tw, name, id, eye) \
+    do { if ((tw)->file) traceEvent (tw, 'B', name, id, eye); } while (0)
+#define TRACE_END(tw, name) \
+    do { if ((tw)->file) traceEvent (tw, 'E', name, 0, -1); } while (0)
+
+/* Pointer to screen latency of the cursor, see latency.cpp */
+// 1 ms buckets, the last one collects everything slower
+#define LATENCY_BUCKETS    100
+#define LATENCY_SOURCES    2
+// eased, snapped by the quality governor, late latched
+#define LATENCY_SMOOTHINGS 3
+
+typedef struct _LatencyDistribution
+{
+    unsigned int  count;
+    unsigned int  buckets[LATENCY_BUCKETS + 1];
+    unsigned long frames;
+    long          maxUs;
+    // input to the drawing of each eye, by DrawingType
+    double        eyeUs[EyeBoth + 1];
+    unsigned int  eyeCount[EyeBoth + 1];
+    unsigned int  lost;
+} LatencyDistribution;
+
+typedef struct _LatencyProbe
+{
+    bool  enabled;
+    bool  pending;
+    float startX, startY;
+    float targetX, targetY;
+    // last position the cursor was drawn at
+    float drawnX, drawnY;
+    struct timeval inputTime;
+    struct timeval reachedTime[EyeBoth + 1];
+    unsigned int inputFrame;
+    unsigned int reachedEyes;
+    LatencyDistribution distributions[LATENCY_SOURCES][LATENCY_SMOOTHINGS];
+    unsigned int nSamples;
+    // local microseconds minus server milliseconds * 1000, the smallest
+    // seen when server events arrived
+    bool    serverClockKnown;
+    int64_t serverClockOffsetUs;
+} LatencyProbe;
+
+    void latencyServerEvent(LatencyProbe *lp, Time serverTime);
+    void latencyPointerMoved(LatencyProbe *lp, float x, float y, unsigned int frame,
+                             Time inputTime);
+    void latencyCursorDrawn(LatencyProbe *lp, int eye, float x, float y);
+    void latencyFrameDone(CompScreen *s, LatencyProbe *lp, unsigned int frame,
+                          int source, int smoothing);
+    void reportLatency(LatencyProbe *lp);
+
+/* Frame input recordings, see record.cpp and tests/replay.cpp. File
+ * layout, native byte order:
+ *   RecordHeader
+ *   per frame: RecordFrame, followed by nWindows RecordWindow entries
+ *              when RECORD_FRAME_WINDOWS is set (the window index was
+ *              rebuilt), otherwise the previous frame's windows apply
+ *
+ * The focused window and the window under the pointer are given by their
+ * slot in the window list that applies, -1 for none. */
+#define RECORD_MAGIC   0x52443353 // "S3DR"
+#define RECORD_VERSION 2
+
+#define RECORD_FRAME_WINDOWS (1 << 0)
+
+typedef struct _RecordHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t  screenWidth;
+    int32_t  screenHeight;
+} RecordHeader;
+
+typedef struct _RecordFrame
+{
+    uint32_t ms;
+    float    pointerX;
+    float    pointerY;
+    float    foregroundDstZ;
+    float    depth;
+    float    lightingStrength;
+    float    fov;
+    float    strength;
+    int32_t  focusSlot;
+    int32_t  pointerSlot;
+    uint8_t  outputMode;
+    uint8_t  flags;
+    uint16_t nWindows;
+} RecordFrame;
+
+typedef struct _RecordWindow
+{
+    uint32_t id;
+    // client leader, the window itself without one
+    uint32_t group;
+    int16_t  x;
+    int16_t  y;
+    uint16_t width;
+    uint16_t height;
+    uint8_t  floatingType;
+    uint8_t  pad[3];
+} RecordWindow;
+
+    void recordFrame(CompScreen *s, int ms, float depth, float lightingStrength);
+    void stopRecording(CompScreen *s);
+
 typedef struct _Stereo3DScreen
 {
     int windowPrivateIndex;
@@ -141,9 +1116,89 @@ typedef struct _Stereo3DScreen
     CursorTexture       cursorTex;
     PositionPollingHandle	pollHandle;
 
+    // source the 3D cursor position is currently taken from
+    PointerSourceEnum   pointerSource;
+    bool                pointerMoved;
+    // server time of the first raw motion since the position was queried
+    Time                pointerMovedTime;
+    // pointer wakeups per source, logged when the source is released
+    unsigned long       pointerWakeups[2];
+    struct timeval      pointerSourceStart;
+
+    // late-latched cursor position, sampled once per frame
+    unsigned int        frameCount;
+    unsigned int        latchedFrame;
+    float               latchedMouseX;
+    float               latchedMouseY;
+
+    // cursor image is fetched asynchronously, see pollCursorImage
+    xcb_xfixes_get_cursor_image_cookie_t cursorCookie;
+    bool cursorRequestPending;
+
+    // late-latched pointer query of the frame, see pollLatchedPointer
+    xcb_query_pointer_cookie_t pointerCookie;
+    bool pointerRequestPending;
+    unsigned int pointerRequestFrame;
+    bool cursorHidden;
+
+    // plugin load to first stereo frame
+    bool firstStereoFrameDone;
+
     AnimationManager    animationMgr;
+    LayoutStats         layoutStats;
+    LayoutWorker        layoutWorker;
+
+    QualityGovernor     quality;
+
+    // windows taking part in the 3D layout, in stacking order;
+    // rebuilt from window events only, not every frame
+    Stereo3DWindow **backgroundWindows;
+    Stereo3DWindow **dockWindows;
+    Stereo3DWindow **floatingWindows;
+    int nBackgroundWindows;
+    int nDockWindows;
+    int nFloatingWindows;
+    int windowIndexSize;
+    LayoutGroupTable layoutGroups;
+    bool windowIndexDirty;
+    int viewportX;
+    int viewportY;
+    // bumped on every rebuild of the index
+    unsigned int windowIndexGeneration;
+
+    // the indexed windows by screen area and the one under the pointer
+    WindowGrid windowGrid;
+    Stereo3DWindow *pointerWindow;
+
+    TraceWriter trace;
+    FrameExporter exporter;
+    LatencyProbe latency;
+    // GL calls of the frame being painted, see glcounters.cpp
+    GLCallCounters glCalls;
+    // hook calls of the frame being painted, see hookstats.cpp
+    HookCounters hookCounters;
+
+    // frame input recording, see record.cpp
+    FILE *recordFile;
+    bool recordFailed;
+    unsigned int recordedIndexGeneration;
+    // windows in the list recorded last
+    int recordedWindows;
+    unsigned long recordedFrames;
+
+    // output snapshot requested by the snapshot action, and the eye
+    // painted on its own while it is taken (-1 otherwise)
+    bool snapshotPending;
+    int captureEye;
+    OutputSnapshot snapshot;
+
+    // topmost window if it is a fullscreen stereo-aware client
+    CompWindow *passthroughWindow;
+    bool passthrough;
 
     bool enabled;
+    // enabled, set up for this frame and not in passthrough
+    bool stereoActive;
     
     //animation
     float animPeriod;
@@ -168,10 +1223,30 @@ typedef struct _Stereo3DScreen
     DrawingType renderingState;
 
 
-    AnaglyphFilter* anaglyphFilter;
-    InterlacedFilter* interlacedFilter;
+    MonoFilter monoFilter;
+    AnaglyphFilter anaglyphFilter;
+    InterlacedFilter interlacedFilter;
+
+    // draw paths of the current output mode and backend, see selectFilter
+    int filterMode;
+    bool filterShaders;
+    // filter eye of each DrawingType in this frame, the eyes switched by
+    // the invert option; -1 where no filter applies
+    int eyeFilter[Cleanup + 1];
+    ShaderBackend shaders;
+
+    // both eyes go to layered in one pass this frame, active while an
+    // output is painted into it
+    LayeredStereo layered;
+    bool layeredStereo;
+    bool layeredActive;
 
-    StereoscopicFilterBase * currFilter;
+    // lenticular views, and the one painted (-1 outside of them)
+    MultiView multiView;
+    int renderView;
+    PrepareOutputFilterProc prepareOutputFilter;
+    CleanupOutputFilterProc cleanupOutputFilter;
+    DrawWindowTextureForEyeProc drawWindowTextureForEye;
 
 
     PaintWindowProc paintWindow;
@@ -243,22 +1318,59 @@ typedef struct _Stereo3DScreen
         PaintOutputProc paintOutput;
         DrawWindowProc drawWindow;
         DrawWindowTextureProc drawWindowTexture;
+
+        WindowStateChangeNotifyProc windowStateChangeNotify;
+        WindowMoveNotifyProc windowMoveNotify;
+        WindowResizeNotifyProc windowResizeNotify;
 } Stereo3DScreen;
 
 struct _Stereo3DWindow
 {
+        CompWindow *window;
+
         WndAnimationAttrs currAttrs;
         WndAnimationAttrs dstAttrs;
 
         bool drawMouse;
+        bool passthroughHint;
         float opacity;
         float saturation;
         float brightness;
 
         FloatingTypeEnum floatingType;
+
+        // depth the layout placed the window at and the one its strategy
+        // picked this time, only windows still moving there are eased
+        bool layoutAssigned;
+        bool layoutMoving;
+        float layoutDepth;
+        float layoutTarget;
+        // application of the window and its group's slot from the top,
+        // see assignLayoutGroups
+        Window layoutGroup;
+        int layoutSlot;
+
+        // position in the stack and cells covered in the window grid,
+        // window below and viewport as of the last index rebuild
+        int stackPosition;
+        Window stackBelow;
+        bool onViewport;
+        bool inGrid;
+        BoxRec gridCells;
+
+        // slot of the window in the layout worker, -1 without one, and
+        // the serial telling it apart from earlier users of the slot
+        int workerSlot;
+        unsigned int workerSerial;
+
+        // position in the window list recorded last, see recordFrame
+        int recordSlot;
 };
 
         FloatingTypeEnum getFloatingType(CompWindow *window);
+        void updateWindowIndex(CompScreen *s);
+        void setupProjections(Stereo3DScreen *sos, int stereoType, float fov,
+                              float maxDisparityInPx, float screenWidthPx);
 
 #define GET_STEREO3D_DISPLAY(d)                            \
     ((Stereo3DDisplay *) (d)->base.privates[displayPrivateIndex].ptr)
@@ -0,0 +1,35 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The checks of the tests. A failed CHECK prints where and why and is
+ * counted in failures, the test carries on and fails at the end. */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(condition, ...)						\
+    do {								\
+	if (!(condition))						\
+	{								\
+	    fprintf (stderr, "%s:%d: %s: ", __FILE__, __LINE__, #condition); \
+	    fprintf (stderr, __VA_ARGS__);				\
+	    fputc ('\n', stderr);					\
+	    failures++;							\
+	}								\
+    } while (0)
+
+#endif
@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+#
+# Generates stereo3d_options.h and stereo3d_options.cpp from
+# stereo3d.xml.in for the test harness, in place of bcop. The getters
+# return the values the tests set with stereo3dSetOptionValue, the
+# defaults of the metadata until then; setting an option calls its
+# notify like core does.
+#
+# usage: genoptions.py stereo3d.xml.in header source
+
+import re
+import sys
+
+TYPES = {
+    'int': 'int',
+    'float': 'float',
+    'bool': 'Bool',
+    'string': 'char *',
+    'match': 'CompMatch *',
+    'key': 'CompAction *',
+    'button': 'CompAction *',
+}
+
+
+def camel(name):
+    return ''.join(part[:1].upper() + part[1:].lower() for part in name.split('_'))
+
+
+def parse(path):
+    source = open(path).read()
+    options = []
+
+    for match in re.finditer(r'<option\s+([^>]*)>(.*?)</option>', source, re.S):
+        attrs = dict(re.findall(r'(\w+)="([^"]*)"', match.group(1)))
+        default = re.search(r'<default>(.*?)</default>', match.group(2), re.S)
+        options.append((attrs['name'], attrs['type'],
+                        default.group(1).strip() if default else ''))
+
+    return options
+
+
+def header(options):
+    out = ['/* generated by genoptions.py from stereo3d.xml.in */',
+           '#ifndef _STEREO3D_OPTIONS_H',
+           '#define _STEREO3D_OPTIONS_H',
+           '',
+           '#include <compiz-core.h>',
+           '',
+           'typedef enum {']
+    out += ['    Stereo3dDisplayOption%s,' % camel(name) for name, kind, value in options]
+    out += ['    Stereo3dDisplayOptionNum',
+            '} Stereo3dDisplayOptions;',
+            '',
+            'typedef void (*stereo3dDisplayOptionChangeNotifyProc) '
+            '(CompDisplay *display, CompOption *opt, Stereo3dDisplayOptions num);',
+            '']
+
+    for name, kind, value in options:
+        c = camel(name)
+        out.append('%s stereo3dGet%s (CompDisplay *d);' % (TYPES[kind], c))
+        out.append('CompOption *stereo3dGet%sOption (CompDisplay *d);' % c)
+        out.append('void stereo3dSet%sNotify (CompDisplay *d, '
+                   'stereo3dDisplayOptionChangeNotifyProc notify);' % c)
+        if kind in ('key', 'button'):
+            out.append('void stereo3dSet%sInitiate (CompDisplay *d, '
+                       'CompActionCallBackProc init);' % c)
+            out.append('void stereo3dSet%sTerminate (CompDisplay *d, '
+                       'CompActionCallBackProc term);' % c)
+
+    out += ['', '#endif', '']
+    return '\n'.join(out)
+
+
+def source(options):
+    out = ['/* generated by genoptions.py from stereo3d.xml.in */',
+           '#include <stdlib.h>',
+           '#include <string.h>',
+           '',
+           '#include "stereo3d_options.h"',
+           '',
+           'typedef struct _OptionValue',
+           '{',
+           '    const char *name;',
+           '    const char *type;',
+           '    const char *defaultValue;',
+           '    int        i;',
+           '    float      f;',
+           '    Bool       b;',
+           '    char       *s;',
+           '    CompMatch  match;',
+           '    stereo3dDisplayOptionChangeNotifyProc notify;',
+           '    CompActionCallBackProc initiate;',
+           '    CompActionCallBackProc terminate;',
+           '} OptionValue;',
+           '',
+           'static OptionValue options[Stereo3dDisplayOptionNum] = {']
+    for name, kind, value in options:
+        out.append('    { "%s", "%s", "%s" },' % (name, kind, value))
+    out += ['};',
+            '',
+            'static bool initialized = false;',
+            '',
+            'static void',
+            'setValue (OptionValue *o, const char *value)',
+            '{',
+            '    o->i = atoi (value);',
+            '    o->f = (float) atof (value);',
+            '    o->b = !strcmp (value, "true") || !strcmp (value, "1");',
+            '    free (o->s);',
+            '    o->s = strdup (value);',
+            '    o->match.expression = o->s;',
+            '}',
+            '',
+            '/* Sets every option back to its default, the callbacks stay */',
+            'void',
+            'stereo3dResetOptions (void)',
+            '{',
+            '    for (int i = 0; i < Stereo3dDisplayOptionNum; i++)',
+            '\tsetValue (&options[i], options[i].defaultValue);',
+            '',
+            '    initialized = true;',
+            '}',
+            '',
+            'static OptionValue *',
+            'getOption (int num)',
+            '{',
+            '    if (!initialized)',
+            '\tstereo3dResetOptions ();',
+            '',
+            '    return &options[num];',
+            '}',
+            '',
+            '/* Sets the named option from its string form and calls its',
+            ' * notify, false for unknown names */',
+            'bool',
+            'stereo3dSetOptionValue (CompDisplay *d, const char *name, const char *value)',
+            '{',
+            '    for (int i = 0; i < Stereo3dDisplayOptionNum; i++)',
+            '    {',
+            '\tOptionValue *o = getOption (i);',
+            '',
+            '\tif (strcmp (o->name, name))',
+            '\t    continue;',
+            '',
+            '\tsetValue (o, value);',
+            '\tif (o->notify)',
+            '\t    (*o->notify) (d, NULL, (Stereo3dDisplayOptions) i);',
+            '',
+            '\treturn true;',
+            '    }',
+            '',
+            '    return false;',
+            '}',
+            '',
+            '/* Initiate callback of the named action, NULL when none is set */',
+            'CompActionCallBackProc',
+            'stereo3dGetOptionInitiate (const char *name)',
+            '{',
+            '    for (int i = 0; i < Stereo3dDisplayOptionNum; i++)',
+            '\tif (!strcmp (options[i].name, name))',
+            '\t    return options[i].initiate;',
+            '',
+            '    return NULL;',
+            '}',
+            '']
+
+    for num, (name, kind, value) in enumerate(options):
+        c = camel(name)
+        field = {'int': 'i', 'float': 'f', 'bool': 'b', 'string': 's'}.get(kind)
+        if field:
+            expr = 'getOption (%d)->%s' % (num, field)
+        elif kind == 'match':
+            expr = '&getOption (%d)->match' % num
+        else:
+            expr = 'NULL'
+
+        out += ['%s' % TYPES[kind],
+                'stereo3dGet%s (CompDisplay *d)' % c,
+                '{',
+                '    return %s;' % expr,
+                '}',
+                '',
+                'CompOption *',
+                'stereo3dGet%sOption (CompDisplay *d)' % c,
+                '{',
+                '    return NULL;',
+                '}',
+                '',
+                'void',
+                'stereo3dSet%sNotify (CompDisplay *d, '
+                'stereo3dDisplayOptionChangeNotifyProc notify)' % c,
+                '{',
+                '    getOption (%d)->notify = notify;' % num,
+                '}',
+                '']
+        if kind in ('key', 'button'):
+            out += ['void',
+                    'stereo3dSet%sInitiate (CompDisplay *d, CompActionCallBackProc init)' % c,
+                    '{',
+                    '    getOption (%d)->initiate = init;' % num,
+                    '}',
+                    '',
+                    'void',
+                    'stereo3dSet%sTerminate (CompDisplay *d, CompActionCallBackProc term)' % c,
+                    '{',
+                    '    getOption (%d)->terminate = term;' % num,
+                    '}',
+                    '']
+
+    return '\n'.join(out)
+
+
+def main():
+    options = parse(sys.argv[1])
+
+    open(sys.argv[2], 'w').write(header(options))
+    open(sys.argv[3], 'w').write(source(options))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,317 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+#include <string.h>
+
+#include "glshim.h"
+
+typedef struct _ShimEntry
+{
+    const char        *name;
+    unsigned long     calls;
+    bool              linked;
+    struct _ShimEntry *next;
+} ShimEntry;
+
+static ShimEntry     *entries;
+static unsigned long total;
+static GLuint        lastName;
+// bound to GL_PIXEL_PACK_BUFFER, glReadPixels writes nothing then
+static GLuint        packBuffer;
+
+static void
+recordCall (ShimEntry *entry)
+{
+    if (!entry->linked)
+    {
+	entry->linked = true;
+	entry->next = entries;
+	entries = entry;
+    }
+
+    entry->calls++;
+    total++;
+}
+
+// one counter per entry point, linked in on its first call
+#define RECORD(name) \
+    do { static ShimEntry entry = { #name, 0, false, NULL }; recordCall (&entry); } while (0)
+
+static void
+genNames (GLsizei n, GLuint *names)
+{
+    for (GLsizei i = 0; i < n; i++)
+	names[i] = ++lastName;
+}
+
+unsigned long
+glShimCalls (const char *name)
+{
+    for (ShimEntry *entry = entries; entry; entry = entry->next)
+	if (!strcmp (entry->name, name))
+	    return entry->calls;
+
+    return 0;
+}
+
+unsigned long
+glShimTotal (void)
+{
+    return total;
+}
+
+void
+glShimReset (void)
+{
+    for (ShimEntry *entry = entries; entry; entry = entry->next)
+	entry->calls = 0;
+
+    total = 0;
+}
+
+extern "C" {
+
+/* GL 1.x, exported by libGL */
+
+void glBegin (GLenum mode) { RECORD (glBegin); }
+void glEnd (void) { RECORD (glEnd); }
+void glVertex2f (GLfloat x, GLfloat y) { RECORD (glVertex2f); }
+void glVertex3f (GLfloat x, GLfloat y, GLfloat z) { RECORD (glVertex3f); }
+void glTexCoord2f (GLfloat s, GLfloat t) { RECORD (glTexCoord2f); }
+void glTexCoord2d (GLdouble s, GLdouble t) { RECORD (glTexCoord2d); }
+void glColor4f (GLfloat r, GLfloat g, GLfloat b, GLfloat a) { RECORD (glColor4f); }
+void glColor4us (GLushort r, GLushort g, GLushort b, GLushort a) { RECORD (glColor4us); }
+void glColor4usv (const GLushort *v) { RECORD (glColor4usv); }
+
+void glMatrixMode (GLenum mode) { RECORD (glMatrixMode); }
+void glPushMatrix (void) { RECORD (glPushMatrix); }
+void glPopMatrix (void) { RECORD (glPopMatrix); }
+void glLoadIdentity (void) { RECORD (glLoadIdentity); }
+void glLoadMatrixf (const GLfloat *m) { RECORD (glLoadMatrixf); }
+void glMultMatrixf (const GLfloat *m) { RECORD (glMultMatrixf); }
+void glTranslatef (GLfloat x, GLfloat y, GLfloat z) { RECORD (glTranslatef); }
+void glOrtho (GLdouble left, GLdouble right, GLdouble bottom, GLdouble top,
+	      GLdouble zNear, GLdouble zFar) { RECORD (glOrtho); }
+void glViewport (GLint x, GLint y, GLsizei width, GLsizei height) { RECORD (glViewport); }
+
+void glEnable (GLenum cap) { RECORD (glEnable); }
+void glDisable (GLenum cap) { RECORD (glDisable); }
+void glEnableClientState (GLenum cap) { RECORD (glEnableClientState); }
+void glDisableClientState (GLenum cap) { RECORD (glDisableClientState); }
+void glHint (GLenum target, GLenum mode) { RECORD (glHint); }
+void glLineWidth (GLfloat width) { RECORD (glLineWidth); }
+void glBlendFunc (GLenum sfactor, GLenum dfactor) { RECORD (glBlendFunc); }
+void glColorMask (GLboolean r, GLboolean g, GLboolean b, GLboolean a) { RECORD (glColorMask); }
+void glClear (GLbitfield mask) { RECORD (glClear); }
+void glClearColor (GLclampf r, GLclampf g, GLclampf b, GLclampf a) { RECORD (glClearColor); }
+void glClearStencil (GLint s) { RECORD (glClearStencil); }
+void glStencilFunc (GLenum func, GLint ref, GLuint mask) { RECORD (glStencilFunc); }
+void glStencilOp (GLenum fail, GLenum zfail, GLenum zpass) { RECORD (glStencilOp); }
+void glStencilMask (GLuint mask) { RECORD (glStencilMask); }
+void glTexEnvi (GLenum target, GLenum pname, GLint param) { RECORD (glTexEnvi); }
+void glPixelStorei (GLenum pname, GLint param) { RECORD (glPixelStorei); }
+void glRasterPos2f (GLfloat x, GLfloat y) { RECORD (glRasterPos2f); }
+
+void glVertexPointer (GLint size, GLenum type, GLsizei stride, const GLvoid *ptr)
+{ RECORD (glVertexPointer); }
+void glTexCoordPointer (GLint size, GLenum type, GLsizei stride, const GLvoid *ptr)
+{ RECORD (glTexCoordPointer); }
+void glDrawArrays (GLenum mode, GLint first, GLsizei count) { RECORD (glDrawArrays); }
+void glDrawElements (GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+{ RECORD (glDrawElements); }
+void glDrawPixels (GLsizei width, GLsizei height, GLenum format, GLenum type,
+		   const GLvoid *pixels) { RECORD (glDrawPixels); }
+
+void glGenTextures (GLsizei n, GLuint *textures) { RECORD (glGenTextures); genNames (n, textures); }
+void glDeleteTextures (GLsizei n, const GLuint *textures) { RECORD (glDeleteTextures); }
+void glBindTexture (GLenum target, GLuint texture) { RECORD (glBindTexture); }
+void glTexParameteri (GLenum target, GLenum pname, GLint param) { RECORD (glTexParameteri); }
+void glTexImage2D (GLenum target, GLint level, GLint internalFormat, GLsizei width,
+		   GLsizei height, GLint border, GLenum format, GLenum type,
+		   const GLvoid *pixels) { RECORD (glTexImage2D); }
+void glTexImage3D (GLenum target, GLint level, GLint internalFormat, GLsizei width,
+		   GLsizei height, GLsizei depth, GLint border, GLenum format,
+		   GLenum type, const GLvoid *pixels) { RECORD (glTexImage3D); }
+void glCopyTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset,
+			  GLint x, GLint y, GLsizei width, GLsizei height)
+{ RECORD (glCopyTexSubImage2D); }
+
+void
+glReadPixels (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format,
+	      GLenum type, GLvoid *pixels)
+{
+    RECORD (glReadPixels);
+
+    // the plugin reads RGBA bytes only, into a buffer object when one is
+    // bound and pixels is an offset
+    if (!packBuffer)
+	memset (pixels, 0, (size_t) width * height * 4);
+}
+
+void
+glGetIntegerv (GLenum pname, GLint *params)
+{
+    RECORD (glGetIntegerv);
+
+    *params = pname == GL_PROGRAM_ERROR_POSITION_ARB ? -1 : 0;
+}
+
+GLenum glGetError (void) { RECORD (glGetError); return GL_NO_ERROR; }
+
+const GLubyte *
+glGetString (GLenum name)
+{
+    RECORD (glGetString);
+
+    if (name == GL_VERSION)
+	return (const GLubyte *) "4.5 glshim";
+    if (name == GL_EXTENSIONS)
+	return (const GLubyte *) "GL_ARB_fragment_program GL_ARB_pixel_buffer_object "
+	    "GL_ARB_texture_non_power_of_two GL_ARB_texture_rectangle "
+	    "GL_EXT_framebuffer_object";
+
+    return (const GLubyte *) "glshim";
+}
+
+/* Extensions, through glShimGetProcAddress */
+
+static void shimGenProgramsARB (GLsizei n, GLuint *programs) { RECORD (glGenProgramsARB); genNames (n, programs); }
+static void shimDeleteProgramsARB (GLsizei n, const GLuint *programs) { RECORD (glDeleteProgramsARB); }
+static void shimBindProgramARB (GLenum target, GLuint program) { RECORD (glBindProgramARB); }
+static void shimProgramStringARB (GLenum target, GLenum format, GLsizei len,
+				  const GLvoid *string) { RECORD (glProgramStringARB); }
+static void shimProgramEnvParameter4fARB (GLenum target, GLuint index, GLfloat x, GLfloat y,
+					  GLfloat z, GLfloat w) { RECORD (glProgramEnvParameter4fARB); }
+static void shimActiveTexture (GLenum texture) { RECORD (glActiveTexture); }
+static void shimClientActiveTexture (GLenum texture) { RECORD (glClientActiveTexture); }
+
+static void shimGenFramebuffers (GLsizei n, GLuint *framebuffers) { RECORD (glGenFramebuffers); genNames (n, framebuffers); }
+static void shimDeleteFramebuffers (GLsizei n, GLuint *framebuffers) { RECORD (glDeleteFramebuffers); }
+static void shimBindFramebuffer (GLenum target, GLuint framebuffer) { RECORD (glBindFramebuffer); }
+static GLenum shimCheckFramebufferStatus (GLenum target) { RECORD (glCheckFramebufferStatus); return GL_FRAMEBUFFER_COMPLETE; }
+static void shimFramebufferTexture2D (GLenum target, GLenum attachment, GLenum textarget,
+				      GLuint texture, GLint level) { RECORD (glFramebufferTexture2D); }
+static void shimFramebufferTexture (GLenum target, GLenum attachment, GLuint texture,
+				    GLint level) { RECORD (glFramebufferTexture); }
+static void shimFramebufferTextureLayer (GLenum target, GLenum attachment, GLuint texture,
+					 GLint level, GLint layer) { RECORD (glFramebufferTextureLayer); }
+static void shimGenerateMipmap (GLenum target) { RECORD (glGenerateMipmap); }
+
+static GLuint shimCreateShader (GLenum type) { RECORD (glCreateShader); return ++lastName; }
+static void shimShaderSource (GLuint shader, GLsizei count, const char **string,
+			      const GLint *length) { RECORD (glShaderSource); }
+static void shimCompileShader (GLuint shader) { RECORD (glCompileShader); }
+static void shimGetShaderiv (GLuint shader, GLenum pname, GLint *params)
+{ RECORD (glGetShaderiv); *params = pname == GL_COMPILE_STATUS ? GL_TRUE : 0; }
+static void shimGetShaderInfoLog (GLuint shader, GLsizei size, GLsizei *length, char *log)
+{ RECORD (glGetShaderInfoLog); if (length) *length = 0; if (size) *log = '\0'; }
+static void shimDeleteShader (GLuint shader) { RECORD (glDeleteShader); }
+static GLuint shimCreateProgram (void) { RECORD (glCreateProgram); return ++lastName; }
+static void shimAttachShader (GLuint program, GLuint shader) { RECORD (glAttachShader); }
+static void shimLinkProgram (GLuint program) { RECORD (glLinkProgram); }
+static void shimGetProgramiv (GLuint program, GLenum pname, GLint *params)
+{ RECORD (glGetProgramiv); *params = pname == GL_LINK_STATUS ? GL_TRUE : 0; }
+static void shimGetProgramInfoLog (GLuint program, GLsizei size, GLsizei *length, char *log)
+{ RECORD (glGetProgramInfoLog); if (length) *length = 0; if (size) *log = '\0'; }
+static void shimDeleteProgram (GLuint program) { RECORD (glDeleteProgram); }
+static void shimUseProgram (GLuint program) { RECORD (glUseProgram); }
+static GLint shimGetUniformLocation (GLuint program, const char *name) { RECORD (glGetUniformLocation); return 0; }
+static void shimUniform1i (GLint location, GLint v0) { RECORD (glUniform1i); }
+static void shimUniform3f (GLint location, GLfloat v0, GLfloat v1, GLfloat v2) { RECORD (glUniform3f); }
+static void shimUniformMatrix4fv (GLint location, GLsizei count, GLboolean transpose,
+				  const GLfloat *value) { RECORD (glUniformMatrix4fv); }
+
+static void shimGenQueries (GLsizei n, GLuint *ids) { RECORD (glGenQueries); genNames (n, ids); }
+static void shimDeleteQueries (GLsizei n, const GLuint *ids) { RECORD (glDeleteQueries); }
+static void shimBeginQuery (GLenum target, GLuint id) { RECORD (glBeginQuery); }
+static void shimEndQuery (GLenum target) { RECORD (glEndQuery); }
+static void shimGetQueryObjectuiv (GLuint id, GLenum pname, GLuint *params)
+{ RECORD (glGetQueryObjectuiv); *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0; }
+
+// the exporter's ring is not mapped, each frame counts as dropped
+static void shimGenBuffers (GLsizei n, GLuint *buffers) { RECORD (glGenBuffers); genNames (n, buffers); }
+static void shimDeleteBuffers (GLsizei n, const GLuint *buffers) { RECORD (glDeleteBuffers); }
+static void
+shimBindBuffer (GLenum target, GLuint buffer)
+{
+    RECORD (glBindBuffer);
+
+    if (target == GL_PIXEL_PACK_BUFFER_ARB)
+	packBuffer = buffer;
+}
+static void shimBufferData (GLenum target, GLsizeiptr size, const GLvoid *data,
+			    GLenum usage) { RECORD (glBufferData); }
+static GLvoid *shimMapBuffer (GLenum target, GLenum access) { RECORD (glMapBuffer); return NULL; }
+static GLboolean shimUnmapBuffer (GLenum target) { RECORD (glUnmapBuffer); return GL_TRUE; }
+
+}
+
+static const struct
+{
+    const char *name;
+    FuncPtr    proc;
+} procs[] = {
+    { "glGenProgramsARB", (FuncPtr) shimGenProgramsARB },
+    { "glDeleteProgramsARB", (FuncPtr) shimDeleteProgramsARB },
+    { "glBindProgramARB", (FuncPtr) shimBindProgramARB },
+    { "glProgramStringARB", (FuncPtr) shimProgramStringARB },
+    { "glProgramEnvParameter4fARB", (FuncPtr) shimProgramEnvParameter4fARB },
+    { "glActiveTexture", (FuncPtr) shimActiveTexture },
+    { "glClientActiveTexture", (FuncPtr) shimClientActiveTexture },
+    { "glGenFramebuffersEXT", (FuncPtr) shimGenFramebuffers },
+    { "glDeleteFramebuffersEXT", (FuncPtr) shimDeleteFramebuffers },
+    { "glBindFramebufferEXT", (FuncPtr) shimBindFramebuffer },
+    { "glCheckFramebufferStatusEXT", (FuncPtr) shimCheckFramebufferStatus },
+    { "glFramebufferTexture2DEXT", (FuncPtr) shimFramebufferTexture2D },
+    { "glGenerateMipmapEXT", (FuncPtr) shimGenerateMipmap },
+    { "glFramebufferTexture", (FuncPtr) shimFramebufferTexture },
+    { "glFramebufferTextureLayer", (FuncPtr) shimFramebufferTextureLayer },
+    { "glCreateShader", (FuncPtr) shimCreateShader },
+    { "glShaderSource", (FuncPtr) shimShaderSource },
+    { "glCompileShader", (FuncPtr) shimCompileShader },
+    { "glGetShaderiv", (FuncPtr) shimGetShaderiv },
+    { "glGetShaderInfoLog", (FuncPtr) shimGetShaderInfoLog },
+    { "glDeleteShader", (FuncPtr) shimDeleteShader },
+    { "glCreateProgram", (FuncPtr) shimCreateProgram },
+    { "glAttachShader", (FuncPtr) shimAttachShader },
+    { "glLinkProgram", (FuncPtr) shimLinkProgram },
+    { "glGetProgramiv", (FuncPtr) shimGetProgramiv },
+    { "glGetProgramInfoLog", (FuncPtr) shimGetProgramInfoLog },
+    { "glDeleteProgram", (FuncPtr) shimDeleteProgram },
+    { "glUseProgram", (FuncPtr) shimUseProgram },
+    { "glGetUniformLocation", (FuncPtr) shimGetUniformLocation },
+    { "glUniform1i", (FuncPtr) shimUniform1i },
+    { "glUniform3f", (FuncPtr) shimUniform3f },
+    { "glUniformMatrix4fv", (FuncPtr) shimUniformMatrix4fv },
+    { "glGenQueries", (FuncPtr) shimGenQueries },
+    { "glDeleteQueries", (FuncPtr) shimDeleteQueries },
+    { "glBeginQuery", (FuncPtr) shimBeginQuery },
+    { "glEndQuery", (FuncPtr) shimEndQuery },
+    { "glGetQueryObjectuiv", (FuncPtr) shimGetQueryObjectuiv },
+    { "glGenBuffersARB", (FuncPtr) shimGenBuffers },
+    { "glDeleteBuffersARB", (FuncPtr) shimDeleteBuffers },
+    { "glBindBufferARB", (FuncPtr) shimBindBuffer },
+    { "glBufferDataARB", (FuncPtr) shimBufferData },
+    { "glMapBufferARB", (FuncPtr) shimMapBuffer },
+    { "glUnmapBufferARB", (FuncPtr) shimUnmapBuffer }
+};
+
+FuncPtr
+glShimGetProcAddress (const GLubyte *name)
+{
+    for (unsigned int i = 0; i < sizeof (procs) / sizeof (procs[0]); i++)
+	if (!strcmp (procs[i].name, (const char *) name))
+	    return procs[i].proc;
+
+    return NULL;
+}
@@ -0,0 +1,34 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* GL entry points that only count their calls, in place of libGL. Every
+ * query succeeds: GL 4.5 with pixel buffer objects, shaders that compile
+ * and framebuffers that are complete. */
+
+#ifndef GLSHIM_H
+#define GLSHIM_H
+
+#include <compiz-core.h>
+
+/* Calls of the named entry point since the last reset */
+unsigned long glShimCalls (const char *name);
+
+/* Calls of every entry point since the last reset */
+unsigned long glShimTotal (void);
+
+void glShimReset (void);
+
+/* Extension entry points, as glXGetProcAddress */
+FuncPtr glShimGetProcAddress (const GLubyte *name);
+
+#endif
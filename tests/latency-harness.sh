@@ -0,0 +1,116 @@
+#!/bin/sh
+# Pointer to photon latency of the 3D cursor, measured from outside the
+# compositor. compiz runs with the plugin on Xvfb with llvmpipe, and
+# latencyprobe moves the pointer with XTest and reads both eyes back
+# until the drawn cursor reaches the pointer. There is one distribution
+# per eye for every pointer source and cursor smoothing:
+#
+# - eased: the cursor eases towards the pointer
+# - snapped: a 240 fps target that llvmpipe cannot hold makes the
+#   adaptive quality drop cursor smoothing
+# - late latched: the position is read right before the cursor is drawn
+#
+# The plugin's own latency_stats lines, from its log, follow the
+# distributions of the probe.
+#
+#   tests/latency-harness.sh [latencyprobe] [samples per run]
+#
+# LATENCY_MODE picks the output mode: 1 anaglyph (default), 2 row or
+# 3 column interlaced. Needs Xvfb, xdpyinfo, dbus-launch, dbus-send and
+# compiz 0.8 with the dbus, mousepoll and stereo3d plugins installed.
+
+set -e
+
+probe=${1:-./latencyprobe}
+samples=${2:-100}
+display=:${LATENCY_DISPLAY:-97}
+mode=${LATENCY_MODE:-1}
+log=$(mktemp /tmp/latency-harness.XXXXXX)
+
+case $mode in
+    1) modeName=anaglyph ;;
+    2) modeName=rows ;;
+    3) modeName=columns ;;
+    *) echo "LATENCY_MODE has to be 1, 2 or 3" >&2; exit 2 ;;
+esac
+
+Xvfb $display -screen 0 1024x768x24 +extension GLX +extension Composite \
+    +extension XInputExtension -nolisten tcp > /dev/null 2>&1 &
+xvfb=$!
+compiz=
+
+cleanup ()
+{
+    [ -n "$compiz" ] && kill $compiz 2> /dev/null
+    kill $xvfb 2> /dev/null
+    [ -n "$DBUS_SESSION_BUS_PID" ] && kill $DBUS_SESSION_BUS_PID 2> /dev/null
+    rm -f $log
+}
+trap cleanup EXIT
+
+export DISPLAY=$display
+export LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe
+eval $(dbus-launch --sh-syntax)
+
+set_option ()
+{
+    dbus-send --print-reply --type=method_call --dest=org.freedesktop.compiz \
+	/org/freedesktop/compiz/stereo3d/allscreens/$1 org.freedesktop.compiz.set $2 \
+	> /dev/null 2>&1
+}
+
+# wait for the server before compiz connects to it
+tries=0
+until xdpyinfo > /dev/null 2>&1; do
+    tries=$((tries + 1))
+    [ $tries -gt 100 ] && { echo "Xvfb did not start" >&2; exit 1; }
+    sleep 0.1
+done
+
+compiz --replace dbus mousepoll stereo3d > $log 2>&1 &
+compiz=$!
+
+# the options can be set once the dbus plugin is up
+tries=0
+until set_option drawMouse boolean:true; do
+    tries=$((tries + 1))
+    [ $tries -gt 100 ] && { echo "compiz did not start, see its log:" >&2; cat $log >&2; exit 1; }
+    sleep 0.1
+done
+
+set_option output_mode int32:$mode
+set_option latency_stats boolean:true
+
+for source in 0 1; do
+    [ $source = 0 ] && sourceName=mousepoll || sourceName=XInput2
+    set_option pointer_source int32:$source
+
+    for smoothing in eased snapped late-latched; do
+	case $smoothing in
+	    eased)
+		set_option late_latch_cursor boolean:false
+		set_option adaptive_quality boolean:false ;;
+	    snapped)
+		set_option late_latch_cursor boolean:false
+		set_option target_fps int32:240
+		set_option adaptive_quality boolean:true ;;
+	    late-latched)
+		set_option late_latch_cursor boolean:true
+		set_option adaptive_quality boolean:false ;;
+	esac
+
+	# the governor takes a while to step down to snapping the cursor
+	[ $smoothing = snapped ] && sleep 3
+
+	"$probe" --samples $samples --mode $modeName --label "$sourceName $smoothing"
+    done
+done
+
+# the plugin logs its distributions every 200 measurements and when
+# latency_stats is switched off
+set_option latency_stats boolean:false
+sleep 0.5
+
+echo
+echo "as the plugin measured it:"
+grep "cursor latency" $log || echo "no measurements logged"
@@ -0,0 +1,474 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Pointer to photon latency of the 3D cursor from outside the
+ * compositor, run by latency-harness.sh against compiz on Xvfb.
+ *
+ * A black window covers the screen with a white block cursor on it.
+ * The pointer is moved with XTest, then the screen is read back until
+ * the cursor drawn in each eye has stopped moving. An eye has reached
+ * the pointer at the first readback showing its cursor where it
+ * stopped; the latency is from the XTest request to the end of that
+ * readback, the frames are the cursor positions the eye went through
+ * up to it. The eyes are told apart by the output mode: the channels of
+ * the anaglyph, or the even and odd rows or columns of the interlaced
+ * modes.
+ *
+ *   latencyprobe [--samples n] [--mode anaglyph|rows|columns] [--label text]
+ *
+ * Prints the distribution of each eye. The readbacks are no faster than
+ * XGetImage of the whole screen, their average interval is printed as
+ * the resolution of the measurement. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+
+#define CURSOR_SIZE 16
+// the pointer stays this far from the screen edges
+#define MARGIN      64
+// a new position is at least this far from the last one
+#define MIN_MOVE    200
+
+// an eye whose cursor has not moved for this long has stopped
+#define STABLE_MS   200
+#define TIMEOUT_MS  3000
+// tries to open the display for this long while the server starts
+#define CONNECT_MS  10000
+
+#define MAX_READBACKS 4096
+
+enum { EyeA = 0, EyeB, Eyes };
+
+typedef enum {
+    ModeAnaglyph = 0,
+    ModeRows,
+    ModeColumns
+} Mode;
+
+static const char *modeNames[] = {
+    "anaglyph", "rows", "columns"
+};
+
+static const char *eyeNames[][Eyes] = {
+    { "left (green)", "right (red)" },
+    { "even rows", "odd rows" },
+    { "even columns", "odd columns" }
+};
+
+typedef struct _Readback
+{
+    double ms;
+    // top left of the cursor in each eye, x < 0 while not visible
+    int    x[Eyes], y[Eyes];
+} Readback;
+
+typedef struct _Samples
+{
+    double       *ms;
+    int          *frames;
+    unsigned int count;
+    unsigned int lost;
+} Samples;
+
+// all readbacks taken and the time they took
+static unsigned int totalReadbacks;
+static double       totalReadbackMs;
+
+static double
+nowMs (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static Display *
+openDisplay (void)
+{
+    double  start = nowMs ();
+    Display *dpy;
+
+    while (!(dpy = XOpenDisplay (NULL)) && nowMs () - start < CONNECT_MS)
+	usleep (100000);
+
+    return dpy;
+}
+
+/* A black window over the whole screen with a white block cursor of
+ * its hot spot in the top left corner */
+static Window
+createTarget (Display *dpy)
+{
+    int                  screen = DefaultScreen (dpy);
+    XSetWindowAttributes attrs;
+    Window               win;
+    Pixmap               pixmap;
+    GC                   gc;
+    XColor               white, black;
+    Cursor               cursor;
+
+    attrs.background_pixel = BlackPixel (dpy, screen);
+    win = XCreateWindow (dpy, RootWindow (dpy, screen), 0, 0,
+			 DisplayWidth (dpy, screen), DisplayHeight (dpy, screen), 0,
+			 CopyFromParent, InputOutput, CopyFromParent, CWBackPixel, &attrs);
+
+    pixmap = XCreatePixmap (dpy, win, CURSOR_SIZE, CURSOR_SIZE, 1);
+    gc = XCreateGC (dpy, pixmap, 0, NULL);
+    XSetForeground (dpy, gc, 1);
+    XFillRectangle (dpy, pixmap, gc, 0, 0, CURSOR_SIZE, CURSOR_SIZE);
+
+    white.red = white.green = white.blue = 0xffff;
+    black.red = black.green = black.blue = 0;
+    cursor = XCreatePixmapCursor (dpy, pixmap, pixmap, &white, &black, 0, 0);
+
+    XDefineCursor (dpy, win, cursor);
+    XMapRaised (dpy, win);
+
+    XFreeGC (dpy, gc);
+    XFreePixmap (dpy, pixmap);
+    XSync (dpy, False);
+
+    return win;
+}
+
+static int
+channelShift (unsigned long mask)
+{
+    int shift = 0;
+
+    while (mask && !(mask & 1))
+    {
+	mask >>= 1;
+	shift++;
+    }
+
+    return shift;
+}
+
+/* Finds the cursor of each eye in a readback of the screen */
+static bool
+readBack (Display *dpy, Mode mode, Readback *rb)
+{
+    Window       root = DefaultRootWindow (dpy);
+    int          width = DisplayWidth (dpy, DefaultScreen (dpy));
+    int          height = DisplayHeight (dpy, DefaultScreen (dpy));
+    XImage       *image;
+    int          redShift, greenShift;
+
+    image = XGetImage (dpy, root, 0, 0, width, height, AllPlanes, ZPixmap);
+    rb->ms = nowMs ();
+
+    if (!image || image->bits_per_pixel != 32)
+    {
+	if (image)
+	    XDestroyImage (image);
+	return false;
+    }
+
+    redShift = channelShift (image->red_mask);
+    greenShift = channelShift (image->green_mask);
+
+    for (int eye = 0; eye < Eyes; eye++)
+	rb->x[eye] = rb->y[eye] = -1;
+
+    for (int y = 0; y < height; y++)
+    {
+	const unsigned int *row = (const unsigned int *) (image->data + y * image->bytes_per_line);
+
+	for (int x = 0; x < width; x++)
+	{
+	    unsigned int red = (row[x] >> redShift) & 0xff;
+	    unsigned int green = (row[x] >> greenShift) & 0xff;
+	    bool         lit[Eyes];
+
+	    switch (mode) {
+	    case ModeAnaglyph:
+		lit[EyeA] = green > 0x80;
+		lit[EyeB] = red > 0x80;
+		break;
+	    case ModeRows:
+		lit[EyeA] = !(y & 1) && green > 0x80;
+		lit[EyeB] = (y & 1) && green > 0x80;
+		break;
+	    case ModeColumns:
+		lit[EyeA] = !(x & 1) && green > 0x80;
+		lit[EyeB] = (x & 1) && green > 0x80;
+		break;
+	    }
+
+	    for (int eye = 0; eye < Eyes; eye++)
+	    {
+		if (!lit[eye])
+		    continue;
+
+		// the interlaced eyes start on the first row or column of theirs
+		if (rb->y[eye] < 0)
+		    rb->y[eye] = mode == ModeRows ? y & ~1 : y;
+		if (rb->x[eye] < 0 || x < rb->x[eye])
+		    rb->x[eye] = mode == ModeColumns ? x & ~1 : x;
+	    }
+	}
+    }
+
+    XDestroyImage (image);
+
+    return true;
+}
+
+static bool
+samePosition (const Readback *a, const Readback *b, int eye)
+{
+    return abs (a->x[eye] - b->x[eye]) <= 1 && abs (a->y[eye] - b->y[eye]) <= 1;
+}
+
+/* Reads back until both eyes have stopped, returns the number of
+ * readbacks taken */
+static int
+followCursor (Display *dpy, Mode mode, Readback *readbacks, double start)
+{
+    double stableSince[Eyes] = { start, start };
+    double last = start;
+    int    n = 0;
+
+    while (n < MAX_READBACKS)
+    {
+	Readback *rb = &readbacks[n];
+	bool     stable = true;
+
+	if (!readBack (dpy, mode, rb))
+	    break;
+
+	totalReadbacks++;
+	totalReadbackMs += rb->ms - last;
+	last = rb->ms;
+
+	for (int eye = 0; eye < Eyes; eye++)
+	{
+	    if (n && !samePosition (rb, &readbacks[n - 1], eye))
+		stableSince[eye] = rb->ms;
+
+	    stable &= rb->x[eye] >= 0 && rb->ms - stableSince[eye] >= STABLE_MS;
+	}
+
+	n++;
+
+	if (stable || rb->ms - start > TIMEOUT_MS)
+	    break;
+    }
+
+    return n;
+}
+
+static void
+addSample (Samples *samples, double ms, int frames)
+{
+    samples->ms[samples->count] = ms;
+    samples->frames[samples->count] = frames;
+    samples->count++;
+}
+
+/* One pointer move, the samples of the eyes go into samples */
+static void
+measure (Display  *dpy,
+	 Mode     mode,
+	 int      x,
+	 int      y,
+	 Readback *before,
+	 Readback *readbacks,
+	 Samples  *samples)
+{
+    double start;
+    int    n;
+
+    start = nowMs ();
+    XTestFakeMotionEvent (dpy, -1, x, y, CurrentTime);
+    XFlush (dpy);
+
+    n = followCursor (dpy, mode, readbacks, start);
+    if (!n)
+    {
+	for (int eye = 0; eye < Eyes; eye++)
+	    samples[eye].lost++;
+	return;
+    }
+
+    for (int eye = 0; eye < Eyes; eye++)
+    {
+	const Readback *settled = &readbacks[n - 1];
+	const Readback *last = before;
+	int            frames = 0;
+	int            i;
+
+	// still where it was, or never settled
+	if (settled->x[eye] < 0 || samePosition (settled, before, eye) ||
+	    settled->ms - start > TIMEOUT_MS)
+	{
+	    samples[eye].lost++;
+	    continue;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+	    if (!samePosition (&readbacks[i], last, eye))
+		frames++;
+	    last = &readbacks[i];
+
+	    if (samePosition (&readbacks[i], settled, eye))
+		break;
+	}
+
+	addSample (&samples[eye], readbacks[i].ms - start, frames);
+    }
+
+    *before = readbacks[n - 1];
+}
+
+static int
+compareMs (const void *a, const void *b)
+{
+    double d = *(const double *) a - *(const double *) b;
+
+    return d < 0 ? -1 : d > 0;
+}
+
+static void
+printDistribution (const char *label, const char *eye, Samples *samples)
+{
+    double frames = 0;
+
+    if (!samples->count)
+    {
+	printf ("%s, %s: no samples, %u lost\n", label, eye, samples->lost);
+	return;
+    }
+
+    for (unsigned int i = 0; i < samples->count; i++)
+	frames += samples->frames[i];
+
+    qsort (samples->ms, samples->count, sizeof (double), compareMs);
+
+    printf ("%s, %s: %u samples, median %.1f ms, p90 %.1f ms, p99 %.1f ms, "
+	    "max %.1f ms, %.2f frames on average, %u lost\n",
+	    label, eye, samples->count,
+	    samples->ms[samples->count / 2],
+	    samples->ms[samples->count * 90 / 100],
+	    samples->ms[samples->count * 99 / 100],
+	    samples->ms[samples->count - 1],
+	    frames / samples->count, samples->lost);
+}
+
+int
+main (int argc, char **argv)
+{
+    Display      *dpy;
+    Mode         mode = ModeAnaglyph;
+    const char   *label = "";
+    int          nSamples = 100, event, error, major, minor;
+    int          width, height, x, y;
+    unsigned int seed = 1;
+    Readback     before, *readbacks;
+    Samples      samples[Eyes];
+
+    for (int i = 1; i < argc; i++)
+    {
+	if (!strcmp (argv[i], "--samples") && i + 1 < argc)
+	    nSamples = atoi (argv[++i]);
+	else if (!strcmp (argv[i], "--label") && i + 1 < argc)
+	    label = argv[++i];
+	else if (!strcmp (argv[i], "--mode") && i + 1 < argc)
+	{
+	    i++;
+	    for (int m = ModeAnaglyph; m <= ModeColumns; m++)
+		if (!strcmp (argv[i], modeNames[m]))
+		    mode = (Mode) m;
+	}
+	else
+	{
+	    fprintf (stderr, "usage: %s [--samples n] [--mode anaglyph|rows|columns] "
+		     "[--label text]\n", argv[0]);
+	    return 2;
+	}
+    }
+
+    dpy = openDisplay ();
+    if (!dpy)
+    {
+	fprintf (stderr, "unable to open the display\n");
+	return 1;
+    }
+
+    if (!XTestQueryExtension (dpy, &event, &error, &major, &minor))
+    {
+	fprintf (stderr, "the server has no XTest\n");
+	return 1;
+    }
+
+    createTarget (dpy);
+
+    width = DisplayWidth (dpy, DefaultScreen (dpy));
+    height = DisplayHeight (dpy, DefaultScreen (dpy));
+
+    readbacks = (Readback *) malloc (MAX_READBACKS * sizeof (Readback));
+
+    for (int eye = 0; eye < Eyes; eye++)
+    {
+	samples[eye].ms = (double *) malloc (nSamples * sizeof (double));
+	samples[eye].frames = (int *) malloc (nSamples * sizeof (int));
+	samples[eye].count = samples[eye].lost = 0;
+    }
+
+    // the first move only brings the cursor to a known place
+    x = width / 2;
+    y = height / 2;
+    for (int eye = 0; eye < Eyes; eye++)
+	before.x[eye] = before.y[eye] = -1;
+    measure (dpy, mode, x, y, &before, readbacks, samples);
+
+    for (int eye = 0; eye < Eyes; eye++)
+	samples[eye].count = samples[eye].lost = 0;
+    totalReadbacks = 0;
+    totalReadbackMs = 0.0;
+
+    for (int i = 0; i < nSamples; i++)
+    {
+	int lastX = x, lastY = y;
+
+	do {
+	    seed = seed * 1103515245 + 12345;
+	    x = MARGIN + (seed >> 8) % (width - 2 * MARGIN - CURSOR_SIZE);
+	    seed = seed * 1103515245 + 12345;
+	    y = MARGIN + (seed >> 8) % (height - 2 * MARGIN - CURSOR_SIZE);
+	} while (abs (x - lastX) + abs (y - lastY) < MIN_MOVE);
+
+	measure (dpy, mode, x, y, &before, readbacks, samples);
+    }
+
+    printf ("%s, %s, %u readbacks, one every %.1f ms\n", label, modeNames[mode],
+	    totalReadbacks, totalReadbacks ? totalReadbackMs / totalReadbacks : 0.0);
+
+    for (int eye = 0; eye < Eyes; eye++)
+	printDistribution (label, eyeNames[mode][eye], &samples[eye]);
+
+    XCloseDisplay (dpy);
+
+    return 0;
+}
@@ -0,0 +1,1979 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The parts of compiz 0.8 core the plugin runs against, following
+ * core's paint.c, fragment.c, texture.c and matrix.c closely enough
+ * for the plugin to draw what it draws under compiz. Left out: damage
+ * regions (every frame paints the whole screen), core's own saturation
+ * function and multitexturing. */
+
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+#include <X11/extensions/XI2.h>
+#include <compiz-mousepoll.h>
+
+#include "mockcore.h"
+
+// the plugin's entry point, called by the bcop generated one under compiz
+CompPluginVTable *getCompPluginInfo (void);
+
+// privates per object type, as many as the tests ever need
+#define MAX_PRIVATES 16
+
+#define MAX_POLLERS   8
+#define MAX_FUNCTIONS 64
+#define MAX_PROGRAMS  64
+#define MAX_OPS       16
+#define MAX_HEADER    16
+
+struct _CompOption
+{
+    const char *name;
+    long       value;
+};
+
+struct _CompPlugin
+{
+    CompPluginVTable *vTable;
+};
+
+typedef struct _MockScreen
+{
+    CompScreen screen;
+    CompOutput output;
+
+    void (*genPrograms) (GLsizei, GLuint *);
+    void (*deletePrograms) (GLsizei, const GLuint *);
+    void (*bindProgram) (GLenum, GLuint);
+    void (*programString) (GLenum, GLenum, GLsizei, const GLvoid *);
+} MockScreen;
+
+typedef struct _MockWindow
+{
+    CompWindow  window;
+    CompTexture texture;
+    REGION      region;
+} MockWindow;
+
+typedef enum { OpFetch, OpColor, OpData } OpType;
+
+typedef struct _FunctionOp
+{
+    OpType type;
+    char   *dst;
+    // source of a colour op, text of a data op
+    char   *str;
+    int    target;
+} FunctionOp;
+
+struct _CompFunctionData
+{
+    char       *header[MAX_HEADER];
+    int        nHeader;
+    FunctionOp ops[MAX_OPS];
+    int        nOp;
+};
+
+typedef struct _MockProgram
+{
+    int    functions[MAX_FRAGMENT_FUNCTIONS];
+    int    nFunction;
+    GLenum target;
+    GLuint program;
+} MockProgram;
+
+typedef struct _LogEntry
+{
+    CompLogLevel level;
+    char         *text;
+} LogEntry;
+
+static CompPlugin   plugin;
+static bool         pluginLoaded;
+// false for a display of mockInitBareDisplay
+static bool         pluginAttached;
+static MockCoreCalls coreCalls;
+static int          mousepollIndex;
+static unsigned int nPrivates[COMP_OBJECT_TYPE_WINDOW + 1];
+static Window       lastId = 0x1000;
+static unsigned int lastActiveNum;
+static CompWindow   *lastFoundWindow;
+
+static GLXGetProcAddressProc getProc;
+
+static struct
+{
+    CompScreen         *screen;
+    PositionUpdateProc update;
+} pollers[MAX_POLLERS];
+
+static CompFunctionData *functions[MAX_FUNCTIONS];
+static bool             failFunctions;
+static MockProgram      programs[MAX_PROGRAMS];
+static int              nPrograms;
+static unsigned int     programBuilds;
+
+static LogEntry *logEntries;
+static int      nLogEntries;
+static bool     logVerbose;
+
+static const GLushort defaultColor[4] = { 0xffff, 0xffff, 0xffff, 0xffff };
+
+static const ScreenPaintAttrib defaultScreenPaintAttrib = {
+    0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -DEFAULT_Z_CAMERA
+};
+
+/* Logging */
+
+void
+compLogMessage (const char *componentName, CompLogLevel level, const char *format, ...)
+{
+    static const char *levelNames[] = { "Fatal", "Error", "Warn", "Info", "Debug" };
+    va_list           args;
+    char              *text;
+
+    va_start (args, format);
+    if (vasprintf (&text, format, args) < 0)
+	text = NULL;
+    va_end (args);
+
+    if (!text)
+	return;
+
+    if (logVerbose)
+	fprintf (stderr, "%s (%s) - %s\n", componentName, levelNames[level], text);
+
+    logEntries = (LogEntry *) realloc (logEntries, (nLogEntries + 1) * sizeof (LogEntry));
+    logEntries[nLogEntries].level = level;
+    logEntries[nLogEntries].text = text;
+    nLogEntries++;
+}
+
+int
+mockCountLogMessages (CompLogLevel level, const char *text)
+{
+    int count = 0;
+
+    for (int i = 0; i < nLogEntries; i++)
+	if (logEntries[i].level <= level && strstr (logEntries[i].text, text))
+	    count++;
+
+    return count;
+}
+
+void
+mockClearLog (void)
+{
+    for (int i = 0; i < nLogEntries; i++)
+	free (logEntries[i].text);
+
+    free (logEntries);
+    logEntries = NULL;
+    nLogEntries = 0;
+}
+
+void
+mockSetLogVerbose (bool verbose)
+{
+    logVerbose = verbose;
+}
+
+CompTimeoutHandle
+compAddTimeout (int minTime, int maxTime, CallBackProc callBack, void *closure)
+{
+    // nothing in the tests waits for one
+    return 0;
+}
+
+void *
+compRemoveTimeout (CompTimeoutHandle handle)
+{
+    return NULL;
+}
+
+/* Plugins and privates */
+
+static int
+allocatePrivateIndex (CompObjectType type)
+{
+    if (nPrivates[type] >= MAX_PRIVATES)
+	return -1;
+
+    return nPrivates[type]++;
+}
+
+int
+allocateDisplayPrivateIndex (void)
+{
+    return allocatePrivateIndex (COMP_OBJECT_TYPE_DISPLAY);
+}
+
+void
+freeDisplayPrivateIndex (int index)
+{
+}
+
+int
+allocateScreenPrivateIndex (CompDisplay *d)
+{
+    return allocatePrivateIndex (COMP_OBJECT_TYPE_SCREEN);
+}
+
+void
+freeScreenPrivateIndex (CompDisplay *d, int index)
+{
+}
+
+int
+allocateWindowPrivateIndex (CompScreen *s)
+{
+    return allocatePrivateIndex (COMP_OBJECT_TYPE_WINDOW);
+}
+
+void
+freeWindowPrivateIndex (CompScreen *s, int index)
+{
+}
+
+Bool
+checkPluginABI (const char *name, int abi)
+{
+    return TRUE;
+}
+
+Bool
+getPluginDisplayIndex (CompDisplay *d, const char *name, int *index)
+{
+    if (strcmp (name, "mousepoll"))
+	return FALSE;
+
+    *index = mousepollIndex;
+
+    return TRUE;
+}
+
+int
+getIntOptionNamed (CompOption *option, int nOption, const char *name, int defaultValue)
+{
+    for (int i = 0; i < nOption; i++)
+	if (!strcmp (option[i].name, name))
+	    return option[i].value;
+
+    return defaultValue;
+}
+
+static void
+initObject (CompObject *object, CompObjectType type, CompObject *parent)
+{
+    object->type = type;
+    object->privates = (CompPrivate *) calloc (MAX_PRIVATES, sizeof (CompPrivate));
+    object->parent = parent;
+}
+
+/* mousepoll */
+
+static PositionPollingHandle
+addPositionPolling (CompScreen *s, PositionUpdateProc update)
+{
+    for (int i = 0; i < MAX_POLLERS; i++)
+    {
+	if (pollers[i].update)
+	    continue;
+
+	pollers[i].screen = s;
+	pollers[i].update = update;
+
+	return i;
+    }
+
+    return -1;
+}
+
+static void
+removePositionPolling (CompScreen *s, PositionPollingHandle id)
+{
+    if (id >= 0 && id < MAX_POLLERS)
+	pollers[id].update = NULL;
+}
+
+static void
+getCurrentPosition (CompScreen *s, int *x, int *y)
+{
+    Window       root, child;
+    int          winX, winY;
+    unsigned int mask;
+
+    XQueryPointer (s->display->display, s->root, &root, &child, x, y, &winX, &winY, &mask);
+}
+
+static MousePollFunc mousePollFunc = {
+    addPositionPolling,
+    removePositionPolling,
+    getCurrentPosition
+};
+
+void
+mockMovePointer (CompScreen *s, int x, int y)
+{
+    xstubSetPointer (x, y);
+
+    for (int i = 0; i < MAX_POLLERS; i++)
+	if (pollers[i].update && pollers[i].screen == s)
+	    (*pollers[i].update) (s, x, y);
+}
+
+/* Lookups */
+
+CompScreen *
+findScreenAtDisplay (CompDisplay *d, Window root)
+{
+    for (CompScreen *s = d->screens; s; s = s->next)
+	if (s->root == root)
+	    return s;
+
+    return NULL;
+}
+
+CompWindow *
+findWindowAtScreen (CompScreen *s, Window id)
+{
+    // core's cache of the last window found
+    if (lastFoundWindow && lastFoundWindow->screen == s && lastFoundWindow->id == id)
+	return lastFoundWindow;
+
+    for (CompWindow *w = s->windows; w; w = w->next)
+	if (w->id == id)
+	    return (lastFoundWindow = w);
+
+    return NULL;
+}
+
+CompWindow *
+findWindowAtDisplay (CompDisplay *d, Window id)
+{
+    for (CompScreen *s = d->screens; s; s = s->next)
+    {
+	CompWindow *w = findWindowAtScreen (s, id);
+
+	if (w)
+	    return w;
+    }
+
+    return NULL;
+}
+
+unsigned int
+getWindowProp (CompDisplay *d, Window id, Atom property, unsigned int defaultValue)
+{
+    return defaultValue;
+}
+
+/* Matches of window types, "Dock | type=Normal" and "any" */
+
+static const char *windowTypeNames[] = {
+    "Desktop", "Dock", "Toolbar", "Menu", "Utility", "Splash", "Dialog",
+    "Normal", "DropdownMenu", "PopupMenu", "Tooltip", "Notification",
+    "Combo", "Dnd", "ModalDialog", "Fullscreen", "Unknown"
+};
+
+static unsigned int
+windowTypeFromString (const char *name, int length)
+{
+    if (length == 3 && !strncmp (name, "any", 3))
+	return ~0;
+
+    for (unsigned int i = 0; i < ARRAY_SIZE (windowTypeNames); i++)
+	if ((int) strlen (windowTypeNames[i]) == length &&
+	    !strncasecmp (windowTypeNames[i], name, length))
+	    return 1 << i;
+
+    return 0;
+}
+
+Bool
+matchEval (CompMatch *match, CompWindow *w)
+{
+    const char *term = match->expression;
+
+    while (term && *term)
+    {
+	const char *end = strchr (term, '|');
+	const char *last;
+
+	if (!end)
+	    end = term + strlen (term);
+
+	while (term < end && *term == ' ')
+	    term++;
+	if (!strncmp (term, "type=", 5))
+	    term += 5;
+	for (last = end; last > term && last[-1] == ' '; last--);
+
+	if (windowTypeFromString (term, last - term) & w->wmType)
+	    return TRUE;
+
+	term = *end ? end + 1 : end;
+    }
+
+    return FALSE;
+}
+
+void
+damageScreen (CompScreen *s)
+{
+}
+
+void
+damageScreenRegion (CompScreen *s, Region region)
+{
+}
+
+void
+addWindowDamage (CompWindow *w)
+{
+}
+
+/* Matrices, column major as GL's */
+
+#define M(row, col) m[(col) * 4 + (row)]
+#define A(row, col) a[(col) * 4 + (row)]
+#define B(row, col) b[(col) * 4 + (row)]
+#define P(row, col) product[(col) * 4 + (row)]
+
+void
+matrixGetIdentity (CompTransform *m)
+{
+    memset (m->m, 0, sizeof (m->m));
+    m->m[0] = m->m[5] = m->m[10] = m->m[15] = 1.0f;
+}
+
+static void
+matmul4 (float *product, const float *a, const float *b)
+{
+    for (int i = 0; i < 4; i++)
+    {
+	const float ai0 = A(i,0), ai1 = A(i,1), ai2 = A(i,2), ai3 = A(i,3);
+
+	P(i,0) = ai0 * B(0,0) + ai1 * B(1,0) + ai2 * B(2,0) + ai3 * B(3,0);
+	P(i,1) = ai0 * B(0,1) + ai1 * B(1,1) + ai2 * B(2,1) + ai3 * B(3,1);
+	P(i,2) = ai0 * B(0,2) + ai1 * B(1,2) + ai2 * B(2,2) + ai3 * B(3,2);
+	P(i,3) = ai0 * B(0,3) + ai1 * B(1,3) + ai2 * B(2,3) + ai3 * B(3,3);
+    }
+}
+
+void
+matrixMultiply (CompTransform       *product,
+		const CompTransform *transformA,
+		const CompTransform *transformB)
+{
+    float temp[16];
+
+    matmul4 (temp, transformA->m, transformB->m);
+    memcpy (product->m, temp, sizeof (temp));
+}
+
+void
+matrixRotate (CompTransform *transform, float angle, float x, float y, float z)
+{
+    float m[16];
+    float s, c, mag, xx, yy, zz, xy, yz, zx, xs, ys, zs, one_c;
+
+    s = (float) sin (angle * M_PI / 180.0);
+    c = (float) cos (angle * M_PI / 180.0);
+
+    memset (m, 0, sizeof (m));
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
+
+    mag = sqrtf (x * x + y * y + z * z);
+    if (mag <= 1.0e-4)
+	return;
+
+    x /= mag;
+    y /= mag;
+    z /= mag;
+
+    xx = x * x;
+    yy = y * y;
+    zz = z * z;
+    xy = x * y;
+    yz = y * z;
+    zx = z * x;
+    xs = x * s;
+    ys = y * s;
+    zs = z * s;
+    one_c = 1.0f - c;
+
+    M(0,0) = (one_c * xx) + c;
+    M(0,1) = (one_c * xy) - zs;
+    M(0,2) = (one_c * zx) + ys;
+    M(1,0) = (one_c * xy) + zs;
+    M(1,1) = (one_c * yy) + c;
+    M(1,2) = (one_c * yz) - xs;
+    M(2,0) = (one_c * zx) - ys;
+    M(2,1) = (one_c * yz) + xs;
+    M(2,2) = (one_c * zz) + c;
+
+    float temp[16];
+
+    matmul4 (temp, transform->m, m);
+    memcpy (transform->m, temp, sizeof (temp));
+}
+
+void
+matrixScale (CompTransform *transform, float x, float y, float z)
+{
+    float *m = transform->m;
+
+    m[0] *= x; m[4] *= y; m[8]  *= z;
+    m[1] *= x; m[5] *= y; m[9]  *= z;
+    m[2] *= x; m[6] *= y; m[10] *= z;
+    m[3] *= x; m[7] *= y; m[11] *= z;
+}
+
+void
+matrixTranslate (CompTransform *transform, float x, float y, float z)
+{
+    float *m = transform->m;
+
+    m[12] = m[0] * x + m[4] * y + m[8]  * z + m[12];
+    m[13] = m[1] * x + m[5] * y + m[9]  * z + m[13];
+    m[14] = m[2] * x + m[6] * y + m[10] * z + m[14];
+    m[15] = m[3] * x + m[7] * y + m[11] * z + m[15];
+}
+
+#undef M
+#undef A
+#undef B
+#undef P
+
+void
+transformToScreenSpace (CompScreen *screen, CompOutput *output, float z, CompTransform *transform)
+{
+    matrixTranslate (transform, -0.5f, -0.5f, z);
+    matrixScale (transform, 1.0f / output->width, -1.0f / output->height, 1.0f);
+    matrixTranslate (transform, -output->region.extents.x1, -output->region.extents.y2, 0.0f);
+}
+
+static void
+frustum (GLfloat *m, GLfloat left, GLfloat right, GLfloat bottom, GLfloat top,
+	 GLfloat nearval, GLfloat farval)
+{
+    memset (m, 0, 16 * sizeof (GLfloat));
+
+    m[0] = (2.0f * nearval) / (right - left);
+    m[5] = (2.0f * nearval) / (top - bottom);
+    m[8] = (right + left) / (right - left);
+    m[9] = (top + bottom) / (top - bottom);
+    m[10] = -(farval + nearval) / (farval - nearval);
+    m[11] = -1.0f;
+    m[14] = -(2.0f * farval * nearval) / (farval - nearval);
+}
+
+static void
+perspective (GLfloat *m, GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar)
+{
+    GLfloat ymax = zNear * tan (fovy * M_PI / 360.0);
+
+    frustum (m, -ymax * aspect, ymax * aspect, -ymax, ymax, zNear, zFar);
+}
+
+/* Fragment functions, kept as their ops and assembled into one ARB
+ * program per function list and texture target like fragment.c */
+
+CompFunctionData *
+createFunctionData (void)
+{
+    return (CompFunctionData *) calloc (1, sizeof (CompFunctionData));
+}
+
+void
+destroyFunctionData (CompFunctionData *data)
+{
+    for (int i = 0; i < data->nHeader; i++)
+	free (data->header[i]);
+
+    for (int i = 0; i < data->nOp; i++)
+    {
+	free (data->ops[i].dst);
+	free (data->ops[i].str);
+    }
+
+    free (data);
+}
+
+static Bool
+addHeaderOp (CompFunctionData *data, const char *type, const char *name)
+{
+    if (data->nHeader >= MAX_HEADER)
+	return FALSE;
+
+    if (asprintf (&data->header[data->nHeader], "%s %s;", type, name) < 0)
+	return FALSE;
+
+    data->nHeader++;
+
+    return TRUE;
+}
+
+Bool
+addTempHeaderOpToFunctionData (CompFunctionData *data, const char *name)
+{
+    return addHeaderOp (data, "TEMP", name);
+}
+
+Bool
+addParamHeaderOpToFunctionData (CompFunctionData *data, const char *name)
+{
+    return addHeaderOp (data, "PARAM", name);
+}
+
+Bool
+addAttribHeaderOpToFunctionData (CompFunctionData *data, const char *name)
+{
+    return addHeaderOp (data, "ATTRIB", name);
+}
+
+static FunctionOp *
+addOp (CompFunctionData *data, OpType type)
+{
+    FunctionOp *op;
+
+    if (data->nOp >= MAX_OPS)
+	return NULL;
+
+    op = &data->ops[data->nOp++];
+    memset (op, 0, sizeof (*op));
+    op->type = type;
+
+    return op;
+}
+
+Bool
+addFetchOpToFunctionData (CompFunctionData *data, const char *dst, const char *offset, int target)
+{
+    FunctionOp *op = addOp (data, OpFetch);
+
+    if (!op)
+	return FALSE;
+
+    op->dst = strdup (dst);
+    op->str = offset ? strdup (offset) : NULL;
+    op->target = target;
+
+    return TRUE;
+}
+
+Bool
+addColorOpToFunctionData (CompFunctionData *data, const char *dst, const char *src)
+{
+    FunctionOp *op = addOp (data, OpColor);
+
+    if (!op)
+	return FALSE;
+
+    op->dst = strdup (dst);
+    op->str = strdup (src);
+
+    return TRUE;
+}
+
+Bool
+addDataOpToFunctionData (CompFunctionData *data, const char *str, ...)
+{
+    FunctionOp *op = addOp (data, OpData);
+    va_list    args;
+    int        length;
+
+    if (!op)
+	return FALSE;
+
+    va_start (args, str);
+    length = vasprintf (&op->str, str, args);
+    va_end (args);
+
+    return length >= 0;
+}
+
+static CompFunctionData *
+copyFunctionData (const CompFunctionData *data)
+{
+    CompFunctionData *copy = createFunctionData ();
+
+    for (int i = 0; i < data->nHeader; i++)
+	copy->header[i] = strdup (data->header[i]);
+    copy->nHeader = data->nHeader;
+
+    for (int i = 0; i < data->nOp; i++)
+    {
+	copy->ops[i] = data->ops[i];
+	copy->ops[i].dst = data->ops[i].dst ? strdup (data->ops[i].dst) : NULL;
+	copy->ops[i].str = data->ops[i].str ? strdup (data->ops[i].str) : NULL;
+    }
+    copy->nOp = data->nOp;
+
+    return copy;
+}
+
+int
+createFragmentFunction (CompScreen *s, const char *name, CompFunctionData *data)
+{
+    if (failFunctions)
+	return 0;
+
+    for (int id = 1; id < MAX_FUNCTIONS; id++)
+    {
+	if (functions[id])
+	    continue;
+
+	functions[id] = copyFunctionData (data);
+
+	return id;
+    }
+
+    return 0;
+}
+
+void
+destroyFragmentFunction (CompScreen *s, int id)
+{
+    MockScreen *ms = (MockScreen *) s;
+
+    if (id <= 0 || id >= MAX_FUNCTIONS || !functions[id])
+	return;
+
+    destroyFunctionData (functions[id]);
+    functions[id] = NULL;
+
+    // programs using the function go with it
+    for (int i = 0; i < nPrograms; i++)
+    {
+	for (int j = 0; j < programs[i].nFunction; j++)
+	{
+	    if (programs[i].functions[j] != id)
+		continue;
+
+	    (*ms->deletePrograms) (1, &programs[i].program);
+	    programs[i--] = programs[--nPrograms];
+	    break;
+	}
+    }
+}
+
+void
+mockFailFragmentFunctions (bool fail)
+{
+    failFunctions = fail;
+}
+
+unsigned int
+mockGetProgramBuilds (void)
+{
+    return programBuilds;
+}
+
+int
+allocFragmentParameters (FragmentAttrib *attrib, int n)
+{
+    int first = attrib->nParam;
+
+    attrib->nParam += n;
+
+    return first;
+}
+
+void
+addFragmentFunction (FragmentAttrib *attrib, int function)
+{
+    if (attrib->nFunction < MAX_FRAGMENT_FUNCTIONS)
+	attrib->function[attrib->nFunction++] = function;
+}
+
+void
+initFragmentAttrib (FragmentAttrib *attrib, const WindowPaintAttrib *paint)
+{
+    attrib->opacity = paint->opacity;
+    attrib->brightness = paint->brightness;
+    attrib->saturation = paint->saturation;
+    attrib->nTexture = 0;
+    attrib->nFunction = 0;
+    attrib->nParam = 0;
+
+    memset (attrib->function, 0, sizeof (attrib->function));
+}
+
+static void
+append (char **source, const char *format, ...)
+{
+    va_list args;
+    char    *text, *joined;
+
+    va_start (args, format);
+    if (vasprintf (&text, format, args) < 0)
+	text = NULL;
+    va_end (args);
+
+    if (asprintf (&joined, "%s%s", *source, text ? text : "") < 0)
+	joined = NULL;
+
+    free (*source);
+    free (text);
+    *source = joined;
+}
+
+/* The first function fetches the texture, the ones after it continue
+ * from its output; the primary colour is applied by the last one */
+static char *
+buildProgramSource (const FragmentAttrib *attrib)
+{
+    char *source = strdup ("!!ARBfp1.0\nTEMP output;\n");
+
+    for (int i = 0; i < attrib->nFunction; i++)
+    {
+	CompFunctionData *data = functions[attrib->function[i]];
+
+	for (int j = 0; j < data->nHeader; j++)
+	    if (!strstr (source, data->header[j]))
+		append (&source, "%s\n", data->header[j]);
+    }
+
+    for (int i = 0; i < attrib->nFunction; i++)
+    {
+	CompFunctionData *data = functions[attrib->function[i]];
+	bool             last = i == attrib->nFunction - 1;
+
+	for (int j = 0; j < data->nOp; j++)
+	{
+	    FunctionOp *op = &data->ops[j];
+
+	    switch (op->type) {
+	    case OpFetch:
+		if (i == 0)
+		    append (&source, "TEX %s, fragment.texcoord[0], texture[0], %s;\n", op->dst,
+			    op->target == COMP_FETCH_TARGET_RECT ? "RECT" : "2D");
+		else
+		    append (&source, "MOV %s, output;\n", op->dst);
+		break;
+	    case OpColor:
+		if (last)
+		    append (&source, "MUL %s, fragment.color, %s;\n", op->dst, op->str);
+		else
+		    append (&source, "MOV %s, %s;\n", op->dst, op->str);
+		break;
+	    case OpData:
+		append (&source, "%s\n", op->str);
+		break;
+	    }
+	}
+    }
+
+    append (&source, "MOV result.color, output;\nEND\n");
+
+    return source;
+}
+
+static GLuint
+getFragmentProgram (CompScreen *s, const FragmentAttrib *attrib, GLenum target)
+{
+    MockScreen  *ms = (MockScreen *) s;
+    MockProgram *mp;
+    char        *source;
+    GLint       errorPos;
+
+    for (int i = 0; i < attrib->nFunction; i++)
+	if (attrib->function[i] <= 0 || attrib->function[i] >= MAX_FUNCTIONS ||
+	    !functions[attrib->function[i]])
+	    return 0;
+
+    for (int i = 0; i < nPrograms; i++)
+    {
+	mp = &programs[i];
+
+	if (mp->target == target && mp->nFunction == attrib->nFunction &&
+	    !memcmp (mp->functions, attrib->function, attrib->nFunction * sizeof (int)))
+	    return mp->program;
+    }
+
+    if (nPrograms == MAX_PROGRAMS)
+	return 0;
+
+    mp = &programs[nPrograms];
+    memcpy (mp->functions, attrib->function, attrib->nFunction * sizeof (int));
+    mp->nFunction = attrib->nFunction;
+    mp->target = target;
+
+    source = buildProgramSource (attrib);
+
+    (*ms->genPrograms) (1, &mp->program);
+    (*ms->bindProgram) (GL_FRAGMENT_PROGRAM_ARB, mp->program);
+    (*ms->programString) (GL_FRAGMENT_PROGRAM_ARB, GL_PROGRAM_FORMAT_ASCII_ARB,
+			  strlen (source), source);
+
+    glGetIntegerv (GL_PROGRAM_ERROR_POSITION_ARB, &errorPos);
+    glGetError ();
+    if (errorPos != -1)
+    {
+	compLogMessage ("core", CompLogLevelError,
+			"failed to load fragment program at %d:\n%s", errorPos, source);
+	(*ms->deletePrograms) (1, &mp->program);
+	mp->program = 0;
+    }
+
+    free (source);
+
+    programBuilds++;
+    nPrograms++;
+
+    return mp->program;
+}
+
+/* Textures */
+
+void
+initTexture (CompScreen *screen, CompTexture *texture)
+{
+    memset (texture, 0, sizeof (CompTexture));
+
+    texture->target = GL_TEXTURE_2D;
+    texture->filter = GL_NEAREST;
+    texture->wrap = GL_CLAMP_TO_EDGE;
+    texture->matrix.xx = 1.0f;
+    texture->matrix.yy = 1.0f;
+    texture->oldMipmaps = TRUE;
+}
+
+void
+finiTexture (CompScreen *screen, CompTexture *texture)
+{
+    if (texture->name)
+	glDeleteTextures (1, &texture->name);
+}
+
+void
+enableTexture (CompScreen *s, CompTexture *texture, CompTextureFilter filter)
+{
+    glEnable (texture->target);
+    glBindTexture (texture->target, texture->name);
+
+    if (filter == COMP_TEXTURE_FILTER_FAST)
+    {
+	if (texture->filter != GL_NEAREST)
+	{
+	    glTexParameteri (texture->target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	    glTexParameteri (texture->target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	    texture->filter = GL_NEAREST;
+	}
+    }
+    else if (texture->filter != s->display->textureFilter)
+    {
+	if (s->display->textureFilter == GL_LINEAR_MIPMAP_LINEAR)
+	{
+	    if (s->textureNonPowerOfTwo && s->fbo && texture->mipmap)
+	    {
+		glTexParameteri (texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+		if (texture->filter != GL_LINEAR)
+		    glTexParameteri (texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		texture->filter = GL_LINEAR_MIPMAP_LINEAR;
+	    }
+	    else if (texture->filter != GL_LINEAR)
+	    {
+		glTexParameteri (texture->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri (texture->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		texture->filter = GL_LINEAR;
+	    }
+	}
+	else
+	{
+	    glTexParameteri (texture->target, GL_TEXTURE_MIN_FILTER, s->display->textureFilter);
+	    glTexParameteri (texture->target, GL_TEXTURE_MAG_FILTER, s->display->textureFilter);
+
+	    texture->filter = s->display->textureFilter;
+	}
+    }
+
+    if (texture->filter == GL_LINEAR_MIPMAP_LINEAR && texture->oldMipmaps)
+    {
+	(*s->generateMipmap) (texture->target);
+	texture->oldMipmaps = FALSE;
+    }
+}
+
+void
+disableTexture (CompScreen *s, CompTexture *texture)
+{
+    glBindTexture (texture->target, 0);
+    glDisable (texture->target);
+}
+
+/* Window geometry, one quad of the whole window */
+
+Bool
+moreWindowVertices (CompWindow *w, int newSize)
+{
+    if (newSize > w->vertexSize)
+    {
+	GLfloat *vertices = (GLfloat *) realloc (w->vertices, sizeof (GLfloat) * newSize);
+
+	if (!vertices)
+	    return FALSE;
+
+	w->vertices = vertices;
+	w->vertexSize = newSize;
+    }
+
+    return TRUE;
+}
+
+Bool
+moreWindowIndices (CompWindow *w, int newSize)
+{
+    if (newSize > w->indexSize)
+    {
+	GLushort *indices = (GLushort *) realloc (w->indices, sizeof (GLushort) * newSize);
+
+	if (!indices)
+	    return FALSE;
+
+	w->indices = indices;
+	w->indexSize = newSize;
+    }
+
+    return TRUE;
+}
+
+static void
+addWindowGeometry (CompWindow *w, CompMatrix *matrix, int nMatrix, Region region, Region clip)
+{
+    int     x1 = w->attrib.x, y1 = w->attrib.y;
+    int     x2 = x1 + w->width, y2 = y1 + w->height;
+    // upper left, lower left, lower right, upper right as core
+    int     corners[4][2] = { { x1, y1 }, { x1, y2 }, { x2, y2 }, { x2, y1 } };
+    GLfloat *d;
+
+    w->texUnits = nMatrix;
+    w->texCoordSize = 2;
+    w->vertexStride = 3 + nMatrix * 2;
+
+    if (!moreWindowVertices (w, (w->vCount + 4) * w->vertexStride))
+	return;
+
+    d = w->vertices + w->vCount * w->vertexStride;
+
+    for (int i = 0; i < 4; i++)
+    {
+	for (int unit = 0; unit < nMatrix; unit++)
+	{
+	    *d++ = matrix[unit].xx * corners[i][0] + matrix[unit].xy * corners[i][1] + matrix[unit].x0;
+	    *d++ = matrix[unit].yx * corners[i][0] + matrix[unit].yy * corners[i][1] + matrix[unit].y0;
+	}
+
+	*d++ = corners[i][0];
+	*d++ = corners[i][1];
+	*d++ = 0.0f;
+    }
+
+    w->vCount += 4;
+}
+
+void
+drawWindowGeometry (CompWindow *w)
+{
+    int     stride = w->vertexStride * sizeof (GLfloat);
+    GLfloat *vertices = w->vertices + w->vertexStride - 3;
+
+    glVertexPointer (3, GL_FLOAT, stride, vertices);
+
+    vertices -= w->texCoordSize;
+    glTexCoordPointer (w->texCoordSize, GL_FLOAT, stride, vertices);
+
+    glDrawArrays (GL_QUADS, 0, w->vCount);
+}
+
+/* Paint functions at the bottom of the wrap chains */
+
+static void
+drawWithColor (CompWindow *w, const FragmentAttrib *attrib, unsigned int mask, bool program)
+{
+    if (mask & PAINT_WINDOW_BLEND_MASK)
+    {
+	glEnable (GL_BLEND);
+
+	if (attrib->opacity != OPAQUE || attrib->brightness != BRIGHT)
+	{
+	    GLushort color = (attrib->opacity * attrib->brightness) >> 16;
+
+	    if (!program)
+		glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	    glColor4us (color, color, color, attrib->opacity);
+
+	    (*w->drawWindowGeometry) (w);
+
+	    glColor4usv (defaultColor);
+	    if (!program)
+		glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	}
+	else
+	{
+	    (*w->drawWindowGeometry) (w);
+	}
+
+	glDisable (GL_BLEND);
+    }
+    else if (attrib->brightness != BRIGHT)
+    {
+	if (!program)
+	    glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glColor4us (attrib->brightness, attrib->brightness, attrib->brightness, BRIGHT);
+
+	(*w->drawWindowGeometry) (w);
+
+	glColor4usv (defaultColor);
+	if (!program)
+	    glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    }
+    else
+    {
+	(*w->drawWindowGeometry) (w);
+    }
+}
+
+void
+drawWindowTexture (CompWindow *w, CompTexture *texture, const FragmentAttrib *attrib, unsigned int mask)
+{
+    CompScreen        *s = w->screen;
+    MockScreen        *ms = (MockScreen *) s;
+    CompTextureFilter filter;
+    GLuint            program = 0;
+
+    coreCalls.drawWindowTexture++;
+
+    if (mask & (PAINT_WINDOW_TRANSFORMED_MASK | PAINT_WINDOW_ON_TRANSFORMED_SCREEN_MASK))
+	filter = (CompTextureFilter) s->filter[SCREEN_TRANS_FILTER];
+    else
+	filter = (CompTextureFilter) s->filter[NOTHING_TRANS_FILTER];
+
+    if (attrib->nFunction && s->fragmentProgram)
+	program = getFragmentProgram (s, attrib, texture->target);
+
+    if (program)
+    {
+	glEnable (GL_FRAGMENT_PROGRAM_ARB);
+	(*ms->bindProgram) (GL_FRAGMENT_PROGRAM_ARB, program);
+    }
+
+    enableTexture (s, texture, filter);
+    drawWithColor (w, attrib, mask, program != 0);
+    disableTexture (s, texture);
+
+    if (program)
+	glDisable (GL_FRAGMENT_PROGRAM_ARB);
+}
+
+static Bool
+drawWindow (CompWindow           *w,
+	    const CompTransform  *transform,
+	    const FragmentAttrib *fragment,
+	    Region               region,
+	    unsigned int         mask)
+{
+    coreCalls.drawWindow++;
+
+    if (w->attrib.map_state != IsViewable)
+	return TRUE;
+
+    if (mask & PAINT_WINDOW_TRANSLUCENT_MASK)
+	mask |= PAINT_WINDOW_BLEND_MASK;
+
+    w->vCount = w->indexCount = 0;
+    (*w->screen->addWindowGeometry) (w, &w->matrix, 1, w->region, region);
+    if (w->vCount)
+	(*w->screen->drawWindowTexture) (w, w->texture, fragment, mask);
+
+    return TRUE;
+}
+
+static Bool
+paintWindow (CompWindow              *w,
+	     const WindowPaintAttrib *attrib,
+	     const CompTransform     *transform,
+	     Region                  region,
+	     unsigned int            mask)
+{
+    FragmentAttrib fragment;
+    Bool           status;
+
+    coreCalls.paintWindow++;
+
+    if (attrib->opacity != OPAQUE)
+	mask |= PAINT_WINDOW_TRANSLUCENT_MASK;
+
+    if (mask & PAINT_WINDOW_OCCLUSION_DETECTION_MASK)
+    {
+	if (mask & (PAINT_WINDOW_TRANSFORMED_MASK | PAINT_WINDOW_NO_CORE_INSTANCE_MASK |
+		    PAINT_WINDOW_TRANSLUCENT_MASK))
+	    return FALSE;
+
+	return !w->shaded;
+    }
+
+    initFragmentAttrib (&fragment, attrib);
+
+    if (mask & PAINT_WINDOW_TRANSFORMED_MASK)
+    {
+	glPushMatrix ();
+	glLoadMatrixf (transform->m);
+    }
+
+    status = (*w->screen->drawWindow) (w, transform, &fragment, region, mask);
+
+    if (mask & PAINT_WINDOW_TRANSFORMED_MASK)
+	glPopMatrix ();
+
+    return status;
+}
+
+static bool
+isPainted (CompWindow *w)
+{
+    return !w->destroyed && (w->shaded || w->attrib.map_state == IsViewable);
+}
+
+/* Occlusion detection top to bottom, then the windows bottom to top.
+ * Clip regions are not tracked, occluded windows are painted too. */
+static void
+paintOutputRegion (CompScreen          *s,
+		   const CompTransform *transform,
+		   Region              region,
+		   CompOutput          *output,
+		   unsigned int        mask)
+{
+    unsigned int windowMask = 0;
+
+    if (mask & PAINT_SCREEN_TRANSFORMED_MASK)
+	windowMask = PAINT_WINDOW_ON_TRANSFORMED_SCREEN_MASK;
+
+    if (!(mask & PAINT_SCREEN_NO_OCCLUSION_DETECTION_MASK))
+	for (CompWindow *w = s->reverseWindows; w; w = w->prev)
+	    if (isPainted (w))
+		(*s->paintWindow) (w, &w->paint, transform, region,
+				   PAINT_WINDOW_OCCLUSION_DETECTION_MASK | windowMask);
+
+    for (CompWindow *w = s->windows; w; w = w->next)
+	if (isPainted (w))
+	    (*s->paintWindow) (w, &w->paint, transform, region, windowMask);
+}
+
+static void
+paintTransformedOutput (CompScreen              *s,
+			const ScreenPaintAttrib *sAttrib,
+			const CompTransform     *transform,
+			Region                  region,
+			CompOutput              *output,
+			unsigned int            mask)
+{
+    CompTransform sTransform = *transform;
+
+    coreCalls.paintTransformedOutput++;
+
+    if (mask & PAINT_SCREEN_CLEAR_MASK)
+	glClear (GL_COLOR_BUFFER_BIT);
+
+    matrixTranslate (&sTransform, sAttrib->xTranslate, sAttrib->yTranslate,
+		     sAttrib->zTranslate + sAttrib->zCamera);
+    matrixRotate (&sTransform, sAttrib->xRotate, 0.0f, 1.0f, 0.0f);
+    matrixRotate (&sTransform, sAttrib->vRotate,
+		  cosf (sAttrib->xRotate * M_PI / 180.0f), 0.0f,
+		  sinf (sAttrib->xRotate * M_PI / 180.0f));
+    matrixRotate (&sTransform, sAttrib->yRotate, 0.0f, 1.0f, 0.0f);
+
+    transformToScreenSpace (s, output, -sAttrib->zTranslate, &sTransform);
+
+    glPushMatrix ();
+    glLoadMatrixf (sTransform.m);
+
+    paintOutputRegion (s, &sTransform, region, output, mask);
+
+    glPopMatrix ();
+}
+
+static Bool
+paintOutput (CompScreen              *s,
+	     const ScreenPaintAttrib *sAttrib,
+	     const CompTransform     *transform,
+	     Region                  region,
+	     CompOutput              *output,
+	     unsigned int            mask)
+{
+    CompTransform sTransform = *transform;
+
+    coreCalls.paintOutput++;
+
+    if (mask & PAINT_SCREEN_REGION_MASK)
+    {
+	if (mask & PAINT_SCREEN_TRANSFORMED_MASK)
+	{
+	    if (mask & PAINT_SCREEN_FULL_MASK)
+	    {
+		(*s->paintTransformedOutput) (s, sAttrib, transform, &output->region, output, mask);
+		return TRUE;
+	    }
+
+	    return FALSE;
+	}
+    }
+    else if (mask & PAINT_SCREEN_FULL_MASK)
+    {
+	(*s->paintTransformedOutput) (s, sAttrib, transform, &output->region, output, mask);
+	return TRUE;
+    }
+    else
+    {
+	return FALSE;
+    }
+
+    glClear (GL_COLOR_BUFFER_BIT);
+
+    transformToScreenSpace (s, output, -DEFAULT_Z_CAMERA, &sTransform);
+
+    glPushMatrix ();
+    glLoadMatrixf (sTransform.m);
+
+    paintOutputRegion (s, &sTransform, region, output, mask);
+
+    glPopMatrix ();
+
+    return TRUE;
+}
+
+static void
+preparePaintScreen (CompScreen *s, int ms)
+{
+    coreCalls.preparePaintScreen++;
+}
+
+static void
+donePaintScreen (CompScreen *s)
+{
+    coreCalls.donePaintScreen++;
+}
+
+static void
+windowMoveNotify (CompWindow *w, int dx, int dy, Bool immediate)
+{
+}
+
+static void
+windowResizeNotify (CompWindow *w, int dx, int dy, int dwidth, int dheight)
+{
+}
+
+static void
+windowStateChangeNotify (CompWindow *w, unsigned int lastState)
+{
+}
+
+static Bool
+damageWindowRect (CompWindow *w, Bool initial, BoxPtr rect)
+{
+    return FALSE;
+}
+
+static void
+handleEvent (CompDisplay *d, XEvent *event)
+{
+}
+
+static void
+matchPropertyChanged (CompDisplay *d, CompWindow *w)
+{
+}
+
+void
+mockPaintScreen (CompScreen *s, int ms)
+{
+    CompTransform identity;
+
+    (*s->preparePaintScreen) (s, ms);
+
+    matrixGetIdentity (&identity);
+
+    for (int i = 0; i < s->nOutputDev; i++)
+    {
+	CompOutput *output = &s->outputDev[i];
+
+	s->currentOutputDev = i;
+
+	glViewport (output->region.extents.x1, s->height - output->region.extents.y2,
+		    output->width, output->height);
+
+	// the plugin damages the whole screen every frame
+	(*s->paintOutput) (s, &defaultScreenPaintAttrib, &identity, &output->region,
+			   output, PAINT_SCREEN_FULL_MASK);
+    }
+
+    (*s->donePaintScreen) (s);
+}
+
+void
+mockTakeCoreCalls (MockCoreCalls *calls)
+{
+    *calls = coreCalls;
+    memset (&coreCalls, 0, sizeof (coreCalls));
+}
+
+/* Objects */
+
+static bool
+initPluginObject (CompObject *object)
+{
+    return !pluginAttached || (*plugin.vTable->initObject) (&plugin, object);
+}
+
+static void
+finiPluginObject (CompObject *object)
+{
+    if (pluginAttached)
+	(*plugin.vTable->finiObject) (&plugin, object);
+}
+
+static CompDisplay *
+initDisplay (GLXGetProcAddressProc getProcAddress, bool withPlugin)
+{
+    CompDisplay *d;
+
+    logVerbose = getenv ("STEREO3D_TEST_VERBOSE") != NULL;
+    pluginAttached = withPlugin;
+
+    // core's own privates come first, as if mousepoll was loaded
+    if (!pluginLoaded)
+	mousepollIndex = allocateDisplayPrivateIndex ();
+
+    if (withPlugin && !pluginLoaded)
+    {
+	plugin.vTable = getCompPluginInfo ();
+	if (!(*plugin.vTable->init) (&plugin))
+	    return NULL;
+
+	pluginLoaded = true;
+    }
+
+    stereo3dResetOptions ();
+    getProc = getProcAddress;
+
+    d = (CompDisplay *) calloc (1, sizeof (CompDisplay));
+    initObject (&d->base, COMP_OBJECT_TYPE_DISPLAY, NULL);
+
+    // never dereferenced, see xstub.cpp
+    d->display = (Display *) d;
+    d->textureFilter = GL_LINEAR;
+    d->handleEvent = handleEvent;
+    d->matchPropertyChanged = matchPropertyChanged;
+    d->base.privates[mousepollIndex].ptr = &mousePollFunc;
+
+    if (!initPluginObject (&d->base))
+    {
+	free (d->base.privates);
+	free (d);
+	return NULL;
+    }
+
+    return d;
+}
+
+CompDisplay *
+mockInitDisplay (GLXGetProcAddressProc getProcAddress)
+{
+    return initDisplay (getProcAddress, true);
+}
+
+CompDisplay *
+mockInitBareDisplay (GLXGetProcAddressProc getProcAddress)
+{
+    return initDisplay (getProcAddress, false);
+}
+
+void
+mockFiniDisplay (CompDisplay *d)
+{
+    while (d->screens)
+    {
+	CompScreen *s = d->screens;
+
+	while (s->windows)
+	    mockRemoveWindow (s->windows);
+
+	finiPluginObject (&s->base);
+
+	for (int i = 0; i < nPrograms; i++)
+	    (*((MockScreen *) s)->deletePrograms) (1, &programs[i].program);
+	nPrograms = 0;
+
+	d->screens = s->next;
+	free (s->base.privates);
+	free (s);
+    }
+
+    if (pluginAttached)
+    {
+	(*plugin.vTable->finiObject) (&plugin, &d->base);
+	(*plugin.vTable->fini) (&plugin);
+    }
+
+    for (int id = 0; id < MAX_FUNCTIONS; id++)
+    {
+	if (functions[id])
+	    destroyFunctionData (functions[id]);
+	functions[id] = NULL;
+    }
+
+    memset (nPrivates, 0, sizeof (nPrivates));
+    memset (pollers, 0, sizeof (pollers));
+    pluginLoaded = false;
+    failFunctions = false;
+
+    free (d->base.privates);
+    free (d);
+}
+
+static bool
+hasExtension (const char *name)
+{
+    const char *extensions = (const char *) glGetString (GL_EXTENSIONS);
+
+    return extensions && strstr (extensions, name);
+}
+
+#define LOAD(type, name) ((type) (*getProc) ((const GLubyte *) name))
+
+CompScreen *
+mockAddScreen (CompDisplay *d, int width, int height)
+{
+    MockScreen *ms = (MockScreen *) calloc (1, sizeof (MockScreen));
+    CompScreen *s = &ms->screen;
+    CompScreen **tail;
+
+    initObject (&s->base, COMP_OBJECT_TYPE_SCREEN, &d->base);
+
+    s->display = d;
+    s->screenNum = 0;
+    for (CompScreen *other = d->screens; other; other = other->next)
+	s->screenNum++;
+    s->root = 0x100 + s->screenNum;
+    s->width = width;
+    s->height = height;
+    s->hsize = s->vsize = 1;
+
+    ms->output.name = (char *) "mock";
+    ms->output.id = 0;
+    ms->output.region.extents.x2 = width;
+    ms->output.region.extents.y2 = height;
+    ms->output.region.numRects = 1;
+    ms->output.region.rects = &ms->output.region.extents;
+    ms->output.width = width;
+    ms->output.height = height;
+    ms->output.workArea.width = width;
+    ms->output.workArea.height = height;
+    s->outputDev = &ms->output;
+    s->nOutputDev = 1;
+    s->fullscreenOutput = ms->output;
+
+    s->getProcAddress = getProc;
+
+    ms->genPrograms = LOAD (void (*) (GLsizei, GLuint *), "glGenProgramsARB");
+    ms->deletePrograms = LOAD (void (*) (GLsizei, const GLuint *), "glDeleteProgramsARB");
+    ms->bindProgram = LOAD (void (*) (GLenum, GLuint), "glBindProgramARB");
+    ms->programString = LOAD (void (*) (GLenum, GLenum, GLsizei, const GLvoid *), "glProgramStringARB");
+    s->programEnvParameter4f = LOAD (GLProgramParameter4fProc, "glProgramEnvParameter4fARB");
+    s->fragmentProgram = hasExtension ("GL_ARB_fragment_program") &&
+			 ms->genPrograms && ms->deletePrograms && ms->bindProgram &&
+			 ms->programString && s->programEnvParameter4f;
+
+    s->genFramebuffers = LOAD (GLGenFramebuffersProc, "glGenFramebuffersEXT");
+    s->deleteFramebuffers = LOAD (GLDeleteFramebuffersProc, "glDeleteFramebuffersEXT");
+    s->bindFramebuffer = LOAD (GLBindFramebufferProc, "glBindFramebufferEXT");
+    s->checkFramebufferStatus = LOAD (GLCheckFramebufferStatusProc, "glCheckFramebufferStatusEXT");
+    s->framebufferTexture2D = LOAD (GLFramebufferTexture2DProc, "glFramebufferTexture2DEXT");
+    s->generateMipmap = LOAD (GLGenerateMipmapProc, "glGenerateMipmapEXT");
+    s->fbo = hasExtension ("GL_EXT_framebuffer_object") &&
+	     s->genFramebuffers && s->deleteFramebuffers && s->bindFramebuffer &&
+	     s->checkFramebufferStatus && s->framebufferTexture2D && s->generateMipmap;
+
+    s->activeTexture = LOAD (GLActiveTextureProc, "glActiveTexture");
+    s->textureNonPowerOfTwo = hasExtension ("GL_ARB_texture_non_power_of_two");
+    s->maxTextureUnits = 1;
+
+    s->filter[NOTHING_TRANS_FILTER] = COMP_TEXTURE_FILTER_FAST;
+    s->filter[SCREEN_TRANS_FILTER] = COMP_TEXTURE_FILTER_GOOD;
+    s->filter[WINDOW_TRANS_FILTER] = COMP_TEXTURE_FILTER_GOOD;
+
+    s->preparePaintScreen = preparePaintScreen;
+    s->donePaintScreen = donePaintScreen;
+    s->paintOutput = paintOutput;
+    s->paintTransformedOutput = paintTransformedOutput;
+    s->paintWindow = paintWindow;
+    s->drawWindow = drawWindow;
+    s->addWindowGeometry = addWindowGeometry;
+    s->drawWindowTexture = drawWindowTexture;
+    s->damageWindowRect = damageWindowRect;
+    s->windowMoveNotify = windowMoveNotify;
+    s->windowResizeNotify = windowResizeNotify;
+    s->windowStateChangeNotify = windowStateChangeNotify;
+
+    // the GL state core leaves behind between frames
+    perspective (s->projection, 60.0f, 1.0f, 0.1f, 100.0f);
+    glMatrixMode (GL_PROJECTION);
+    glLoadMatrixf (s->projection);
+    glMatrixMode (GL_MODELVIEW);
+    glLoadIdentity ();
+
+    glClearColor (0.0f, 0.0f, 0.0f, 1.0f);
+    glBlendFunc (GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable (GL_CULL_FACE);
+    glDisable (GL_BLEND);
+    glDisable (GL_DEPTH_TEST);
+    glColor4usv (defaultColor);
+    glTexEnvi (GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glEnableClientState (GL_VERTEX_ARRAY);
+    glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+
+    for (tail = &d->screens; *tail; tail = &(*tail)->next);
+    *tail = s;
+
+    if (!initPluginObject (&s->base))
+    {
+	*tail = NULL;
+	free (s->base.privates);
+	free (ms);
+	return NULL;
+    }
+
+    return s;
+}
+
+#undef LOAD
+
+static void
+sendEvent (CompDisplay *d, XEvent *event)
+{
+    (*d->handleEvent) (d, event);
+}
+
+void
+mockRawMotion (CompScreen *s, int x, int y, Time time)
+{
+    XEvent event;
+
+    xstubSetPointer (x, y);
+    xstubSetRawEventTime (time);
+
+    memset (&event, 0, sizeof (event));
+    event.xcookie.type = GenericEvent;
+    event.xcookie.extension = XSTUB_XI_OPCODE;
+    event.xcookie.evtype = XI_RawMotion;
+    event.xcookie.cookie = 1;
+
+    sendEvent (s->display, &event);
+}
+
+static void
+sendStructureEvent (CompWindow *w, int type)
+{
+    XEvent event;
+
+    memset (&event, 0, sizeof (event));
+    event.type = type;
+
+    // selected on the root, so that is the event window
+    switch (type) {
+    case MapNotify:
+	event.xmap.event = w->screen->root;
+	event.xmap.window = w->id;
+	break;
+    case UnmapNotify:
+	event.xunmap.event = w->screen->root;
+	event.xunmap.window = w->id;
+	break;
+    case DestroyNotify:
+	event.xdestroywindow.event = w->screen->root;
+	event.xdestroywindow.window = w->id;
+	break;
+    case ConfigureNotify:
+	event.xconfigure.event = w->screen->root;
+	event.xconfigure.window = w->id;
+	event.xconfigure.x = w->attrib.x;
+	event.xconfigure.y = w->attrib.y;
+	event.xconfigure.width = w->width;
+	event.xconfigure.height = w->height;
+	event.xconfigure.above = w->prev ? w->prev->id : None;
+	break;
+    }
+
+    sendEvent (w->screen->display, &event);
+}
+
+static void
+updateWindowMatrix (CompWindow *w)
+{
+    w->matrix = w->texture->matrix;
+    w->matrix.x0 -= w->attrib.x * w->matrix.xx;
+    w->matrix.y0 -= w->attrib.y * w->matrix.yy;
+}
+
+static void
+linkWindowOnTop (CompWindow *w)
+{
+    CompScreen *s = w->screen;
+
+    w->prev = s->reverseWindows;
+    w->next = NULL;
+
+    if (s->reverseWindows)
+	s->reverseWindows->next = w;
+    else
+	s->windows = w;
+
+    s->reverseWindows = w;
+}
+
+static void
+unlinkWindow (CompWindow *w)
+{
+    CompScreen *s = w->screen;
+
+    if (w->prev)
+	w->prev->next = w->next;
+    else
+	s->windows = w->next;
+
+    if (w->next)
+	w->next->prev = w->prev;
+    else
+	s->reverseWindows = w->prev;
+
+    w->next = w->prev = NULL;
+}
+
+CompWindow *
+mockAddWindow (CompScreen   *s,
+	       int          x,
+	       int          y,
+	       int          width,
+	       int          height,
+	       unsigned int type,
+	       bool         mapped)
+{
+    MockWindow *mw = (MockWindow *) calloc (1, sizeof (MockWindow));
+    CompWindow *w = &mw->window;
+
+    initObject (&w->base, COMP_OBJECT_TYPE_WINDOW, &s->base);
+
+    w->screen = s;
+    w->id = ++lastId;
+    w->attrib.x = w->serverX = x;
+    w->attrib.y = w->serverY = y;
+    w->attrib.width = w->width = width;
+    w->attrib.height = w->height = height;
+    w->attrib.map_state = IsUnmapped;
+    w->type = w->wmType = type;
+    w->alive = TRUE;
+    w->damaged = TRUE;
+
+    mw->region.extents.x1 = x;
+    mw->region.extents.y1 = y;
+    mw->region.extents.x2 = x + width;
+    mw->region.extents.y2 = y + height;
+    mw->region.numRects = 1;
+    mw->region.rects = &mw->region.extents;
+    w->region = &mw->region;
+
+    initTexture (s, &mw->texture);
+    glGenTextures (1, &mw->texture.name);
+    mw->texture.matrix.xx = 1.0f / width;
+    mw->texture.matrix.yy = 1.0f / height;
+    mw->texture.mipmap = TRUE;
+    w->texture = &mw->texture;
+    updateWindowMatrix (w);
+
+    w->paint.opacity = OPAQUE;
+    w->paint.brightness = BRIGHT;
+    w->paint.saturation = COLOR;
+    w->paint.xScale = w->paint.yScale = 1.0f;
+    w->drawWindowGeometry = drawWindowGeometry;
+
+    linkWindowOnTop (w);
+
+    if (!initPluginObject (&w->base))
+    {
+	unlinkWindow (w);
+	free (w->base.privates);
+	free (mw);
+	return NULL;
+    }
+
+    if (mapped)
+	mockMapWindow (w, true);
+
+    return w;
+}
+
+void
+mockRemoveWindow (CompWindow *w)
+{
+    CompScreen *s = w->screen;
+    XEvent     event;
+
+    if (w->attrib.map_state == IsViewable)
+	mockMapWindow (w, false);
+
+    finiPluginObject (&w->base);
+    unlinkWindow (w);
+
+    if (lastFoundWindow == w)
+	lastFoundWindow = NULL;
+
+    memset (&event, 0, sizeof (event));
+    event.type = DestroyNotify;
+    event.xdestroywindow.event = s->root;
+    event.xdestroywindow.window = w->id;
+    sendEvent (s->display, &event);
+
+    finiTexture (s, w->texture);
+    free (w->vertices);
+    free (w->indices);
+    free (w->base.privates);
+    free ((MockWindow *) w);
+}
+
+void
+mockMapWindow (CompWindow *w, bool mapped)
+{
+    CompScreen *s = w->screen;
+
+    w->attrib.map_state = mapped ? IsViewable : IsUnmapped;
+    if (mapped)
+	w->mapNum = ++s->mapNum;
+
+    sendStructureEvent (w, mapped ? MapNotify : UnmapNotify);
+}
+
+void
+mockRaiseWindow (CompWindow *w)
+{
+    unlinkWindow (w);
+    linkWindowOnTop (w);
+
+    sendStructureEvent (w, ConfigureNotify);
+}
+
+void
+mockMoveWindow (CompWindow *w, int x, int y)
+{
+    MockWindow *mw = (MockWindow *) w;
+    int        dx = x - w->attrib.x, dy = y - w->attrib.y;
+
+    w->attrib.x = w->serverX = x;
+    w->attrib.y = w->serverY = y;
+
+    mw->region.extents.x1 += dx;
+    mw->region.extents.y1 += dy;
+    mw->region.extents.x2 += dx;
+    mw->region.extents.y2 += dy;
+    updateWindowMatrix (w);
+
+    (*w->screen->windowMoveNotify) (w, dx, dy, TRUE);
+
+    sendStructureEvent (w, ConfigureNotify);
+}
+
+void
+mockActivateWindow (CompWindow *w)
+{
+    w->screen->display->activeWindow = w->id;
+    w->activeNum = ++lastActiveNum;
+}
+
+void
+mockSetWindowImage (CompWindow *w, GLenum target, const unsigned char *rgba)
+{
+    CompTexture *texture = w->texture;
+
+    if (texture->target != target)
+    {
+	glDeleteTextures (1, &texture->name);
+	glGenTextures (1, &texture->name);
+	texture->target = target;
+	texture->filter = GL_NEAREST;
+    }
+
+    glBindTexture (target, texture->name);
+    glTexParameteri (target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri (target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri (target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D (target, 0, GL_RGBA, w->width, w->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    glBindTexture (target, 0);
+
+    texture->filter = GL_NEAREST;
+    texture->oldMipmaps = TRUE;
+    texture->mipmap = target == GL_TEXTURE_2D;
+
+    // normalized coordinates for 2D textures, texels for rectangles
+    texture->matrix.xx = target == GL_TEXTURE_2D ? 1.0f / w->width : 1.0f;
+    texture->matrix.yy = target == GL_TEXTURE_2D ? 1.0f / w->height : 1.0f;
+    texture->matrix.x0 = texture->matrix.y0 = 0.0f;
+    updateWindowMatrix (w);
+}
+
+/* Options and actions */
+
+bool
+mockSetOption (CompDisplay *d, const char *name, const char *value)
+{
+    return stereo3dSetOptionValue (d, name, value);
+}
+
+bool
+mockSetBoolOption (CompDisplay *d, const char *name, bool value)
+{
+    return mockSetOption (d, name, value ? "true" : "false");
+}
+
+bool
+mockSetIntOption (CompDisplay *d, const char *name, int value)
+{
+    char text[16];
+
+    snprintf (text, sizeof (text), "%d", value);
+
+    return mockSetOption (d, name, text);
+}
+
+bool
+mockInitiateAction (CompDisplay *d, const char *name, CompScreen *s)
+{
+    CompActionCallBackProc initiate = stereo3dGetOptionInitiate (name);
+    CompOption             option;
+
+    if (!initiate)
+	return false;
+
+    option.name = "root";
+    option.value = s->root;
+
+    return (*initiate) (d, NULL, 0, &option, 1);
+}
@@ -0,0 +1,124 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Headless compiz core the plugin is loaded into by the tests, see
+ * mockcore.cpp. It paints like core does: every output through
+ * paintOutput, each viewable window through paintWindow, drawWindow
+ * and drawWindowTexture, with the window's fragment functions compiled
+ * into an ARB program. GL comes from the test, either the recording
+ * shim of glshim.cpp or a real context. */
+
+#ifndef MOCKCORE_H
+#define MOCKCORE_H
+
+#include <compiz-core.h>
+
+/* Loads the plugin onto a new display. getProcAddress resolves the
+ * extension entry points of every screen added to it. */
+CompDisplay *mockInitDisplay (GLXGetProcAddressProc getProcAddress);
+/* A display, its screens and windows without the plugin, core alone */
+CompDisplay *mockInitBareDisplay (GLXGetProcAddressProc getProcAddress);
+void mockFiniDisplay (CompDisplay *d);
+
+/* A screen with one output covering it. GL has to be current, the
+ * client state and projection core sets up are set here. */
+CompScreen *mockAddScreen (CompDisplay *d, int width, int height);
+
+/* A window of a CompWindowType*Mask at the top of the stack, mapped or
+ * not. Its texture is a 2D texture without storage. */
+CompWindow *mockAddWindow (CompScreen   *s,
+			   int          x,
+			   int          y,
+			   int          width,
+			   int          height,
+			   unsigned int type,
+			   bool         mapped);
+void mockRemoveWindow (CompWindow *w);
+
+/* Window changes, each sent to the plugin as the event core handles */
+void mockMapWindow (CompWindow *w, bool mapped);
+void mockRaiseWindow (CompWindow *w);
+void mockMoveWindow (CompWindow *w, int x, int y);
+void mockActivateWindow (CompWindow *w);
+
+/* Gives the window texture storage of its size, rgba has its rows top
+ * first. target is GL_TEXTURE_2D or GL_TEXTURE_RECTANGLE_ARB. */
+void mockSetWindowImage (CompWindow          *w,
+			 GLenum              target,
+			 const unsigned char *rgba);
+
+/* One frame of every output, ms since the last one */
+void mockPaintScreen (CompScreen *s, int ms);
+
+/* Calls that reached core's own paint hooks, at the bottom of the wrap
+ * chain */
+typedef struct _MockCoreCalls
+{
+    unsigned int preparePaintScreen;
+    unsigned int paintOutput;
+    unsigned int paintTransformedOutput;
+    unsigned int donePaintScreen;
+    unsigned int paintWindow;
+    unsigned int drawWindow;
+    unsigned int drawWindowTexture;
+} MockCoreCalls;
+
+/* The calls since the last time they were taken */
+void mockTakeCoreCalls (MockCoreCalls *calls);
+
+/* Moves the pointer XQueryPointer reports and runs the mousepoll
+ * callbacks with it */
+void mockMovePointer (CompScreen *s, int x, int y);
+
+/* Moves the pointer XQueryPointer reports and sends an XInput2 raw
+ * motion event of server time time */
+void mockRawMotion (CompScreen *s, int x, int y, Time time);
+
+/* Fragment functions fail to compile from now on, like on a driver
+ * rejecting ARB programs */
+void mockFailFragmentFunctions (bool fail);
+
+/* Fragment programs built and bound since the display was created */
+unsigned int mockGetProgramBuilds (void);
+
+/* Messages logged through compLogMessage since the last clear, the
+ * ones at level or more severe containing text */
+int mockCountLogMessages (CompLogLevel level, const char *text);
+void mockClearLog (void);
+void mockSetLogVerbose (bool verbose);
+
+/* Sets an option of the plugin, calling its notify */
+bool mockSetOption (CompDisplay *d, const char *name, const char *value);
+bool mockSetBoolOption (CompDisplay *d, const char *name, bool value);
+bool mockSetIntOption (CompDisplay *d, const char *name, int value);
+
+/* Runs the initiate callback of a key or button option on s */
+bool mockInitiateAction (CompDisplay *d, const char *name, CompScreen *s);
+
+/* Options, see genoptions.py */
+void stereo3dResetOptions (void);
+bool stereo3dSetOptionValue (CompDisplay *d, const char *name, const char *value);
+CompActionCallBackProc stereo3dGetOptionInitiate (const char *name);
+
+/* X server state of xstub.cpp */
+// the major opcode of XInputExtension
+#define XSTUB_XI_OPCODE 131
+
+void xstubSetPointer (int x, int y);
+void xstubSetXInput2 (bool available);
+void xstubSetRawEventTime (Time time);
+void xstubSetCursorImage (int width, int height);
+// synchronous XQueryPointer round trips so far
+unsigned int xstubGetPointerQueries (void);
+
+#endif
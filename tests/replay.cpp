@@ -0,0 +1,347 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Replays a recording of record_file at full speed, through the layout
+ * and the projection setup of the plugin and outside the compositor:
+ *
+ *   replay [--strategy n] [--fps n] recording
+ *
+ * The layout strategy and the target frame rate the recorded frame
+ * times are held against are those of the layout_strategy and
+ * target_fps options, the defaults unless given. Prints the replay
+ * timings and the frames that were slow when recorded. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stereo3d.h"
+#include "mockcore.h"
+#include "glshim.h"
+
+/* Open addressing map from recorded window ids to replay state */
+typedef struct _ReplayWindows
+{
+    uint32_t       *ids;
+    Stereo3DWindow *windows;
+    unsigned int   mask;
+} ReplayWindows;
+
+static Stereo3DWindow *
+lookupReplayWindow (ReplayWindows *rw, uint32_t id)
+{
+    unsigned int i = (id * 2654435761u) & rw->mask;
+
+    while (rw->ids[i] && rw->ids[i] != id)
+	i = (i + 1) & rw->mask;
+
+    if (!rw->ids[i])
+    {
+	Stereo3DWindow *sow = &rw->windows[i];
+
+	rw->ids[i] = id;
+	sow->currAttrs.scale = 1.0f;
+	sow->dstAttrs.scale = 1.0f;
+    }
+
+    return &rw->windows[i];
+}
+
+/* Window at slot of the recorded window list, background windows first,
+ * then docks and floating windows, NULL for none */
+static Stereo3DWindow *
+getReplaySlot (int            slot,
+	       Stereo3DWindow **background,
+	       int            nBackground,
+	       Stereo3DWindow **dock,
+	       int            nDock,
+	       Stereo3DWindow **floating,
+	       int            nFloating)
+{
+    if (slot < 0)
+	return NULL;
+    if (slot < nBackground)
+	return background[slot];
+    if ((slot -= nBackground) < nDock)
+	return dock[slot];
+    if ((slot -= nDock) < nFloating)
+	return floating[slot];
+
+    return NULL;
+}
+
+/* Walks the recording once without replaying it, returns the number of
+ * frames or -1 if it is truncated */
+static int
+scanRecording (const char *data, size_t size, int *nWindowRecords, int *maxWindows)
+{
+    size_t offset = sizeof (RecordHeader);
+    int    nFrames = 0;
+
+    *nWindowRecords = 0;
+    *maxWindows = 0;
+
+    while (offset < size)
+    {
+	const RecordFrame *frame = (const RecordFrame *) (data + offset);
+
+	if (offset + sizeof (RecordFrame) > size)
+	    return -1;
+	offset += sizeof (RecordFrame);
+
+	if (frame->flags & RECORD_FRAME_WINDOWS)
+	{
+	    if (offset + frame->nWindows * sizeof (RecordWindow) > size)
+		return -1;
+	    offset += frame->nWindows * sizeof (RecordWindow);
+
+	    *nWindowRecords += frame->nWindows;
+	    if (frame->nWindows > *maxWindows)
+		*maxWindows = frame->nWindows;
+	}
+
+	nFrames++;
+    }
+
+    return nFrames;
+}
+
+/* Drives setupProjections and layoutWindows with every recorded frame as
+ * fast as possible. Frames that took longer than the target frame rate
+ * allows when they were recorded are reported as stutter. */
+static bool
+replayRecording (CompDisplay *d, const char *path)
+{
+    struct stat    st;
+    struct timeval start, before, after;
+    const char     *data;
+    int            fd, nFrames, nWindowRecords, maxWindows;
+    unsigned int   capacity;
+    size_t         offset;
+    ReplayWindows  rw;
+    AnimationManager animationMgr;
+    LayoutGroupTable groups;
+    Stereo3DScreen *scratch;
+    Stereo3DWindow **background, **dock, **floating;
+    Stereo3DWindow *focusWindow, *pointerWindow;
+    int            nBackground = 0, nDock = 0, nFloating = 0;
+    long           frameUs, maxFrameUs = 0, totalUs;
+    int            slowestFrame = 0, worstRecordedFrame = 0, nStutter = 0;
+    unsigned int   worstRecordedMs = 0;
+    float          budget = 1000.0f / stereo3dGetTargetFps (d);
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0 || fstat (fd, &st) < 0 || (size_t) st.st_size < sizeof (RecordHeader))
+    {
+	fprintf (stderr, "unable to read %s\n", path);
+	if (fd >= 0)
+	    close (fd);
+	return false;
+    }
+
+    data = (const char *) mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (data == MAP_FAILED)
+    {
+	fprintf (stderr, "unable to map %s\n", path);
+	return false;
+    }
+
+    const RecordHeader *header = (const RecordHeader *) data;
+
+    nFrames = -1;
+    if (header->magic == RECORD_MAGIC && header->version == RECORD_VERSION)
+	nFrames = scanRecording (data, st.st_size, &nWindowRecords, &maxWindows);
+
+    if (nFrames < 0)
+    {
+	fprintf (stderr, "%s is not a valid recording\n", path);
+	munmap ((void *) data, st.st_size);
+	return false;
+    }
+
+    for (capacity = 16; capacity < 2 * (unsigned int) nWindowRecords; capacity *= 2);
+
+    rw.mask = capacity - 1;
+    rw.ids = (uint32_t *) calloc (capacity, sizeof (uint32_t));
+    rw.windows = (Stereo3DWindow *) calloc (capacity, sizeof (Stereo3DWindow));
+    background = (Stereo3DWindow **) malloc ((maxWindows + 1) * sizeof (Stereo3DWindow *));
+    dock = (Stereo3DWindow **) malloc ((maxWindows + 1) * sizeof (Stereo3DWindow *));
+    floating = (Stereo3DWindow **) malloc ((maxWindows + 1) * sizeof (Stereo3DWindow *));
+    scratch = (Stereo3DScreen *) calloc (1, sizeof (Stereo3DScreen));
+
+    if (!rw.ids || !rw.windows || !background || !dock || !floating || !scratch)
+    {
+	fprintf (stderr, "unable to allocate replay state\n");
+	free (rw.ids);
+	free (rw.windows);
+	free (background);
+	free (dock);
+	free (floating);
+	free (scratch);
+	munmap ((void *) data, st.st_size);
+	return false;
+    }
+
+    memset (&animationMgr, 0, sizeof (animationMgr));
+    memset (&groups, 0, sizeof (groups));
+    animationMgr.strategy = stereo3dGetLayoutStrategy (d);
+
+    gettimeofday (&start, 0);
+    after = start;
+
+    offset = sizeof (RecordHeader);
+    for (int f = 0; f < nFrames; f++)
+    {
+	const RecordFrame *frame = (const RecordFrame *) (data + offset);
+	offset += sizeof (RecordFrame);
+
+	if (frame->flags & RECORD_FRAME_WINDOWS)
+	{
+	    const RecordWindow *windows = (const RecordWindow *) (data + offset);
+	    offset += frame->nWindows * sizeof (RecordWindow);
+
+	    nBackground = nDock = nFloating = 0;
+
+	    for (int i = 0; i < frame->nWindows; i++)
+	    {
+		Stereo3DWindow *sow = lookupReplayWindow (&rw, windows[i].id);
+
+		// as updateWindowIndex does
+		if (sow->floatingType != (FloatingTypeEnum) windows[i].floatingType)
+		    sow->layoutAssigned = false;
+		sow->floatingType = (FloatingTypeEnum) windows[i].floatingType;
+		sow->layoutGroup = windows[i].group;
+		sow->drawMouse = false;
+
+		if (sow->floatingType == FTBACKGROUND)
+		    background[nBackground++] = sow;
+		else if (sow->floatingType == FTDOCK)
+		    dock[nDock++] = sow;
+		else if (sow->floatingType == FTWINDOW)
+		    floating[nFloating++] = sow;
+	    }
+
+	    assignLayoutGroups (&groups, floating, nFloating);
+
+	    animationMgr.cursorWindow = NULL;
+	    animationMgr.layoutEvents |= LAYOUT_EVENT (LayoutEventRestack);
+	    animationMgr.layoutSettled = false;
+	}
+
+	animationMgr.mouseDst.x = frame->pointerX;
+	animationMgr.mouseDst.y = frame->pointerY;
+	animationMgr.foregroundDstZ = frame->foregroundDstZ;
+
+	focusWindow = getReplaySlot (frame->focusSlot, background, nBackground,
+				     dock, nDock, floating, nFloating);
+	pointerWindow = getReplaySlot (frame->pointerSlot, background, nBackground,
+				       dock, nDock, floating, nFloating);
+
+	// as updateWindowsPosition does
+	if (focusWindow != animationMgr.focusWindow)
+	{
+	    animationMgr.focusWindow = focusWindow;
+	    animationMgr.layoutEvents |= LAYOUT_EVENT (LayoutEventFocus);
+	}
+
+	gettimeofday (&before, 0);
+
+	setupProjections (scratch, frame->outputMode, frame->fov,
+			  frame->strength, header->screenWidth);
+	layoutWindows (&animationMgr, background, nBackground, dock, nDock,
+		       floating, nFloating, pointerWindow, frame->depth,
+		       frame->lightingStrength);
+
+	gettimeofday (&after, 0);
+
+	frameUs = (after.tv_sec - before.tv_sec) * 1000000 +
+		  (after.tv_usec - before.tv_usec);
+	if (frameUs > maxFrameUs)
+	{
+	    maxFrameUs = frameUs;
+	    slowestFrame = f;
+	}
+
+	if (frame->ms > budget)
+	    nStutter++;
+	if (frame->ms > worstRecordedMs)
+	{
+	    worstRecordedMs = frame->ms;
+	    worstRecordedFrame = f;
+	}
+    }
+
+    totalUs = (after.tv_sec - start.tv_sec) * 1000000 +
+	      (after.tv_usec - start.tv_usec);
+
+    printf ("replayed %d frames of %s with the %s layout in %ld us, %.2f us per frame, "
+	    "slowest frame %d took %ld us\n",
+	    nFrames, path, getLayoutStrategyName (animationMgr.strategy), totalUs,
+	    nFrames ? (float) totalUs / nFrames : 0.0f, slowestFrame, maxFrameUs);
+    printf ("%d recorded frames over the %.1f ms budget, worst was frame %d at %u ms\n",
+	    nStutter, budget, worstRecordedFrame, worstRecordedMs);
+
+    free (rw.ids);
+    free (rw.windows);
+    free (background);
+    free (dock);
+    free (floating);
+    free (scratch);
+    freeLayoutGroups (&groups);
+    munmap ((void *) data, st.st_size);
+
+    return true;
+}
+
+static void
+usage (void)
+{
+    fprintf (stderr, "usage: replay [--strategy n] [--fps n] recording\n");
+}
+
+int
+main (int argc, char **argv)
+{
+    CompDisplay *d = mockInitDisplay (glShimGetProcAddress);
+    const char  *path = NULL;
+    bool        ok, bad = false;
+
+    for (int i = 1; i < argc && !bad; i++)
+    {
+	if (i + 1 < argc && !strcmp (argv[i], "--strategy"))
+	    mockSetIntOption (d, "layout_strategy", atoi (argv[++i]));
+	else if (i + 1 < argc && !strcmp (argv[i], "--fps"))
+	    mockSetIntOption (d, "target_fps", atoi (argv[++i]));
+	else if (!path && argv[i][0] != '-')
+	    path = argv[i];
+	else
+	    bad = true;
+    }
+
+    if (bad || !path)
+    {
+	usage ();
+	mockFiniDisplay (d);
+	return 2;
+    }
+
+    ok = replayRecording (d, path);
+
+    mockFiniDisplay (d);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+/* libX11-xcb, implemented by xstub.cpp */
+#ifndef _X11_XLIB_XCB_H_
+#define _X11_XLIB_XCB_H_
+
+#include <X11/Xlib.h>
+#include <xcb/xcb.h>
+
+extern "C" {
+xcb_connection_t *XGetXCBConnection (Display *dpy);
+}
+
+#endif
@@ -0,0 +1,34 @@
+/* The XInput 2 client API used by the plugin, implemented by xstub.cpp */
+#ifndef _XINPUT2_H_
+#define _XINPUT2_H_
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XI2.h>
+
+typedef struct {
+    int           deviceid;
+    int           mask_len;
+    unsigned char *mask;
+} XIEventMask;
+
+// the fields of the raw event the plugin reads
+typedef struct {
+    int           type;
+    unsigned long serial;
+    Bool          send_event;
+    Display       *display;
+    int           extension;
+    int           evtype;
+    Time          time;
+    int           deviceid;
+    int           sourceid;
+    int           detail;
+    int           flags;
+} XIRawEvent;
+
+extern "C" {
+Status XIQueryVersion (Display *dpy, int *major, int *minor);
+int XISelectEvents (Display *dpy, Window win, XIEventMask *masks, int num_masks);
+}
+
+#endif
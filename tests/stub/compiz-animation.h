@@ -0,0 +1 @@
+/* The animation plugin's API is not used */
@@ -0,0 +1,379 @@
+/* The subset of the compiz 0.8 core API used by the plugin, declared
+ * as core declares it. mockcore.cpp implements it for the tests. */
+#ifndef _COMPIZ_CORE_H
+#define _COMPIZ_CORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/Xfixes.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glx.h>
+#include <GL/glext.h>
+
+#define CORE_ABIVERSION 20090619
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+typedef int CompBool;
+typedef int CompTimeoutHandle;
+typedef Bool (*CallBackProc) (void *closure);
+
+typedef struct _CompPlugin  CompPlugin;
+typedef struct _CompDisplay CompDisplay;
+typedef struct _CompScreen  CompScreen;
+typedef struct _CompWindow  CompWindow;
+typedef struct _CompObject  CompObject;
+typedef struct _CompMatch   CompMatch;
+typedef struct _CompFunctionData CompFunctionData;
+
+typedef union _CompPrivate {
+    void	  *ptr;
+    long	  val;
+    unsigned long uval;
+    void	  *(*fptr) (void);
+} CompPrivate;
+
+typedef unsigned int CompObjectType;
+#define COMP_OBJECT_TYPE_CORE    0
+#define COMP_OBJECT_TYPE_DISPLAY 1
+#define COMP_OBJECT_TYPE_SCREEN  2
+#define COMP_OBJECT_TYPE_WINDOW  3
+
+struct _CompObject {
+    CompObjectType type;
+    CompPrivate    *privates;
+    CompObject     *parent;
+};
+
+typedef struct { short x1, x2, y1, y2; } BOX, BoxRec, *BoxPtr;
+typedef struct _XRegion { long size; long numRects; BOX *rects; BOX extents; } REGION;
+
+typedef struct { short x, y; } Point;
+
+typedef union _CompVector {
+    float v[4];
+    struct { float x, y, z, w; };
+} CompVector;
+
+typedef struct _CompTransform { float m[16]; } CompTransform;
+
+typedef struct _CompMatrix { float xx; float yx; float xy; float yy; float x0; float y0; } CompMatrix;
+
+typedef enum { COMP_TEXTURE_FILTER_FAST, COMP_TEXTURE_FILTER_GOOD } CompTextureFilter;
+
+typedef struct _CompTexture {
+    GLuint     name;
+    GLenum     target;
+    GLfloat    dx, dy;
+    void      *pixmap;
+    GLenum     filter;
+    GLenum     wrap;
+    CompMatrix matrix;
+    Bool       oldMipmaps;
+    Bool       mipmap;
+    int        refCount;
+} CompTexture;
+
+#define MAX_FRAGMENT_FUNCTIONS 16
+typedef struct _FragmentAttrib {
+    GLushort opacity;
+    GLushort brightness;
+    GLushort saturation;
+    int	     nTexture;
+    int	     function[MAX_FRAGMENT_FUNCTIONS];
+    int	     nFunction;
+    int	     nParam;
+} FragmentAttrib;
+
+typedef struct _WindowPaintAttrib {
+    GLushort opacity;
+    GLushort brightness;
+    GLushort saturation;
+    GLfloat  xScale;
+    GLfloat  yScale;
+    GLfloat  xTranslate;
+    GLfloat  yTranslate;
+} WindowPaintAttrib;
+
+typedef struct _ScreenPaintAttrib {
+    GLfloat xRotate, yRotate, vRotate, xTranslate, yTranslate, zTranslate, zCamera;
+} ScreenPaintAttrib;
+
+typedef struct _CompOutput {
+    char       *name;
+    int        id;
+    REGION     region;
+    int        width;
+    int        height;
+    XRectangle workArea;
+} CompOutput;
+
+#define COLOR  0xffff
+#define OPAQUE 0xffff
+#define BRIGHT 0xffff
+#define DEFAULT_Z_CAMERA 0.866025404f
+
+#define PAINT_SCREEN_REGION_MASK		   (1 << 0)
+#define PAINT_SCREEN_FULL_MASK			   (1 << 1)
+#define PAINT_SCREEN_TRANSFORMED_MASK		   (1 << 2)
+#define PAINT_SCREEN_WITH_TRANSFORMED_WINDOWS_MASK (1 << 3)
+#define PAINT_SCREEN_CLEAR_MASK			   (1 << 4)
+#define PAINT_SCREEN_NO_OCCLUSION_DETECTION_MASK   (1 << 5)
+
+#define PAINT_WINDOW_ON_TRANSFORMED_SCREEN_MASK (1 << 0)
+#define PAINT_WINDOW_OCCLUSION_DETECTION_MASK	(1 << 1)
+#define PAINT_WINDOW_NO_CORE_INSTANCE_MASK	(1 << 2)
+#define PAINT_WINDOW_TRANSLUCENT_MASK		(1 << 16)
+#define PAINT_WINDOW_TRANSFORMED_MASK		(1 << 17)
+#define PAINT_WINDOW_BLEND_MASK			(1 << 19)
+
+#define COMP_FETCH_TARGET_2D   0
+#define COMP_FETCH_TARGET_RECT 1
+#define COMP_FETCH_TARGET_NUM  2
+
+#define CompWindowStateFullscreenMask (1 << 10)
+
+#define CompWindowTypeDesktopMask      (1 << 0)
+#define CompWindowTypeDockMask         (1 << 1)
+#define CompWindowTypeToolbarMask      (1 << 2)
+#define CompWindowTypeMenuMask         (1 << 3)
+#define CompWindowTypeUtilMask         (1 << 4)
+#define CompWindowTypeSplashMask       (1 << 5)
+#define CompWindowTypeDialogMask       (1 << 6)
+#define CompWindowTypeNormalMask       (1 << 7)
+#define CompWindowTypeDropdownMenuMask (1 << 8)
+#define CompWindowTypePopupMenuMask    (1 << 9)
+#define CompWindowTypeTooltipMask      (1 << 10)
+#define CompWindowTypeNotificationMask (1 << 11)
+#define CompWindowTypeComboMask        (1 << 12)
+#define CompWindowTypeDndMask          (1 << 13)
+#define CompWindowTypeModalDialogMask  (1 << 14)
+#define CompWindowTypeFullscreenMask   (1 << 15)
+#define CompWindowTypeUnknownMask      (1 << 16)
+
+typedef enum { CompLogLevelFatal = 0, CompLogLevelError, CompLogLevelWarn, CompLogLevelInfo, CompLogLevelDebug } CompLogLevel;
+
+typedef void (*PreparePaintScreenProc) (CompScreen *, int);
+typedef void (*DonePaintScreenProc) (CompScreen *);
+typedef Bool (*PaintOutputProc) (CompScreen *, const ScreenPaintAttrib *, const CompTransform *, Region, CompOutput *, unsigned int);
+typedef void (*PaintTransformedOutputProc) (CompScreen *, const ScreenPaintAttrib *, const CompTransform *, Region, CompOutput *, unsigned int);
+typedef Bool (*PaintWindowProc) (CompWindow *, const WindowPaintAttrib *, const CompTransform *, Region, unsigned int);
+typedef Bool (*DrawWindowProc) (CompWindow *, const CompTransform *, const FragmentAttrib *, Region, unsigned int);
+typedef void (*DrawWindowTextureProc) (CompWindow *, CompTexture *, const FragmentAttrib *, unsigned int);
+typedef void (*AddWindowGeometryProc) (CompWindow *, CompMatrix *, int, Region, Region);
+typedef Bool (*DamageWindowRectProc) (CompWindow *, Bool, BoxPtr);
+typedef void (*WindowMoveNotifyProc) (CompWindow *, int, int, Bool);
+typedef void (*WindowResizeNotifyProc) (CompWindow *, int, int, int, int);
+typedef void (*WindowStateChangeNotifyProc) (CompWindow *, unsigned int);
+typedef void (*HandleEventProc) (CompDisplay *, XEvent *);
+typedef void (*MatchPropertyChangedProc) (CompDisplay *, CompWindow *);
+typedef void (*FuncPtr) (void);
+typedef FuncPtr (*GLXGetProcAddressProc) (const GLubyte *procName);
+typedef void (*GLProgramParameter4fProc) (GLenum, GLuint, GLfloat, GLfloat, GLfloat, GLfloat);
+typedef void (*GLGenFramebuffersProc) (GLsizei, GLuint *);
+typedef void (*GLDeleteFramebuffersProc) (GLsizei, GLuint *);
+typedef void (*GLBindFramebufferProc) (GLenum, GLuint);
+typedef GLenum (*GLCheckFramebufferStatusProc) (GLenum);
+typedef void (*GLFramebufferTexture2DProc) (GLenum, GLenum, GLenum, GLuint, GLint);
+typedef void (*GLGenerateMipmapProc) (GLenum);
+typedef void (*GLActiveTextureProc) (GLenum);
+
+/* A match is kept as its expression, see matchEval */
+struct _CompMatch {
+    char *expression;
+};
+
+typedef struct _CompOption CompOption;
+typedef struct _CompAction CompAction;
+typedef unsigned int CompActionState;
+typedef Bool (*CompActionCallBackProc) (CompDisplay *, CompAction *, CompActionState, CompOption *, int);
+
+struct _CompDisplay {
+    CompObject  base;
+    CompDisplay *next;
+    Display     *display;
+    CompScreen  *screens;
+    Window      activeWindow;
+    int         fixesEvent, fixesError;
+    HandleEventProc handleEvent;
+    MatchPropertyChangedProc matchPropertyChanged;
+    GLenum      textureFilter;
+};
+#define NOTHING_TRANS_FILTER 0
+#define SCREEN_TRANS_FILTER  1
+#define WINDOW_TRANS_FILTER  2
+
+struct _CompScreen {
+    CompObject  base;
+    CompScreen  *next;
+    CompDisplay *display;
+    CompWindow  *windows;
+    CompWindow  *reverseWindows;
+    Window      root;
+    int         screenNum;
+    int         width, height;
+    int         x, y;
+    int         hsize, vsize;
+    CompOutput  *outputDev;
+    int         nOutputDev;
+    int         currentOutputDev;
+    CompOutput  fullscreenOutput;
+    GLfloat     projection[16];
+    int         mapNum;
+    Bool        fragmentProgram;
+    Bool        fbo;
+    Bool        textureNonPowerOfTwo;
+    int         maxTextureUnits;
+    int         filter[3];
+    GLXGetProcAddressProc getProcAddress;
+    GLProgramParameter4fProc programEnvParameter4f;
+    GLGenFramebuffersProc genFramebuffers;
+    GLDeleteFramebuffersProc deleteFramebuffers;
+    GLBindFramebufferProc bindFramebuffer;
+    GLCheckFramebufferStatusProc checkFramebufferStatus;
+    GLFramebufferTexture2DProc framebufferTexture2D;
+    GLGenerateMipmapProc generateMipmap;
+    GLActiveTextureProc activeTexture;
+    PreparePaintScreenProc preparePaintScreen;
+    DonePaintScreenProc donePaintScreen;
+    PaintOutputProc paintOutput;
+    PaintTransformedOutputProc paintTransformedOutput;
+    PaintWindowProc paintWindow;
+    DrawWindowProc drawWindow;
+    AddWindowGeometryProc addWindowGeometry;
+    DrawWindowTextureProc drawWindowTexture;
+    DamageWindowRectProc damageWindowRect;
+    WindowMoveNotifyProc windowMoveNotify;
+    WindowResizeNotifyProc windowResizeNotify;
+    WindowStateChangeNotifyProc windowStateChangeNotify;
+};
+
+typedef struct _CompWindowExtents { int left, right, top, bottom; } CompWindowExtents;
+
+#define WIN_X(w) ((w)->attrib.x - (w)->input.left)
+#define WIN_Y(w) ((w)->attrib.y - (w)->input.top)
+#define WIN_W(w) ((w)->width + (w)->input.left + (w)->input.right)
+#define WIN_H(w) ((w)->height + (w)->input.top + (w)->input.bottom)
+
+struct _CompWindow {
+    CompObject  base;
+    CompScreen  *screen;
+    CompWindow  *next;
+    CompWindow  *prev;
+    Window      id;
+    Window      frame;
+    Window      clientLeader;
+    unsigned int mapNum;
+    unsigned int activeNum;
+    XWindowAttributes attrib;
+    int         serverX, serverY;
+    int         width, height;
+    Region      region;
+    CompWindowExtents input;
+    unsigned int type;
+    unsigned int wmType;
+    unsigned int state;
+    unsigned int actions;
+    Bool        shaded;
+    Bool        invisible;
+    Bool        destroyed;
+    Bool        damaged;
+    Bool        alive;
+    char        *resName;
+    char        *resClass;
+    CompTexture *texture;
+    CompMatrix  matrix;
+    WindowPaintAttrib paint;
+    GLfloat     *vertices;
+    int         vertexSize;
+    int         vertexStride;
+    GLushort    *indices;
+    int         indexSize;
+    int         vCount;
+    int         texUnits;
+    int         texCoordSize;
+    int         indexCount;
+    void        (*drawWindowGeometry) (CompWindow *);
+};
+
+typedef struct _CompPluginVTable {
+    const char *name;
+    void *getMetadata;
+    Bool (*init) (CompPlugin *);
+    void (*fini) (CompPlugin *);
+    CompBool (*initObject) (CompPlugin *, CompObject *);
+    void (*finiObject) (CompPlugin *, CompObject *);
+    void *getObjectOptions;
+    void *setObjectOption;
+} CompPluginVTable;
+
+typedef CompBool (*InitPluginObjectProc) (CompPlugin *, CompObject *);
+typedef void (*FiniPluginObjectProc) (CompPlugin *, CompObject *);
+
+#define ARRAY_SIZE(array) (sizeof (array) / sizeof (array[0]))
+#define DISPATCH(object, dispTab, tabSize, args) do { if ((object)->type < (tabSize) && dispTab[(object)->type]) (*dispTab[(object)->type]) args; } while (0)
+#define RETURN_DISPATCH(object, dispTab, tabSize, def, args) if ((object)->type < (tabSize) && dispTab[(object)->type]) return (*dispTab[(object)->type]) args; else return (def)
+
+#define WRAP(priv, real, func, wrapFunc) (priv)->func = (real)->func, (real)->func = (wrapFunc)
+#define UNWRAP(priv, real, func) (real)->func = (priv)->func
+
+void compLogMessage (const char *componentName, CompLogLevel level, const char *format, ...);
+CompTimeoutHandle compAddTimeout (int minTime, int maxTime, CallBackProc callBack, void *closure);
+void *compRemoveTimeout (CompTimeoutHandle handle);
+
+int allocateDisplayPrivateIndex (void);
+void freeDisplayPrivateIndex (int index);
+int allocateScreenPrivateIndex (CompDisplay *d);
+void freeScreenPrivateIndex (CompDisplay *d, int index);
+int allocateWindowPrivateIndex (CompScreen *s);
+void freeWindowPrivateIndex (CompScreen *s, int index);
+Bool checkPluginABI (const char *name, int abi);
+Bool getPluginDisplayIndex (CompDisplay *d, const char *name, int *index);
+int getIntOptionNamed (CompOption *option, int nOption, const char *name, int defaultValue);
+CompScreen *findScreenAtDisplay (CompDisplay *d, Window root);
+CompWindow *findWindowAtScreen (CompScreen *s, Window id);
+CompWindow *findWindowAtDisplay (CompDisplay *d, Window id);
+unsigned int getWindowProp (CompDisplay *d, Window id, Atom property, unsigned int defaultValue);
+Bool matchEval (CompMatch *match, CompWindow *w);
+void damageScreen (CompScreen *s);
+void damageScreenRegion (CompScreen *s, Region region);
+void addWindowDamage (CompWindow *w);
+
+void matrixGetIdentity (CompTransform *m);
+void matrixMultiply (CompTransform *product, const CompTransform *transformA, const CompTransform *transformB);
+void matrixRotate (CompTransform *transform, float angle, float x, float y, float z);
+void matrixScale (CompTransform *transform, float x, float y, float z);
+void matrixTranslate (CompTransform *transform, float x, float y, float z);
+void transformToScreenSpace (CompScreen *screen, CompOutput *output, float z, CompTransform *transform);
+
+CompFunctionData *createFunctionData (void);
+void destroyFunctionData (CompFunctionData *data);
+Bool addTempHeaderOpToFunctionData (CompFunctionData *data, const char *name);
+Bool addParamHeaderOpToFunctionData (CompFunctionData *data, const char *name);
+Bool addAttribHeaderOpToFunctionData (CompFunctionData *data, const char *name);
+Bool addFetchOpToFunctionData (CompFunctionData *data, const char *dst, const char *offset, int target);
+Bool addColorOpToFunctionData (CompFunctionData *data, const char *dst, const char *src);
+Bool addDataOpToFunctionData (CompFunctionData *data, const char *str, ...);
+int createFragmentFunction (CompScreen *s, const char *name, CompFunctionData *data);
+void destroyFragmentFunction (CompScreen *s, int id);
+int allocFragmentParameters (FragmentAttrib *attrib, int n);
+void addFragmentFunction (FragmentAttrib *attrib, int function);
+void initFragmentAttrib (FragmentAttrib *attrib, const WindowPaintAttrib *paint);
+
+void initTexture (CompScreen *screen, CompTexture *texture);
+void finiTexture (CompScreen *screen, CompTexture *texture);
+void enableTexture (CompScreen *screen, CompTexture *texture, CompTextureFilter filter);
+void disableTexture (CompScreen *screen, CompTexture *texture);
+void drawWindowTexture (CompWindow *w, CompTexture *texture, const FragmentAttrib *attrib, unsigned int mask);
+void drawWindowGeometry (CompWindow *w);
+Bool moreWindowVertices (CompWindow *w, int newSize);
+Bool moreWindowIndices (CompWindow *w, int newSize);
+
+#endif
@@ -0,0 +1,23 @@
+/* mousepoll 0.8 API, the mock core polls on request of the test */
+#ifndef _COMPIZ_MOUSEPOLL_H
+#define _COMPIZ_MOUSEPOLL_H
+
+#include <compiz-core.h>
+
+#define MOUSEPOLL_ABIVERSION 20080116
+
+typedef int PositionPollingHandle;
+
+typedef void (*PositionUpdateProc) (CompScreen *s, int x, int y);
+
+typedef PositionPollingHandle (*AddPositionPollingProc) (CompScreen *s, PositionUpdateProc update);
+typedef void (*RemovePositionPollingProc) (CompScreen *s, PositionPollingHandle id);
+typedef void (*GetCurrentPositionProc) (CompScreen *s, int *x, int *y);
+
+typedef struct _MousePollFunc {
+    AddPositionPollingProc    addPositionPolling;
+    RemovePositionPollingProc removePositionPolling;
+    GetCurrentPositionProc    getCurrentPosition;
+} MousePollFunc;
+
+#endif
@@ -0,0 +1 @@
+/* Plugin loading is done by mockcore.cpp, nothing of it is used */
@@ -0,0 +1,31 @@
+/* The XFixes cursor image request, implemented by xstub.cpp */
+#ifndef __XFIXES_H
+#define __XFIXES_H
+
+#include <xcb/xcb.h>
+
+typedef struct {
+    unsigned int sequence;
+} xcb_xfixes_get_cursor_image_cookie_t;
+
+typedef struct {
+    uint8_t  response_type;
+    uint8_t  pad0;
+    uint16_t sequence;
+    uint32_t length;
+    int16_t  x;
+    int16_t  y;
+    uint16_t width;
+    uint16_t height;
+    uint16_t xhot;
+    uint16_t yhot;
+    uint32_t cursor_serial;
+    uint8_t  pad1[8];
+} xcb_xfixes_get_cursor_image_reply_t;
+
+extern "C" {
+xcb_xfixes_get_cursor_image_cookie_t xcb_xfixes_get_cursor_image (xcb_connection_t *c);
+uint32_t *xcb_xfixes_get_cursor_image_cursor_image (const xcb_xfixes_get_cursor_image_reply_t *R);
+}
+
+#endif
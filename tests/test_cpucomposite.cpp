@@ -0,0 +1,362 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The CPU compositor of cpucomposite.cpp. Each output mode of two
+ * generated eye images has to match the golden PPM in data/ and the
+ * per-pixel definition of the mode, and the SIMD kernels have to give
+ * the same bytes as the scalar build of the same file: those this CPU
+ * runs (AVX2, SSE2 or NEON) and those of the build without AVX2. The
+ * modes are timed at 1080p and 4K in each build.
+ *
+ *   test_cpucomposite [--update] [--no-timing]
+ *
+ * --update rewrites the golden images from the scalar build. */
+
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "stereo3d.h"
+#include "check.h"
+
+/* cpucomposite.cpp built with STEREO3D_NO_SIMD and STEREO3D_NO_AVX2 */
+bool cpuCompositeScalar (const CpuImage *left, const CpuImage *right, CpuImage *out,
+			 CpuCompositeMode mode);
+bool cpuCompositeNoAvx2 (const CpuImage *left, const CpuImage *right, CpuImage *out,
+			 CpuCompositeMode mode);
+const char *getCpuCompositeKernelsNoAvx2 (void);
+
+// odd sizes leave tails behind the four and eight pixel SIMD loops
+#define GOLDEN_WIDTH  131
+#define GOLDEN_HEIGHT 67
+
+#define TIMING_RUNS 5
+
+static const char *modeNames[] = {
+    "anaglyph", "rows", "columns", "side-by-side"
+};
+
+/* Gradients with noise on top, the eyes differing in every channel */
+static void
+makeEye (CpuImage *image, int width, int height, unsigned int seed)
+{
+    allocCpuImage (image, width, height);
+
+    for (int y = 0; y < height; y++)
+    {
+	for (int x = 0; x < width; x++)
+	{
+	    unsigned char *p = image->pixels + y * image->stride + x * 4;
+
+	    seed = seed * 1103515245 + 12345;
+
+	    p[0] = (x * 255 / width + (seed >> 16)) & 0xff;
+	    p[1] = (y * 255 / height + (seed >> 20)) & 0xff;
+	    p[2] = ((x + y) * 3 + (seed >> 24)) & 0xff;
+	    p[3] = 0xff;
+	}
+    }
+}
+
+static bool
+readPPM (const char *path, CpuImage *image)
+{
+    FILE *file = fopen (path, "rb");
+    int  width, height, max;
+    bool ok;
+
+    if (!file)
+	return false;
+
+    ok = fscanf (file, "P6 %d %d %d", &width, &height, &max) == 3 && max == 255 &&
+	 fgetc (file) != EOF && allocCpuImage (image, width, height);
+
+    for (int i = 0; ok && i < width * height; i++)
+    {
+	ok = fread (image->data + i * 4, 1, 3, file) == 3;
+	image->data[i * 4 + 3] = 0xff;
+    }
+
+    fclose (file);
+
+    return ok;
+}
+
+static void
+writePPM (const char *path, const CpuImage *image)
+{
+    FILE *file = fopen (path, "wb");
+
+    if (!file)
+    {
+	CHECK (file, "unable to write %s", path);
+	return;
+    }
+
+    fprintf (file, "P6\n%d %d\n255\n", image->width, image->height);
+
+    for (int y = 0; y < image->height; y++)
+	for (int x = 0; x < image->width; x++)
+	    fwrite (image->pixels + y * image->stride + x * 4, 1, 3, file);
+
+    fclose (file);
+}
+
+static int
+channelDiff (const CpuImage *a, const CpuImage *b, int x, int y, int c)
+{
+    return abs (a->pixels[y * a->stride + x * 4 + c] - b->pixels[y * b->stride + x * 4 + c]);
+}
+
+/* Largest difference of the colour channels, alpha too when asked */
+static int
+maxDiff (const CpuImage *a, const CpuImage *b, bool alpha)
+{
+    int diff = 0;
+
+    for (int y = 0; y < a->height; y++)
+	for (int x = 0; x < a->width; x++)
+	    for (int c = 0; c < (alpha ? 4 : 3); c++)
+		if (channelDiff (a, b, x, y, c) > diff)
+		    diff = channelDiff (a, b, x, y, c);
+
+    return diff;
+}
+
+static const unsigned char *
+pixel (const CpuImage *image, int x, int y)
+{
+    return image->pixels + y * image->stride + x * 4;
+}
+
+/* The modes as the GL paths define them: the anaglyph matrix of
+ * AnaglyphFilter in floating point, the eye of each row or column as
+ * the stencil of InterlacedFilter selects it, and the halved eyes next
+ * to each other */
+static void
+referenceComposite (const CpuImage *left, const CpuImage *right, CpuImage *out,
+		    CpuCompositeMode mode)
+{
+    for (int y = 0; y < out->height; y++)
+    {
+	for (int x = 0; x < out->width; x++)
+	{
+	    const unsigned char *l = pixel (left, x, y);
+	    const unsigned char *r = pixel (right, x, y);
+	    unsigned char       *o = out->pixels + y * out->stride + x * 4;
+	    int                 half = out->width / 2;
+
+	    switch (mode) {
+	    case CpuAnaglyph:
+		o[0] = (unsigned char) floor (0.1 * r[0] + 0.63 * r[1] + 0.27 * r[2] + 0.5);
+		o[1] = (unsigned char) floor (0.1 * l[0] + 0.9 * l[1] + 0.5);
+		o[2] = (unsigned char) floor (0.1 * l[0] + 0.9 * l[2] + 0.5);
+		o[3] = 0xff;
+		break;
+	    case CpuRowInterlaced:
+		memcpy (o, (y & 1) ? r : l, 4);
+		break;
+	    case CpuColumnInterlaced:
+		memcpy (o, (x & 1) ? r : l, 4);
+		break;
+	    case CpuSideBySide:
+	    {
+		const CpuImage *eye = x < half ? left : right;
+		int            ex = 2 * (x < half ? x : x - half);
+		const unsigned char *p = pixel (eye, ex, y);
+		const unsigned char *q = pixel (eye, ex + 1 < eye->width ? ex + 1 : ex, y);
+
+		for (int c = 0; c < 4; c++)
+		    o[c] = (p[c] + q[c] + 1) >> 1;
+		break;
+	    }
+	    }
+	}
+    }
+}
+
+/* The same image with its rows bottom-up, like readOutputImage gives */
+static void
+flipImage (const CpuImage *image, CpuImage *flipped)
+{
+    allocCpuImage (flipped, image->width, image->height);
+
+    for (int y = 0; y < image->height; y++)
+	memcpy (flipped->data + (image->height - 1 - y) * image->width * 4,
+		pixel (image, 0, y), image->width * 4);
+
+    flipped->pixels = flipped->data + (image->height - 1) * image->width * 4;
+    flipped->stride = -image->width * 4;
+}
+
+static void
+checkGolden (bool update)
+{
+    CpuImage left, right, flippedLeft, flippedRight;
+
+    makeEye (&left, GOLDEN_WIDTH, GOLDEN_HEIGHT, 1);
+    makeEye (&right, GOLDEN_WIDTH, GOLDEN_HEIGHT, 2);
+    flipImage (&left, &flippedLeft);
+    flipImage (&right, &flippedRight);
+
+    for (int mode = CpuAnaglyph; mode <= CpuSideBySide; mode++)
+    {
+	CpuImage simd, noAvx2, scalar, flipped, reference, golden;
+	char     path[1024];
+
+	allocCpuImage (&simd, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	allocCpuImage (&noAvx2, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	allocCpuImage (&scalar, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	allocCpuImage (&flipped, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	allocCpuImage (&reference, GOLDEN_WIDTH, GOLDEN_HEIGHT);
+
+	cpuComposite (&left, &right, &simd, (CpuCompositeMode) mode);
+	cpuCompositeNoAvx2 (&left, &right, &noAvx2, (CpuCompositeMode) mode);
+	cpuCompositeScalar (&left, &right, &scalar, (CpuCompositeMode) mode);
+	cpuComposite (&flippedLeft, &flippedRight, &flipped, (CpuCompositeMode) mode);
+	referenceComposite (&left, &right, &reference, (CpuCompositeMode) mode);
+
+	CHECK (maxDiff (&simd, &scalar, true) == 0,
+	       "%s: the %s and scalar kernels differ by up to %d", modeNames[mode],
+	       getCpuCompositeKernels (), maxDiff (&simd, &scalar, true));
+	CHECK (maxDiff (&noAvx2, &scalar, true) == 0,
+	       "%s: the %s and scalar kernels differ by up to %d", modeNames[mode],
+	       getCpuCompositeKernelsNoAvx2 (), maxDiff (&noAvx2, &scalar, true));
+	CHECK (maxDiff (&simd, &flipped, true) == 0,
+	       "%s: bottom-up eyes give a different image", modeNames[mode]);
+
+	// the fixed point anaglyph matrix rounds its weights to 1/256
+	CHECK (maxDiff (&scalar, &reference, true) <= (mode == CpuAnaglyph ? 1 : 0),
+	       "%s: differs from the definition of the mode by up to %d",
+	       modeNames[mode], maxDiff (&scalar, &reference, true));
+
+	snprintf (path, sizeof (path), "%s/cpu-%s.ppm", STEREO3D_TEST_DATA, modeNames[mode]);
+
+	if (update)
+	{
+	    writePPM (path, &scalar);
+	}
+	else if (readPPM (path, &golden))
+	{
+	    CHECK (golden.width == GOLDEN_WIDTH && golden.height == GOLDEN_HEIGHT &&
+		   maxDiff (&simd, &golden, false) == 0,
+		   "%s: differs from %s", modeNames[mode], path);
+	    freeCpuImage (&golden);
+	}
+	else
+	{
+	    CHECK (false, "unable to read %s", path);
+	}
+
+	freeCpuImage (&simd);
+	freeCpuImage (&noAvx2);
+	freeCpuImage (&scalar);
+	freeCpuImage (&flipped);
+	freeCpuImage (&reference);
+    }
+
+    freeCpuImage (&left);
+    freeCpuImage (&right);
+    freeCpuImage (&flippedLeft);
+    freeCpuImage (&flippedRight);
+}
+
+static double
+nowMs (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+typedef bool (*CompositeProc) (const CpuImage *, const CpuImage *, CpuImage *, CpuCompositeMode);
+
+/* Best of TIMING_RUNS */
+static double
+timeComposite (CompositeProc composite, const CpuImage *left, const CpuImage *right,
+	       CpuImage *out, CpuCompositeMode mode)
+{
+    double best = 0.0;
+
+    for (int run = 0; run < TIMING_RUNS; run++)
+    {
+	double start = nowMs ();
+	double ms;
+
+	(*composite) (left, right, out, mode);
+
+	ms = nowMs () - start;
+	if (!run || ms < best)
+	    best = ms;
+    }
+
+    return best;
+}
+
+static void
+reportTimings (int width, int height, const char *name)
+{
+    CpuImage left, right, out;
+
+    makeEye (&left, width, height, 3);
+    makeEye (&right, width, height, 4);
+    allocCpuImage (&out, width, height);
+
+    for (int mode = CpuAnaglyph; mode <= CpuSideBySide; mode++)
+    {
+	double simd = timeComposite (cpuComposite, &left, &right, &out, (CpuCompositeMode) mode);
+	double noAvx2 = timeComposite (cpuCompositeNoAvx2, &left, &right, &out,
+				       (CpuCompositeMode) mode);
+	double scalar = timeComposite (cpuCompositeScalar, &left, &right, &out,
+				       (CpuCompositeMode) mode);
+
+	printf ("%-5s %-12s %-6s %7.2f ms %7.0f Mpixel/s   %-6s %7.2f ms %7.0f Mpixel/s   "
+		"scalar %7.2f ms %7.0f Mpixel/s\n",
+		name, modeNames[mode], getCpuCompositeKernels (), simd,
+		width * height / (simd * 1000.0), getCpuCompositeKernelsNoAvx2 (), noAvx2,
+		width * height / (noAvx2 * 1000.0), scalar, width * height / (scalar * 1000.0));
+    }
+
+    freeCpuImage (&left);
+    freeCpuImage (&right);
+    freeCpuImage (&out);
+}
+
+int
+main (int argc, char **argv)
+{
+    bool update = false, timing = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+	if (!strcmp (argv[i], "--update"))
+	    update = true;
+	else if (!strcmp (argv[i], "--no-timing"))
+	    timing = false;
+    }
+
+    checkGolden (update);
+
+    if (timing)
+    {
+	reportTimings (1920, 1080, "1080p");
+	reportTimings (3840, 2160, "4K");
+    }
+
+    if (failures)
+	fprintf (stderr, "%d checks failed\n", failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The GL calls of every frame within the budgets of glcounters.cpp.
+ * Each output mode, with and without the GLSL and layered paths and
+ * the cursor drawn, is painted while windows and the pointer move and
+ * the quality governor steps down to reduced resolution and back up. */
+
+#include <string.h>
+
+#include "stereo3d.h"
+#include "mockcore.h"
+#include "glshim.h"
+#include "check.h"
+
+#define SCREEN_WIDTH  1280
+#define SCREEN_HEIGHT 1024
+
+#define N_WINDOWS 48
+
+// frames of each phase: windows moving, frames too slow, frames in time
+#define MOVING_FRAMES 60
+#define SLOW_FRAMES   200
+#define FAST_FRAMES   400
+
+typedef struct _Config
+{
+    int  outputMode;
+    bool glsl;
+    bool layered;
+    bool cursor;
+} Config;
+
+static const char *siteNames[] = {
+    "other", "filter", "filter setup", "projection", "cursor", "wireframe"
+};
+
+static const char *typeNames[] = {
+    "matrix", "color mask", "stencil", "fragment", "vertex", "texture bind",
+    "glGetError", "state", "uniform", "framebuffer"
+};
+
+static DonePaintScreenProc pluginDonePaintScreen;
+static const Config        *config;
+static int                 frame;
+static int                 countedFrames;
+static int                 cursorFrames;
+static int                 maxQualityLevel;
+
+/* Above the plugin in the wrap chain, so the frame is checked before
+ * checkGLCallBudget starts counting the next one */
+static void
+testDonePaintScreen (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+
+    if (sos->stereoActive && sos->glCalls.enabled)
+    {
+	bool exceeded[GLSiteCount][GLCallTypeCount];
+	int  overruns = countGLCallOverruns (&sos->glCalls, s->width, s->height, exceeded);
+
+	CHECK (overruns == 0, "mode %d glsl %d layered %d cursor %d: %d budgets "
+	       "exceeded in frame %d", config->outputMode, config->glsl,
+	       config->layered, config->cursor, overruns, frame);
+
+	for (int site = 0; overruns && site < GLSiteCount; site++)
+	    for (int type = 0; type < GLCallTypeCount; type++)
+		if (exceeded[site][type])
+		    fprintf (stderr, "    %s: %u %s calls for %u uses\n", siteNames[site],
+			     sos->glCalls.calls[site][type], typeNames[type],
+			     sos->glCalls.units[site]);
+
+	if (getGLCallTotal (&sos->glCalls))
+	    countedFrames++;
+	if (sos->glCalls.units[GLSiteCursor])
+	    cursorFrames++;
+	if (sos->quality.level > maxQualityLevel)
+	    maxQualityLevel = sos->quality.level;
+    }
+
+    s->donePaintScreen = pluginDonePaintScreen;
+    (*s->donePaintScreen) (s);
+    pluginDonePaintScreen = s->donePaintScreen;
+    s->donePaintScreen = testDonePaintScreen;
+}
+
+static void
+paintFrames (CompScreen *s, CompWindow **windows, int nFrames, int ms, bool move)
+{
+    for (int i = 0; i < nFrames; i++, frame++)
+    {
+	mockMovePointer (s, (frame * 13) % SCREEN_WIDTH, (frame * 7) % SCREEN_HEIGHT);
+
+	if (move)
+	{
+	    CompWindow *w = windows[frame % N_WINDOWS];
+
+	    mockMoveWindow (w, (w->attrib.x + 41) % (SCREEN_WIDTH - w->width),
+			    (w->attrib.y + 23) % (SCREEN_HEIGHT - w->height));
+	    mockRaiseWindow (w);
+	    mockActivateWindow (w);
+	}
+
+	mockPaintScreen (s, ms);
+    }
+}
+
+static void
+checkConfig (const Config *c)
+{
+    CompDisplay *d = mockInitDisplay (glShimGetProcAddress);
+    CompScreen  *s;
+    CompWindow  *windows[N_WINDOWS];
+
+    config = c;
+    frame = 0;
+    countedFrames = 0;
+    cursorFrames = 0;
+    maxQualityLevel = QualityFull;
+
+    mockSetIntOption (d, "output_mode", c->outputMode);
+    mockSetBoolOption (d, "glsl", c->glsl);
+    mockSetBoolOption (d, "layered_stereo", c->layered);
+    mockSetBoolOption (d, "drawMouse", c->cursor);
+    mockSetBoolOption (d, "adaptive_quality", true);
+    mockSetBoolOption (d, "gl_call_stats", true);
+
+    s = mockAddScreen (d, SCREEN_WIDTH, SCREEN_HEIGHT);
+    mockAddWindow (s, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, CompWindowTypeDesktopMask, true);
+    mockAddWindow (s, 0, 0, SCREEN_WIDTH, 24, CompWindowTypeDockMask, true);
+
+    for (int i = 0; i < N_WINDOWS; i++)
+	windows[i] = mockAddWindow (s, (i * 97) % (SCREEN_WIDTH - 400),
+				    (i * 61) % (SCREEN_HEIGHT - 300),
+				    400, 300, CompWindowTypeNormalMask, true);
+
+    // a translucent one, drawn with blending
+    windows[N_WINDOWS - 1]->paint.opacity = OPAQUE / 2;
+
+    pluginDonePaintScreen = s->donePaintScreen;
+    s->donePaintScreen = testDonePaintScreen;
+
+    paintFrames (s, windows, MOVING_FRAMES, 16, true);
+    paintFrames (s, windows, SLOW_FRAMES, 100, false);
+    paintFrames (s, windows, FAST_FRAMES, 10, false);
+
+    CHECK (countedFrames > MOVING_FRAMES + SLOW_FRAMES,
+	   "mode %d: only %d of %d frames were counted", c->outputMode,
+	   countedFrames, frame);
+    CHECK (!c->cursor || cursorFrames > 0, "mode %d: the cursor was never drawn",
+	   c->outputMode);
+
+    mockFiniDisplay (d);
+}
+
+int
+main (int argc, char **argv)
+{
+    bool reducedResolution = false;
+
+    for (int mode = 0; mode <= 4; mode++)
+    {
+	for (int variant = 0; variant < 6; variant++)
+	{
+	    Config c;
+
+	    c.outputMode = mode;
+	    c.glsl = variant % 3 > 0;
+	    c.layered = variant % 3 > 1;
+	    c.cursor = variant >= 3;
+
+	    // the layered path needs GLSL, the lenticular one always has it
+	    if (mode == 4 && variant % 3 != 1)
+		continue;
+	    if (c.layered && (mode < 1 || mode > 3))
+		continue;
+
+	    checkConfig (&c);
+
+	    if (maxQualityLevel == QualityReducedResolution)
+		reducedResolution = true;
+	}
+    }
+
+    // the slow frames have to reach the reduced resolution pass somewhere
+    CHECK (reducedResolution, "the quality governor never reduced the resolution");
+
+    if (failures)
+	fprintf (stderr, "%d checks failed\n", failures);
+
+    return failures ? 1 : 0;
+}
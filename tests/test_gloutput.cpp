@@ -0,0 +1,419 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The output of the three GL paths on real GL: Mesa's llvmpipe in an
+ * offscreen EGL pbuffer, driven by the mock core instead of glshim.
+ *
+ * A desktop and overlapping windows with textures are painted with the
+ * cursor in every output mode with a CPU counterpart, by the fixed
+ * function filters, the GLSL programs and the layered eye buffer. The
+ * snapshot action paints the eyes on their own and the frame, and
+ * writes the CPU composite of the eyes next to the GL output:
+ *
+ * - the output of each path has to match the CPU composite of its eyes
+ * - the eyes of the GLSL and layered paths have to match the fixed
+ *   function ones, and so do their outputs
+ *
+ * The frame time of each path is reported. Skipped, with 77, where no
+ * EGL display with desktop GL can be had.
+ *
+ *   test_gloutput [--no-timing] */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "stereo3d.h"
+#include "mockcore.h"
+#include "check.h"
+
+#define SCREEN_WIDTH  640
+#define SCREEN_HEIGHT 360
+
+#define SETTLE_FRAMES 120
+#define TIMING_FRAMES 20
+
+// channel difference still counted as a match, like the snapshot's own
+#define TOLERANCE     8
+// pixels past the tolerance, out of 1000, the rest is rasterization
+// and rounding
+#define MAX_DIFFERING 2
+
+#define SKIPPED       77
+
+typedef enum {
+    PathFixed = 0,
+    PathGlsl,
+    PathLayered,
+    PathCount
+} GLPath;
+
+static const char *pathNames[] = {
+    "fixed function", "GLSL", "layered"
+};
+
+static const char *modeNames[] = {
+    "", "anaglyph", "rows", "columns"
+};
+
+// what the snapshot of one path and mode wrote
+typedef struct _PathImages
+{
+    CpuImage left, right, gpu, cpu;
+    bool     read;
+} PathImages;
+
+static EGLDisplay eglDisplay;
+static EGLSurface eglSurface;
+static EGLContext eglContext;
+
+static FuncPtr
+eglProcAddress (const GLubyte *name)
+{
+    return (FuncPtr) eglGetProcAddress ((const char *) name);
+}
+
+/* A desktop GL context current on a pbuffer of the screen's size, with
+ * the stencil the interlaced filters need */
+static bool
+initEGL (void)
+{
+    static const EGLint configAttribs[] = {
+	EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+	EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+	EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+	EGL_STENCIL_SIZE, 8,
+	EGL_NONE
+    };
+    static const EGLint surfaceAttribs[] = {
+	EGL_WIDTH, SCREEN_WIDTH, EGL_HEIGHT, SCREEN_HEIGHT, EGL_NONE
+    };
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay;
+    EGLConfig                       config;
+    EGLint                          major, minor, nConfigs;
+
+    // llvmpipe, whatever the machine has
+    setenv ("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+    setenv ("GALLIUM_DRIVER", "llvmpipe", 0);
+
+    getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+	eglGetProcAddress ("eglGetPlatformDisplayEXT");
+    if (!getPlatformDisplay)
+	return false;
+
+    eglDisplay = getPlatformDisplay (EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize (eglDisplay, &major, &minor))
+	return false;
+
+    if (!eglBindAPI (EGL_OPENGL_API) ||
+	!eglChooseConfig (eglDisplay, configAttribs, &config, 1, &nConfigs) || !nConfigs)
+	return false;
+
+    eglSurface = eglCreatePbufferSurface (eglDisplay, config, surfaceAttribs);
+    eglContext = eglCreateContext (eglDisplay, config, EGL_NO_CONTEXT, NULL);
+
+    return eglSurface != EGL_NO_SURFACE && eglContext != EGL_NO_CONTEXT &&
+	   eglMakeCurrent (eglDisplay, eglSurface, eglSurface, eglContext);
+}
+
+static void
+finiEGL (void)
+{
+    eglMakeCurrent (eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext (eglDisplay, eglContext);
+    eglDestroySurface (eglDisplay, eglSurface);
+    eglTerminate (eglDisplay);
+}
+
+static bool
+readPPM (const char *path, CpuImage *image)
+{
+    FILE *file = fopen (path, "rb");
+    int  width, height, max;
+    bool ok;
+
+    if (!file)
+	return false;
+
+    ok = fscanf (file, "P6 %d %d %d", &width, &height, &max) == 3 && max == 255 &&
+	 fgetc (file) != EOF && allocCpuImage (image, width, height);
+
+    for (int i = 0; ok && i < width * height; i++)
+    {
+	ok = fread (image->data + i * 4, 1, 3, file) == 3;
+	image->data[i * 4 + 3] = 0xff;
+    }
+
+    fclose (file);
+
+    return ok;
+}
+
+/* Pixels out of 1000 with a colour channel differing by more than
+ * TOLERANCE, the largest difference in maxDiff */
+static int
+differing (const CpuImage *a, const CpuImage *b, int *maxDiff)
+{
+    unsigned long count = 0;
+
+    *maxDiff = 0;
+
+    for (int y = 0; y < a->height; y++)
+    {
+	for (int x = 0; x < a->width; x++)
+	{
+	    const unsigned char *p = a->pixels + y * a->stride + x * 4;
+	    const unsigned char *q = b->pixels + y * b->stride + x * 4;
+	    bool                differs = false;
+
+	    for (int c = 0; c < 3; c++)
+	    {
+		int diff = abs (p[c] - q[c]);
+
+		if (diff > *maxDiff)
+		    *maxDiff = diff;
+		differs |= diff > TOLERANCE;
+	    }
+
+	    count += differs;
+	}
+    }
+
+    return count * 1000 / (a->width * a->height);
+}
+
+/* Rings of colour over a gradient, different for every window */
+static void
+setWindowImage (CompWindow *w, unsigned int seed)
+{
+    unsigned char *rgba = (unsigned char *) malloc (w->width * w->height * 4);
+
+    for (int y = 0; y < w->height; y++)
+    {
+	for (int x = 0; x < w->width; x++)
+	{
+	    unsigned char *p = rgba + (y * w->width + x) * 4;
+	    int           ring = ((x - w->width / 2) * (x - w->width / 2) +
+				  (y - w->height / 2) * (y - w->height / 2)) / 97;
+
+	    p[0] = (x * 255 / w->width + seed * 71) & 0xff;
+	    p[1] = (y * 255 / w->height + seed * 113) & 0xff;
+	    p[2] = (ring & 1) ? 0xe0 : 0x20 + seed * 40;
+	    p[3] = 0xff;
+	}
+    }
+
+    mockSetWindowImage (w, GL_TEXTURE_2D, rgba);
+    free (rgba);
+}
+
+static void
+setPath (CompDisplay *d, GLPath path)
+{
+    mockSetBoolOption (d, "glsl", path != PathFixed);
+    mockSetBoolOption (d, "layered_stereo", path == PathLayered);
+}
+
+static double
+nowMs (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/* Paints a snapshot of the path in the mode and reads what it wrote,
+ * returns the frame time in ms when timing */
+static double
+snapshotPath (CompDisplay *d,
+	      CompScreen  *s,
+	      const char  *dir,
+	      int         mode,
+	      GLPath      path,
+	      bool        timing,
+	      PathImages  *images)
+{
+    static const char *names[] = { "left", "right", "gpu", "cpu" };
+    CpuImage          *targets[] = { &images->left, &images->right, &images->gpu, &images->cpu };
+    char              prefix[1024], file[1100];
+    double            ms = 0.0;
+
+    snprintf (prefix, sizeof (prefix), "%s/%s-%d", dir, modeNames[mode], path);
+
+    mockSetIntOption (d, "output_mode", mode);
+    mockSetOption (d, "snapshot_file", prefix);
+    setPath (d, path);
+
+    for (int i = 0; i < SETTLE_FRAMES; i++)
+	mockPaintScreen (s, 16);
+
+    if (timing)
+    {
+	double start;
+
+	glFinish ();
+	start = nowMs ();
+
+	for (int i = 0; i < TIMING_FRAMES; i++)
+	    mockPaintScreen (s, 16);
+
+	glFinish ();
+	ms = (nowMs () - start) / TIMING_FRAMES;
+    }
+
+    mockInitiateAction (d, "snapshot", s);
+    mockPaintScreen (s, 16);
+
+    images->read = true;
+
+    for (int i = 0; i < 4; i++)
+    {
+	snprintf (file, sizeof (file), "%s-%s.ppm", prefix, names[i]);
+	images->read &= readPPM (file, targets[i]);
+    }
+
+    CHECK (images->read, "%s %s: the snapshot images were not written", modeNames[mode],
+	   pathNames[path]);
+
+    return ms;
+}
+
+static void
+compare (const char *what, int mode, const CpuImage *a, const CpuImage *b)
+{
+    int maxDiff, count = differing (a, b, &maxDiff);
+
+    CHECK (count <= MAX_DIFFERING,
+	   "%s: %s, %d pixels of 1000 differ, by up to %d", modeNames[mode], what,
+	   count, maxDiff);
+}
+
+static void
+freeImages (PathImages *images)
+{
+    if (!images->read)
+	return;
+
+    freeCpuImage (&images->left);
+    freeCpuImage (&images->right);
+    freeCpuImage (&images->gpu);
+    freeCpuImage (&images->cpu);
+}
+
+static void
+checkMode (CompDisplay *d, CompScreen *s, const char *dir, int mode, bool timing)
+{
+    PathImages images[PathCount];
+    double     ms[PathCount];
+
+    memset (images, 0, sizeof (images));
+
+    for (int path = PathFixed; path < PathCount; path++)
+    {
+	char what[64];
+
+	ms[path] = snapshotPath (d, s, dir, mode, (GLPath) path, timing, &images[path]);
+	if (!images[path].read)
+	    continue;
+
+	snprintf (what, sizeof (what), "%s output against the CPU composite",
+		  pathNames[path]);
+	compare (what, mode, &images[path].gpu, &images[path].cpu);
+
+	if (path == PathFixed || !images[PathFixed].read)
+	    continue;
+
+	snprintf (what, sizeof (what), "%s left eye against fixed function", pathNames[path]);
+	compare (what, mode, &images[path].left, &images[PathFixed].left);
+	snprintf (what, sizeof (what), "%s right eye against fixed function", pathNames[path]);
+	compare (what, mode, &images[path].right, &images[PathFixed].right);
+	snprintf (what, sizeof (what), "%s output against fixed function", pathNames[path]);
+	compare (what, mode, &images[path].gpu, &images[PathFixed].gpu);
+    }
+
+    if (timing)
+	printf ("%-8s %dx%d on llvmpipe: fixed function %.2f ms, GLSL %.2f ms, "
+		"layered %.2f ms a frame\n", modeNames[mode], SCREEN_WIDTH, SCREEN_HEIGHT,
+		ms[PathFixed], ms[PathGlsl], ms[PathLayered]);
+
+    for (int path = PathFixed; path < PathCount; path++)
+	freeImages (&images[path]);
+}
+
+int
+main (int argc, char **argv)
+{
+    CompDisplay *d;
+    CompScreen  *s;
+    CompWindow  *w;
+    char        dir[] = "/tmp/stereo3d-gloutput.XXXXXX";
+    char        command[64];
+    bool        timing = !(argc > 1 && !strcmp (argv[1], "--no-timing"));
+
+    if (!initEGL ())
+    {
+	printf ("no EGL pbuffer with desktop GL, skipped\n");
+	return SKIPPED;
+    }
+
+    if (!mkdtemp (dir))
+    {
+	fprintf (stderr, "unable to create %s\n", dir);
+	return 1;
+    }
+
+    printf ("%s, %s\n", glGetString (GL_RENDERER), glGetString (GL_VERSION));
+
+    d = mockInitDisplay (eglProcAddress);
+    mockSetBoolOption (d, "drawMouse", true);
+
+    s = mockAddScreen (d, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    w = mockAddWindow (s, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, CompWindowTypeDesktopMask, true);
+    setWindowImage (w, 0);
+    w = mockAddWindow (s, 0, 0, SCREEN_WIDTH, 24, CompWindowTypeDockMask, true);
+    setWindowImage (w, 1);
+
+    for (int i = 0; i < 3; i++)
+    {
+	w = mockAddWindow (s, 60 + i * 150, 50 + i * 60, 260, 180, CompWindowTypeNormalMask, true);
+	setWindowImage (w, i + 2);
+    }
+
+    mockMovePointer (s, 300, 200);
+
+    for (int mode = 1; mode <= 3; mode++)
+	checkMode (d, s, dir, mode, timing);
+
+    mockFiniDisplay (d);
+    finiEGL ();
+
+    if (failures)
+    {
+	fprintf (stderr, "%d checks failed, the images are in %s\n", failures, dir);
+    }
+    else
+    {
+	snprintf (command, sizeof (command), "rm -rf %s", dir);
+	if (system (command))
+	    fprintf (stderr, "unable to remove %s\n", dir);
+    }
+
+    return failures ? 1 : 0;
+}
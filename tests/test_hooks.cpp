@@ -0,0 +1,498 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Per-frame work of the paint hooks against the number of windows.
+ * Every output mode, with and without the GLSL and layered paths, is
+ * painted at 16 to 1024 visible windows; the hook calls and the GL
+ * calls of a frame have to grow at most linearly with the visible
+ * windows and not at all with unmapped ones. Each screen counts its
+ * own frames.
+ *
+ * Toggled off, a frame has to pass every hook on to core once and do
+ * no GL, layout, index or grid work of its own; its time is reported
+ * against core painting the same windows without the plugin. */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "stereo3d.h"
+#include "mockcore.h"
+#include "glshim.h"
+#include "check.h"
+
+#define SCREEN_WIDTH  1920
+#define SCREEN_HEIGHT 1080
+
+#define WARMUP_FRAMES 300
+#define FRAMES        8
+
+// disabled frames timed against core alone, the fastest of the runs
+#define TIMED_FRAMES  50
+#define TIMED_RUNS    5
+
+static const int windowCounts[] = { 16, 64, 256, 1024 };
+
+#define N_COUNTS ARRAY_SIZE (windowCounts)
+
+typedef struct _FrameCounts
+{
+    // hook calls of the last frame, as counted until donePaintScreen
+    unsigned int  hooks[HookCounterCount];
+    unsigned long glCalls;
+} FrameCounts;
+
+typedef struct _Config
+{
+    int  outputMode;
+    bool glsl;
+    bool layered;
+} Config;
+
+static const char *counterNames[] = {
+    "preparePaintScreen", "paintOutput", "paintTransformedOutput",
+    "donePaintScreen", "paintWindow", "drawWindow", "drawWindowTexture",
+    "prepareFilter", "applyFilter", "cleanupFilter", "layout window",
+    "window index rebuild", "window grid lookup", "GL calls"
+};
+
+static DonePaintScreenProc pluginDonePaintScreen;
+static FrameCounts         lastFrame;
+
+/* Above the plugin in the wrap chain, so the counts are taken before
+ * the plugin's donePaintScreen resets them */
+static void
+testDonePaintScreen (CompScreen *s)
+{
+    STEREO3D_SCREEN (s);
+
+    memcpy (lastFrame.hooks, sos->hookCounters.frame, sizeof (lastFrame.hooks));
+
+    s->donePaintScreen = pluginDonePaintScreen;
+    (*s->donePaintScreen) (s);
+    pluginDonePaintScreen = s->donePaintScreen;
+    s->donePaintScreen = testDonePaintScreen;
+}
+
+/* Normal windows from the first to the last one, tiled over the
+ * screen; the last one gets the focus */
+static void
+addVisibleWindows (CompScreen *s, int first, int last)
+{
+    CompWindow *w = NULL;
+
+    for (int i = first; i < last; i++)
+	w = mockAddWindow (s, (i * 37) % (SCREEN_WIDTH - 300), (i * 53) % (SCREEN_HEIGHT - 250),
+			   300, 200, CompWindowTypeNormalMask, true);
+
+    if (w)
+	mockActivateWindow (w);
+}
+
+static void
+addHiddenWindows (CompScreen *s, int n)
+{
+    for (int i = 0; i < n; i++)
+	mockAddWindow (s, (i * 71) % SCREEN_WIDTH, (i * 29) % SCREEN_HEIGHT,
+		       300, 200, CompWindowTypeNormalMask, false);
+}
+
+static unsigned long
+countOf (const FrameCounts *counts, int counter)
+{
+    if (counter == HookGLCalls)
+	return counts->glCalls;
+
+    return counts->hooks[counter];
+}
+
+/* Hook and GL calls of a frame once the layout has settled */
+static FrameCounts
+measure (CompScreen *s, const Config *config, int nVisible)
+{
+    FrameCounts counts;
+
+    for (int frame = 0; frame < WARMUP_FRAMES; frame++)
+	mockPaintScreen (s, 16);
+
+    memset (&counts, 0, sizeof (counts));
+
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+	glShimReset ();
+	mockPaintScreen (s, 16);
+
+	lastFrame.glCalls = glShimTotal ();
+
+	// the frames of a still scene are the same
+	for (int counter = 0; frame && counter < HookCounterCount; counter++)
+	    CHECK (countOf (&lastFrame, counter) == countOf (&counts, counter),
+		   "mode %d: %s %lu in frame %d of %d windows, %lu in the one before",
+		   config->outputMode, counterNames[counter], countOf (&lastFrame, counter),
+		   frame, nVisible, countOf (&counts, counter));
+	counts = lastFrame;
+    }
+
+    return counts;
+}
+
+/* One session of the plugin, its window count growing from the first
+ * to the last of windowCounts like on a desktop in use */
+static void
+checkConfig (const Config *config)
+{
+    FrameCounts counts[N_COUNTS];
+    CompDisplay *d = mockInitDisplay (glShimGetProcAddress);
+    CompScreen  *s;
+    int         nVisible = 0, nHidden = 0;
+
+    mockClearLog ();
+
+    mockSetIntOption (d, "output_mode", config->outputMode);
+    mockSetBoolOption (d, "glsl", config->glsl);
+    mockSetBoolOption (d, "layered_stereo", config->layered);
+    mockSetBoolOption (d, "hook_stats", true);
+    mockSetBoolOption (d, "gl_call_stats", true);
+
+    s = mockAddScreen (d, SCREEN_WIDTH, SCREEN_HEIGHT);
+    mockAddWindow (s, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, CompWindowTypeDesktopMask, true);
+    mockAddWindow (s, 0, SCREEN_HEIGHT - 32, SCREEN_WIDTH, 32, CompWindowTypeDockMask, true);
+
+    pluginDonePaintScreen = s->donePaintScreen;
+    s->donePaintScreen = testDonePaintScreen;
+
+    for (unsigned int i = 0; i < N_COUNTS; i++)
+    {
+	FrameCounts hidden;
+
+	addVisibleWindows (s, nVisible, windowCounts[i]);
+	nVisible = windowCounts[i];
+
+	counts[i] = measure (s, config, nVisible);
+
+	// unmapped windows are not painted, laid out or looked up
+	addHiddenWindows (s, 3 * nVisible - nHidden);
+	nHidden = 3 * nVisible;
+
+	hidden = measure (s, config, nVisible);
+	for (int counter = 0; counter < HookCounterCount; counter++)
+	    CHECK (countOf (&hidden, counter) == countOf (&counts[i], counter),
+		   "mode %d glsl %d layered %d: %s %lu with %d unmapped windows, "
+		   "%lu without", config->outputMode, config->glsl, config->layered,
+		   counterNames[counter], countOf (&hidden, counter),
+		   nHidden, countOf (&counts[i], counter));
+    }
+
+    mockFiniDisplay (d);
+
+    for (int counter = 0; counter < HookCounterCount; counter++)
+    {
+	// a + b * n with a, b >= 0 is never more than 4 times a + b * n / 4
+	for (unsigned int i = 1; i < N_COUNTS; i++)
+	{
+	    unsigned long small = countOf (&counts[i - 1], counter);
+	    unsigned long large = countOf (&counts[i], counter);
+	    int           ratio = windowCounts[i] / windowCounts[i - 1];
+
+	    CHECK (large <= ratio * small,
+		   "mode %d glsl %d layered %d: %s grows from %lu at %d windows "
+		   "to %lu at %d", config->outputMode, config->glsl, config->layered,
+		   counterNames[counter], small, windowCounts[i - 1],
+		   large, windowCounts[i]);
+	}
+    }
+
+    // every visible window is painted, so the counts measure them
+    CHECK (countOf (&counts[N_COUNTS - 1], HookPaintWindow) >= (unsigned long) windowCounts[N_COUNTS - 1],
+	   "mode %d: %lu paintWindow calls for %d windows", config->outputMode,
+	   countOf (&counts[N_COUNTS - 1], HookPaintWindow), windowCounts[N_COUNTS - 1]);
+
+    CHECK (!mockCountLogMessages (CompLogLevelWarn, "grows faster than the window count"),
+	   "mode %d glsl %d layered %d: the plugin reported superlinear hook calls",
+	   config->outputMode, config->glsl, config->layered);
+
+    if (getenv ("STEREO3D_TEST_VERBOSE"))
+    {
+	for (int counter = 0; counter < HookCounterCount; counter++)
+	{
+	    printf ("mode %d glsl %d layered %d %-22s", config->outputMode,
+		    config->glsl, config->layered, counterNames[counter]);
+	    for (unsigned int i = 0; i < N_COUNTS; i++)
+		printf (" %8lu", countOf (&counts[i], counter));
+	    printf ("\n");
+	}
+    }
+}
+
+/* Bucket of the hook statistics the frames of a screen went into, -1
+ * when there are several or none */
+static int
+onlyBucket (CompScreen *s)
+{
+    int bucket = -1;
+
+    STEREO3D_SCREEN (s);
+
+    for (int b = 0; b < HOOK_STATS_BUCKETS; b++)
+    {
+	if (!sos->hookCounters.windows[b][HookPaintWindow])
+	    continue;
+	if (bucket >= 0)
+	    return -1;
+	bucket = b;
+    }
+
+    return bucket;
+}
+
+/* Two screens of different window counts painted in turn, each has to
+ * evaluate its own frames */
+static void
+checkScreens (void)
+{
+    CompDisplay *d = mockInitDisplay (glShimGetProcAddress);
+    CompScreen  *screens[2];
+    int         buckets[2];
+
+    mockClearLog ();
+    mockSetBoolOption (d, "hook_stats", true);
+
+    for (int i = 0; i < 2; i++)
+    {
+	screens[i] = mockAddScreen (d, SCREEN_WIDTH, SCREEN_HEIGHT);
+	mockAddWindow (screens[i], 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT,
+		       CompWindowTypeDesktopMask, true);
+	addVisibleWindows (screens[i], 0, windowCounts[2 * i]);
+    }
+
+    for (int frame = 0; frame < WARMUP_FRAMES; frame++)
+	for (int i = 0; i < 2; i++)
+	    mockPaintScreen (screens[i], 16);
+
+    for (int i = 0; i < 2; i++)
+    {
+	STEREO3D_SCREEN (screens[i]);
+
+	buckets[i] = onlyBucket (screens[i]);
+
+	CHECK (sos->hookCounters.frames >= WARMUP_FRAMES / 2,
+	       "screen %d: %u of %d frames evaluated", i, sos->hookCounters.frames,
+	       WARMUP_FRAMES);
+	CHECK (buckets[i] >= 0, "screen %d: frames counted at several window counts", i);
+    }
+
+    CHECK (buckets[0] != buckets[1],
+	   "%d and %d windows counted at the same window count", windowCounts[0],
+	   windowCounts[2]);
+
+    mockFiniDisplay (d);
+}
+
+static double
+nowMs (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/* The desktop, a dock and n visible windows */
+static CompScreen *
+addScreen (CompDisplay *d, int n)
+{
+    CompScreen *s = mockAddScreen (d, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    mockAddWindow (s, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, CompWindowTypeDesktopMask, true);
+    mockAddWindow (s, 0, SCREEN_HEIGHT - 32, SCREEN_WIDTH, 32, CompWindowTypeDockMask, true);
+    addVisibleWindows (s, 0, n);
+
+    return s;
+}
+
+/* ms per frame, the fastest of the runs */
+static double
+timeFrames (CompScreen *s)
+{
+    double best = 0.0;
+
+    for (int run = 0; run < TIMED_RUNS; run++)
+    {
+	double start = nowMs (), ms;
+
+	for (int frame = 0; frame < TIMED_FRAMES; frame++)
+	    mockPaintScreen (s, 16);
+
+	ms = (nowMs () - start) / TIMED_FRAMES;
+	if (!run || ms < best)
+	    best = ms;
+    }
+
+    return best;
+}
+
+static bool
+closedTrace (const char *path)
+{
+    char   tail[3] = { 0 };
+    FILE   *file = fopen (path, "r");
+    size_t n = 0;
+
+    if (!file)
+	return false;
+
+    if (!fseek (file, -2, SEEK_END))
+	n = fread (tail, 1, 2, file);
+    fclose (file);
+
+    return n == 2 && !strcmp (tail, "]\n");
+}
+
+/* Stereo toggled off with the most windows, against core without the
+ * plugin */
+static void
+checkDisabled (void)
+{
+    static const char *forwarded[] = {
+	"preparePaintScreen", "paintOutput", "paintTransformedOutput",
+	"donePaintScreen", "paintWindow", "drawWindow", "drawWindowTexture"
+    };
+    int           n = windowCounts[N_COUNTS - 1];
+    CompDisplay   *d;
+    CompScreen    *s;
+    MockCoreCalls bare, core;
+    unsigned long bareGL, gl;
+    double        bareMs, disabledMs;
+    char          trace[64], shm[64];
+    unsigned int  before[HookCounterCount], hookCalls;
+    int           fd;
+
+    d = mockInitBareDisplay (glShimGetProcAddress);
+    s = addScreen (d, n);
+
+    mockPaintScreen (s, 16);
+    mockTakeCoreCalls (&bare);
+    glShimReset ();
+    mockPaintScreen (s, 16);
+    bareGL = glShimTotal ();
+    mockTakeCoreCalls (&bare);
+
+    bareMs = timeFrames (s);
+    mockFiniDisplay (d);
+
+    snprintf (trace, sizeof (trace), "/tmp/stereo3d-hooks-%d.json", (int) getpid ());
+    snprintf (shm, sizeof (shm), "/stereo3d-hooks-%d", (int) getpid ());
+
+    d = mockInitDisplay (glShimGetProcAddress);
+    mockSetBoolOption (d, "hook_stats", true);
+    mockSetOption (d, "trace_file", trace);
+    mockSetOption (d, "export_shm", shm);
+    s = addScreen (d, n);
+
+    for (int frame = 0; frame < WARMUP_FRAMES; frame++)
+	mockPaintScreen (s, 16);
+
+    CHECK (mockInitiateAction (d, "toggle", s), "toggle not bound");
+
+    // the trace is complete and the ring gone without another frame
+    CHECK (closedTrace (trace), "%s left open when stereo was toggled off", trace);
+    fd = shm_open (shm, O_RDONLY, 0);
+    CHECK (fd < 0, "%s still exported when stereo was toggled off", shm);
+    if (fd >= 0)
+	close (fd);
+    unlink (trace);
+    shm_unlink (shm);
+
+    // core sets the texture filters back from the mipmapped ones once
+    mockPaintScreen (s, 16);
+
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+	STEREO3D_SCREEN (s);
+
+	// the pointer moving over the windows is not looked up either
+	mockMovePointer (s, 100 + frame * 150, 100 + frame * 90);
+
+	memcpy (before, sos->hookCounters.frame, sizeof (before));
+	mockTakeCoreCalls (&core);
+	glShimReset ();
+	mockPaintScreen (s, 16);
+	gl = glShimTotal ();
+	mockTakeCoreCalls (&core);
+
+	CHECK (gl == bareGL, "disabled frame %d: %lu GL calls, core alone makes %lu",
+	       frame, gl, bareGL);
+
+	for (int hook = 0; hook < (int) ARRAY_SIZE (forwarded); hook++)
+	{
+	    unsigned int plugin = sos->hookCounters.frame[hook] - before[hook];
+	    unsigned int reached = ((unsigned int *) &core)[hook];
+	    unsigned int alone = ((unsigned int *) &bare)[hook];
+
+	    CHECK (plugin == reached && reached == alone,
+		   "disabled frame %d: %u %s calls, %u forwarded to core, %u without the plugin",
+		   frame, plugin, forwarded[hook], reached, alone);
+	}
+
+	for (int counter = HookPrepareFilter; counter < HookGLCalls; counter++)
+	    CHECK (sos->hookCounters.frame[counter] == before[counter],
+		   "disabled frame %d: %u %s", frame,
+		   sos->hookCounters.frame[counter] - before[counter], counterNames[counter]);
+    }
+
+    disabledMs = timeFrames (s);
+    mockFiniDisplay (d);
+
+    hookCalls = bare.preparePaintScreen + bare.paintOutput + bare.paintTransformedOutput +
+		bare.donePaintScreen + bare.paintWindow + bare.drawWindow + bare.drawWindowTexture;
+
+    printf ("%d windows, ms per frame: core alone %.3f, stereo toggled off %.3f, "
+	    "%.1f ns more for each of %u hook calls\n", n, bareMs, disabledMs,
+	    (disabledMs - bareMs) * 1000000.0 / hookCalls, hookCalls);
+}
+
+int
+main (int argc, char **argv)
+{
+    for (int mode = 0; mode <= 4; mode++)
+    {
+	for (int variant = 0; variant < 3; variant++)
+	{
+	    Config config;
+
+	    // the layered path needs GLSL, the lenticular one always has it
+	    config.outputMode = mode;
+	    config.glsl = variant > 0;
+	    config.layered = variant > 1;
+
+	    if (mode == 4 && variant != 1)
+		continue;
+	    if (config.layered && (mode < 1 || mode > 3))
+		continue;
+
+	    checkConfig (&config);
+	}
+    }
+
+    checkScreens ();
+    checkDisabled ();
+
+    if (failures)
+	fprintf (stderr, "%d checks failed\n", failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The start of the cursor latency measurements of latency.cpp. With
+ * XInput2 a measurement has to start at the server time of the first
+ * raw motion towards the new position, however late the event arrives
+ * or the position is queried; with mousepoll it starts when the
+ * position arrives. The mock frames take no time, so all the latency a
+ * measurement sees is the lateness of the events. The pointer moves
+ * further than the easing covers in a frame, so every measurement takes
+ * more than one. The late-latched cursor has to be drawn where the
+ * pointer is at the frame, without a synchronous query of the server.
+ * tests/latency-harness.sh measures the real thing under Xvfb. */
+
+#include <string.h>
+#include <sys/time.h>
+
+#include "stereo3d.h"
+#include "mockcore.h"
+#include "glshim.h"
+#include "check.h"
+
+#define SCREEN_WIDTH  1920
+#define SCREEN_HEIGHT 1080
+
+#define SETTLE_FRAMES 60
+
+// the raw motion arrives this late
+#define LATE_MS 40
+
+// the server clock started this long before ours, its times are
+// unrelated to the local ones
+#define SERVER_START_MS 123456789
+
+static Time
+serverTime (void)
+{
+    struct timeval now;
+
+    gettimeofday (&now, 0);
+
+    return (Time) ((now.tv_sec * 1000 + now.tv_usec / 1000) % 86400000) + SERVER_START_MS;
+}
+
+static void
+settle (CompScreen *s)
+{
+    for (int i = 0; i < SETTLE_FRAMES; i++)
+	mockPaintScreen (s, 16);
+}
+
+static LatencyDistribution *
+eased (CompScreen *s, int source)
+{
+    STEREO3D_SCREEN (s);
+
+    return &sos->latency.distributions[source][0];
+}
+
+static void
+checkXInput2 (CompDisplay *d, CompScreen *s)
+{
+    LatencyDistribution *ld = eased (s, PSXINPUT2);
+    Time                late;
+
+    // arriving on time relates the server clock to ours
+    mockRawMotion (s, 100, 100, serverTime ());
+    settle (s);
+
+    CHECK (ld->count == 1 && ld->maxUs < LATE_MS * 1000,
+	   "%u measurements, slowest %ld us after events on time", ld->count, ld->maxUs);
+
+    // the position queried after the second motion is dated from the
+    // first one
+    late = serverTime () - LATE_MS;
+    mockRawMotion (s, 900, 500, late);
+    mockRawMotion (s, 1500, 700, late + LATE_MS);
+    settle (s);
+
+    CHECK (ld->count == 2 && ld->maxUs >= LATE_MS * 1000 && ld->maxUs < 1000000,
+	   "%u measurements, slowest %ld us with a motion %d ms late", ld->count,
+	   ld->maxUs, LATE_MS);
+    CHECK (ld->frames > 2, "%lu frames for both measurements", ld->frames);
+    CHECK (ld->eyeCount[EyeLeft] == 2 && ld->eyeCount[EyeRight] == 2,
+	   "the eyes reached the cursor %u and %u times", ld->eyeCount[EyeLeft],
+	   ld->eyeCount[EyeRight]);
+
+    // a server restart gives a clock far ahead, taken from then on
+    mockRawMotion (s, 300, 300, serverTime () + 3600000);
+    settle (s);
+
+    CHECK (ld->count == 3 && ld->maxUs < 1000000,
+	   "%u measurements, slowest %ld us across a server restart", ld->count, ld->maxUs);
+}
+
+static void
+checkMousepoll (CompDisplay *d, CompScreen *s)
+{
+    LatencyDistribution *ld = eased (s, PSMOUSEPOLL);
+
+    mockMovePointer (s, 700, 200);
+    settle (s);
+
+    CHECK (ld->count == 1 && ld->maxUs < LATE_MS * 1000,
+	   "%u measurements, slowest %ld us with the position arriving now",
+	   ld->count, ld->maxUs);
+}
+
+static void
+checkLateLatch (CompDisplay *d, CompScreen *s)
+{
+    unsigned int queries;
+
+    STEREO3D_SCREEN (s);
+
+    mockSetBoolOption (d, "late_latch_cursor", true);
+    settle (s);
+
+    // the pointer moves without telling the plugin
+    xstubSetPointer (1200, 640);
+    queries = xstubGetPointerQueries ();
+    mockPaintScreen (s, 16);
+
+    CHECK (sos->latchedFrame == sos->frameCount &&
+	   sos->latchedMouseX == 1200 && sos->latchedMouseY == 640,
+	   "cursor latched at %.0f, %.0f in frame %u of %u", sos->latchedMouseX,
+	   sos->latchedMouseY, sos->latchedFrame, sos->frameCount);
+    CHECK (xstubGetPointerQueries () == queries,
+	   "%u XQueryPointer round trips in a late-latched frame",
+	   xstubGetPointerQueries () - queries);
+
+    mockSetBoolOption (d, "late_latch_cursor", false);
+}
+
+int
+main (int argc, char **argv)
+{
+    CompDisplay *d;
+    CompScreen  *s;
+
+    xstubSetXInput2 (true);
+
+    d = mockInitDisplay (glShimGetProcAddress);
+    mockSetBoolOption (d, "drawMouse", true);
+    mockSetBoolOption (d, "latency_stats", true);
+    mockSetIntOption (d, "pointer_source", 1);
+
+    s = mockAddScreen (d, SCREEN_WIDTH, SCREEN_HEIGHT);
+    mockAddWindow (s, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, CompWindowTypeDesktopMask, true);
+    mockAddWindow (s, 200, 150, 800, 600, CompWindowTypeNormalMask, true);
+
+    settle (s);
+    checkXInput2 (d, s);
+
+    mockSetIntOption (d, "pointer_source", 0);
+    settle (s);
+    checkMousepoll (d, s);
+    checkLateLatch (d, s);
+
+    mockFiniDisplay (d);
+
+    if (failures)
+	fprintf (stderr, "%d checks failed\n", failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The layout worker of layoutworker.cpp with thousands of windows, laid
+ * out once on the compositor thread and once on the worker:
+ *
+ * - the foreground moves in and out, every window is placed again and
+ *   eased on every frame it moves
+ * - windows are raised, focused, opened and closed, the window index is
+ *   rebuilt on the compositor thread after each
+ * - the worker is switched off and on again while the windows settle
+ *
+ * Once settled both have to leave every window in the same place with
+ * the same lighting. The preparePaintScreen time of each phase, on the
+ * compositor thread's CPU clock, is reported. With the foreground moving
+ * the worker has to take time off the thread, at the most windows at
+ * least half of it. The most windows are also laid out grouped by
+ * application, where the windows of each application have to settle at
+ * one depth of their own. */
+
+#include <string.h>
+#include <time.h>
+
+#include "stereo3d.h"
+#include "mockcore.h"
+#include "glshim.h"
+#include "check.h"
+
+#define SCREEN_WIDTH  1920
+#define SCREEN_HEIGHT 1080
+
+#define PHASE_FRAMES  120
+#define SETTLE_FRAMES 300
+
+// the foreground steps in or out every this many frames
+#define FOREGROUND_INTERVAL 10
+// a window raised and focused every this many frames, one closed and
+// opened every CHURN_INTERVAL frames
+#define RAISE_INTERVAL 8
+#define CHURN_INTERVAL 24
+
+// client leaders of the windows laid out grouped by application, ids
+// above those mockAddWindow hands out
+#define APPLICATIONS     64
+#define APPLICATION_BASE 0x1000000
+
+typedef struct _Run
+{
+    int  windows;
+    int  strategy;
+    bool most;
+} Run;
+
+static const Run runs[] = {
+    { 1000, LayoutStackLinear, false },
+    { 4000, LayoutStackLinear, true },
+    { 4000, LayoutAppGroups,   true }
+};
+
+#define N_RUNS ARRAY_SIZE (runs)
+
+typedef struct _WindowState
+{
+    float z;
+    float brightness;
+    float saturation;
+    float opacity;
+    bool  drawMouse;
+} WindowState;
+
+// average preparePaintScreen ms of the frames of each phase
+typedef struct _PhaseTimes
+{
+    double foreground;
+    double restack;
+} PhaseTimes;
+
+static PreparePaintScreenProc pluginPreparePaintScreen;
+static double                 prepareMs;
+
+static double
+threadCpuMs (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/* Above the plugin in the wrap chain, timing its preparePaintScreen */
+static void
+testPreparePaintScreen (CompScreen *s,
+			int        ms)
+{
+    double start = threadCpuMs ();
+
+    s->preparePaintScreen = pluginPreparePaintScreen;
+    (*s->preparePaintScreen) (s, ms);
+    pluginPreparePaintScreen = s->preparePaintScreen;
+    s->preparePaintScreen = testPreparePaintScreen;
+
+    prepareMs += threadCpuMs () - start;
+}
+
+/* Window placed by position, of the application of window index */
+static CompWindow *
+addWindow (CompScreen *s, int position, int index)
+{
+    CompWindow *w = mockAddWindow (s, (position * 37) % (SCREEN_WIDTH - 300),
+				   (position * 53) % (SCREEN_HEIGHT - 250),
+				   300, 200, CompWindowTypeNormalMask, true);
+
+    w->clientLeader = APPLICATION_BASE + index % APPLICATIONS;
+
+    return w;
+}
+
+/* Lays out n windows through the phases, leaving the settled state of
+ * the windows in states */
+static PhaseTimes
+runLayout (int n, int strategy, bool thread, WindowState *states)
+{
+    CompDisplay *d = mockInitDisplay (glShimGetProcAddress);
+    CompScreen  *s;
+    CompWindow  **windows = (CompWindow **) malloc (n * sizeof (CompWindow *));
+    PhaseTimes  times;
+
+    mockSetBoolOption (d, "layout_thread", thread);
+    mockSetIntOption (d, "layout_strategy", strategy);
+
+    s = mockAddScreen (d, SCREEN_WIDTH, SCREEN_HEIGHT);
+    mockAddWindow (s, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, CompWindowTypeDesktopMask, true);
+    mockAddWindow (s, 0, 0, SCREEN_WIDTH, 24, CompWindowTypeDockMask, true);
+
+    for (int i = 0; i < n; i++)
+	windows[i] = addWindow (s, i, i);
+
+    pluginPreparePaintScreen = s->preparePaintScreen;
+    s->preparePaintScreen = testPreparePaintScreen;
+
+    // windows from the start to the end of the layout
+    for (int i = 0; i < SETTLE_FRAMES; i++)
+	mockPaintScreen (s, 16);
+
+    prepareMs = 0.0;
+
+    for (int i = 0; i < PHASE_FRAMES; i++)
+    {
+	if (i % FOREGROUND_INTERVAL == 0)
+	    mockInitiateAction (d, i < PHASE_FRAMES / 2 ? "move_foreground_in_button" :
+				"move_foreground_out_button", s);
+
+	mockPaintScreen (s, 16);
+    }
+
+    times.foreground = prepareMs / PHASE_FRAMES;
+    prepareMs = 0.0;
+
+    for (int i = 0; i < PHASE_FRAMES; i++)
+    {
+	mockMovePointer (s, (i * 13) % SCREEN_WIDTH, (i * 7) % SCREEN_HEIGHT);
+
+	if (i % RAISE_INTERVAL == 0)
+	{
+	    CompWindow *w = windows[(i * 7919) % n];
+
+	    mockRaiseWindow (w);
+	    mockActivateWindow (w);
+	}
+
+	// a closed window's slot goes to the next one opened, of the same
+	// application
+	if (i % CHURN_INTERVAL == 0)
+	{
+	    int replaced = (i * 31) % n;
+
+	    mockRemoveWindow (windows[replaced]);
+	    windows[replaced] = addWindow (s, replaced + i, replaced);
+	}
+
+	mockPaintScreen (s, 16);
+    }
+
+    times.restack = prepareMs / PHASE_FRAMES;
+
+    for (int i = 0; i < SETTLE_FRAMES; i++)
+    {
+	// back on the compositor thread for a while and over to the worker
+	if (thread && i == 3)
+	    mockSetBoolOption (d, "layout_thread", false);
+	if (thread && i == 8)
+	    mockSetBoolOption (d, "layout_thread", true);
+
+	mockPaintScreen (s, 16);
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+	STEREO3D_WINDOW (windows[i]);
+
+	states[i].z = sow->currAttrs.translation.z;
+	states[i].brightness = sow->brightness;
+	states[i].saturation = sow->saturation;
+	states[i].opacity = sow->opacity;
+	states[i].drawMouse = sow->drawMouse;
+    }
+
+    s->preparePaintScreen = pluginPreparePaintScreen;
+    mockFiniDisplay (d);
+    free (windows);
+
+    return times;
+}
+
+static double
+saved (double before, double after)
+{
+    return before > 0.0 ? 100.0 * (before - after) / before : 0.0;
+}
+
+/* Windows of one application at one depth, each application at its own,
+ * returns the number of applications breaking that */
+static int
+countSplitApplications (int n, const WindowState *states)
+{
+    float depths[APPLICATIONS];
+    int   split = 0;
+
+    for (int app = 0; app < APPLICATIONS; app++)
+    {
+	depths[app] = states[app].z;
+
+	for (int i = app; i < n; i += APPLICATIONS)
+	    if (fabsf (states[i].z - depths[app]) > 1e-5f)
+	    {
+		split++;
+		break;
+	    }
+
+	for (int other = 0; other < app; other++)
+	    if (fabsf (depths[other] - depths[app]) <= 1e-5f)
+	    {
+		split++;
+		break;
+	    }
+    }
+
+    return split;
+}
+
+static void
+checkRun (const Run *run)
+{
+    int         n = run->windows;
+    WindowState *syncStates = (WindowState *) malloc (n * sizeof (WindowState));
+    WindowState *threadStates = (WindowState *) malloc (n * sizeof (WindowState));
+    PhaseTimes  sync, thread;
+    int         differing = 0, cursors = 0;
+    const char  *name = getLayoutStrategyName (run->strategy);
+
+    sync = runLayout (n, run->strategy, false, syncStates);
+    thread = runLayout (n, run->strategy, true, threadStates);
+
+    for (int i = 0; i < n; i++)
+    {
+	WindowState *a = &syncStates[i], *b = &threadStates[i];
+
+	if (fabsf (a->z - b->z) > 1e-5f || fabsf (a->brightness - b->brightness) > 1e-5f ||
+	    fabsf (a->saturation - b->saturation) > 1e-5f || a->opacity != b->opacity ||
+	    a->drawMouse != b->drawMouse)
+	{
+	    if (!differing)
+		fprintf (stderr, "window %d: z %f / %f, brightness %f / %f, cursor %d / %d\n",
+			 i, a->z, b->z, a->brightness, b->brightness, a->drawMouse, b->drawMouse);
+	    differing++;
+	}
+
+	cursors += b->drawMouse;
+    }
+
+    CHECK (differing == 0, "%d windows %s: %d windows laid out differently on the worker",
+	   n, name, differing);
+    CHECK (cursors == 1, "%d windows %s: the cursor is hooked to %d windows", n, name, cursors);
+
+    if (run->strategy == LayoutAppGroups)
+    {
+	int split = countSplitApplications (n, syncStates);
+
+	CHECK (split == 0, "%d windows: %d applications not at a depth of their own", n, split);
+    }
+
+    printf ("%5d windows %s, preparePaintScreen on the compositor thread, without and "
+	    "with the layout worker:\n"
+	    "      foreground moving %.3f ms, %.3f ms (%.0f%% saved)\n"
+	    "      windows restacked %.3f ms, %.3f ms (%.0f%% saved)\n",
+	    n, name, sync.foreground, thread.foreground,
+	    saved (sync.foreground, thread.foreground),
+	    sync.restack, thread.restack, saved (sync.restack, thread.restack));
+
+    CHECK (thread.foreground < (run->most ? sync.foreground / 2 : sync.foreground),
+	   "%d windows %s: the layout worker saves too little compositor time", n, name);
+
+    free (syncStates);
+    free (threadStates);
+}
+
+int
+main (int argc, char **argv)
+{
+    for (unsigned int i = 0; i < N_RUNS; i++)
+	checkRun (&runs[i]);
+
+    if (failures)
+	fprintf (stderr, "%d checks failed\n", failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* The Xlib, XInput2, XFixes and xcb calls of the plugin, answered from
+ * state the tests set instead of a server. The cursor image and pointer
+ * requests are answered on the first poll for them. */
+
+#include <string.h>
+
+#include <X11/Xlib-xcb.h>
+#include <X11/extensions/XInput2.h>
+#include <xcb/xcbext.h>
+#include <xcb/xfixes.h>
+
+#include "mockcore.h"
+
+static int  pointerX, pointerY;
+static bool xinput2;
+static Time rawEventTime;
+static int  cursorWidth = 16, cursorHeight = 16;
+static unsigned int pointerQueries;
+
+void
+xstubSetPointer (int x, int y)
+{
+    pointerX = x;
+    pointerY = y;
+}
+
+void
+xstubSetXInput2 (bool available)
+{
+    xinput2 = available;
+}
+
+void
+xstubSetRawEventTime (Time time)
+{
+    rawEventTime = time;
+}
+
+unsigned int
+xstubGetPointerQueries (void)
+{
+    return pointerQueries;
+}
+
+void
+xstubSetCursorImage (int width, int height)
+{
+    cursorWidth = width;
+    cursorHeight = height;
+}
+
+extern "C" {
+
+Bool
+XQueryPointer (Display      *display,
+	       Window       w,
+	       Window       *root,
+	       Window       *child,
+	       int          *rootX,
+	       int          *rootY,
+	       int          *winX,
+	       int          *winY,
+	       unsigned int *mask)
+{
+    pointerQueries++;
+
+    *root = w;
+    *child = None;
+    *rootX = *winX = pointerX;
+    *rootY = *winY = pointerY;
+    *mask = 0;
+
+    return True;
+}
+
+Atom
+XInternAtom (Display *display, const char *name, Bool onlyIfExists)
+{
+    Atom atom = 1;
+
+    // stable and distinct enough for the few atoms of the plugin
+    while (*name)
+	atom = atom * 31 + (unsigned char) *name++;
+
+    return (atom & 0xffffff) | 0x1000;
+}
+
+Status
+XInternAtoms (Display *display, char **names, int count, Bool onlyIfExists, Atom *atoms)
+{
+    for (int i = 0; i < count; i++)
+	atoms[i] = XInternAtom (display, names[i], onlyIfExists);
+
+    return 1;
+}
+
+Bool
+XQueryExtension (Display    *display,
+		 const char *name,
+		 int        *majorOpcode,
+		 int        *firstEvent,
+		 int        *firstError)
+{
+    if (strcmp (name, "XInputExtension") || !xinput2)
+	return False;
+
+    *majorOpcode = XSTUB_XI_OPCODE;
+    *firstEvent = 0;
+    *firstError = 0;
+
+    return True;
+}
+
+Status
+XIQueryVersion (Display *display, int *major, int *minor)
+{
+    return xinput2 ? Success : BadRequest;
+}
+
+int
+XISelectEvents (Display *display, Window win, XIEventMask *masks, int numMasks)
+{
+    return Success;
+}
+
+// the data of the raw motion event sent last, claimed at most once
+Bool
+XGetEventData (Display *display, XGenericEventCookie *cookie)
+{
+    XIRawEvent *raw;
+
+    if (cookie->extension != XSTUB_XI_OPCODE || !cookie->cookie)
+	return False;
+
+    raw = (XIRawEvent *) calloc (1, sizeof (XIRawEvent));
+    raw->type = GenericEvent;
+    raw->extension = cookie->extension;
+    raw->evtype = cookie->evtype;
+    raw->time = rawEventTime;
+
+    cookie->data = raw;
+    cookie->cookie = 0;
+
+    return True;
+}
+
+void
+XFreeEventData (Display *display, XGenericEventCookie *cookie)
+{
+    free (cookie->data);
+    cookie->data = NULL;
+}
+
+void
+XFixesHideCursor (Display *display, Window win)
+{
+}
+
+void
+XFixesShowCursor (Display *display, Window win)
+{
+}
+
+int
+XChangeProperty (Display             *display,
+		 Window              w,
+		 Atom                property,
+		 Atom                type,
+		 int                 format,
+		 int                 mode,
+		 const unsigned char *data,
+		 int                 nElements)
+{
+    return Success;
+}
+
+int
+XDeleteProperty (Display *display, Window w, Atom property)
+{
+    return Success;
+}
+
+xcb_connection_t *
+XGetXCBConnection (Display *display)
+{
+    // never dereferenced, the xcb calls below ignore it
+    return (xcb_connection_t *) display;
+}
+
+static unsigned int lastSequence, pointerSequence;
+
+xcb_xfixes_get_cursor_image_cookie_t
+xcb_xfixes_get_cursor_image (xcb_connection_t *c)
+{
+    xcb_xfixes_get_cursor_image_cookie_t cookie;
+
+    cookie.sequence = ++lastSequence;
+
+    return cookie;
+}
+
+xcb_query_pointer_cookie_t
+xcb_query_pointer (xcb_connection_t *c, xcb_window_t window)
+{
+    xcb_query_pointer_cookie_t cookie;
+
+    cookie.sequence = pointerSequence = ++lastSequence;
+
+    return cookie;
+}
+
+static void *
+queryPointerReply (void)
+{
+    xcb_query_pointer_reply_t *qp;
+
+    qp = (xcb_query_pointer_reply_t *) calloc (1, sizeof (*qp));
+    qp->same_screen = 1;
+    qp->root_x = qp->win_x = pointerX;
+    qp->root_y = qp->win_y = pointerY;
+
+    return qp;
+}
+
+uint32_t *
+xcb_xfixes_get_cursor_image_cursor_image (const xcb_xfixes_get_cursor_image_reply_t *reply)
+{
+    return (uint32_t *) (reply + 1);
+}
+
+int
+xcb_poll_for_reply (xcb_connection_t     *c,
+		    unsigned int         request,
+		    void                 **reply,
+		    xcb_generic_error_t  **error)
+{
+    xcb_xfixes_get_cursor_image_reply_t *ci;
+    size_t                              size;
+
+    *error = NULL;
+
+    if (request == pointerSequence)
+    {
+	*reply = queryPointerReply ();
+	return 1;
+    }
+
+    size = sizeof (*ci) + (size_t) cursorWidth * cursorHeight * 4;
+    ci = (xcb_xfixes_get_cursor_image_reply_t *) calloc (1, size);
+
+    ci->x = pointerX;
+    ci->y = pointerY;
+    ci->width = cursorWidth;
+    ci->height = cursorHeight;
+
+    // opaque white arrow-sized block
+    memset (xcb_xfixes_get_cursor_image_cursor_image (ci), 0xff,
+	    (size_t) cursorWidth * cursorHeight * 4);
+
+    *reply = ci;
+    *error = NULL;
+
+    return 1;
+}
+
+void
+xcb_discard_reply (xcb_connection_t *c, unsigned int sequence)
+{
+}
+
+int
+xcb_flush (xcb_connection_t *c)
+{
+    return 1;
+}
+
+}
@@ -0,0 +1,139 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Begin/end events in the Chrome trace event format. Events are
+ * formatted into a buffer that is written out only when it fills up,
+ * so tracing a frame costs a few snprintf calls and no syscalls. */
+
+#include "stereo3d.h"
+
+#include <unistd.h>
+
+#define TRACE_BUFFER_SIZE (1 << 18)
+// longest event, flush before an event could overflow the buffer
+#define TRACE_EVENT_MAX   256
+
+static const char *eyeNames[] = {
+    "left",
+    "right",
+    "single",
+    "both"
+};
+
+static void
+flushTrace (TraceWriter *tw)
+{
+    if (tw->used)
+	fwrite (tw->buffer, 1, tw->used, tw->file);
+    tw->used = 0;
+}
+
+static bool
+startTracing (TraceWriter *tw, const char *path)
+{
+    tw->buffer = (char *) malloc (TRACE_BUFFER_SIZE);
+    tw->file = tw->buffer ? fopen (path, "w") : NULL;
+
+    if (!tw->file)
+    {
+	compLogMessage ("stereo3d", CompLogLevelWarn,
+			"unable to open %s for tracing", path);
+	free (tw->buffer);
+	tw->buffer = NULL;
+	tw->failed = true;
+	return false;
+    }
+
+    tw->used = snprintf (tw->buffer, TRACE_BUFFER_SIZE, "[");
+    tw->pid = getpid ();
+    tw->nEvents = 0;
+
+    compLogMessage ("stereo3d", CompLogLevelInfo, "tracing to %s", path);
+
+    return true;
+}
+
+void
+stopTracing (TraceWriter *tw)
+{
+    if (!tw->file)
+	return;
+
+    tw->used += snprintf (tw->buffer + tw->used, TRACE_BUFFER_SIZE - tw->used, "\n]\n");
+    flushTrace (tw);
+
+    fclose (tw->file);
+    tw->file = NULL;
+
+    free (tw->buffer);
+    tw->buffer = NULL;
+
+    compLogMessage ("stereo3d", CompLogLevelInfo, "traced %lu events", tw->nEvents);
+}
+
+/* Opens or closes the trace following the trace_file option, called at
+ * the start of every frame */
+void
+updateTracing (CompScreen *s, TraceWriter *tw)
+{
+    const char *path = stereo3dGetTraceFile (s->display);
+
+    if (!path || !*path)
+    {
+	stopTracing (tw);
+	tw->failed = false;
+	return;
+    }
+
+    if (!tw->file && !tw->failed)
+	startTracing (tw, path);
+}
+
+/* id and eye are added as args when set, eye is a DrawingType or -1 */
+void
+traceEvent (TraceWriter *tw, char phase, const char *name, Window id, int eye)
+{
+    struct timeval tv;
+    char           *out;
+    int            left;
+
+    if (tw->used + TRACE_EVENT_MAX > TRACE_BUFFER_SIZE)
+	flushTrace (tw);
+
+    gettimeofday (&tv, 0);
+
+    out = tw->buffer + tw->used;
+    left = TRACE_BUFFER_SIZE - tw->used;
+
+    tw->used += snprintf (out, left,
+			  "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":1,\"ts\":%ld%06ld",
+			  tw->nEvents ? "," : "", name, phase, tw->pid, (long) tv.tv_sec, (long) tv.tv_usec);
+
+    if (id || (eye >= 0 && eye <= EyeBoth))
+    {
+	out = tw->buffer + tw->used;
+	left = TRACE_BUFFER_SIZE - tw->used;
+
+	if (id && eye >= 0 && eye <= EyeBoth)
+	    tw->used += snprintf (out, left, ",\"args\":{\"window\":\"0x%lx\",\"eye\":\"%s\"}",
+				  id, eyeNames[eye]);
+	else if (id)
+	    tw->used += snprintf (out, left, ",\"args\":{\"window\":\"0x%lx\"}", id);
+	else
+	    tw->used += snprintf (out, left, ",\"args\":{\"eye\":\"%s\"}", eyeNames[eye]);
+    }
+
+    tw->used += snprintf (tw->buffer + tw->used, TRACE_BUFFER_SIZE - tw->used, "}");
+
+    tw->nEvents++;
+}
@@ -0,0 +1,205 @@
+/**
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ **/
+
+/* Uniform grid over the screen used to find the window under the
+ * pointer. Every cell lists the layout windows whose frame overlaps it,
+ * topmost first, so a lookup only tests the few windows of one cell.
+ * Windows are inserted when the window index is rebuilt and moved
+ * between cells from the move and resize notifications. */
+
+#include "stereo3d.h"
+
+static void
+getCellRange (WindowGrid *grid, CompWindow *w, BoxRec *cells)
+{
+    int x1 = WIN_X (w) / WINDOW_GRID_CELL_SIZE;
+    int y1 = WIN_Y (w) / WINDOW_GRID_CELL_SIZE;
+    int x2 = (WIN_X (w) + WIN_W (w) - 1) / WINDOW_GRID_CELL_SIZE;
+    int y2 = (WIN_Y (w) + WIN_H (w) - 1) / WINDOW_GRID_CELL_SIZE;
+
+    // windows partly off screen land in the border cells
+    cells->x1 = x1 < 0 ? 0 : (x1 >= grid->cols ? grid->cols - 1 : x1);
+    cells->y1 = y1 < 0 ? 0 : (y1 >= grid->rows ? grid->rows - 1 : y1);
+    cells->x2 = x2 < 0 ? 0 : (x2 >= grid->cols ? grid->cols - 1 : x2);
+    cells->y2 = y2 < 0 ? 0 : (y2 >= grid->rows ? grid->rows - 1 : y2);
+}
+
+static bool
+insertIntoCell (WindowGridCell *cell, Stereo3DWindow *sow)
+{
+    int i;
+
+    if (cell->nWindows == cell->size)
+    {
+	int            size = cell->size ? cell->size * 2 : 4;
+	Stereo3DWindow **windows;
+
+	windows = (Stereo3DWindow **) realloc (cell->windows, size * sizeof (Stereo3DWindow *));
+	if (!windows)
+	    return false;
+
+	cell->windows = windows;
+	cell->size = size;
+    }
+
+    // topmost first, inserting top to bottom only ever appends
+    for (i = cell->nWindows; i > 0; i--)
+    {
+	if (cell->windows[i - 1]->stackPosition > sow->stackPosition)
+	    break;
+	cell->windows[i] = cell->windows[i - 1];
+    }
+
+    cell->windows[i] = sow;
+    cell->nWindows++;
+
+    return true;
+}
+
+static void
+removeFromCell (WindowGridCell *cell, Stereo3DWindow *sow)
+{
+    int i;
+
+    for (i = 0; i < cell->nWindows; i++)
+    {
+	if (cell->windows[i] == sow)
+	{
+	    memmove (cell->windows + i, cell->windows + i + 1,
+		     (cell->nWindows - i - 1) * sizeof (Stereo3DWindow *));
+	    cell->nWindows--;
+	    return;
+	}
+    }
+}
+
+/* Empties the grid and sizes it for a screen of width x height */
+bool
+resetWindowGrid (WindowGrid *grid, int width, int height)
+{
+    int cols = (width + WINDOW_GRID_CELL_SIZE - 1) / WINDOW_GRID_CELL_SIZE;
+    int rows = (height + WINDOW_GRID_CELL_SIZE - 1) / WINDOW_GRID_CELL_SIZE;
+    int i;
+
+    if (cols < 1)
+	cols = 1;
+    if (rows < 1)
+	rows = 1;
+
+    if (cols != grid->cols || rows != grid->rows)
+    {
+	finiWindowGrid (grid);
+
+	grid->cells = (WindowGridCell *) calloc (cols * rows, sizeof (WindowGridCell));
+	if (!grid->cells)
+	    return false;
+
+	grid->cols = cols;
+	grid->rows = rows;
+    }
+
+    for (i = 0; i < grid->cols * grid->rows; i++)
+	grid->cells[i].nWindows = 0;
+
+    return true;
+}
+
+void
+finiWindowGrid (WindowGrid *grid)
+{
+    int i;
+
+    if (grid->cells)
+    {
+	for (i = 0; i < grid->cols * grid->rows; i++)
+	    free (grid->cells[i].windows);
+	free (grid->cells);
+    }
+
+    grid->cells = NULL;
+    grid->cols = 0;
+    grid->rows = 0;
+}
+
+void
+insertGridWindow (WindowGrid *grid, Stereo3DWindow *sow)
+{
+    int x, y;
+
+    if (!grid->cells)
+	return;
+
+    getCellRange (grid, sow->window, &sow->gridCells);
+
+    for (y = sow->gridCells.y1; y <= sow->gridCells.y2; y++)
+    {
+	for (x = sow->gridCells.x1; x <= sow->gridCells.x2; x++)
+	{
+	    if (!insertIntoCell (&grid->cells[y * grid->cols + x], sow))
+	    {
+		compLogMessage ("stereo3d", CompLogLevelError, "unable to grow window grid");
+		return;
+	    }
+	}
+    }
+
+    sow->inGrid = true;
+}
+
+void
+removeGridWindow (WindowGrid *grid, Stereo3DWindow *sow)
+{
+    int x, y;
+
+    if (!sow->inGrid)
+	return;
+
+    // cells it was inserted into before the move
+    for (y = sow->gridCells.y1; y <= sow->gridCells.y2; y++)
+	for (x = sow->gridCells.x1; x <= sow->gridCells.x2; x++)
+	    removeFromCell (&grid->cells[y * grid->cols + x], sow);
+
+    sow->inGrid = false;
+}
+
+/* Topmost layout window whose frame contains x, y, counted in hc */
+Stereo3DWindow *
+findGridWindow (WindowGrid *grid, HookCounters *hc, int x, int y)
+{
+    WindowGridCell *cell;
+    int            col, row, i;
+
+    HOOK_COUNT (hc, HookGridLookup);
+
+    if (!grid->cells)
+	return NULL;
+
+    col = x / WINDOW_GRID_CELL_SIZE;
+    row = y / WINDOW_GRID_CELL_SIZE;
+
+    if (x < 0 || y < 0 || col >= grid->cols || row >= grid->rows)
+	return NULL;
+
+    cell = &grid->cells[row * grid->cols + col];
+
+    for (i = 0; i < cell->nWindows; i++)
+    {
+	CompWindow *w = cell->windows[i]->window;
+
+	if (x >= WIN_X (w) && x < WIN_X (w) + WIN_W (w) &&
+	    y >= WIN_Y (w) && y < WIN_Y (w) + WIN_H (w))
+	    return cell->windows[i];
+    }
+
+    return NULL;
+}